@@ -0,0 +1,91 @@
+#ifndef _BVH_H_
+#define _BVH_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Bounding volume hierarchy over a triangle soup, for ray queries such as picking.
+ *
+ * The tree is built top-down with the surface area heuristic over binned
+ * centroids. The top levels are split one after the other, with the binning
+ * spread over the threads, and the subtrees below them are then built in
+ * parallel. The binary tree is collapsed into a 4-wide one afterwards:
+ * every node holds the boxes of its four children side by side, so that one
+ * SSE slab test covers all of them, and the leaves hold their triangles in
+ * packs of four that are intersected at once. Nodes are 128 bytes and stored
+ * depth-first in one array, with the packs of each leaf in the same order.
+ */
+class BVH{
+public:
+	struct Hit{
+		float distance; //< in units of the ray direction
+		unsigned int triangle; //< index into the triangles the hierarchy was built from
+		glm::vec2 barycentrics; //< weights of the second and third vertex
+		glm::vec3 normal; //< unit geometric normal, by the winding of the triangle
+	};
+
+	/**
+	 * Builds the hierarchy over triangle_vertices, three per triangle
+	 */
+	explicit BVH(const std::vector<glm::vec3> &triangle_vertices);
+
+	/**
+	 * Closest hit along origin + t * direction with t in [0, max_distance].
+	 * Both sides of the triangles are hit. Returns false if nothing is.
+	 */
+	bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit,
+	               float max_distance = std::numeric_limits<float>::max()) const;
+
+	/**
+	 * Whether anything is hit along the ray with t in [0, max_distance], stops at the first hit
+	 */
+	bool occluded(const glm::vec3 &origin, const glm::vec3 &direction,
+	              float max_distance = std::numeric_limits<float>::max()) const;
+
+	size_t getNodeCount() const{ return nodes.size(); }
+	size_t getTriangleCount() const{ return triangle_count; }
+	glm::vec3 getMin() const{ return min_dim; }
+	glm::vec3 getMax() const{ return max_dim; }
+
+private:
+	/**
+	 * Four children: the bounds as min xyz then max xyz, four lanes each.
+	 * A child is either the index of a node, or leaf_flag | the first pack of a leaf
+	 * with count packs. Unused children have empty bounds and never get hit.
+	 */
+	struct Node{
+		float bounds[6][4];
+		uint32_t child[4];
+		uint32_t count[4];
+	};
+
+	/**
+	 * Four triangles as a corner and two edges, the unused lanes are degenerate
+	 */
+	struct TrianglePack{
+		float v0[3][4];
+		float e1[3][4];
+		float e2[3][4];
+		uint32_t triangle[4];
+	};
+
+	static const uint32_t leaf_flag = 0x80000000u;
+
+	/**
+	 * Walks the nodes nearest first, any_hit returns at the first hit found and leaves hit alone
+	 */
+	template<bool any_hit>
+	bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance, Hit *hit) const;
+
+	std::vector<Node> nodes;
+	std::vector<TrianglePack> packs;
+	size_t triangle_count;
+	glm::vec3 min_dim;
+	glm::vec3 max_dim;
+};
+
+#endif // _BVH_H_
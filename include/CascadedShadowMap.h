@@ -0,0 +1,79 @@
+#ifndef _CASCADEDSHADOWMAP_H_
+#define _CASCADEDSHADOWMAP_H_
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * Shadow map of a directional light split into cascades.
+ *
+ * The view frustum is cut into cascade_count slices along the view
+ * direction, with the split distances blended between a uniform and a
+ * logarithmic distribution. Each slice gets its own orthographic light
+ * camera fitted around the slice's bounding sphere and its own layer of a
+ * depth texture array. The sphere keeps the projection size constant when
+ * the camera turns, and the light camera is moved in whole shadow map texels,
+ * so that the shadow edges do not crawl while the camera moves.
+ */
+class CascadedShadowMap{
+public:
+	static const unsigned int cascade_count = 3;
+
+	/**
+	 * @param resolution width and height of each cascade
+	 */
+	CascadedShadowMap(unsigned int resolution);
+	~CascadedShadowMap();
+
+	/**
+	 * Fits the cascades to the view frustum between near_plane and far_plane
+	 * @param view world to camera space
+	 * @param light_direction world space direction towards the light
+	 */
+	void update(const glm::mat4 &view, float fovy, float aspect, float near_plane, float far_plane,
+	            const glm::vec3 &light_direction);
+
+	/**
+	 * Binds the layer of a cascade as the depth target, sets the viewport and clears it
+	 */
+	void bindCascade(unsigned int cascade);
+	static void unbind();
+
+	const glm::mat4 &getLightView(unsigned int cascade) const{ return light_views[cascade]; }
+	const glm::mat4 &getLightProjection(unsigned int cascade) const{ return light_projections[cascade]; }
+
+	/**
+	 * Camera space to shadow map coordinates in [0, 1] of a cascade
+	 */
+	const glm::mat4 &getShadowMatrix(unsigned int cascade) const{ return shadow_matrices[cascade]; }
+
+	/**
+	 * Distance from the camera where a cascade ends
+	 */
+	float getSplitDistance(unsigned int cascade) const{ return split_distances[cascade]; }
+
+	GLuint getTexture() const{ return depth_texture; }
+
+	/**
+	 * #defines the shaders sampling the shadow map need
+	 */
+	static std::vector<std::string> getShaderDefines();
+
+private:
+	GLuint fbo_name;
+	GLuint depth_texture;
+	unsigned int resolution;
+
+	glm::mat4 light_views[cascade_count];
+	glm::mat4 light_projections[cascade_count];
+	glm::mat4 shadow_matrices[cascade_count];
+	float split_distances[cascade_count];
+
+	static const float split_lambda; //< 0: uniform splits, 1: logarithmic splits
+	static const float caster_distance; //< how far behind a slice casters are still included
+};
+
+#endif // _CASCADEDSHADOWMAP_H_
@@ -0,0 +1,160 @@
+#ifndef _CLUSTERBUILDER_H_
+#define _CLUSTERBUILDER_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+/**
+ * Cuts a mesh into a DAG of triangle clusters at decreasing levels of detail
+ * and writes it to a paged file that ClusterStreamer draws from.
+ *
+ * The triangles are cut into clusters of up to max_cluster_triangles along a
+ * Morton curve. Then, level by level, clusters are merged into groups of up
+ * to group_size with the neighbours they share the most border with, each
+ * group is simplified to half its triangles by edge collapses driven by
+ * quadric error metrics, and the result is cut into new clusters, until a
+ * single cluster remains or no group simplifies any further. Edges on the
+ * border of a group, which include the UV and normal seams, are never
+ * collapsed, so that the clusters of any level fit the clusters of any other
+ * one along them, and growing the groups across the longest borders of the
+ * last level lets those be simplified in turn.
+ *
+ * Every cluster carries the error and bounding sphere of the group it was
+ * made by and of the group it was merged into. Both only grow towards the
+ * coarse clusters, so that choosing, per cluster, whether its own error is
+ * small enough on screen and its parents' is not, always picks a cut through
+ * the DAG without holes or overlaps.
+ *
+ * The file holds a header, the cluster table, the group table and then the
+ * pages: corners_per_page corners each, laid out like the vertex buffers of a
+ * Model but interleaved, so that a page is uploaded as it is read. The clusters
+ * merged into the same group are stored next to each other, so that refining a
+ * group usually means loading a single page.
+ */
+class ClusterBuilder{
+public:
+	static const uint32_t file_version = 1;
+	static const unsigned int max_cluster_triangles = 128;
+	static const unsigned int group_size = 4; //< clusters merged and simplified together
+	static const uint32_t corners_per_page = 4096;
+	static const uint32_t no_group = 0xffffffffu;
+
+	/**
+	 * One corner of a triangle in a page, the attributes of basic_phong.vert
+	 */
+	struct Vertex{
+		float position[3];
+		float normal[3];
+		float uv[2];
+		float tangent[4]; //< handedness in w
+		float edge_curvature; //< of the edge facing the corner
+	};
+
+	struct Header{
+		char magic[4]; //< "CDAG"
+		uint32_t version;
+		uint32_t corners_per_page;
+		uint32_t page_count;
+		uint32_t cluster_count;
+		uint32_t group_count;
+		uint32_t group_child_count;
+		uint32_t root_page_count; //< the first pages, holding the clusters that are never merged
+		glm::vec3 min_dim; //< bounds of the mesh, in the space of the Model it was loaded as
+		glm::vec3 max_dim;
+	};
+
+	struct Cluster{
+		glm::vec4 bounds; //< sphere around the triangles: center, radius
+		glm::vec4 lod_bounds; //< sphere of the group that made the cluster
+		glm::vec4 parent_lod_bounds; //< sphere of the group it is merged into
+		float lod_error; //< object space error of the group that made it, 0 at full detail
+		float parent_lod_error; //< of the group it is merged into, FLT_MAX if it never is
+		uint32_t page;
+		uint32_t first_corner; //< in the page
+		uint32_t corner_count;
+		uint32_t group; //< merged into, no_group for the coarsest clusters
+		uint32_t source_group; //< that made it, no_group at full detail
+		uint32_t level;
+	};
+
+	struct Group{
+		uint32_t first_child; //< into the group children, the clusters merged into the group
+		uint32_t child_count;
+		uint32_t first_cluster; //< the clusters the group was simplified into, next to each other in the table
+		uint32_t cluster_count;
+	};
+
+	/**
+	 * Loads the mesh through Model, into memory, and builds the DAG
+	 */
+	explicit ClusterBuilder(const std::string &mesh_path);
+
+	/**
+	 * Writes the cluster file, throws if it cannot be written
+	 */
+	void write(const std::string &filename) const;
+
+	size_t getClusterCount() const{ return clusters.size(); }
+	size_t getLevelCount() const{ return level_count; }
+	size_t getPageCount() const{ return page_count; }
+	size_t getTriangleCount() const{ return triangle_count; } //< of the full detail mesh
+
+private:
+	/**
+	 * A cluster while building, its triangles index the welded vertices
+	 */
+	struct BuildCluster{
+		std::vector<uint32_t> indices;
+		Cluster cluster;
+	};
+
+	/**
+	 * Appends the corners of part and its children with their transforms applied
+	 */
+	static void flatten(const Model::Geometry &geometry, const MeshPart &part, const glm::mat4 &transform,
+	                    std::vector<glm::vec3> &positions, std::vector<glm::vec3> &normals, std::vector<glm::vec2> &uvs);
+
+	/**
+	 * Splits the clusters of a level into groups of up to group_size neighbouring clusters
+	 */
+	void groupClusters(const std::vector<uint32_t> &level_clusters, std::vector<std::vector<uint32_t> > &level_groups) const;
+
+	/**
+	 * Cuts the triangles of indices into clusters along the Morton curve of their centroids
+	 */
+	void makeClusters(const std::vector<uint32_t> &indices, uint32_t level, std::vector<uint32_t> &made);
+
+	/**
+	 * Collapses edges of the triangles in indices, keeping the border edges, until at most
+	 * target_triangles are left. Returns the largest error of a collapse.
+	 */
+	float simplify(std::vector<uint32_t> &indices, size_t target_triangles) const;
+
+	/**
+	 * Lays the clusters out in pages and sorts the table from the coarse to the fine clusters
+	 */
+	void layOut();
+
+	// the welded vertices of the whole mesh
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> uvs;
+
+	std::vector<BuildCluster> clusters;
+	std::vector<Group> groups;
+	std::vector<uint32_t> group_children;
+	std::vector<std::vector<uint32_t> > page_clusters; //< the clusters in every page, in order
+	glm::vec3 min_dim;
+	glm::vec3 max_dim;
+	size_t level_count;
+	size_t page_count;
+	size_t root_page_count;
+	size_t triangle_count;
+};
+
+#endif // _CLUSTERBUILDER_H_
@@ -0,0 +1,142 @@
+#ifndef _CLUSTERSTREAMER_H_
+#define _CLUSTERSTREAMER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "ClusterBuilder.h"
+
+/**
+ * Draws a mesh written by ClusterBuilder while only a fixed budget of its
+ * pages is in memory.
+ *
+ * The tables of the file are read up front, the pages holding the coarsest
+ * clusters are loaded and kept, and the rest share the slots left in one
+ * vertex buffer of budget_bytes. Every frame, update picks a cut through the
+ * DAG: a cluster is drawn where the error of its parents projects to more
+ * than error_pixels on screen and its own error does not, as long as the
+ * finer clusters it would be replaced by are all in memory. Where they are
+ * not, the cluster is drawn anyway and their pages are requested, the ones
+ * with the largest projected error first. The requests are read from the
+ * file by a thread of the streamer, and uploaded on the next calls to update,
+ * evicting the pages that were used the longest time ago.
+ */
+class ClusterStreamer{
+public:
+	/**
+	 * One cluster of the cut, as a range of the vertex array
+	 */
+	struct Draw{
+		GLint first;
+		GLsizei count;
+		glm::vec4 bounds; //< sphere around the triangles: center, radius
+	};
+
+	/**
+	 * Reads the tables and the coarsest pages of filename, throws if they do not fit in budget_bytes.
+	 * Needs a current OpenGL context.
+	 */
+	ClusterStreamer(const std::string &filename, size_t budget_bytes);
+	~ClusterStreamer();
+
+	/**
+	 * Uploads the pages read since the last call and picks the cut for a camera at model_view,
+	 * with viewport_height pixels over the height of projection. Appends the clusters of the
+	 * cut inside the view frustum to draws, and all of them to unculled_draws if given.
+	 */
+	void update(const glm::mat4 &model_view, const glm::mat4 &projection, float viewport_height, float error_pixels,
+	            std::vector<Draw> &draws, std::vector<Draw> *unculled_draws = nullptr);
+
+	GLuint getVertexArray() const{ return vertex_array; } //< the attributes of basic_phong.vert
+	const glm::vec3 &getMin() const{ return header.min_dim; }
+	const glm::vec3 &getMax() const{ return header.max_dim; }
+	size_t getPageCount() const{ return header.page_count; }
+	size_t getSlotCount() const{ return slot_pages.size(); }
+	size_t getResidentPageCount() const{ return resident_pages; }
+	size_t getPendingPageCount() const{ return pending_pages; } //< requested and not uploaded yet
+	size_t getUploadedBytes() const{ return uploaded_bytes; } //< since the streamer was created
+
+private:
+	typedef ClusterBuilder::Cluster Cluster;
+	typedef ClusterBuilder::Group Group;
+	typedef ClusterBuilder::Vertex Vertex;
+
+	/**
+	 * A page read by the loader thread, empty if it could not be read
+	 */
+	struct LoadedPage{
+		uint32_t page;
+		std::vector<Vertex> corners;
+	};
+
+	/**
+	 * Reads the requested pages until the streamer is destroyed
+	 */
+	void loadPages();
+
+	/**
+	 * Reads a page from the file, leaves corners empty and returns false if it cannot
+	 */
+	bool readPage(uint32_t page, std::vector<Vertex> &corners);
+
+	/**
+	 * Copies a page into a slot of the vertex buffer, evicting the least recently used
+	 * page if none is free. Returns false if every slot is taken by a page still in use.
+	 */
+	bool upload(const LoadedPage &loaded);
+
+	/**
+	 * The screen space error, in pixels, of error over sphere bounds, infinite if the camera is inside
+	 */
+	float projectedError(const glm::vec4 &bounds, float error) const;
+
+	/**
+	 * Queues the pages that are missing to refine group, with the given priority
+	 */
+	void requestGroup(uint32_t group, float priority);
+
+	ClusterBuilder::Header header;
+	std::vector<Cluster> clusters;
+	std::vector<Group> groups;
+	std::vector<uint32_t> group_children;
+	size_t page_bytes;
+	size_t data_offset; //< of the first page in the file
+
+	GLuint vertex_buffer;
+	GLuint vertex_array;
+	std::vector<uint32_t> slot_pages; //< the page in each slot of the vertex buffer, or no_page
+	std::vector<uint32_t> page_slots; //< the slot of each page, or no_page if it is not in memory
+	std::vector<uint32_t> page_last_used; //< the frame the cut last went through a page
+	std::vector<uint32_t> page_requested; //< the frame a page was last asked for in
+	std::vector<bool> page_pending; //< queued for or being read by the loader thread
+	std::vector<unsigned char> refinable; //< per group, of the current frame
+	std::vector<std::pair<float, uint32_t> > requests; //< of the current frame: priority, page
+	uint32_t frame;
+	size_t resident_pages;
+	size_t pending_pages;
+	size_t uploaded_bytes;
+
+	// the state of the cut being picked
+	glm::mat4 cut_model_view;
+	float cut_scale; //< of model_view
+	float pixels_per_unit; //< at a distance of 1 from the camera
+
+	std::ifstream file; //< loader thread only after construction
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<uint32_t> queue; //< pages for the loader thread, most important first, guarded by mutex
+	std::vector<LoadedPage> loaded_pages; //< read and waiting for update, guarded by mutex
+	bool stopping; //< guarded by mutex
+};
+
+#endif // _CLUSTERSTREAMER_H_
@@ -0,0 +1,46 @@
+#ifndef _DYNAMICRESOLUTION_H_
+#define _DYNAMICRESOLUTION_H_
+
+#include <ostream>
+
+/**
+ * Picks the internal render resolution from the measured GPU time.
+ *
+ * The scene is rendered into a fraction of the window resolution and
+ * upscaled afterwards, so lowering the scale directly cuts fragment work.
+ * The scale moves in fixed steps with the same kind of hysteresis as the
+ * LOD governor to avoid resizing every frame.
+ */
+class DynamicResolution{
+public:
+	/**
+	 * @param target_ms GPU time to hold, in milliseconds
+	 */
+	DynamicResolution(double target_ms = 16.6);
+
+	/**
+	 * Feeds the GPU time of the last frame to the controller
+	 */
+	void update(double gpu_ms);
+
+	void setEnabled(bool enabled);
+	bool isEnabled() const{ return enabled; }
+
+	/**
+	 * Fraction of the window resolution to render at, per axis
+	 */
+	float getScale() const{ return enabled ? scale : 1.f; }
+
+	void printState(std::ostream &os) const;
+
+private:
+	bool enabled;
+	double target_ms;
+	double smoothed_ms;
+	float scale;
+
+	int frames_over_budget;
+	int frames_under_budget;
+};
+
+#endif // _DYNAMICRESOLUTION_H_
@@ -0,0 +1,44 @@
+#ifndef _FILEWATCHER_H_
+#define _FILEWATCHER_H_
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Reports changes to a set of files.
+ *
+ * On Linux the directories of the files are watched with inotify, so a
+ * waiting thread sleeps until something is written. Editors often save
+ * by writing a new file and renaming it over the old one, which is why
+ * the directory is watched rather than the file itself. Elsewhere the
+ * modification times are polled.
+ */
+class FileWatcher{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	void addFile(const std::string &path);
+
+	/**
+	 * Blocks for up to timeout_ms and returns the watched files
+	 * that changed, as they were passed to addFile
+	 */
+	std::vector<std::string> waitForChanges(unsigned int timeout_ms);
+
+private:
+	FileWatcher(const FileWatcher &);
+	FileWatcher &operator=(const FileWatcher &);
+
+	static time_t modificationTime(const std::string &path);
+
+	std::map<std::string, time_t> files; //< path -> last seen modification time
+#ifdef __linux__
+	int inotify_fd;
+	std::map<int, std::string> directories; //< watch descriptor -> directory
+#endif
+};
+
+#endif // _FILEWATCHER_H_
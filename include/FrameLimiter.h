@@ -0,0 +1,46 @@
+#ifndef _FRAMELIMITER_H_
+#define _FRAMELIMITER_H_
+
+#include <ostream>
+
+/**
+ * Paces the main loop to a target frame rate, sampling input as late as possible.
+ *
+ * Instead of sleeping after a frame has been built, the limiter sleeps before
+ * the input is read: until the next frame deadline minus the time the update
+ * is expected to take. The estimate follows the slowest recent updates and
+ * adds a safety margin, so the frame is still handed over in time while the
+ * input it shows is as fresh as it can be. The OS sleep only covers the bulk
+ * of the wait, the last stretch yields in a loop for precision.
+ */
+class FrameLimiter{
+public:
+	/**
+	 * @param target_fps frame rate to hold, 0 runs unlimited
+	 */
+	FrameLimiter(double target_fps = 0.0);
+
+	void setTargetFrameRate(double target_fps);
+	double getTargetFrameRate() const{ return target_fps; }
+
+	/**
+	 * Sleeps until the latest moment input can be sampled
+	 * for the next frame to be ready at its deadline
+	 */
+	void waitForInputSample();
+
+	/**
+	 * Reports the time from sampling the input to handing the frame over,
+	 * in milliseconds, and moves on to the next deadline
+	 */
+	void frameSubmitted(double update_ms);
+
+	void printState(std::ostream &os) const;
+
+private:
+	double target_fps;
+	double deadline; //< Timer::getCurrentTime() by which the next frame is handed over
+	double update_estimate_ms;
+};
+
+#endif // _FRAMELIMITER_H_
@@ -0,0 +1,94 @@
+#ifndef _FRAMEQUEUE_H_
+#define _FRAMEQUEUE_H_
+
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * Fixed ring of frames passed from one producer thread to one consumer thread.
+ *
+ * The producer fills a free slot between beginWrite() and endWrite(), the
+ * consumer reads the oldest published one between beginRead() and endRead().
+ * Slots are reused, so whatever a frame allocates (e.g. vector capacity) is
+ * kept from one frame to the next. With three slots the producer can fill one
+ * while one waits and one is being consumed; it blocks only when it is a full
+ * two frames ahead, which also bounds the latency the queue adds.
+ */
+template<typename T, unsigned int slot_count = 3>
+class FrameQueue{
+public:
+	FrameQueue() : head(0), published(0), closed(false){}
+
+	/**
+	 * Waits for a free slot. Returns nullptr once the queue is closed.
+	 */
+	T *beginWrite(){
+		std::unique_lock<std::mutex> lock(mutex);
+		slot_freed.wait(lock, [this](){ return published < slot_count || closed; });
+		if(closed)
+			return nullptr;
+		return &slots[(head + published) % slot_count];
+	}
+
+	/**
+	 * Publishes the slot returned by beginWrite()
+	 */
+	void endWrite(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			++published;
+		}
+		frame_published.notify_one();
+	}
+
+	/**
+	 * Waits for the oldest published frame. Returns nullptr once the
+	 * queue is closed, frames still waiting are dropped.
+	 */
+	const T *beginRead(){
+		std::unique_lock<std::mutex> lock(mutex);
+		frame_published.wait(lock, [this](){ return published > 0 || closed; });
+		if(closed)
+			return nullptr;
+		return &slots[head];
+	}
+
+	/**
+	 * Hands the slot returned by beginRead() back to the producer
+	 */
+	void endRead(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			head = (head + 1) % slot_count;
+			--published;
+		}
+		slot_freed.notify_one();
+	}
+
+	/**
+	 * Wakes up and turns away both sides, e.g. on exit
+	 */
+	void close(){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+		}
+		slot_freed.notify_all();
+		frame_published.notify_all();
+	}
+
+private:
+	FrameQueue(const FrameQueue &);
+	FrameQueue &operator=(const FrameQueue &);
+
+	T slots[slot_count];
+	unsigned int head; //< oldest published slot
+	unsigned int published; //< including the one being read
+	bool closed;
+
+	std::mutex mutex;
+	std::condition_variable slot_freed;
+	std::condition_variable frame_published;
+};
+
+#endif // _FRAMEQUEUE_H_
@@ -0,0 +1,147 @@
+#ifndef _FBO_HPP__
+#define _FBO_HPP__
+
+#include <GL/glew.h>
+
+#include "GameException.h"
+
+namespace GLUtils {
+
+	/**
+	 * Offscreen render target with an RGBA8 color buffer
+	 * and a 24 bit depth buffer.
+	 * Single-sampled targets use textures so they can be sampled by
+	 * later passes, multisampled ones use renderbuffers that have to be
+	 * resolved with blitTo().
+	 */
+	class FBO {
+	public:
+		FBO(unsigned int width, unsigned int height, unsigned int samples = 1) : width(0), height(0) {
+			GLint max_samples;
+			glGetIntegerv(GL_MAX_SAMPLES, &max_samples);
+			this->samples = samples > (unsigned int)max_samples ? max_samples : samples;
+
+			glGenFramebuffers(1, &fbo_name);
+			if (isMultisampled()) {
+				glGenRenderbuffers(1, &color_buffer);
+				glGenRenderbuffers(1, &depth_buffer);
+			}
+			else {
+				glGenTextures(1, &color_buffer);
+				glGenTextures(1, &depth_buffer);
+			}
+			resize(width, height);
+		}
+
+		~FBO() {
+			glDeleteFramebuffers(1, &fbo_name);
+			if (isMultisampled()) {
+				glDeleteRenderbuffers(1, &color_buffer);
+				glDeleteRenderbuffers(1, &depth_buffer);
+			}
+			else {
+				glDeleteTextures(1, &color_buffer);
+				glDeleteTextures(1, &depth_buffer);
+			}
+		}
+
+		/**
+		 * (Re)allocates the attachments. Does nothing if the size is unchanged.
+		 */
+		void resize(unsigned int width, unsigned int height) {
+			if (width == this->width && height == this->height)
+				return;
+			this->width = width;
+			this->height = height;
+
+			bind();
+			if (isMultisampled()) {
+				glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+				glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer);
+				glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+				glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+				glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_buffer);
+			}
+			else {
+				glBindTexture(GL_TEXTURE_2D, color_buffer);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+				setTextureParameters();
+
+				glBindTexture(GL_TEXTURE_2D, depth_buffer);
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+				setTextureParameters();
+				glBindTexture(GL_TEXTURE_2D, 0);
+
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_buffer, 0);
+				glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_buffer, 0);
+			}
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				THROW_EXCEPTION("Framebuffer is incomplete");
+			unbind();
+		}
+
+		/**
+		 * Copies (and resolves, if multisampled) the color of the region
+		 * [0, src_w] x [0, src_h] into [0, dst_w] x [0, dst_h] of target,
+		 * or of the window if target is null.
+		 * Multisampled sources can only be copied at the same size.
+		 */
+		void blitTo(FBO *target, unsigned int src_w, unsigned int src_h,
+		            unsigned int dst_w, unsigned int dst_h, GLenum filter = GL_NEAREST) {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_name);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target ? target->name() : 0);
+			glBlitFramebuffer(0, 0, src_w, src_h, 0, 0, dst_w, dst_h, GL_COLOR_BUFFER_BIT, filter);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		/**
+		 * Copies (and resolves, if multisampled) the depth of the region
+		 * [0, w] x [0, h] into target
+		 */
+		void blitDepthTo(FBO *target, unsigned int w, unsigned int h) {
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_name);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->name());
+			glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		inline void bind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo_name);
+		}
+
+		static inline void unbind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		inline bool isMultisampled() { return samples > 1; }
+
+		inline GLuint name() { return fbo_name; }
+		inline GLuint getColorTexture() { return color_buffer; }
+		inline GLuint getDepthTexture() { return depth_buffer; }
+		inline unsigned int getWidth() { return width; }
+		inline unsigned int getHeight() { return height; }
+		inline unsigned int getSamples() { return samples; }
+
+	private:
+		static void setTextureParameters() {
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		}
+
+		FBO() {}
+		GLuint fbo_name; //< FBO name
+		GLuint color_buffer; //< texture, or renderbuffer if multisampled
+		GLuint depth_buffer; //< texture, or renderbuffer if multisampled
+		unsigned int width;
+		unsigned int height;
+		unsigned int samples;
+	};
+
+};//namespace GLUtils
+
+#endif
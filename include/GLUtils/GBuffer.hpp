@@ -0,0 +1,91 @@
+#ifndef _GBUFFER_HPP__
+#define _GBUFFER_HPP__
+
+#include <GL/glew.h>
+
+#include "GameException.h"
+
+namespace GLUtils {
+
+	/**
+	 * Render target of the deferred geometry pass:
+	 * RGBA8 albedo + shininess, RGBA16F camera space normal and a 24 bit depth texture
+	 */
+	class GBuffer {
+	public:
+		GBuffer(unsigned int width, unsigned int height) : width(width), height(height) {
+			glGenFramebuffers(1, &fbo_name);
+			glGenTextures(1, &albedo_specular_texture);
+			glGenTextures(1, &normal_texture);
+			glGenTextures(1, &depth_texture);
+
+			allocate(albedo_specular_texture, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+			allocate(normal_texture, GL_RGBA16F, GL_RGBA, GL_FLOAT);
+			allocate(depth_texture, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT);
+
+			bind();
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo_specular_texture, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_texture, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
+			const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+			glDrawBuffers(2, draw_buffers);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				THROW_EXCEPTION("G-buffer is incomplete");
+			unbind();
+		}
+
+		~GBuffer() {
+			glDeleteFramebuffers(1, &fbo_name);
+			glDeleteTextures(1, &albedo_specular_texture);
+			glDeleteTextures(1, &normal_texture);
+			glDeleteTextures(1, &depth_texture);
+		}
+
+		inline void bind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, fbo_name);
+		}
+
+		static inline void unbind() {
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+
+		/**
+		 * Binds the three textures to consecutive texture units starting at first_unit
+		 */
+		void bindTextures(GLuint first_unit) {
+			glActiveTexture(GL_TEXTURE0 + first_unit);
+			glBindTexture(GL_TEXTURE_2D, albedo_specular_texture);
+			glActiveTexture(GL_TEXTURE0 + first_unit + 1);
+			glBindTexture(GL_TEXTURE_2D, normal_texture);
+			glActiveTexture(GL_TEXTURE0 + first_unit + 2);
+			glBindTexture(GL_TEXTURE_2D, depth_texture);
+		}
+
+		inline GLuint name() { return fbo_name; }
+		inline GLuint getDepthTexture() { return depth_texture; }
+		inline unsigned int getWidth() { return width; }
+		inline unsigned int getHeight() { return height; }
+
+	private:
+		void allocate(GLuint texture, GLint internal_format, GLenum format, GLenum type) {
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, type, NULL);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glBindTexture(GL_TEXTURE_2D, 0);
+		}
+
+		GBuffer() {}
+		GLuint fbo_name;
+		GLuint albedo_specular_texture;
+		GLuint normal_texture;
+		GLuint depth_texture;
+		unsigned int width;
+		unsigned int height;
+	};
+
+};//namespace GLUtils
+
+#endif
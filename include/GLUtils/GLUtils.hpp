@@ -62,6 +62,29 @@ namespace GLUtils
 
 #define CHECK_GL_ERROR() GLUtils::checkGLErrors(__FILE__, __LINE__)
 
+	/**
+	 * Returns src with text inserted right after its #version line
+	 */
+	inline std::string insertAfterVersion(const std::string &src, const std::string &text){
+		std::string::size_type insert_at = 0;
+		if(src.compare(0, 8, "#version") == 0){
+			insert_at = src.find('\n');
+			insert_at = insert_at == std::string::npos ? src.size() : insert_at + 1;
+		}
+		return std::string(src).insert(insert_at, text);
+	}
+
+	/**
+	 * Returns src with a #define for each of the given names
+	 * inserted right after its #version line
+	 */
+	inline std::string addDefines(const std::string &src, const std::vector<std::string> &defines){
+		std::string header;
+		for(size_t i = 0; i < defines.size(); ++i)
+			header += "#define " + defines[i] + "\n";
+		return insertAfterVersion(src, header);
+	}
+
 	inline std::string readFile(std::string file){
 		int length;
 		std::string buffer;
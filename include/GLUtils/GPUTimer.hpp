@@ -0,0 +1,85 @@
+#ifndef _GPUTIMER_HPP__
+#define _GPUTIMER_HPP__
+
+#include <GL/glew.h>
+
+namespace GLUtils {
+
+	/**
+	 * Measures GPU time between begin() and end() with timestamp queries.
+	 * Queries are kept in a small ring so that reading a result never
+	 * stalls the pipeline: the value returned by elapsedMilliseconds()
+	 * lags a few frames behind the frame being submitted. A frame is not
+	 * measured if the GPU is still ring_size frames behind.
+	 */
+	class GPUTimer {
+	public:
+		GPUTimer() : current(0), skipped(false), last_result_ms(0.0) {
+			glGenQueries(2 * ring_size, queries);
+			for (unsigned int i = 0; i < ring_size; ++i)
+				pending[i] = false;
+		}
+
+		~GPUTimer() {
+			glDeleteQueries(2 * ring_size, queries);
+		}
+
+		inline void begin() {
+			// the queries of this slot cannot be reissued before their results are read
+			collect();
+			skipped = pending[current];
+			if (!skipped)
+				glQueryCounter(queries[2 * current], GL_TIMESTAMP);
+		}
+
+		inline void end() {
+			if (skipped)
+				return;
+			glQueryCounter(queries[2 * current + 1], GL_TIMESTAMP);
+			pending[current] = true;
+			current = (current + 1) % ring_size;
+			collect();
+		}
+
+		/**
+		 * Returns the most recent GPU time that is available, in milliseconds
+		 */
+		inline double elapsedMilliseconds() const {
+			return last_result_ms;
+		}
+
+	private:
+		static const unsigned int ring_size = 4;
+
+		/**
+		 * Reads back every finished query, oldest first, without blocking
+		 */
+		void collect() {
+			for (unsigned int n = 0; n < ring_size; ++n) {
+				const unsigned int i = (current + n) % ring_size;
+				if (!pending[i])
+					continue;
+
+				GLint available = GL_FALSE;
+				glGetQueryObjectiv(queries[2 * i + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available != GL_TRUE)
+					break;
+
+				GLuint64 start_ns, end_ns;
+				glGetQueryObjectui64v(queries[2 * i], GL_QUERY_RESULT, &start_ns);
+				glGetQueryObjectui64v(queries[2 * i + 1], GL_QUERY_RESULT, &end_ns);
+				last_result_ms = (end_ns - start_ns) * 1e-6;
+				pending[i] = false;
+			}
+		}
+
+		GLuint queries[2 * ring_size]; //< begin/end timestamp pairs
+		bool pending[ring_size];
+		unsigned int current;
+		bool skipped; //< the slot of this frame was still pending at begin()
+		double last_result_ms;
+	};
+
+};//namespace GLUtils
+
+#endif
@@ -4,51 +4,144 @@
 #include "GameException.h"
 
 #include <string>
+#include <cstring>
 #include <sstream>
+#include <fstream>
+#include <iterator>
 #include <vector>
+#include <map>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include <GL/glew.h>
 
 namespace GLUtils {
 
+/**
+ * Linked GLSL program.
+ *
+ * Linked binaries are stored in the directory set with setBinaryCacheDirectory,
+ * keyed by a hash of the stage sources and the driver, and loaded from there
+ * instead of compiling on later runs. Where GL_KHR_parallel_shader_compile is
+ * available, compiling and linking run on the driver's threads: the
+ * constructor returns right away and the link result is collected by
+ * isReady() or, blocking, by the first use() or getUniform().
+ */
 class Program {
 public:
-	Program(std::string vs, std::string fs) {
-		name = glCreateProgram();
-		attachShader(vs, GL_VERTEX_SHADER);
+	/**
+	 * Compute program
+	 */
+	explicit Program(std::string cs) {
+		std::vector<Stage> stages;
+		stages.push_back(Stage(GL_COMPUTE_SHADER, cs));
+		build(stages);
+	}
 
-		attachShader(fs, GL_FRAGMENT_SHADER);
-		link();
+	Program(std::string vs, std::string fs) {
+		std::vector<Stage> stages;
+		stages.push_back(Stage(GL_VERTEX_SHADER, vs));
+		stages.push_back(Stage(GL_FRAGMENT_SHADER, fs));
+		build(stages);
 	}
 
 	Program(std::string vs, std::string gs, std::string fs) {
-		name = glCreateProgram();
-		attachShader(vs, GL_VERTEX_SHADER);
-		attachShader(gs, GL_GEOMETRY_SHADER);
-		attachShader(fs, GL_FRAGMENT_SHADER);
-		link();
+		std::vector<Stage> stages;
+		stages.push_back(Stage(GL_VERTEX_SHADER, vs));
+		stages.push_back(Stage(GL_GEOMETRY_SHADER, gs));
+		stages.push_back(Stage(GL_FRAGMENT_SHADER, fs));
+		build(stages);
 	}
 
 	Program(std::string vs, std::string tcs, std::string tes, std::string fs) {
-		name = glCreateProgram();
-		attachShader(vs, GL_VERTEX_SHADER);
-		attachShader(tcs, GL_TESS_CONTROL_SHADER);
-		attachShader(tes, GL_TESS_EVALUATION_SHADER);
-		attachShader(fs, GL_FRAGMENT_SHADER);
-		link();
+		std::vector<Stage> stages;
+		stages.push_back(Stage(GL_VERTEX_SHADER, vs));
+		stages.push_back(Stage(GL_TESS_CONTROL_SHADER, tcs));
+		stages.push_back(Stage(GL_TESS_EVALUATION_SHADER, tes));
+		stages.push_back(Stage(GL_FRAGMENT_SHADER, fs));
+		build(stages);
 	}
 	
 	Program(std::string vs, std::string tcs, std::string tes, std::string gs, std::string fs) {
-		name = glCreateProgram();
-		attachShader(vs, GL_VERTEX_SHADER);
-		attachShader(tcs, GL_TESS_CONTROL_SHADER);
-		attachShader(tes, GL_TESS_EVALUATION_SHADER);
-		attachShader(gs, GL_GEOMETRY_SHADER);
-		attachShader(fs, GL_FRAGMENT_SHADER);
-		link();
+		std::vector<Stage> stages;
+		stages.push_back(Stage(GL_VERTEX_SHADER, vs));
+		stages.push_back(Stage(GL_TESS_CONTROL_SHADER, tcs));
+		stages.push_back(Stage(GL_TESS_EVALUATION_SHADER, tes));
+		stages.push_back(Stage(GL_GEOMETRY_SHADER, gs));
+		stages.push_back(Stage(GL_FRAGMENT_SHADER, fs));
+		build(stages);
+	}
+
+	~Program() {
+		deleteShaders();
+		glDeleteProgram(name);
+	}
+
+	Program(const Program &) = delete;
+	Program &operator=(const Program &) = delete;
+
+	/**
+	 * Stores linked binaries in directory from now on, creating it if needed.
+	 * An empty directory turns the cache off.
+	 */
+	static void setBinaryCacheDirectory(const std::string &directory) {
+		if (!directory.empty()) {
+#ifdef _WIN32
+			_mkdir(directory.c_str());
+#else
+			mkdir(directory.c_str(), 0755);
+#endif
+		}
+		binaryCacheDirectory() = directory;
+	}
+
+	/**
+	 * Lets the driver compile on as many threads as it likes,
+	 * if it supports GL_KHR_parallel_shader_compile
+	 */
+	static void enableParallelCompile() {
+		if (GLEW_KHR_parallel_shader_compile)
+			glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+
+	/**
+	 * Returns true once the program is linked, without blocking.
+	 * Throws if compiling or linking failed.
+	 */
+	bool isReady() {
+		if (!pending)
+			return true;
+
+		GLint completed = GL_FALSE;
+		glGetProgramiv(name, GL_COMPLETION_STATUS_KHR, &completed);
+		if (completed != GL_TRUE)
+			return false;
+		finishLink();
+		return true;
+	}
+
+	/**
+	 * Blocks until the program is linked, throws if compiling or linking failed
+	 */
+	inline void waitForLink() {
+		if (pending)
+			finishLink();
+	}
+
+	/**
+	 * True if the program came out of the binary cache
+	 */
+	inline bool isFromCache() const {
+		return from_cache;
 	}
 
 	inline void use() {
+		if (pending)
+			finishLink();
 		glUseProgram(name);
 	}
 
@@ -56,16 +149,29 @@ public:
 		glUseProgram(0);
 	}
 
-	inline GLint getUniform(std::string var) {
+	/**
+	 * Returns the location of a uniform. Locations are cached, so a missing
+	 * uniform (e.g. one optimized away in this program) is only reported once.
+	 */
+	inline GLint getUniform(const std::string &var) {
+		std::map<std::string, GLint>::const_iterator it = uniform_locations.find(var);
+		if (it != uniform_locations.end())
+			return it->second;
+
+		if (pending)
+			finishLink();
 		GLint loc = glGetUniformLocation(name, var.c_str());
 //		assert(loc >= 0);
 		if(loc < 0){
 			std::cout << "uniform '" << var << "' could not be found.\n";
 		}
+		uniform_locations[var] = loc;
 		return loc;
 	}
 
 	inline void setAttributePointer(std::string var, unsigned int size, GLenum type=GL_FLOAT, GLboolean normalized=GL_FALSE, GLsizei stride=0, GLvoid* pointer=NULL) {
+		if (pending)
+			finishLink();
 		GLint loc = glGetAttribLocation(name, var.c_str());
 		assert(loc >= 0);
 		glVertexAttribPointer(loc, size, type, normalized, stride, pointer);
@@ -75,9 +181,155 @@ public:
 	GLuint name; //< OpenGL shader program
 
 private:
+	struct Stage {
+		Stage(GLenum type, const std::string &src) : type(type), src(src), shader(0) {}
+		GLenum type;
+		std::string src;
+		GLuint shader;
+	};
+
+	std::map<std::string, GLint> uniform_locations;
+	std::vector<Stage> stages; //< kept until the link result is collected, for the error log
+	std::string cache_file;
+	bool pending = false;
+	bool from_cache = false;
+
+	static std::string &binaryCacheDirectory() {
+		static std::string directory;
+		return directory;
+	}
+
+	static bool binaryCacheSupported() {
+		if (binaryCacheDirectory().empty() || !GLEW_ARB_get_program_binary)
+			return false;
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	/**
+	 * 64 bit FNV-1a
+	 */
+	static void hash(unsigned long long &h, const void *data, size_t size) {
+		const unsigned char *bytes = static_cast<const unsigned char *>(data);
+		for (size_t i = 0; i < size; ++i) {
+			h ^= bytes[i];
+			h *= 1099511628211ULL;
+		}
+	}
+
+	/**
+	 * Cache file of the given stages on the current driver
+	 */
+	static std::string cacheFileName(const std::vector<Stage> &stages) {
+		unsigned long long h = 14695981039346656037ULL;
+		const GLenum driver_strings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+		for (int i = 0; i < 3; ++i) {
+			const char *driver = reinterpret_cast<const char *>(glGetString(driver_strings[i]));
+			if (driver != NULL)
+				hash(h, driver, strlen(driver) + 1);
+		}
+		for (size_t i = 0; i < stages.size(); ++i) {
+			hash(h, &stages[i].type, sizeof(GLenum));
+			hash(h, stages[i].src.c_str(), stages[i].src.size() + 1);
+		}
+
+		std::stringstream file;
+		file << binaryCacheDirectory() << "/" << std::hex << h << ".bin";
+		return file.str();
+	}
+
+	void build(const std::vector<Stage> &program_stages) {
+		name = glCreateProgram();
+
+		if (binaryCacheSupported()) {
+			cache_file = cacheFileName(program_stages);
+			if (loadBinary())
+				return;
+		}
+
+		stages = program_stages;
+		for (size_t i = 0; i < stages.size(); ++i)
+			attachShader(stages[i]);
+		if (!cache_file.empty())
+			glProgramParameteri(name, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		glLinkProgram(name);
+
+		// with parallel compilation nothing is queried until the result is needed
+		pending = true;
+		if (!GLEW_KHR_parallel_shader_compile)
+			finishLink();
+	}
+
+	bool loadBinary() {
+		std::ifstream file(cache_file.c_str(), std::ios::binary);
+		if (!file.good())
+			return false;
+
+		GLenum format = 0;
+		file.read(reinterpret_cast<char *>(&format), sizeof(GLenum));
+		if (file.fail())
+			return false;
+		// reading through the buffer leaves the state of the stream alone, an empty binary is a truncated file
+		std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (binary.empty())
+			return false;
+
+		glProgramBinary(name, format, &binary[0], GLsizei(binary.size()));
+		GLint linkstatus = GL_FALSE;
+		glGetProgramiv(name, GL_LINK_STATUS, &linkstatus);
+		// the driver may reject binaries of an older version of itself, or of another driver with
+		// GL_INVALID_ENUM, which is cleared so that it is not blamed on the compile falling back
+		from_cache = linkstatus == GL_TRUE;
+		if (!from_cache)
+			while (glGetError() != GL_NO_ERROR) {}
+		return from_cache;
+	}
+
+	void saveBinary() {
+		GLint length = 0;
+		glGetProgramiv(name, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0)
+			return;
+
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(name, length, NULL, &format, &binary[0]);
+
+		std::ofstream file(cache_file.c_str(), std::ios::binary);
+		if (!file.good()) {
+			std::cout << "Could not write the program binary " << cache_file << std::endl;
+			return;
+		}
+		file.write(reinterpret_cast<const char *>(&format), sizeof(GLenum));
+		file.write(&binary[0], binary.size());
+	}
+
+	/**
+	 * Collects the compile and link results, throws with the logs on failure
+	 */
+	void finishLink() {
+		pending = false;
+		for (size_t i = 0; i < stages.size(); ++i)
+			checkCompileStatus(stages[i]);
+		link();
+		deleteShaders();
+		if (!cache_file.empty())
+			saveBinary();
+	}
+
+	void deleteShaders() {
+		for (size_t i = 0; i < stages.size(); ++i) {
+			if (stages[i].shader != 0) {
+				glDetachShader(name, stages[i].shader);
+				glDeleteShader(stages[i].shader);
+			}
+		}
+		stages.clear();
+	}
+
 	void link() {
 		std::stringstream log;
-		glLinkProgram(name);
 
 		// check for errors
 		GLint linkstatus;
@@ -100,35 +352,42 @@ private:
 		}
 	}
 
-	void attachShader(std::string& src, unsigned int type) {
+	void attachShader(Stage &stage) {
 		std::stringstream log;
 		// create shader object
-		GLuint s = glCreateShader(type);
+		GLuint s = glCreateShader(stage.type);
 		if (s == 0) {
-			log << "Failed to create shader of type " << type << std::endl;
+			log << "Failed to create shader of type " << stage.type << std::endl;
 			THROW_EXCEPTION(log.str());
 		}
 
-		// set source code and compile
-		const GLchar* src_list[1] = { src.c_str() };
+		// set source code and compile, the status is checked by finishLink
+		const GLchar* src_list[1] = { stage.src.c_str() };
 		glShaderSource(s, 1, src_list, NULL);
 		glCompileShader(s);
 
+		glAttachShader(name, s);
+		stage.shader = s;
+	}
+
+	void checkCompileStatus(const Stage &stage) {
+		std::stringstream log;
+
 		// check for errors
 		GLint compile_status;
-		glGetShaderiv(s, GL_COMPILE_STATUS, &compile_status);
+		glGetShaderiv(stage.shader, GL_COMPILE_STATUS, &compile_status);
 		if (compile_status != GL_TRUE) {
 			// compilation failed
 			log << "Compilation failed!" << std::endl;
 			log << "--- source code ---" << std::endl;
-			log << src << std::endl;
+			log << stage.src << std::endl;
 
 			GLint logsize;
-			glGetShaderiv(s, GL_INFO_LOG_LENGTH, &logsize);
+			glGetShaderiv(stage.shader, GL_INFO_LOG_LENGTH, &logsize);
 
 			if (logsize > 0) {
 				std::vector<GLchar> infolog(logsize + 1);
-				glGetShaderInfoLog(s, logsize, NULL, &infolog[0]);
+				glGetShaderInfoLog(stage.shader, logsize, NULL, &infolog[0]);
 
 				log << "--- error log ---" << std::endl;
 				log << std::string(infolog.begin(), infolog.end()) << std::endl;
@@ -137,8 +396,6 @@ private:
 			}
 			THROW_EXCEPTION(log.str());
 		}
-		
-		glAttachShader(name, s);
 	}
 
 };
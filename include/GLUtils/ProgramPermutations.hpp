@@ -0,0 +1,131 @@
+#ifndef _PROGRAMPERMUTATIONS_HPP__
+#define _PROGRAMPERMUTATIONS_HPP__
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "GLUtils/GLUtils.hpp"
+
+namespace GLUtils {
+
+	/**
+	 * The specialized variants of one program: every combination of feature
+	 * flags gets its own Program, built from the same sources with a
+	 * #define per set flag, so that disabled features cost nothing at runtime
+	 * instead of being skipped by uniform branches.
+	 *
+	 * Variants are built on first request; through the program binary cache
+	 * that is a cheap load on every run after the first.
+	 */
+	class ProgramPermutations {
+	public:
+		typedef std::map<unsigned int, std::string> FeatureDefines; //< flag bit -> #define name
+		typedef std::function<void(Program &)> Initializer; //< run once on every new variant, e.g. for sampler units
+
+		ProgramPermutations(const FeatureDefines &features, const std::string &vs, const std::string &fs,
+		                    Initializer initializer = Initializer())
+		    : features(features), initializer(initializer) {
+			sources.push_back(vs);
+			sources.push_back(fs);
+		}
+
+		ProgramPermutations(const FeatureDefines &features, const std::string &vs, const std::string &tcs,
+		                    const std::string &tes, const std::string &fs, Initializer initializer = Initializer())
+		    : features(features), initializer(initializer) {
+			sources.push_back(vs);
+			sources.push_back(tcs);
+			sources.push_back(tes);
+			sources.push_back(fs);
+		}
+
+		/**
+		 * Returns the variant for the flags set in key, building it if needed.
+		 * Flags that are not features of these programs are ignored.
+		 */
+		const std::shared_ptr<Program> &get(unsigned int key) {
+			Variant &variant = build(key);
+			if (!variant.initialized) {
+				variant.initialized = true;
+				if (initializer)
+					initializer(*variant.program);
+			}
+			return variant.program;
+		}
+
+		/**
+		 * Starts building every variant without waiting for any of them.
+		 * Only worth it where the driver compiles in the background.
+		 */
+		void prebuildAll() {
+			unsigned int all_flags = 0;
+			for (FeatureDefines::const_iterator it = features.begin(); it != features.end(); ++it)
+				all_flags |= it->first;
+
+			// every subset of the feature flags
+			unsigned int key = 0;
+			do {
+				build(key);
+				key = (key - all_flags) & all_flags;
+			} while (key != 0);
+		}
+
+		/**
+		 * Builds every variant and waits for all of them.
+		 * Throws if any of them fails to compile or link.
+		 */
+		void buildAll() {
+			prebuildAll();
+			for (std::map<unsigned int, Variant>::iterator it = variants.begin(); it != variants.end(); ++it) {
+				it->second.program->waitForLink();
+				get(it->first);
+			}
+		}
+
+		inline size_t getVariantCount() const {
+			return variants.size();
+		}
+
+	private:
+		struct Variant {
+			std::shared_ptr<Program> program;
+			bool initialized = false;
+		};
+
+		FeatureDefines features;
+		Initializer initializer;
+		std::vector<std::string> sources;
+		std::map<unsigned int, Variant> variants;
+
+		Variant &build(unsigned int key) {
+			std::vector<std::string> defines;
+			unsigned int variant_key = 0;
+			for (FeatureDefines::const_iterator it = features.begin(); it != features.end(); ++it) {
+				if (key & it->first) {
+					variant_key |= it->first;
+					defines.push_back(it->second);
+				}
+			}
+
+			Variant &variant = variants[variant_key];
+			if (variant.program)
+				return variant;
+
+			std::vector<std::string> variant_sources(sources.size());
+			for (size_t i = 0; i < sources.size(); ++i)
+				variant_sources[i] = addDefines(sources[i], defines);
+
+			if (variant_sources.size() == 2)
+				variant.program.reset(new Program(variant_sources[0], variant_sources[1]));
+			else
+				variant.program.reset(new Program(variant_sources[0], variant_sources[1],
+				                                  variant_sources[2], variant_sources[3]));
+			return variant;
+		}
+	};
+
+}; //Namespace GLUtils
+
+#endif
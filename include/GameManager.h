@@ -1,16 +1,39 @@
 #ifndef _GAMEMANAGER_H_
 #define _GAMEMANAGER_H_
 
+#include <exception>
 #include <memory>
 #include <map>
+#include <mutex>
+#include <string>
+#include <thread>
 
 #include <GL/glew.h>
 #include <SDL.h>
 #include <glm/glm.hpp>
 
 #include "Timer.h"
+#include "FrameQueue.h"
+#include "FrameLimiter.h"
+#include "LatencyMonitor.h"
+#include "LODGovernor.h"
+#include "DynamicResolution.h"
+#include "HiZCulling.h"
+#include "TiledLightCulling.h"
+#include "CascadedShadowMap.h"
+#include "ClusterStreamer.h"
+#include "HotReloader.h"
 #include "GLUtils/GLUtils.hpp"
+#include "GLUtils/ProgramPermutations.hpp"
+#include "GLUtils/GPUTimer.hpp"
+#include "GLUtils/FBO.hpp"
+#include "GLUtils/GBuffer.hpp"
+#include "ImpostorAtlas.h"
 #include "Model.h"
+#include "RenderDevice.h"
+#include "Scene.h"
+#include "SoftwareRenderer.h"
+#include "Terrain.h"
 #include "VirtualTrackball.h"
 
 /**
@@ -22,9 +45,9 @@ class GameManager{
 public:
 
 	/**
-	 * Constructor
+	 * Constructor, the models and instances to draw are read from scene_path
 	 */
-	GameManager();
+	explicit GameManager(const std::string &scene_path = "scenes/ball.scene");
 
 	/**
 	 * Destructor
@@ -40,19 +63,30 @@ public:
 	void move_ball(float zOffset);
 	void display_commands();
 	/**
-	 * The main loop of the game. Runs the SDL main loop
+	 * The main loop of the game. Runs the SDL main loop and updates the
+	 * scene on the calling thread, and renders on a thread of its own
 	 */
 	void play();
 
 	/**
-	 * Quit function
+	 * Measures the CPU cost of culling and submitting the draw list of the scene
+	 * for frames frames, drawing through a NullRenderDevice. Needs no window nor
+	 * OpenGL context, so the meshes are not loaded: every model stands for one
+	 * draw over a unit box. Prints the timings and the calls per frame.
 	 */
-	void quit();
+	void benchmarkNullDevice(unsigned int frames);
+
+	/**
+	 * Draws the first frame of the scene with the SoftwareRenderer and writes it
+	 * to filename. Needs no window nor OpenGL context: the models are loaded into
+	 * memory, and the view, light and LOD settings are the ones play starts with.
+	 */
+	void renderSoftware(const std::string &filename);
 
 	/**
-	 * Function that handles rendering into the OpenGL context
+	 * Quit function
 	 */
-	void render();
+	void quit();
 
 protected:
 	/**
@@ -84,10 +118,80 @@ protected:
 	void createSimpleProgram();
 
 	/**
-	 * Creates vertex array objects
+	 * The permutations of every program drawing the model, built from the
+	 * files in shaders/. Only reads files and creates GL objects, so it can
+	 * also run on the hot-reload loader thread.
+	 */
+	struct ScenePrograms{
+		std::shared_ptr<GLUtils::ProgramPermutations> phong;
+		std::shared_ptr<GLUtils::ProgramPermutations> depth;
+		std::shared_ptr<GLUtils::ProgramPermutations> gbuffer;
+		std::shared_ptr<GLUtils::ProgramPermutations> deferred_lighting;
+		std::shared_ptr<GLUtils::ProgramPermutations> impostor;
+		std::shared_ptr<GLUtils::ProgramPermutations> impostor_gbuffer; //< geometry pass of the deferred path
+		std::shared_ptr<GLUtils::ProgramPermutations> terrain;
+		std::shared_ptr<GLUtils::ProgramPermutations> terrain_depth;
+		std::shared_ptr<GLUtils::ProgramPermutations> terrain_gbuffer;
+	};
+	ScenePrograms createScenePrograms() const;
+
+	/**
+	 * Watches the shaders, and the mesh and textures of every model of the
+	 * scene, and rebuilds them in the background when they are saved
+	 */
+	void createHotReload();
+
+	/**
+	 * Points program, depth_program, gbuffer_program, deferred_lighting_program and
+	 * the impostor and terrain programs at the permutations matching the shader features
+	 */
+	void selectProgramVariants(unsigned int features);
+
+	/**
+	 * Shader feature flags of the current options
+	 */
+	unsigned int getShaderFeatures() const;
+
+	/**
+	 * Loads the models of the scene, creates a vertex array object for each
+	 * and bakes their impostor atlases, and opens the streamed meshes and the terrain
 	 */
 	void createVAO();
 
+	/**
+	 * Points the vertex attributes of scene_vaos[model] at the buffers of bound_models[model]
+	 */
+	void bindModelAttributes(unsigned int model);
+
+	/**
+	 * Creates the offscreen render targets and the programs
+	 * used to anti-alias and upscale them to the window
+	 */
+	void createPostProcessing();
+
+	/**
+	 * Moves the lights and the orbiting instances, on the main thread
+	 */
+	void animate();
+
+	/**
+	 * Takes over the OpenGL context and renders every frame
+	 * published to frame_queue until it is closed
+	 */
+	void renderLoop();
+
+	/**
+	 * Scatters count coloured point lights around the model
+	 */
+	void createPointLights(unsigned int count);
+
+	/**
+	 * Draws a fullscreen triangle sampling source_texture with program,
+	 * of which only source_scale (per axis) holds the image
+	 */
+	void drawFullscreenPass(const std::shared_ptr<GLUtils::Program> &program, GLuint source_texture,
+	                        float source_scale);
+
 	static const unsigned int window_width = 800;
 	static const unsigned int window_height = 600;
 
@@ -99,7 +203,18 @@ protected:
 
 	bool debugSwitch = false;
 	bool lighting_enabled = true;
-	bool distance_LOD_enabled;
+	bool distance_LOD_enabled = false;
+	bool curvature_LOD_enabled = true;
+	bool depth_prepass_enabled = false;
+	bool occlusion_culling_enabled = false;
+	bool deferred_enabled = false;
+	unsigned int point_light_count = 64; //< lit by the deferred path only
+	bool shadows_enabled = true;
+	int swap_interval = 1; //< 0 off, 1 vsync, -1 adaptive vsync
+	float shadow_lod_scale = 0.5f; //< tessellation of the shadow casters relative to the main view
+	float impostor_distance = 30.f; //< in radii of an instance, instances further away are drawn as impostors, 0 never
+	float cluster_error_pixels = 1.f; //< the streamed meshes are refined until their error on screen is below this
+	float terrain_detail = 3.f; //< the terrain nodes are split within this many times their size of the camera
 
 private:
 	enum RenderMode{
@@ -109,35 +224,337 @@ private:
 		RENDERMODE_FLAT,
 	};
 
+	enum AntiAliasingMode{
+		AA_OFF,
+		AA_MSAA_2X,
+		AA_MSAA_4X,
+		AA_MSAA_8X,
+		AA_FXAA,
+		AA_MODE_COUNT
+	};
+
+	/**
+	 * Feature flags of the shader permutations, each one is a #define
+	 */
+	enum ShaderFeature{
+		FEATURE_LIGHTING = 1 << 0,
+		FEATURE_DEBUG_BARY = 1 << 1,
+		FEATURE_DISTANCE_LOD = 1 << 2,
+		FEATURE_CURVATURE_LOD = 1 << 3
+	};
+
 	enum TextureShaderLayoutIndex{
 		DIFFUSE_TEX,
 		NORMAL_TEX,
-		SPECULAR_TEX
+		SPECULAR_TEX,
+		SHADOW_TEX
+	};
+
+	enum ImpostorTextureShaderLayoutIndex{
+		IMPOSTOR_ALBEDO_TEX,
+		IMPOSTOR_NORMAL_TEX,
+		IMPOSTOR_DEPTH_TEX
+	};
+
+	enum TerrainTextureShaderLayoutIndex{
+		TERRAIN_HEIGHT_TEX
 	};
 
+	/**
+	 * (Re)creates scene_fbo with the samples of mode
+	 */
+	void createSceneTarget(AntiAliasingMode mode);
+	static unsigned int getSampleCount(AntiAliasingMode mode);
+	static const char *getAntiAliasingModeName(AntiAliasingMode mode);
+	static const char *getSwapIntervalName(int swap_interval);
+
+	/**
+	 * When an input event happened, in Timer::getCurrentTime() seconds,
+	 * or negative for events that are not input
+	 */
+	static double getInputEventTime(const SDL_Event &event);
+
+	/**
+	 * Sets the swap interval on the render thread, falls back
+	 * to plain vsync where adaptive vsync is not supported
+	 */
+	void applySwapInterval(int swap_interval);
+
 	void increaseLOD();
 	void decreaseLOD();
 	void zoomIn();
 	void zoomOut();
 
-	static void renderMeshRecursive(MeshPart &mesh, const std::shared_ptr<GLUtils::Program> &program,
-	                                const glm::mat4 &modelview, const glm::mat4 &transform,
-	                                glm::mat4 &projection_matrix);
+	/**
+	 * Casts a ray through the window pixel x, y against the instances the scene's
+	 * octree finds along it, and prints which instance, triangle and part it hits first
+	 */
+	void pick(int x, int y);
+
+	/**
+	 * One glDrawArrays of the scene, with everything needed to sort it
+	 */
+	struct DrawItem{
+		unsigned int model; //< index into FrameSnapshot::models
+		unsigned int first;
+		unsigned int count;
+		glm::mat4 model_matrix; //< including the transforms of all parent mesh parts
+		glm::vec3 min_dim; //< bounding box before model_matrix
+		glm::vec3 max_dim;
+		float view_distance; //< from the camera to the center of the part's bounding box
+		float tess_level; //< of the manual LOD mode, picked for the instance by its size on screen
+	};
+
+	/**
+	 * An instance drawn as an impostor, with everything needed to draw it
+	 */
+	struct ImpostorDraw{
+		unsigned int model; //< index into FrameSnapshot::models
+		glm::mat4 model_matrix; //< of the instance, the atlas already holds the mesh part transforms
+	};
+
+	/**
+	 * Everything the render thread needs to draw one frame, copied from the
+	 * main thread's state so that both can work on different frames at once
+	 */
+	struct FrameSnapshot{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 light_position; //< camera space
+		std::vector<TiledLightCulling::PointLight> point_lights; //< world space
+		float tess_scale; //< from the LOD governor
+		int lod_bias;
+		float shadow_lod_scale;
+		float cluster_error_pixels;
+		float terrain_detail;
+		float resolution_scale;
+		RenderMode render_mode;
+		AntiAliasingMode aa_mode;
+		int swap_interval;
+		unsigned int shader_features;
+		bool lighting_enabled;
+		bool depth_prepass_enabled;
+		bool occlusion_culling_enabled;
+		bool deferred_enabled;
+		bool shadows_enabled;
+		std::vector<std::shared_ptr<Model> > models; //< in the order of the scene, the draw items index them
+		std::vector<DrawItem> draw_list; //< visible instances, grouped by model and sorted front to back within each
+		std::vector<DrawItem> shadow_draw_list; //< instances that may shadow the view, empty without shadows
+		std::vector<ImpostorDraw> impostor_list; //< visible instances beyond impostor_distance, grouped by model
+		std::vector<ImpostorDraw> shadow_impostor_list; //< the same for the shadow casters
+		double input_time; //< Timer::getCurrentTime() of the oldest input event, negative if none
+	};
+
+	/**
+	 * What the render thread measured of the last frame it finished
+	 */
+	struct FrameTimings{
+		double submit_ms; //< CPU time of render(), without the swap
+		double gpu_ms;
+		double gpu_shadow_ms;
+		double gpu_post_ms;
+	};
+
+	/**
+	 * Copies the current state and draw list into frame
+	 */
+	void fillFrameSnapshot(FrameSnapshot &frame);
+
+	/**
+	 * Issues the GL commands of frame into the window
+	 */
+	void render(const FrameSnapshot &frame);
+
+	/**
+	 * Brings the scene render target to the window: resolves it,
+	 * applies FXAA and upscales it, depending on the modes of frame
+	 */
+	void postProcess(const FrameSnapshot &frame);
+
+	/**
+	 * Bins the main light and the point lights into screen tiles, then
+	 * lights the G-buffer into the bound scene render target
+	 */
+	void renderDeferredLighting(const FrameSnapshot &frame);
+
+	/**
+	 * Feeds the frame timings to the LOD governor and, if enabled,
+	 * prints them about once a second. Runs on the main thread.
+	 */
+	void updateFrameTimings(double update_ms, const FrameTimings &timings);
+
+	/**
+	 * Appends the draws of the given scene instances, skipping the ones smaller than
+	 * a pixel and picking the tessellation level of the others by their projected size.
+	 * meshes holds the mesh of every model of the scene. Given an impostor_list, the
+	 * instances further than impostor_distance go there instead.
+	 */
+	void collectInstanceDraws(const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix,
+	                          const std::vector<const MeshPart *> &meshes, const std::vector<uint32_t> &instances,
+	                          std::vector<DrawItem> &draw_list, std::vector<ImpostorDraw> *impostor_list = nullptr) const;
+
+	/**
+	 * The order of the main draw list: by model, so that each is bound once,
+	 * and front to back within a model so that early depth testing rejects as much as possible
+	 */
+	static bool isDrawnBefore(const DrawItem &a, const DrawItem &b);
+
+	/**
+	 * Flattens the mesh part hierarchy into a draw list
+	 */
+	static void collectDrawsRecursive(const MeshPart &mesh, const glm::mat4 &view_matrix,
+	                                  const glm::mat4 &model_matrix, unsigned int model, float tess_level,
+	                                  std::vector<DrawItem> &draw_list);
+
+	/**
+	 * Picks the cut of every streamed mesh for frame, with viewport_height pixels in the
+	 * render target, into cluster_draw_list and, with shadows, cluster_shadow_draw_list
+	 */
+	void collectClusterDraws(const FrameSnapshot &frame, float viewport_height);
+
+	/**
+	 * Binds program and sets the LOD and lighting uniforms shared by the depth and shading programs
+	 */
+	void setFrameUniforms(const std::shared_ptr<GLUtils::Program> &program, const FrameSnapshot &frame);
+
+	/**
+	 * Runs the GPU culling pass over the draw list of frame
+	 */
+	void cullDrawList(const FrameSnapshot &frame);
+
+	/**
+	 * Builds the depth pyramid for the next frame's culling
+	 * from the depth of the scene render target
+	 */
+	void buildDepthPyramid(GLsizei width, GLsizei height);
+
+	/**
+	 * Issues every draw of draw_list with the given program through render_device. Goes
+	 * through the culled indirect commands if occlusion culling is on and gpu_culled is set,
+	 * which is only valid for the draw list of frame.
+	 */
+	void renderDrawList(const std::shared_ptr<GLUtils::Program> &program, const FrameSnapshot &frame,
+	                    const std::vector<DrawItem> &draw_list, const glm::mat4 &view_matrix,
+	                    const glm::mat4 &projection_matrix, bool gpu_culled);
+
+	/**
+	 * Locations of the uniforms set for every draw
+	 */
+	struct DrawUniforms{
+		GLint proj_mat;
+		GLint model_view_mat;
+		GLint model_mat;
+		GLint model_view_mat_3x3;
+		GLint normal_mat;
+		GLint tess_level;
+	};
+	static DrawUniforms getDrawUniforms(GLUtils::Program &program);
+
+	/**
+	 * The vertex array and textures a model of the scene is drawn with
+	 */
+	struct ModelBinding{
+		GLuint vertex_array;
+		GLuint diffuse_map;
+		GLuint normal_map;
+		GLuint specular_map;
+	};
+
+	/**
+	 * The submission loop of renderDrawList, on any device: binds the vertex array and textures
+	 * of each model as its draws come up and sets the matrices and tessellation level of every
+	 * draw, skipping the level when it did not change. indirect draws the i-th draw with the
+	 * i-th command of the bound indirect buffer.
+	 */
+	static void submitDrawList(RenderDevice &device, GLuint program, const DrawUniforms &uniforms,
+	                           const std::vector<ModelBinding> &models, const std::vector<DrawItem> &draw_list,
+	                           const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix, bool indirect);
+
+	/**
+	 * Locations of the uniforms of the impostor programs
+	 */
+	struct ImpostorUniforms{
+		GLint proj_mat;
+		GLint view_mat;
+		GLint center;
+		GLint radius;
+	};
+	static ImpostorUniforms getImpostorUniforms(GLUtils::Program &program);
+
+	/**
+	 * The atlas a model of the scene is drawn with as an impostor
+	 */
+	struct ImpostorBinding{
+		GLuint albedo_map;
+		GLuint normal_map;
+		GLuint depth_map;
+		glm::vec3 center;
+		float radius;
+	};
+
+	/**
+	 * Draws impostor_list with program through render_device, its instances
+	 * starting at base_instance in impostor_instance_buffer
+	 */
+	void renderImpostorList(const std::shared_ptr<GLUtils::Program> &program,
+	                        const std::vector<ImpostorDraw> &impostor_list, GLuint base_instance,
+	                        const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix);
+
+	/**
+	 * The submission loop of renderImpostorList, on any device: one instanced draw of
+	 * a quad for every run of instances of the same model, with that model's atlas bound
+	 */
+	static void submitImpostorList(RenderDevice &device, GLuint program, const ImpostorUniforms &uniforms,
+	                               GLuint vertex_array, const std::vector<ImpostorBinding> &bindings,
+	                               const std::vector<ImpostorDraw> &impostor_list, GLuint base_instance,
+	                               const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix);
+
+	/**
+	 * Draws node_count nodes of the terrain, starting at first_node in the instance buffer of
+	 * its last update, with program, a terrain program. They morph for the camera of frame in
+	 * every pass, so that the shadows fit the terrain they fall on.
+	 */
+	void renderTerrain(const std::shared_ptr<GLUtils::Program> &program, const FrameSnapshot &frame,
+	                   GLuint first_node, size_t node_count, const glm::mat4 &view_matrix,
+	                   const glm::mat4 &projection_matrix);
+
+	/**
+	 * Renders the shadow draw list into every cascade of the shadow map,
+	 * tessellated at shadow_lod_scale of the level the main view would use
+	 */
+	void renderShadowMaps(const FrameSnapshot &frame);
+
+	/**
+	 * Binds the shadow map and sets the uniforms of shadow.glsl on the bound program
+	 */
+	void setShadowUniforms(const std::shared_ptr<GLUtils::Program> &program, const FrameSnapshot &frame);
 
 	SDL_Window *main_window; 
 	SDL_GLContext main_context; 
 	RenderMode render_mode;
+	AntiAliasingMode aa_mode;
 
-	GLuint main_scene_vao[1]; //< number of different "collection" of vbo's we have
+	std::vector<GLuint> scene_vaos; //< one per model of the scene, render thread only
+	GLuint fullscreen_vao; //< empty, the fullscreen triangle is generated in the vertex shader
 
-	std::map<std::string, std::shared_ptr<Model>> models;
+	std::map<std::string, std::shared_ptr<Model>> models; //< by scene model name, swapped in by the hot reload, read with std::atomic_load
 	std::map<std::string, std::shared_ptr<GLUtils::Program>> shaders;
 
 
 	float zoom;
 	float LOD;
 	Timer fps_timer;
+	Timer cpu_frame_timer;
+	Timer timings_print_timer;
+	bool print_timings = false;
+	std::shared_ptr<GLUtils::GPUTimer> gpu_frame_timer;
+	std::shared_ptr<GLUtils::GPUTimer> gpu_post_timer; //< resolve, anti-aliasing and upscale
+	std::shared_ptr<GLUtils::GPUTimer> gpu_shadow_timer;
+	LODGovernor lod_governor;
+	DynamicResolution dynamic_resolution;
 	VirtualTrackball cam_trackball;
+	FrameLimiter frame_limiter;
+	std::shared_ptr<LatencyMonitor> latency_monitor;
 
 	struct{
 		glm::vec3 position;
@@ -148,9 +565,63 @@ private:
 		glm::mat4 view;
 	} camera;
 
-	std::shared_ptr<Model> model;
+	std::string scene_path;
+	std::shared_ptr<Scene> scene; //< main thread only
+	std::vector<std::shared_ptr<Model> > scene_bounds_models; //< the models the scene's bounds were taken from
+	std::vector<uint32_t> visible_instances; //< reused by every snapshot
+	std::vector<const MeshPart *> scene_meshes; //< of the models of the snapshot being filled
+	std::vector<std::shared_ptr<Model> > bound_models; //< the ones scene_vaos point at, render thread only
+	std::vector<std::shared_ptr<Model> > retired_models; //< replaced in bound_models, kept until nothing else holds them
+	std::vector<ModelBinding> model_bindings; //< of bound_models, render thread only
+	std::vector<std::shared_ptr<ImpostorAtlas> > impostor_atlases; //< of bound_models, render thread only
+	std::vector<ImpostorBinding> impostor_bindings; //< of impostor_atlases, render thread only
+	std::vector<glm::mat4> impostor_instances; //< the impostor list then the shadow impostor list of a frame
+	GLuint impostor_vao; //< reads a model matrix per instance from impostor_instance_buffer
+	GLuint impostor_instance_buffer;
+	std::shared_ptr<GLUtils::Program> impostor_bake_program;
+	std::vector<std::shared_ptr<ClusterStreamer> > cluster_streamers; //< one per streamed mesh of the scene, render thread only
+	std::vector<glm::mat4> streamed_transforms; //< of the streamed meshes, copied from the scene
+	std::vector<ModelBinding> streamed_bindings; //< the streamers' vertex arrays and the meshes' textures
+	std::vector<ClusterStreamer::Draw> cluster_draws; //< of one streamed mesh, reused every frame
+	std::vector<ClusterStreamer::Draw> cluster_shadow_draws;
+	std::vector<DrawItem> cluster_draw_list; //< the clusters of the streamed meshes inside the view, render thread only
+	std::vector<DrawItem> cluster_shadow_draw_list; //< their whole cut, which may shadow the view
+	std::shared_ptr<Terrain> terrain; //< of the scene, null if it has none, render thread only
+	std::shared_ptr<RenderDevice> render_device; //< what the draw lists are submitted through
+	std::shared_ptr<HotReloader> hot_reloader;
+	ScenePrograms scene_programs;
+	bool programs_reloaded; //< since the last frame, the attribute locations may have moved, render thread only
+	// variants selected for the current frame
 	std::shared_ptr<GLUtils::Program> program;
-	glm::mat4 model_matrix; 
+	std::shared_ptr<GLUtils::Program> depth_program; //< same tessellation, no shading
+	std::shared_ptr<GLUtils::Program> gbuffer_program; //< geometry pass of the deferred path
+	std::shared_ptr<GLUtils::Program> deferred_lighting_program;
+	std::shared_ptr<GLUtils::Program> impostor_program;
+	std::shared_ptr<GLUtils::Program> impostor_depth_program; //< the unlit variant, for the shadow maps
+	std::shared_ptr<GLUtils::Program> impostor_gbuffer_program;
+	std::shared_ptr<GLUtils::Program> terrain_program;
+	std::shared_ptr<GLUtils::Program> terrain_depth_program;
+	std::shared_ptr<GLUtils::Program> terrain_gbuffer_program;
+	std::shared_ptr<GLUtils::GBuffer> gbuffer;
+	std::shared_ptr<HiZCulling> hiz_culling;
+	std::shared_ptr<TiledLightCulling> light_culling;
+	std::shared_ptr<CascadedShadowMap> shadow_map;
+	std::vector<TiledLightCulling::PointLight> point_lights; //< world space, the main light is not included
+	std::shared_ptr<GLUtils::Program> upscale_program;
+	std::shared_ptr<GLUtils::Program> fxaa_program;
+	std::shared_ptr<GLUtils::FBO> scene_fbo; //< multisampled in the MSAA modes
+	AntiAliasingMode scene_fbo_mode;
+	bool occlusion_culling_rendered = false; //< whether the last rendered frame was culled
+	int applied_swap_interval = 2; //< none of the modes, so the first frame sets it
+	std::shared_ptr<GLUtils::FBO> resolve_fbo; //< single-sampled copy of scene_fbo when it has to be sampled
+	std::shared_ptr<GLUtils::FBO> post_fbo; //< FXAA output when it still has to be upscaled
+
+	FrameQueue<FrameSnapshot> frame_queue;
+	std::thread render_thread;
+	std::exception_ptr render_error; //< thrown on the render thread, rethrown by play
+	std::mutex timings_mutex;
+	FrameTimings last_timings; //< guarded by timings_mutex
+	bool timings_pending = false; //< guarded by timings_mutex
 };
 
 #endif // _GAMEMANAGER_H_
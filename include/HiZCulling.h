@@ -0,0 +1,88 @@
+#ifndef _HIZCULLING_H_
+#define _HIZCULLING_H_
+
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLUtils/GLUtils.hpp"
+
+/**
+ * GPU occlusion culling against a hierarchical depth buffer.
+ *
+ * At the end of a frame the depth buffer is reduced into a mip pyramid
+ * holding the farthest depth of each texel's footprint. The next frame, a
+ * compute pass projects the bounding box of every draw, reads the pyramid
+ * level where the box covers at most 2x2 texels and zeroes the instance
+ * count of the draw's indirect command if the box lies behind all of them.
+ * Occluded draws are then skipped by the GPU before reaching the tessellator.
+ *
+ * The pyramid is one frame old, so a draw that is uncovered by a large
+ * camera move can be missing for a single frame.
+ */
+class HiZCulling{
+public:
+	/**
+	 * Same layout as the draw commands read by glDrawArraysIndirect
+	 */
+	struct DrawArraysIndirectCommand{
+		GLuint count;
+		GLuint instance_count;
+		GLuint first;
+		GLuint base_instance;
+	};
+
+	/**
+	 * Bounding box of a draw, std430 compatible
+	 */
+	struct Bounds{
+		glm::mat4 model_matrix;
+		glm::vec4 min_dim;
+		glm::vec4 max_dim;
+	};
+
+	/**
+	 * @param width, height largest depth buffer the pyramid will be built from
+	 */
+	HiZCulling(unsigned int width, unsigned int height);
+	~HiZCulling();
+
+	/**
+	 * Builds the pyramid from the region [0, width] x [0, height] of depth_texture
+	 */
+	void buildPyramid(GLuint depth_texture, unsigned int width, unsigned int height);
+
+	/**
+	 * Uploads one command and one bounding box per draw and culls them.
+	 * Only frustum culling is done until a pyramid has been built.
+	 */
+	void cull(const std::vector<DrawArraysIndirectCommand> &commands, const std::vector<Bounds> &bounds,
+	          const glm::mat4 &view_projection);
+
+	/**
+	 * Binds the culled commands to GL_DRAW_INDIRECT_BUFFER
+	 */
+	void bindIndirectBuffer();
+
+	/**
+	 * Forgets the pyramid, e.g. when the depth buffer it came from is no longer valid
+	 */
+	void invalidate(){ pyramid_valid = false; }
+
+private:
+	std::shared_ptr<GLUtils::Program> build_program;
+	std::shared_ptr<GLUtils::Program> cull_program;
+
+	GLuint pyramid_texture;
+	unsigned int pyramid_levels; //< allocated
+	unsigned int used_levels; //< built from the last depth buffer
+	glm::ivec2 pyramid_size; //< size of level 0 of the last build
+	bool pyramid_valid;
+
+	GLuint bounds_buffer;
+	GLuint command_buffer;
+};
+
+#endif // _HIZCULLING_H_
@@ -0,0 +1,83 @@
+#ifndef _HOTRELOADER_H_
+#define _HOTRELOADER_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <SDL.h>
+
+#include "FileWatcher.h"
+
+/**
+ * Rebuilds resources in the background when the files they are made from change.
+ *
+ * A loader thread waits on a FileWatcher and runs the build function of every
+ * resource whose files changed. It has its own OpenGL context sharing objects
+ * with the main one, so builds can compile programs and upload buffers and
+ * textures without stalling the render loop. A build returns a commit function
+ * that swaps the new resource in; commits run on the render thread at the start
+ * of a frame, once a fence shows the GPU has finished the upload. A build that
+ * throws is reported and leaves the current resource in place.
+ */
+class HotReloader{
+public:
+	typedef std::function<void()> Commit; //< runs on the render thread between frames
+	typedef std::function<Commit()> Build; //< runs on the loader thread, may throw
+
+	/**
+	 * Creates the loader context, sharing with context which must be current
+	 */
+	HotReloader(SDL_Window *window, SDL_GLContext context);
+	~HotReloader();
+
+	/**
+	 * Runs build whenever one of files changes. Must be called before start.
+	 */
+	void watch(const std::vector<std::string> &files, Build build);
+
+	/**
+	 * Starts the loader thread
+	 */
+	void start();
+
+	/**
+	 * Runs the commits of the builds the GPU has finished, call once per frame
+	 */
+	void commitFinished();
+
+private:
+	HotReloader(const HotReloader &);
+	HotReloader &operator=(const HotReloader &);
+
+	struct Watch{
+		std::vector<std::string> files;
+		Build build;
+	};
+
+	struct Finished{
+		GLsync fence;
+		Commit commit;
+	};
+
+	void run();
+
+	SDL_Window *window;
+	SDL_GLContext loader_context;
+
+	FileWatcher file_watcher;
+	std::vector<Watch> watches;
+
+	std::thread loader_thread;
+	std::atomic<bool> stopping;
+
+	std::mutex finished_mutex;
+	std::vector<Finished> finished; //< guarded by finished_mutex
+};
+
+#endif // _HOTRELOADER_H_
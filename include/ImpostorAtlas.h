@@ -0,0 +1,65 @@
+#ifndef _IMPOSTORATLAS_H_
+#define _IMPOSTORATLAS_H_
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLUtils/GLUtils.hpp"
+#include "Model.h"
+
+/**
+ * Pictures of a model from every direction, to draw distant instances of it
+ * as a single quad instead of tessellating every triangle.
+ *
+ * The directions are spread over the sphere by an octahedral mapping: the
+ * atlas is a grid of frame_count x frame_count frames, and the frame at grid
+ * position (x, y) looks at the model from the direction the octahedron maps
+ * (x, y) / (frame_count - 1) to, with y up. Each frame is an orthographic
+ * picture of the model's bounding sphere holding the diffuse color and
+ * coverage, the normal with the normal map applied and the shininess, and
+ * the depth. impostor.vert picks the four frames around the direction an
+ * instance is seen from, impostor.frag blends them and moves the quad's
+ * depth onto the pictured surface.
+ */
+class ImpostorAtlas{
+public:
+	static const unsigned int frame_count = 8; //< frames along each side of the atlas
+	static const unsigned int frame_size = 128; //< pixels along each side of a frame
+
+	/**
+	 * Renders every frame of the atlas with bake_program (impostor_bake.vert and .frag).
+	 * vertex_array has to point at the buffers of model.
+	 */
+	ImpostorAtlas(Model &model, GLuint vertex_array, GLUtils::Program &bake_program);
+	~ImpostorAtlas();
+
+	GLuint getAlbedoTexture() const{ return albedo_texture; } //< RGBA8, rgb: diffuse color, a: coverage
+	GLuint getNormalTexture() const{ return normal_texture; } //< RGBA8, rgb: normal * 0.5 + 0.5 in the model's space, a: shininess / 255
+	GLuint getDepthTexture() const{ return depth_texture; } //< 0 at center + radius towards the frame's direction, 1 at center - radius
+	const glm::vec3 &getCenter() const{ return center; } //< of the bounding sphere the frames picture, in the model's space
+	float getRadius() const{ return radius; }
+
+	/**
+	 * #defines the shaders drawing the impostors need
+	 */
+	static std::vector<std::string> getShaderDefines();
+
+private:
+	/**
+	 * Draws part and its children into the current frame
+	 */
+	void bakePart(const MeshPart &part, const glm::mat4 &model_matrix, const glm::mat4 &view_projection,
+	              GLUtils::Program &bake_program);
+
+	GLuint fbo_name;
+	GLuint albedo_texture;
+	GLuint normal_texture;
+	GLuint depth_texture;
+	glm::vec3 center;
+	float radius;
+};
+
+#endif // _IMPOSTORATLAS_H_
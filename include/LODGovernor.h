@@ -0,0 +1,71 @@
+#ifndef _LODGOVERNOR_H_
+#define _LODGOVERNOR_H_
+
+#include <ostream>
+
+/**
+ * Closed-loop controller that keeps the frame time around a target
+ * by trading tessellation detail for speed.
+ *
+ * The slowest of the CPU and GPU frame time is smoothed and compared
+ * against a band around the target. Only when the frame time stays outside
+ * the band for a number of consecutive frames is the detail changed, so that
+ * the LOD does not oscillate. The continuous tessellation scale is used
+ * first; once it is at its lower bound, the discrete LOD bias takes over.
+ */
+class LODGovernor{
+public:
+	/**
+	 * @param target_ms frame time to hold, in milliseconds
+	 */
+	LODGovernor(double target_ms = 16.6);
+
+	/**
+	 * Feeds the timings of the last frame to the controller
+	 */
+	void update(double cpu_ms, double gpu_ms);
+
+	/**
+	 * Restores full detail
+	 */
+	void reset();
+
+	void setEnabled(bool enabled);
+	bool isEnabled() const{ return enabled; }
+
+	void setTargetFrameTime(double target_ms){ this->target_ms = target_ms; }
+	double getTargetFrameTime() const{ return target_ms; }
+
+	/**
+	 * Smoothed frame time the controller reacts to, in milliseconds
+	 */
+	double getSmoothedFrameTime() const{ return smoothed_ms; }
+
+	/**
+	 * Factor in [min_tess_scale, 1] applied to every tessellation level
+	 */
+	float getTessellationScale() const{ return enabled ? tess_scale : 1.f; }
+
+	/**
+	 * Number of discrete LOD levels subtracted from the tessellation level
+	 */
+	int getLODBias() const{ return enabled ? lod_bias : 0; }
+
+	void printState(std::ostream &os) const;
+
+private:
+	void decreaseDetail();
+	void increaseDetail();
+
+	bool enabled;
+	double target_ms;
+	double smoothed_ms;
+
+	float tess_scale;
+	int lod_bias;
+
+	int frames_over_budget;
+	int frames_under_budget;
+};
+
+#endif // _LODGOVERNOR_H_
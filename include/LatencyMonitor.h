@@ -0,0 +1,75 @@
+#ifndef _LATENCYMONITOR_H_
+#define _LATENCYMONITOR_H_
+
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>
+
+/**
+ * Measures the time from an input event to the GPU finishing the frame that shows it.
+ *
+ * After each swap, a timestamp query and a fence are put in the command stream.
+ * Once the fence has signalled, the GPU timestamp is mapped onto the CPU clock
+ * of Timer (the offset between the two is measured every frame) and compared
+ * with the time of the oldest input event the frame consumed. The display's
+ * own scan-out delay comes on top and cannot be seen from here.
+ *
+ * frameSwapped() and collect() issue GL calls and belong to the render thread,
+ * the statistics can be read from any thread.
+ */
+class LatencyMonitor{
+public:
+	struct Percentiles{
+		double p50;
+		double p90;
+		double p99;
+		double max;
+		size_t sample_count;
+	};
+
+	LatencyMonitor();
+	~LatencyMonitor();
+
+	/**
+	 * Marks the end of a frame, call right after the swap.
+	 * input_time is the Timer::getCurrentTime() of the oldest input
+	 * event of the frame, or negative if it had none.
+	 */
+	void frameSwapped(double input_time);
+
+	/**
+	 * Turns the frames the GPU has finished into samples, without blocking
+	 */
+	void collect();
+
+	/**
+	 * Latency in milliseconds over the most recent samples
+	 */
+	Percentiles getPercentiles() const;
+
+	void printState(std::ostream &os) const;
+
+private:
+	LatencyMonitor(const LatencyMonitor &);
+	LatencyMonitor &operator=(const LatencyMonitor &);
+
+	static const unsigned int ring_size = 8; //< frames in flight that can be measured
+	static const size_t window_size = 1024; //< samples the percentiles are taken over
+
+	struct Pending{
+		GLuint query;
+		GLsync fence;
+		double input_time;
+	};
+
+	Pending pending[ring_size];
+	unsigned int next; //< oldest slot, the next one to be reused
+
+	mutable std::mutex samples_mutex;
+	std::vector<double> samples; //< ring of window_size, guarded by samples_mutex
+	size_t sample_cursor;
+};
+
+#endif // _LATENCYMONITOR_H_
@@ -0,0 +1,104 @@
+#ifndef _LOOSEOCTREE_H_
+#define _LOOSEOCTREE_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Loose octree over the bounding boxes of objects, for visibility and ray queries.
+ *
+ * The nodes are the cells of a regular octree grown by half their size on
+ * every side, so an object goes straight into the node of the depth its size
+ * allows and of the cell its centre falls into, without descending or
+ * splitting anything. Moving an object relinks it only when it leaves that
+ * cell or changes size class, and removing it swaps it with the last object
+ * of its node. Nodes are created on demand and count the objects below them,
+ * so queries skip empty branches and take branches that lie fully inside the
+ * frustum without testing their objects one by one.
+ */
+class LooseOctree{
+public:
+	/**
+	 * The six planes of a view frustum, facing inwards: a point p is inside
+	 * if dot(plane.xyz, p) + plane.w >= 0 for all of them
+	 */
+	struct Frustum{
+		explicit Frustum(const glm::mat4 &view_projection);
+		glm::vec4 planes[6];
+	};
+
+	/**
+	 * An octree over the cube enclosing [min_dim, max_dim], max_depth levels below the root.
+	 * Objects whose centre falls outside of it are kept at the root and tested by every query.
+	 */
+	LooseOctree(const glm::vec3 &min_dim, const glm::vec3 &max_dim, unsigned int max_depth = 8);
+
+	/**
+	 * Objects are named by small integers, such as their index in a caller's array
+	 */
+	void insert(uint32_t object, const glm::vec3 &min_dim, const glm::vec3 &max_dim);
+	void update(uint32_t object, const glm::vec3 &min_dim, const glm::vec3 &max_dim);
+	void remove(uint32_t object);
+
+	/**
+	 * Appends the objects whose boxes intersect the frustum. With a non-zero sweep,
+	 * the boxes are taken as extruded without end along it, which finds the casters
+	 * of shadows falling into the frustum for a light shining along sweep.
+	 */
+	void queryFrustum(const Frustum &frustum, std::vector<uint32_t> &objects,
+	                  const glm::vec3 &sweep = glm::vec3(0.f)) const;
+
+	/**
+	 * Fills hits with the objects whose boxes the ray origin + t * direction
+	 * enters at some t >= 0, along with that t, nearest first
+	 */
+	void queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+	              std::vector<std::pair<float, uint32_t> > &hits) const;
+
+	size_t getNodeCount() const{ return nodes.size(); }
+	size_t getObjectCount() const{ return object_count; }
+
+private:
+	struct Node{
+		glm::vec3 min_dim; //< loose bounds, twice the size of the cell
+		glm::vec3 max_dim;
+		uint32_t parent;
+		uint32_t children[8]; //< 0 where no child was created, the root being no one's child
+		uint32_t subtree_count; //< objects in this node and below
+		std::vector<uint32_t> objects;
+	};
+
+	struct Object{
+		glm::vec3 min_dim;
+		glm::vec3 max_dim;
+		uint32_t node; //< no_node while not inserted
+		uint32_t slot; //< index into the objects of the node
+	};
+
+	static const uint32_t no_node = 0xFFFFFFFFu;
+
+	/**
+	 * The node a box belongs to, created along with its ancestors if needed
+	 */
+	uint32_t findNode(const glm::vec3 &min_dim, const glm::vec3 &max_dim);
+	void link(uint32_t object, uint32_t node);
+	void unlink(uint32_t object);
+
+	void collect(uint32_t node, std::vector<uint32_t> &objects) const;
+	void queryFrustum(uint32_t node, const Frustum &frustum, const glm::vec3 &sweep,
+	                  std::vector<uint32_t> &objects) const;
+	void queryRay(uint32_t node, const glm::vec3 &origin, const glm::vec3 &inverse_direction,
+	              std::vector<std::pair<float, uint32_t> > &hits) const;
+
+	glm::vec3 root_min; //< corner of the root cell
+	float root_size; //< edge of the root cell
+	unsigned int max_depth;
+	std::vector<Node> nodes;
+	std::vector<Object> objects;
+	size_t object_count;
+};
+
+#endif // _LOOSEOCTREE_H_
@@ -13,64 +13,165 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "GLUtils/VBO.hpp"
+#include "BVH.h"
 
 struct MeshPart{
-	MeshPart() : first(0), count(0){}
+	MeshPart() : first(0), count(0), min_dim(0.f), max_dim(0.f){}
 	glm::mat4 transform;
 	unsigned int first;
 	unsigned int count;
+	glm::vec3 min_dim; //< bounding box of this part's own vertices, before transform
+	glm::vec3 max_dim;
 	std::vector<MeshPart> children;
 };
 
 class Model{
 public:
-	Model(std::string filename, bool invert = false);
+	/**
+	 * Where a ray hits the model, in the space the model matrix maps from
+	 */
+	struct Hit{
+		glm::vec3 position;
+		glm::vec3 normal; //< unit geometric normal
+		float distance; //< in units of the ray direction
+		unsigned int triangle; //< index of the triangle in the vertex buffers
+		const MeshPart *part; //< the part whose draw range holds the triangle
+	};
+
+	/**
+	 * Where the loaded mesh and textures are kept
+	 */
+	enum Storage{
+		STORE_GPU, //< in vertex buffers and textures of the current OpenGL context
+		STORE_CPU //< in memory, see getGeometry and getDiffuseImage, no context needed
+	};
+
+	/**
+	 * What the vertex buffers hold, one entry per corner of every triangle
+	 */
+	struct Geometry{
+		std::vector<float> positions; //< xyz
+		std::vector<float> normals; //< xyz
+		std::vector<float> uvs; //< uv, empty if the mesh has none
+		std::vector<float> tangents; //< xyzw, handedness in w, empty without uvs
+		std::vector<float> edge_curvatures; //< of the edge facing the corner
+	};
+
+	/**
+	 * A texture as it is uploaded: RGB, 8 bits per channel, rows from the bottom up
+	 */
+	struct Image{
+		Image() : width(0), height(0){}
+		unsigned int width;
+		unsigned int height;
+		std::vector<unsigned char> rgb;
+	};
+
+	/**
+	 * Loads the mesh and its diffuse, normal and specular maps.
+	 * OBJ files are read by ObjLoader, anything else goes through Assimp.
+	 * Safe to call on a loader thread with a shared OpenGL context current,
+	 * or without any context if storage is STORE_CPU, where an empty map path
+	 * leaves that map out.
+	 */
+	Model(std::string filename, std::string diffuse_map, std::string normal_map, std::string specular_map,
+	      bool invert = false, Storage storage = STORE_GPU);
 	~Model();
 
-	MeshPart getMesh(){ return root; }
+	MeshPart &getMesh(){ return root; }
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getVertices(){ return vertices; }
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getNormals(){ return normals; }
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getColors(){ return colors; }
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getUVs(){ return uvs; }
-	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getTangents(){ return tangents; }
-	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getBinormals(){ return binormals; }
+	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getTangents(){ return tangents; } //< vec4, handedness in w
+	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> getEdgeCurvatures(){ return edge_curvatures; }
+	std::shared_ptr<BVH> getBVH(){ return bvh; } //< over the triangles with the part transforms applied
+	GLuint getDiffuseMap() const{ return diffuse_texture; }
+	GLuint getBumpMap() const{ return bump_texture; }
+	GLuint getSpecularMap() const{ return specular_texture; }
+
+	// empty unless the model was loaded with STORE_CPU
+	const Geometry &getGeometry() const{ return geometry; }
+	const Image &getDiffuseImage() const{ return diffuse_image; }
+	const Image &getBumpImage() const{ return bump_image; }
+	const Image &getSpecularImage() const{ return specular_image; }
+
+	/**
+	 * Closest triangle along origin + t * direction, with the ray in the space the model matrix maps from.
+	 * Returns false if nothing is hit.
+	 */
+	bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit) const;
 	void bindDiffuseMap(GLuint texture_unit);
 	void bindBumpMap(GLuint texture_unit);
 	void bindSpecularMap(GLuint texture_unit);
 	void unbindTexture();
 
+	/**
+	 * The weight of the edge between two vertex normals, as stored for the corner facing it
+	 */
+	static float edgeCurvature(const glm::vec3 &n0, const glm::vec3 &n1);
+	static GLuint loadTexture(std::string filename);
+
 private:
-	static void compute_tangent_space(const std::vector<glm::vec3> &face_vertices,
-	                                  const std::vector<glm::vec3> &face_normals,
-	                                  const std::vector<glm::vec2> &face_uvs,
-	                                  std::vector<float> &tangent_data_out,
-	                                  std::vector<float> &binormal_data_out);
 	static void loadRecursive(MeshPart &part, bool invert,
 	                          std::vector<float> &vertex_data, std::vector<float> &normal_data,
 	                          std::vector<float> &color_data, std::vector<float> &uv_data,
-	                          std::vector<float> &tangent_data, std::vector<float> &binormal_data,
+	                          std::vector<float> &tangent_data, std::vector<float> &curvature_data,
 	                          const aiScene *scene,
 	                          const aiNode *node);
-	GLuint loadTexture(std::string filename);
+	/**
+	 * Fills the per-corner data from an OBJ file, one child part per o/g group
+	 */
+	void loadObj(const std::string &filename, bool invert,
+	             std::vector<float> &vertex_data, std::vector<float> &normal_data, std::vector<float> &uv_data,
+	             std::vector<float> &tangent_data, std::vector<float> &curvature_data);
+
+	/**
+	 * Appends the TangentSpace tangents of an indexed mesh to tangent_data, per corner.
+	 * With invert the normals are flipped afterwards, so the handedness is flipped too.
+	 */
+	static void appendTangents(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+	                           const std::vector<glm::vec2> &uvs, const std::vector<unsigned int> &indices,
+	                           bool invert, std::vector<float> &tangent_data);
+	static void loadImage(const std::string &filename, Image &image);
+
+	/**
+	 * Appends the triangles of part and its children with their transforms applied,
+	 * and where the draw range of each part starts
+	 */
+	void collectTriangles(const MeshPart &part, const glm::mat4 &parent_transform,
+	                      const std::vector<float> &vertex_data, std::vector<glm::vec3> &triangle_vertices);
 
 	static void findBBoxRecursive(const aiScene *scene, const aiNode *node, glm::vec3 &min_dim, glm::vec3 &max_dim,
 	                              aiMatrix4x4 *trafo);
 
-	const aiScene *scene;
 	MeshPart root;
 
+	/**
+	 * The first triangle of a part's draw range, sorted by it
+	 */
+	struct PartRange{
+		unsigned int first_triangle;
+		const MeshPart *part;
+	};
+	std::vector<PartRange> part_ranges;
+	std::shared_ptr<BVH> bvh;
+
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> normals;
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> vertices;
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> colors;
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> uvs;
 	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> tangents;
-	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> binormals;
+	std::shared_ptr<GLUtils::VBO<GL_ARRAY_BUFFER>> edge_curvatures; //< per-vertex weight of the opposite edge
 
 	glm::vec3 min_dim;
 	glm::vec3 max_dim;
 
 	unsigned int n_vertices;
+	Storage storage;
 	GLuint diffuse_texture, bump_texture, specular_texture;
+	Geometry geometry;
+	Image diffuse_image, bump_image, specular_image;
 };
 
 #endif
@@ -0,0 +1,84 @@
+#ifndef _NORMALBAKER_H_
+#define _NORMALBAKER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+/**
+ * Bakes the surface detail of a high poly mesh into a tangent space normal map
+ * of a low poly mesh, so that the low poly one can be drawn in its place.
+ *
+ * Both meshes are loaded through Model and are expected in the same space in
+ * their files, the low poly one with UVs. Every texel of the map covered by a
+ * low poly triangle casts a ray from a cage max_distance out along the
+ * interpolated vertex normal back through the surface, and the first hit on the
+ * high poly mesh, found through its BVH, gives the normal. That normal is
+ * stored in the tangent frame the loader generates for the low poly mesh, with
+ * the binormal following from the handedness as in basic_phong.vert, and
+ * encoded as n * 0.5 + 0.5 with y up. Rows of texels are spread over the
+ * threads, and the baked texels are grown into the empty ones around them so
+ * that filtering at the UV seams does not pick up the background.
+ */
+class NormalBaker{
+public:
+	/**
+	 * Loads both meshes, max_distance is how far apart the surfaces may be,
+	 * in units of the high poly mesh's size
+	 */
+	NormalBaker(const std::string &high_poly_path, const std::string &low_poly_path, float max_distance = 0.05f);
+
+	/**
+	 * Bakes a width by height map, replacing the last one
+	 */
+	void bake(unsigned int width, unsigned int height);
+
+	/**
+	 * Writes the map with DevIL, the format follows the extension of filename
+	 */
+	void writeImage(const std::string &filename) const;
+
+	const std::vector<unsigned char> &getPixels() const{ return pixels; } //< RGB, rows from the bottom up as uploaded
+	size_t getCoveredTexels() const{ return covered_texels; } //< inside a low poly triangle in the last bake
+	size_t getMissedTexels() const{ return missed_texels; } //< of those, the ones whose ray missed the high poly mesh
+
+private:
+	/**
+	 * The per-corner data of a model with the transforms of its parts applied
+	 */
+	struct Surface{
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec4> tangents; //< handedness in w
+	};
+
+	/**
+	 * Appends the corners of part and its children to surface, with transform in place of the part's own
+	 */
+	static void flatten(const Model::Geometry &geometry, const MeshPart &part, const glm::mat4 &transform,
+	                    Surface &surface);
+
+	/**
+	 * Fills the empty texels next to baked ones with the average of those, passes times
+	 */
+	void dilate(std::vector<glm::vec3> &normals, std::vector<bool> &filled, unsigned int passes) const;
+
+	std::shared_ptr<Model> high_poly;
+	std::shared_ptr<Model> low_poly;
+	Surface high_surface; //< in the space of the high poly BVH
+	Surface low_surface; //< moved into the same space
+	float max_distance;
+
+	unsigned int width;
+	unsigned int height;
+	std::vector<unsigned char> pixels;
+	size_t covered_texels;
+	size_t missed_texels;
+};
+
+#endif // _NORMALBAKER_H_
@@ -0,0 +1,53 @@
+#ifndef _OBJLOADER_H_
+#define _OBJLOADER_H_
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Fast path for Wavefront OBJ files, without going through Assimp.
+ *
+ * The file is memory mapped and cut into line-aligned chunks that are parsed
+ * in parallel. Relative (negative) indices are resolved once the number of
+ * vertices before every chunk is known, and polygons are triangulated as fans.
+ * The v/vt/vn triplets of the corners are then welded into unique vertices
+ * through a hash table split into shards: every chunk sorts its corners by
+ * shard, then every shard is filled by one thread, in file order, so no locks
+ * are taken and the result does not depend on the thread count.
+ *
+ * Vertices without a normal get the area-weighted average of the faces
+ * around their position, as Assimp's aiProcess_GenSmoothNormals would.
+ */
+class ObjLoader{
+public:
+	/**
+	 * A named o/g section of the file, as a range of triangles
+	 */
+	struct Group{
+		std::string name;
+		unsigned int first_triangle;
+		unsigned int triangle_count;
+	};
+
+	struct Mesh{
+		std::vector<glm::vec3> positions; //< one per welded vertex
+		std::vector<glm::vec3> normals; //< one per welded vertex
+		std::vector<glm::vec2> uvs; //< one per welded vertex, empty if the file has none
+		std::vector<unsigned int> indices; //< three per triangle
+		std::vector<Group> groups; //< only groups with triangles
+	};
+
+	/**
+	 * Reads filename into mesh, throws if it cannot be read or is malformed
+	 */
+	static void load(const std::string &filename, Mesh &mesh);
+
+	/**
+	 * Whether filename has the .obj extension
+	 */
+	static bool isObjFile(const std::string &filename);
+};
+
+#endif // _OBJLOADER_H_
@@ -0,0 +1,55 @@
+#ifndef _PARALLELFOR_H_
+#define _PARALLELFOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs body(i) for every i in [0, count), spread over the hardware threads.
+ *
+ * Meant for a few coarse tasks (chunks of a file, shards of a table), not
+ * for single elements: every task is fetched from a shared counter, so
+ * uneven tasks balance out. The calling thread works along, and the first
+ * exception thrown by a task is rethrown here once all threads are done.
+ */
+template<typename Body>
+void parallelFor(size_t count, Body body){
+	const size_t thread_count = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+	if(thread_count <= 1){
+		for(size_t i = 0; i < count; ++i)
+			body(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto work = [&](){
+		try{
+			for(size_t i = next++; i < count; i = next++)
+				body(i);
+		}
+		catch(...){
+			std::lock_guard<std::mutex> lock(error_mutex);
+			if(!error)
+				error = std::current_exception();
+			next = count;
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for(size_t t = 1; t < thread_count; ++t)
+		threads.push_back(std::thread(work));
+	work();
+	for(size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+#endif // _PARALLELFOR_H_
@@ -0,0 +1,175 @@
+#ifndef _RENDERDEVICE_H_
+#define _RENDERDEVICE_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/**
+ * The OpenGL calls of the per-draw submission path, behind an interface:
+ * the per-frame uniforms of the scene, shadow, terrain and impostor passes,
+ * their draws and the state that changes between them. The fullscreen and
+ * compute passes still call OpenGL directly.
+ *
+ * GLRenderDevice forwards them to the current context. NullRenderDevice needs
+ * no context at all: it counts the calls by kind, and can record them into a
+ * command stream to be inspected or replayed on another device. Drawing
+ * through it measures what submitting a draw list costs the CPU alone, and
+ * shows how many state changes and uniform uploads a frame makes.
+ */
+class RenderDevice{
+public:
+	virtual ~RenderDevice(){}
+
+	virtual void useProgram(GLuint program) = 0;
+	virtual void bindVertexArray(GLuint vertex_array) = 0;
+	virtual void bindTexture(GLuint unit, GLenum target, GLuint texture) = 0;
+	virtual void setUniform(GLint location, int value) = 0;
+	virtual void setUniform(GLint location, float value) = 0;
+	virtual void setUniform(GLint location, const glm::vec2 &value) = 0;
+	virtual void setUniform(GLint location, const glm::vec3 &value) = 0;
+	virtual void setUniform(GLint location, const glm::mat3 &value) = 0;
+	virtual void setUniform(GLint location, const glm::mat4 &value) = 0;
+	/**
+	 * Sets count elements of a uniform array, starting at the one of location
+	 */
+	virtual void setUniform(GLint location, const float *values, GLsizei count) = 0;
+	virtual void setUniform(GLint location, const glm::vec2 *values, GLsizei count) = 0;
+	virtual void setUniform(GLint location, const glm::mat4 *values, GLsizei count) = 0;
+	virtual void setPatchVertices(GLint count) = 0;
+	/**
+	 * Offsets the depth of filled polygons as glPolygonOffset, turned off if both are 0
+	 */
+	virtual void setPolygonOffset(float factor, float units) = 0;
+	virtual void drawArrays(GLenum mode, GLint first, GLsizei count) = 0;
+	/**
+	 * Draws the command at offset bytes into the bound GL_DRAW_INDIRECT_BUFFER
+	 */
+	virtual void drawArraysIndirect(GLenum mode, size_t offset) = 0;
+	/**
+	 * Draws instance_count instances of count vertices, the instanced attributes starting at base_instance
+	 */
+	virtual void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
+	                                 GLuint base_instance) = 0;
+};
+
+class GLRenderDevice : public RenderDevice{
+public:
+	void useProgram(GLuint program) override;
+	void bindVertexArray(GLuint vertex_array) override;
+	void bindTexture(GLuint unit, GLenum target, GLuint texture) override;
+	void setUniform(GLint location, int value) override;
+	void setUniform(GLint location, float value) override;
+	void setUniform(GLint location, const glm::vec2 &value) override;
+	void setUniform(GLint location, const glm::vec3 &value) override;
+	void setUniform(GLint location, const glm::mat3 &value) override;
+	void setUniform(GLint location, const glm::mat4 &value) override;
+	void setUniform(GLint location, const float *values, GLsizei count) override;
+	void setUniform(GLint location, const glm::vec2 *values, GLsizei count) override;
+	void setUniform(GLint location, const glm::mat4 *values, GLsizei count) override;
+	void setPatchVertices(GLint count) override;
+	void setPolygonOffset(float factor, float units) override;
+	void drawArrays(GLenum mode, GLint first, GLsizei count) override;
+	void drawArraysIndirect(GLenum mode, size_t offset) override;
+	void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
+	                         GLuint base_instance) override;
+};
+
+class NullRenderDevice : public RenderDevice{
+public:
+	enum Command{
+		USE_PROGRAM,
+		BIND_VERTEX_ARRAY,
+		BIND_TEXTURE,
+		PATCH_VERTICES,
+		POLYGON_OFFSET,
+		UNIFORM_INT,
+		UNIFORM_FLOAT,
+		UNIFORM_VEC2,
+		UNIFORM_VEC3,
+		UNIFORM_MAT3,
+		UNIFORM_MAT4,
+		UNIFORM_FLOAT_ARRAY,
+		UNIFORM_VEC2_ARRAY,
+		UNIFORM_MAT4_ARRAY,
+		DRAW_ARRAYS,
+		DRAW_ARRAYS_INDIRECT,
+		DRAW_ARRAYS_INSTANCED,
+		COMMAND_COUNT
+	};
+
+	/**
+	 * With record set, every call is also appended to the command stream
+	 */
+	explicit NullRenderDevice(bool record = false);
+
+	void useProgram(GLuint program) override;
+	void bindVertexArray(GLuint vertex_array) override;
+	void bindTexture(GLuint unit, GLenum target, GLuint texture) override;
+	void setUniform(GLint location, int value) override;
+	void setUniform(GLint location, float value) override;
+	void setUniform(GLint location, const glm::vec2 &value) override;
+	void setUniform(GLint location, const glm::vec3 &value) override;
+	void setUniform(GLint location, const glm::mat3 &value) override;
+	void setUniform(GLint location, const glm::mat4 &value) override;
+	void setUniform(GLint location, const float *values, GLsizei count) override;
+	void setUniform(GLint location, const glm::vec2 *values, GLsizei count) override;
+	void setUniform(GLint location, const glm::mat4 *values, GLsizei count) override;
+	void setPatchVertices(GLint count) override;
+	void setPolygonOffset(float factor, float units) override;
+	void drawArrays(GLenum mode, GLint first, GLsizei count) override;
+	void drawArraysIndirect(GLenum mode, size_t offset) override;
+	void drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
+	                         GLuint base_instance) override;
+
+	size_t getCallCount(Command command) const{ return call_counts[command]; }
+	size_t getStateChanges() const; //< program, vertex array and texture binds, patch size and polygon offset
+	size_t getRedundantStateChanges() const{ return redundant_state_changes; } //< binds of what was bound already
+	size_t getUniformUploads() const;
+	size_t getDrawCalls() const;
+
+	/**
+	 * Every call as its Command followed by its arguments, one 32 bit word each,
+	 * floats by their bits and matrices column by column. Arrays are given by
+	 * their location and count, then their elements one after the other
+	 */
+	const std::vector<uint32_t> &getStream() const{ return stream; }
+
+	/**
+	 * Issues the recorded calls on device, in order
+	 */
+	void replay(RenderDevice &device) const;
+
+	/**
+	 * Forgets the counts, the stream and the bound state
+	 */
+	void reset();
+
+	/**
+	 * Prints the counts of the calls on one line
+	 */
+	void printCounts(std::ostream &out) const;
+
+	static const char *getCommandName(Command command);
+
+private:
+	void record(Command command, const uint32_t *arguments, size_t count);
+	void recordState(GLuint &bound, GLuint name);
+	void recordArray(Command command, GLint location, const float *values, size_t words);
+
+	static const unsigned int texture_units = 32;
+
+	bool recording;
+	size_t call_counts[COMMAND_COUNT];
+	size_t redundant_state_changes;
+	std::vector<uint32_t> stream;
+	GLuint bound_program;
+	GLuint bound_vertex_array;
+	GLuint bound_patch_vertices;
+	GLuint bound_textures[texture_units];
+};
+
+#endif // _RENDERDEVICE_H_
@@ -0,0 +1,147 @@
+#ifndef _SCENE_H_
+#define _SCENE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "LooseOctree.h"
+
+/**
+ * The models of a scene and the instances placing them in the world, read from a text file.
+ *
+ * Every line is one statement, anything after a # is a comment:
+ *
+ *   model <name> <mesh> <diffuse map> <normal map> <specular map>
+ *   instance <model> <x> <y> <z> [scale [yaw in degrees]] [orbit <radians per second>]
+ *   grid <model> <nx> <ny> <nz> <spacing> [scale] [orbit <radians per second>]
+ *   streamed <cluster file> <diffuse map> <normal map> <specular map> <x> <y> <z> [scale [yaw in degrees]]
+ *   terrain <tile file> <x> <y> <z> <size> <height>
+ *
+ * A grid places nx * ny * nz instances centred on the origin. A streamed
+ * mesh is a file written by ClusterBuilder, drawn through a ClusterStreamer
+ * that culls and picks the detail of its clusters itself, so it is kept
+ * apart from the instances and out of the octree. The same goes for the
+ * terrain, a file written by Terrain::generate, of which a scene has at
+ * most one: size wide, centered on x, z, rising from y up to y + height. Orbiting
+ * instances circle the y axis. The world bounds of the instances are kept
+ * in a loose octree, which answers the visibility, shadow and picking queries
+ * and is updated in place as instances move. It is built once the bounds of
+ * every model are known, see setModelBounds.
+ */
+class Scene{
+public:
+	struct ModelDescription{
+		std::string name;
+		std::string mesh_path;
+		std::string diffuse_map_path;
+		std::string normal_map_path;
+		std::string specular_map_path;
+	};
+
+	struct Instance{
+		unsigned int model; //< index into the models
+		glm::mat4 transform; //< model matrix
+		float orbit_speed; //< radians per second around the y axis, 0 for static instances
+		glm::vec3 min_dim; //< world space bounds, valid once the model bounds are set
+		glm::vec3 max_dim;
+	};
+
+	struct StreamedMesh{
+		std::string cluster_path;
+		std::string diffuse_map_path;
+		std::string normal_map_path;
+		std::string specular_map_path;
+		glm::mat4 transform; //< model matrix
+	};
+
+	struct TerrainDescription{
+		std::string tile_path;
+		glm::vec3 position; //< center of the terrain in x and z, its lowest possible height in y
+		float size;
+		float height;
+	};
+
+	/**
+	 * Reads the scene file, throws a GameException naming the line of any error
+	 */
+	explicit Scene(const std::string &filename);
+
+	const std::vector<ModelDescription> &getModels() const{ return models; }
+	const std::vector<Instance> &getInstances() const{ return instances; }
+	const std::vector<StreamedMesh> &getStreamedMeshes() const{ return streamed_meshes; }
+	bool hasTerrain() const{ return has_terrain; }
+	const TerrainDescription &getTerrain() const{ return terrain; } //< only if hasTerrain()
+
+	/**
+	 * Sets the bounds of a model before any instance transform and moves its instances
+	 * in the octree, which is created when the last model gets its bounds
+	 */
+	void setModelBounds(unsigned int model, const glm::vec3 &min_dim, const glm::vec3 &max_dim);
+
+	/**
+	 * Moves the orbiting instances by elapsed seconds
+	 */
+	void animate(float elapsed);
+
+	/**
+	 * Appends the instances whose bounds intersect the view frustum of view_projection
+	 */
+	void queryVisible(const glm::mat4 &view_projection, std::vector<uint32_t> &instances) const;
+
+	/**
+	 * Appends the instances that may cast a shadow into the view frustum
+	 * for a directional light shining along light_direction
+	 */
+	void queryShadowCasters(const glm::mat4 &view_projection, const glm::vec3 &light_direction,
+	                        std::vector<uint32_t> &instances) const;
+
+	/**
+	 * The instances whose bounds the ray origin + t * direction enters, with that t, nearest first
+	 */
+	void queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+	              std::vector<std::pair<float, uint32_t> > &hits) const;
+
+	/**
+	 * The octree, null until every model has bounds
+	 */
+	std::shared_ptr<LooseOctree> getOctree() const{ return octree; }
+
+private:
+	// location is the file and line the statement came from, for the errors
+	void parseModel(std::istream &line, const std::string &location);
+	void parseInstance(std::istream &line, const std::string &location);
+	void parseGrid(std::istream &line, const std::string &location);
+	void parseStreamed(std::istream &line, const std::string &location);
+	void parseTerrain(std::istream &line, const std::string &location);
+	unsigned int findModel(const std::string &name, const std::string &location) const;
+	void addInstance(unsigned int model, const glm::mat4 &transform, float orbit_speed);
+
+	/**
+	 * Recomputes the world bounds of an instance from its transform and model bounds
+	 */
+	void updateBounds(uint32_t instance);
+
+	/**
+	 * Creates the octree around everything the instances can reach
+	 */
+	void buildOctree();
+
+	std::vector<ModelDescription> models;
+	std::vector<std::pair<glm::vec3, glm::vec3> > model_bounds;
+	std::vector<bool> has_bounds;
+	unsigned int models_without_bounds;
+	std::vector<Instance> instances;
+	std::vector<glm::mat4> base_transforms; //< of the instances before any orbit
+	std::vector<StreamedMesh> streamed_meshes;
+	TerrainDescription terrain;
+	bool has_terrain;
+	float orbit_time; //< seconds animated so far
+	std::shared_ptr<LooseOctree> octree;
+};
+
+#endif // _SCENE_H_
@@ -0,0 +1,148 @@
+#ifndef _SOFTWARERENDERER_H_
+#define _SOFTWARERENDERER_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Model.h"
+
+/**
+ * Draws models on the CPU the way the basic_phong program draws them on the GPU,
+ * as a reference to compare the GPU output against and a fallback where there is no GPU.
+ *
+ * It reads the same per-corner data the vertex buffers are made from (see
+ * Model::STORE_CPU) and follows the shaders stage by stage: the vertex
+ * shader, the PN triangles and tessellation levels of the control and
+ * evaluation shaders, and the Blinn-Phong shading with normal and specular
+ * maps of the fragment shader. The tessellated triangles are clipped, culled
+ * and binned into 64x64 pixel tiles, and every tile is rasterized by a worker
+ * thread with SSE edge functions four pixels at a time. Rasterizing only keeps
+ * the nearest triangle of every pixel, shading then happens once per pixel
+ * over whole rows.
+ *
+ * Unlike the GPU path there are no shadows, no anti-aliasing and no
+ * mip-maps, and the tessellation pattern of equal_spacing is approximated: the
+ * patch is cut into a uniform grid at the highest of its levels, and the
+ * vertices on an edge with a lower outer level are moved onto that edge's own
+ * vertices, which keeps neighbouring patches watertight.
+ */
+class SoftwareRenderer{
+public:
+	/**
+	 * The uniforms of the basic_phong program for one draw
+	 */
+	struct DrawState{
+		glm::mat4 projection; //< proj_mat
+		glm::mat4 model_view; //< model_view_mat
+		glm::mat4 model; //< model_mat
+		glm::mat3 model_view_3x3; //< model_view_mat_3x3
+		glm::mat3 normal; //< normal_mat
+		glm::vec3 light_position; //< light_position, camera space
+		float tess_level; //< TessLevel
+		float tess_scale; //< TessScale
+		float lod_bias; //< LODBias
+		bool distance_lod; //< the DISTANCE_LOD permutation, measured from the eye
+		bool curvature_lod; //< the CURVATURE_LOD permutation
+		bool lighting; //< the LIGHTING permutation, otherwise the diffuse map is drawn as is
+	};
+
+	SoftwareRenderer(unsigned int width, unsigned int height);
+
+	/**
+	 * Clears the color to color and the depth to the far plane, and drops the queued draws
+	 */
+	void clear(const glm::vec3 &color);
+
+	/**
+	 * Queues the patches of count corners from first, drawn in the order of the calls.
+	 * The model has to be loaded with STORE_CPU and is kept alive until finish.
+	 */
+	void draw(const std::shared_ptr<Model> &model, unsigned int first, unsigned int count, const DrawState &state);
+
+	/**
+	 * Tessellates, bins, rasterizes and shades the queued draws into the image
+	 */
+	void finish();
+
+	/**
+	 * Writes the image with DevIL, the format follows the extension of filename
+	 */
+	void writeImage(const std::string &filename) const;
+
+	unsigned int getWidth() const{ return width; }
+	unsigned int getHeight() const{ return height; }
+	const std::vector<unsigned char> &getPixels() const{ return pixels; } //< RGBA, rows from the bottom up
+	size_t getTriangleCount() const{ return triangle_count; } //< rasterized by the last finish, after clipping and culling
+
+private:
+	static const unsigned int tile_size = 64;
+	// uv, then the view and light vectors in tangent space
+	static const unsigned int attribute_count = 8;
+
+	/**
+	 * A tessellated vertex before clipping
+	 */
+	struct ClipVertex{
+		glm::vec4 position;
+		float attributes[attribute_count];
+	};
+
+	/**
+	 * A vertex in window coordinates, y up as in OpenGL
+	 */
+	struct Vertex{
+		float x, y;
+		float z; //< depth in [0, 1]
+		float inverse_w;
+		float attributes[attribute_count];
+	};
+
+	struct Triangle{
+		Vertex vertices[3];
+		uint32_t draw;
+		float texel_density; //< uv area per pixel of area, decides between the minifying and magnifying filter
+	};
+
+	struct Draw{
+		std::shared_ptr<Model> model;
+		unsigned int first;
+		unsigned int count;
+		DrawState state;
+	};
+
+	/**
+	 * Runs the shader stages over the patches [first_patch, end_patch) of a draw
+	 * and appends the visible triangles
+	 */
+	void tessellate(uint32_t draw_index, unsigned int first_patch, unsigned int end_patch,
+	                std::vector<Triangle> &triangles) const;
+
+	/**
+	 * Clips a triangle against the near plane and the guard band, culls its back
+	 * face and appends what is left in window coordinates
+	 */
+	void emitTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, uint32_t draw,
+	                  std::vector<Triangle> &triangles) const;
+
+	/**
+	 * Resolves the nearest triangle of every pixel in a tile, then shades the tile.
+	 * bins holds the triangles overlapping each tile, one list per binning task.
+	 */
+	void renderTile(unsigned int tile, const std::vector<std::vector<std::vector<uint32_t> > > &bins);
+
+	unsigned int width;
+	unsigned int height;
+	unsigned int tiles_x;
+	unsigned int tiles_y;
+	std::vector<Draw> draws;
+	std::vector<Triangle> triangles;
+	size_t triangle_count;
+	std::vector<float> depth;
+	std::vector<unsigned char> pixels;
+};
+
+#endif // _SOFTWARERENDERER_H_
@@ -0,0 +1,33 @@
+#ifndef _TANGENTSPACE_H_
+#define _TANGENTSPACE_H_
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/**
+ * Tangent frames for normal mapping, following the conventions of MikkTSpace.
+ *
+ * Every face contributes its UV-aligned tangent direction, projected into the
+ * tangent plane of each corner's normal and weighted by the corner angle.
+ * The contributions are summed per vertex, keeping faces with mirrored UVs
+ * apart so that a mirror seam does not cancel out, and orthonormalized against
+ * the normal. The result is a unit tangent per corner with the handedness in w,
+ * from which the shader rebuilds the bitangent as w * cross(normal, tangent).
+ *
+ * The faces are processed four at a time with SSE, in batches spread over
+ * the hardware threads. Any indexed triangle mesh will do, whichever loader
+ * it came from.
+ */
+class TangentSpace{
+public:
+	/**
+	 * Fills corner_tangents with one tangent per entry of indices,
+	 * which index positions, normals and uvs alike
+	 */
+	static void generate(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+	                     const std::vector<glm::vec2> &uvs, const std::vector<unsigned int> &indices,
+	                     std::vector<glm::vec4> &corner_tangents);
+};
+
+#endif // _TANGENTSPACE_H_
@@ -0,0 +1,202 @@
+#ifndef _TERRAIN_H_
+#define _TERRAIN_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "LooseOctree.h"
+
+/**
+ * A heightmap terrain drawn CDLOD style: as a quadtree of square nodes, each
+ * one a single quad patch that terrain.tcs tessellates into the same
+ * grid_size x grid_size grid and terrain.tes lifts to the heights of its tile.
+ *
+ * Every frame, update walks the quadtree from the root and splits the nodes
+ * that come nearer to the camera than the LOD range of their children, which
+ * doubles from one level to the next, so that about the same number of nodes
+ * is drawn at every level and the triangle count hardly depends on the size
+ * of the terrain. Near the end of its range, a node morphs every other
+ * vertex of its grid onto the grid of its parent, so that there is no
+ * popping when it is replaced, and where a node meets a coarser one its
+ * edge already matches the coarser grid. The nodes outside the view frustum
+ * are culled on the CPU against their bounds.
+ *
+ * The heights come from a tile file: a pyramid of tiles of tile_resolution
+ * squared cells, one covering the whole terrain, four the next level and so
+ * on, every level sampling the same heights at half the spacing of the one
+ * above, so that the tiles of neighbouring nodes agree on the vertices they
+ * share. The root tile is loaded and kept, the others share the layers of a
+ * texture array that the tiles around the camera are streamed into by a
+ * thread of the terrain, evicting the ones used the longest time ago. A node
+ * is only split once the tiles of its children are there, until then it is
+ * drawn at its own level and theirs are requested, the nearest first.
+ */
+class Terrain{
+public:
+	static const uint32_t file_version = 1;
+	static const unsigned int grid_size = 32; //< tessellation level of every node, cells per side
+	static const unsigned int max_depth = 16; //< levels of the quadtree, the morph ranges are a uniform array this long
+
+	/**
+	 * One node to draw, an instance of the patch of terrain.vert
+	 */
+	struct Node{
+		glm::vec4 area; //< x, z of the corner with the smallest coordinates, size, depth
+		glm::vec4 tile; //< s, t of that corner in its tile, in [0, 1], the size of the node in the tile, the texture layer
+	};
+
+	struct Header{
+		char magic[4]; //< "TERR"
+		uint32_t version;
+		uint32_t tile_levels; //< of the pyramid, the last one holding 4^(tile_levels - 1) tiles
+		uint32_t tile_resolution; //< cells per side of a tile, a power of two
+	};
+
+	/**
+	 * Writes a tile file of procedural heights, ridged fractal noise with
+	 * detail down to the sample spacing of the finest level. Throws if the
+	 * file cannot be written.
+	 */
+	static void generate(const std::string &filename, unsigned int tile_levels, unsigned int tile_resolution);
+
+	/**
+	 * Reads the tables and the root tile of filename and places the terrain: centered on
+	 * position in x and z, size wide, its heights from position.y up to position.y + height.
+	 * At most budget_tiles tiles are kept in memory. Needs a current OpenGL context.
+	 */
+	Terrain(const std::string &filename, const glm::vec3 &position, float size, float height, size_t budget_tiles);
+	~Terrain();
+
+	/**
+	 * Uploads the tiles read since the last call, and selects the nodes for a camera at
+	 * camera_position, world space, with ranges of detail times the size of a node.
+	 * The nodes inside the frustum of view_projection come first in the instance buffer,
+	 * followed by every selected node if shadow_nodes is set.
+	 */
+	void update(const glm::vec3 &camera_position, const glm::mat4 &view_projection, float detail, bool shadow_nodes);
+
+	/**
+	 * #defines the shaders drawing the terrain need
+	 */
+	static std::vector<std::string> getShaderDefines();
+
+	GLuint getVertexArray() const{ return vertex_array; } //< reads the nodes of the last update per instance
+	GLuint getHeightTexture() const{ return height_texture; } //< GL_TEXTURE_2D_ARRAY, one tile per layer
+	size_t getNodeCount() const{ return node_count; } //< inside the frustum
+	size_t getShadowNodeCount() const{ return nodes.size() - node_count; } //< after the ones inside the frustum
+	const std::vector<glm::vec2> &getMorphRanges() const{ return morph_ranges; } //< per depth: start, end
+	glm::vec2 getHeightRange() const{ return glm::vec2(origin.y, height); } //< base, scale of the stored heights
+	unsigned int getTileResolution() const{ return header.tile_resolution; }
+	size_t getTileCount() const{ return tile_bounds.size(); }
+	size_t getResidentTileCount() const{ return resident_tiles; }
+	size_t getPendingTileCount() const{ return pending_tiles; } //< requested and not uploaded yet
+
+private:
+	/**
+	 * A tile read by the loader thread, empty if it could not be read
+	 */
+	struct LoadedTile{
+		uint32_t tile;
+		std::vector<uint16_t> samples;
+	};
+
+	/**
+	 * Samples per side of a stored tile: the cell corners and one more all around,
+	 * so that the normals at the edges are taken across them
+	 */
+	static unsigned int tileSamples(unsigned int tile_resolution){ return tile_resolution + 3; }
+
+	/**
+	 * Index of a tile in the file, the levels one after the other, rows of x within a level
+	 */
+	static uint32_t tileIndex(unsigned int level, uint32_t x, uint32_t y){
+		return ((1u << (2 * level)) - 1) / 3 + (y << level) + x;
+	}
+
+	/**
+	 * Walks the quadtree below the node at depth, x, y, appending the nodes to draw
+	 */
+	void selectNode(unsigned int depth, uint32_t x, uint32_t y);
+
+	/**
+	 * Appends the node at depth, x, y to the nodes, inside the frustum or not
+	 */
+	void addNode(unsigned int depth, uint32_t x, uint32_t y, bool inside);
+
+	/**
+	 * The tile the node at depth, x, y samples its heights from
+	 */
+	uint32_t nodeTile(unsigned int depth, uint32_t x, uint32_t y) const;
+
+	/**
+	 * World space bounds of the node at depth, x, y
+	 */
+	void nodeBounds(unsigned int depth, uint32_t x, uint32_t y, glm::vec3 &min_dim, glm::vec3 &max_dim) const;
+
+	/**
+	 * Reads the requested tiles until the terrain is destroyed
+	 */
+	void loadTiles();
+
+	/**
+	 * Reads a tile from the file, leaves samples empty and returns false if it cannot
+	 */
+	bool readTile(uint32_t tile, std::vector<uint16_t> &samples);
+
+	/**
+	 * Copies a tile into a layer of the height texture, evicting the least recently used
+	 * tile if none is free. Returns false if every layer is taken by a tile still in use.
+	 */
+	bool upload(const LoadedTile &loaded);
+
+	Header header;
+	std::vector<glm::vec2> tile_bounds; //< lowest and highest height of every tile, in [0, 1]
+	size_t tile_bytes;
+	size_t data_offset; //< of the first tile in the file
+	unsigned int leaf_depth; //< of the smallest nodes, a sample of the finest tiles per grid cell
+	glm::vec3 origin; //< world space corner with the smallest coordinates
+	float size;
+	float height;
+
+	GLuint height_texture;
+	GLuint node_buffer;
+	GLuint vertex_array;
+	std::vector<uint32_t> layer_tiles; //< the tile in each layer of the height texture, or no_tile
+	std::vector<uint32_t> tile_layers; //< the layer of each tile, or no_tile if it is not in memory
+	std::vector<uint32_t> tile_last_used; //< the frame a node last sampled a tile
+	std::vector<uint32_t> tile_requested; //< the frame a tile was last asked for in
+	std::vector<bool> tile_pending; //< queued for or being read by the loader thread
+	std::vector<std::pair<float, uint32_t> > requests; //< of the current frame: priority, tile
+	uint32_t frame;
+	size_t resident_tiles;
+	size_t pending_tiles;
+
+	// the state of the selection being made
+	std::vector<glm::vec2> morph_ranges;
+	std::vector<float> lod_ranges; //< per depth, the distance within which nodes of that depth are drawn
+	std::vector<Node> nodes; //< inside the frustum, then all of them for the shadows
+	std::vector<Node> outside_nodes; //< selected outside the frustum
+	size_t node_count;
+	glm::vec3 selection_camera;
+	LooseOctree::Frustum selection_frustum;
+	bool selecting_shadow_nodes;
+
+	std::ifstream file; //< loader thread only after construction
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::deque<uint32_t> queue; //< tiles for the loader thread, most important first, guarded by mutex
+	std::vector<LoadedTile> loaded_tiles; //< read and waiting for update, guarded by mutex
+	bool stopping; //< guarded by mutex
+};
+
+#endif // _TERRAIN_H_
@@ -0,0 +1,74 @@
+#ifndef _TILEDLIGHTCULLING_H_
+#define _TILEDLIGHTCULLING_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLUtils/GLUtils.hpp"
+
+/**
+ * Bins point lights into screen tiles with a compute shader, so that the
+ * deferred lighting pass only loops over the lights that can reach a pixel.
+ *
+ * Every tile of tile_size x tile_size pixels finds the depth range of the
+ * G-buffer under it, builds the view space frustum enclosing that range and
+ * keeps the lights whose sphere of influence intersects it. The result is
+ * one light count per tile and a fixed-size list of light indices per tile.
+ */
+class TiledLightCulling{
+public:
+	static const unsigned int tile_size = 16;
+	static const unsigned int max_lights_per_tile = 256;
+
+	/**
+	 * Point light as stored in the light buffer, std430 compatible
+	 */
+	struct PointLight{
+		glm::vec4 position_radius; //< xyz: position, w: distance at which the light fades out
+		glm::vec4 color;
+	};
+
+	/**
+	 * @param width, height largest render size that will be culled
+	 */
+	TiledLightCulling(unsigned int width, unsigned int height);
+	~TiledLightCulling();
+
+	/**
+	 * Uploads the lights (in camera space) and bins them
+	 * against the region [0, width] x [0, height] of depth_texture
+	 */
+	void cull(const std::vector<PointLight> &lights, GLuint depth_texture,
+	          unsigned int width, unsigned int height, const glm::mat4 &projection);
+
+	/**
+	 * Binds the light, tile count and tile index buffers to
+	 * the shader storage bindings 0, 1 and 2
+	 */
+	void bindBuffers();
+	static void unbindBuffers();
+
+	/**
+	 * Number of tiles per row of the last cull
+	 */
+	unsigned int getTileCountX() const{ return tiles_x; }
+
+	/**
+	 * #defines the shaders reading the tile lists need
+	 */
+	static std::vector<std::string> getShaderDefines();
+
+private:
+	std::shared_ptr<GLUtils::Program> cull_program;
+
+	GLuint light_buffer;
+	GLuint tile_count_buffer;
+	GLuint tile_index_buffer;
+	unsigned int tiles_x;
+};
+
+#endif // _TILEDLIGHTCULLING_H_
@@ -1,18 +1,12 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
-#ifdef _WIN32
-#include <sys/timeb.h>
-#include <windows.h>
-#include <time.h>
-#else
-#include <sys/time.h>
-#include <unistd.h>
-#endif
+#include <chrono>
 
 
 /**
  *  A very basic timer class, suitable for FPS counters etc.
+ *  Based on the monotonic steady clock, so it never jumps with the wall clock.
  */
 class Timer {
 
@@ -45,28 +39,12 @@ public:
 	};
 
 	/** 
-	 * Return the current time as number of elapsed seconds of this day.
+	 * Return the current time in seconds since an arbitrary, fixed point.
 	 */
 	double static getCurrentTime() {
-#ifdef WIN32
-#if 1
-    LARGE_INTEGER f;
-    LARGE_INTEGER t;
-    QueryPerformanceFrequency(&f);
-    QueryPerformanceCounter(&t);
-    return t.QuadPart/(double) f.QuadPart;
-#else
-    struct _timeb ts;
-		_ftime(&ts);
-		return (ts.time + 0.001 * ts.millitm);
-#endif
-#else
-    struct timeval tv;
-    struct timezone tz;
-    gettimeofday(&tv, &tz);
-    return tv.tv_sec+tv.tv_usec*1e-6;
-#endif
-  };
+		typedef std::chrono::duration<double> seconds;
+		return std::chrono::duration_cast<seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	};
 
 
 private:
@@ -0,0 +1,60 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <string>
+
+/**
+ * Scoped CPU tracing with Chrome trace-event export.
+ *
+ * TRACE_SCOPE marks a scope as a duration event and TRACE_COUNTER records
+ * a value over time. Every thread appends to its own preallocated buffer,
+ * so recording takes no lock: two steady_clock reads and a store. The
+ * export writes the JSON that chrome://tracing and Perfetto open.
+ *
+ * Names must be string literals (or otherwise outlive the trace), only the
+ * pointer is stored. Recording is off until setEnabled(true).
+ */
+namespace Trace {
+
+	void setEnabled(bool enabled);
+	bool isEnabled();
+
+	/**
+	 * Names the calling thread in the exported trace
+	 */
+	void setThreadName(const char *name);
+
+	/**
+	 * Records a sample of a counter track
+	 */
+	void counter(const char *name, double value);
+
+	/**
+	 * Writes every event recorded so far to filename, returns false if it could not be written
+	 */
+	bool exportChromeJSON(const std::string &filename);
+
+	/**
+	 * Records the time between construction and destruction
+	 */
+	class Scope {
+	public:
+		explicit Scope(const char *name);
+		~Scope();
+
+	private:
+		Scope(const Scope &);
+		Scope &operator=(const Scope &);
+
+		const char *name;
+		long long start_ns; //< negative while tracing is off
+	};
+
+} // namespace Trace
+
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNTER(name, value) Trace::counter(name, value)
+
+#endif // _TRACE_H_
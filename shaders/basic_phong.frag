@@ -1,16 +1,18 @@
 #version 430 core
 
-uniform bool lighting;
+// LIGHTING and DEBUG_BARY are defined per program permutation,
+// only the lit variant samples the normal and specular maps
 uniform sampler2D diffuse_texture;
 uniform sampler2D specular_texture;
 uniform sampler2D normal_texture;
 
-uniform bool debugSwitch;
+// shadowFactor() is inserted from shadow.glsl
 
 in vec2 ex_Texture_coords;
 //in vec3 ex_Normal;
 in vec3 ex_View;
 in vec3 ex_Light;
+in vec3 ex_Position;
 out vec4 res_Color;
 in vec3 baryColor;
 
@@ -30,44 +32,37 @@ in vec3 baryColor;
 // }
 
 void main() {
+#if defined(DEBUG_BARY)
+	// shows colors to debug interpolation of the UVW barycentric coords 
+	// in the evaluation shader
+	res_Color = vec4(baryColor, 1.f); 
+#elif defined(LIGHTING)
 	vec3 specColor = vec3(1.f);
 	
 	vec4 diffColor = texture2D(diffuse_texture, ex_Texture_coords.xy);
 	
-	vec3 normal = texture2D(normal_texture, ex_Texture_coords).rgb;
+	// the map stores the tangent space normal as n * 0.5 + 0.5
+	vec3 normal = texture2D(normal_texture, ex_Texture_coords).rgb * 2.f - 1.f;
 	//normal = bumpNormal(normal);
 
+	vec3 v = normalize(ex_View );
+	vec3 l = normalize(ex_Light);
+	vec3 n = normalize(normal);
+	vec3 h = normalize(v+l);
+	float diffFactor = max(0.f, dot(l, n)); // Lambert's factor
+	float specFactor = 0.f;
 
-    if(lighting) {
-		vec3 v = normalize(ex_View );
-		vec3 l = normalize(ex_Light);
-		vec3 n = normalize(normal);
-		vec3 h = normalize(v+l);
-		float diffFactor = max(0.f, dot(l, n)); // Lambert's factor
-		float specFactor = 0.f;
-
-		float shininess = 0.f;
-		if(debugSwitch){
-			// shows colors to debug interpolation of the UVW barycentric coords 
-			// in the evaluation shader
-			res_Color = vec4(baryColor, 1.f); 
-			
-		} 
-		else {
-			shininess = texture2D(specular_texture, ex_Texture_coords.xy).r * 255.f;
-			if(shininess < 255.f) {
-				specFactor = pow(max(0.f, dot(h, n)), shininess);
-			}
-		
-			vec3 lightweighting =  
-								+ vec3(diffColor) * diffFactor 
-								+ specColor * specFactor;
-			res_Color = vec4(lightweighting, diffColor.a);
-
-		}	
-
-	} 
-	else {
-		res_Color = diffColor;
+	float shininess = texture2D(specular_texture, ex_Texture_coords.xy).r * 255.f;
+	if(shininess < 255.f) {
+		specFactor = pow(max(0.f, dot(h, n)), shininess);
 	}
-}
\ No newline at end of file
+
+	vec3 lightweighting =  
+						+ vec3(diffColor) * diffFactor 
+						+ specColor * specFactor;
+	lightweighting *= shadowFactor(ex_Position);
+	res_Color = vec4(lightweighting, diffColor.a);
+#else
+	res_Color = texture2D(diffuse_texture, ex_Texture_coords.xy);
+#endif
+}
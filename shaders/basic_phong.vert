@@ -7,19 +7,28 @@ uniform vec3 light_position;
 
 
 uniform mat3 model_view_mat_3x3;
-in  vec3 tangent;
-in  vec3 binormal;
 
-
-in  vec3 position;
-in  vec3 normal;
-in	vec2 UV;
+// fixed locations, so that every program built from this shader
+// can share the same vertex array object
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 UV;
+layout(location = 3) in vec4 tangent; // handedness in w
+layout(location = 5) in float edge_curvature;
 
 out vec2 tc_Texture_coords;
 out vec3 tc_Normal;
+#ifdef DEFERRED
+// tangent space basis in camera space, lighting happens later per pixel
+out vec3 tc_Tangent;
+out vec3 tc_Binormal;
+out vec3 tc_ViewNormal;
+#else
 out vec3 tc_View;
 out vec3 tc_Light;
-out vec3 tc_Position;
+#endif
+invariant out vec3 tc_Position;
+out float tc_EdgeCurvature;
 
 
 void main() {
@@ -27,23 +36,29 @@ void main() {
 	tc_Position = (model_view_mat * vec4(position, 1.0)).xyz;
 
 	vec4 position_cameraSpace = model_view_mat * vec4(position, 1.0);
-	tc_View = -position_cameraSpace.xyz;
-	tc_Light = light_position - position_cameraSpace.xyz;
 	vec3 light_normal =  normalize(normal_mat * normal);
 
 	tc_Texture_coords = UV;
+	tc_EdgeCurvature = edge_curvature;
 	
-	// calculate the tangent space basis
-	vec3 vertexTangent_cameraspace 		= 	model_view_mat_3x3 * tangent;
+	// calculate the tangent space basis, the binormal follows from the handedness
+	vec3 binormal = tangent.w * cross(normal, tangent.xyz);
+	vec3 vertexTangent_cameraspace 		= 	model_view_mat_3x3 * tangent.xyz;
 	vec3 vertexBinormal_cameraspace 	= 	model_view_mat_3x3 * binormal;
 	vec3 vertexNormal_cameraspace 		= 	model_view_mat_3x3 * light_normal;
 
+#ifdef DEFERRED
+	tc_Tangent = vertexTangent_cameraspace;
+	tc_Binormal = vertexBinormal_cameraspace;
+	tc_ViewNormal = vertexNormal_cameraspace;
+#else
 	mat3 TBN = transpose(mat3( 
 		vertexTangent_cameraspace,
 		vertexBinormal_cameraspace,
 		vertexNormal_cameraspace 	
 	));
 
-	tc_View = TBN * tc_View;
-	tc_Light = TBN * tc_Light;
+	tc_View = TBN * -position_cameraSpace.xyz;
+	tc_Light = TBN * (light_position - position_cameraSpace.xyz);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#version 430 core
+
+// Lighting pass of the deferred path: the Blinn-Phong of basic_phong.frag,
+// evaluated once per pixel from the G-buffer for every light binned into
+// the pixel's tile by light_cull.comp (TILE_SIZE and MAX_LIGHTS_PER_TILE
+// are defined by TiledLightCulling). shadowFactor() comes from shadow.glsl.
+// LIGHTING is defined per program permutation.
+
+struct PointLight {
+	vec4 position_radius; // camera space
+	vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer LightBuffer {
+	PointLight lights[];
+};
+
+layout(std430, binding = 1) readonly buffer TileLightCount {
+	uint tile_light_count[];
+};
+
+layout(std430, binding = 2) readonly buffer TileLightIndices {
+	uint tile_light_indices[];
+};
+
+uniform sampler2D albedo_specular_texture;
+uniform sampler2D normal_texture;
+uniform sampler2D depth_texture;
+// part of the G-buffer that was rendered to, in [0, 1]
+uniform vec2 source_scale;
+
+uniform mat4 inv_proj_mat;
+uniform uint tiles_x;
+uniform vec4 clear_color;
+
+in vec2 ex_Texture_coords;
+out vec4 res_Color;
+
+void main() {
+	vec2 uv = ex_Texture_coords * source_scale;
+	float depth = texture(depth_texture, uv).r;
+
+	// keep the depth so that later passes and the depth pyramid still work
+	gl_FragDepth = depth;
+	if(depth == 1.f) {
+		res_Color = clear_color;
+		return;
+	}
+
+	vec4 albedo_specular = texture(albedo_specular_texture, uv);
+	vec3 diffColor = albedo_specular.rgb;
+#ifndef LIGHTING
+	res_Color = vec4(diffColor, 1.f);
+#else
+
+	vec4 position = inv_proj_mat * vec4(ex_Texture_coords * 2.f - 1.f, depth * 2.f - 1.f, 1.f);
+	position /= position.w;
+
+	vec3 specColor = vec3(1.f);
+	vec3 v = normalize(-position.xyz);
+	vec3 n = normalize(texture(normal_texture, uv).xyz);
+	float shininess = albedo_specular.a * 255.f;
+
+	ivec2 tile = ivec2(uv * vec2(textureSize(depth_texture, 0))) / TILE_SIZE;
+	uint tile_index = uint(tile.y) * tiles_x + uint(tile.x);
+	uint count = tile_light_count[tile_index];
+
+	vec3 color = vec3(0.f);
+	for(uint i = 0u; i < count; ++i) {
+		uint light_index = tile_light_indices[tile_index * uint(MAX_LIGHTS_PER_TILE) + i];
+		PointLight light = lights[light_index];
+		vec3 to_light = light.position_radius.xyz - position.xyz;
+
+		// smooth window reaching zero at the radius of the light
+		float falloff = length(to_light) / light.position_radius.w;
+		float attenuation = clamp(1.f - falloff * falloff * falloff * falloff, 0.f, 1.f);
+		attenuation *= attenuation;
+		// only the main light casts shadows
+		if(light_index == 0u)
+			attenuation *= shadowFactor(position.xyz);
+
+		vec3 l = normalize(to_light);
+		vec3 h = normalize(v+l);
+		float diffFactor = max(0.f, dot(l, n)); // Lambert's factor
+		float specFactor = 0.f;
+		if(shininess < 255.f) {
+			specFactor = pow(max(0.f, dot(h, n)), shininess);
+		}
+
+		color += light.color.rgb * attenuation * (diffColor * diffFactor + specColor * specFactor);
+	}
+
+	res_Color = vec4(color, 1.f);
+#endif
+}
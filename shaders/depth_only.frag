@@ -0,0 +1,5 @@
+#version 430 core
+
+// depth pre-pass: only the depth written by the rasterizer is needed
+void main() {
+}
@@ -0,0 +1,10 @@
+#version 430 core
+
+// covers the screen with a single triangle generated from gl_VertexID,
+// so no vertex buffer is needed
+out vec2 ex_Texture_coords;
+
+void main() {
+	ex_Texture_coords = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(ex_Texture_coords * 2.f - 1.f, 0.f, 1.f);
+}
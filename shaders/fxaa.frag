@@ -0,0 +1,57 @@
+#version 430 core
+
+// Fast approximate anti-aliasing, after the FXAA console version by Timothy Lottes.
+// Finds the local edge direction from the luma of the four diagonal neighbours
+// and blends along it.
+
+uniform sampler2D source_texture;
+// part of source_texture that was rendered to, in [0, 1]
+uniform vec2 source_scale;
+
+in vec2 ex_Texture_coords;
+out vec4 res_Color;
+
+const float span_max = 8.f;
+const float reduce_mul = 1.f / 8.f;
+const float reduce_min = 1.f / 128.f;
+const vec3 luma_weights = vec3(0.299f, 0.587f, 0.114f);
+
+vec2 max_uv;
+
+vec3 fetch(vec2 uv) {
+	return texture(source_texture, min(uv, max_uv)).rgb;
+}
+
+void main() {
+	vec2 texel = 1.f / vec2(textureSize(source_texture, 0));
+	max_uv = source_scale - 0.5f * texel;
+	vec2 uv = ex_Texture_coords * source_scale;
+
+	vec3 rgb_m = fetch(uv);
+	float luma_nw = dot(fetch(uv + vec2(-1.f, -1.f) * texel), luma_weights);
+	float luma_ne = dot(fetch(uv + vec2( 1.f, -1.f) * texel), luma_weights);
+	float luma_sw = dot(fetch(uv + vec2(-1.f,  1.f) * texel), luma_weights);
+	float luma_se = dot(fetch(uv + vec2( 1.f,  1.f) * texel), luma_weights);
+	float luma_m = dot(rgb_m, luma_weights);
+
+	float luma_min = min(luma_m, min(min(luma_nw, luma_ne), min(luma_sw, luma_se)));
+	float luma_max = max(luma_m, max(max(luma_nw, luma_ne), max(luma_sw, luma_se)));
+
+	vec2 dir = vec2(-((luma_nw + luma_ne) - (luma_sw + luma_se)),
+	                 ((luma_nw + luma_sw) - (luma_ne + luma_se)));
+	float dir_reduce = max((luma_nw + luma_ne + luma_sw + luma_se) * 0.25f * reduce_mul, reduce_min);
+	float rcp_dir_min = 1.f / (min(abs(dir.x), abs(dir.y)) + dir_reduce);
+	dir = clamp(dir * rcp_dir_min, vec2(-span_max), vec2(span_max)) * texel;
+
+	vec3 rgb_a = 0.5f * (fetch(uv + dir * (1.f / 3.f - 0.5f)) +
+	                     fetch(uv + dir * (2.f / 3.f - 0.5f)));
+	vec3 rgb_b = rgb_a * 0.5f + 0.25f * (fetch(uv - dir * 0.5f) +
+	                                     fetch(uv + dir * 0.5f));
+
+	// the wider blend overshot the local contrast: fall back to the narrow one
+	float luma_b = dot(rgb_b, luma_weights);
+	if(luma_b < luma_min || luma_b > luma_max)
+		res_Color = vec4(rgb_a, 1.f);
+	else
+		res_Color = vec4(rgb_b, 1.f);
+}
@@ -0,0 +1,29 @@
+#version 430 core
+
+// Geometry pass of the deferred path: stores the surface attributes
+// so lighting can be done once per pixel afterwards
+
+uniform sampler2D diffuse_texture;
+uniform sampler2D specular_texture;
+uniform sampler2D normal_texture;
+
+in vec2 ex_Texture_coords;
+in vec3 ex_Tangent;
+in vec3 ex_Binormal;
+in vec3 ex_ViewNormal;
+
+layout(location = 0) out vec4 res_AlbedoSpecular; // rgb: diffuse color, a: shininess / 255
+layout(location = 1) out vec4 res_Normal; // xyz: camera space normal
+
+void main() {
+	vec4 diffColor = texture(diffuse_texture, ex_Texture_coords);
+	float shininess = texture(specular_texture, ex_Texture_coords).r;
+
+	// same basis as the TBN matrix of the forward path, but taking the
+	// normal out of tangent space instead of taking the light into it
+	vec3 normal = texture(normal_texture, ex_Texture_coords).rgb * 2.f - 1.f;
+	mat3 TBN = mat3(ex_Tangent, ex_Binormal, ex_ViewNormal);
+
+	res_AlbedoSpecular = vec4(diffColor.rgb, shininess);
+	res_Normal = vec4(normalize(TBN * normal), 0.f);
+}
@@ -0,0 +1,98 @@
+#version 430 core
+
+// Blends the frames of the impostor atlas picked by impostor.vert and moves
+// the depth of the quad onto the pictured surface, so that impostors
+// intersect each other and the rest of the scene like the models would.
+// LIGHTING and DEFERRED are defined per program permutation, as for the
+// models. IMPOSTOR_FRAMES is defined by ImpostorAtlas.
+
+uniform sampler2D albedo_texture;
+uniform sampler2D normal_texture;
+uniform sampler2D depth_texture;
+uniform mat4 proj_mat;
+uniform vec3 light_position;
+
+// shadowFactor() is inserted from shadow.glsl, except for DEFERRED
+
+flat in ivec2 ex_Frame;
+flat in vec4 ex_FrameWeights;
+in vec2 ex_FrameCoords[4];
+flat in mat3 ex_NormalMat;
+flat in float ex_Radius;
+in vec3 ex_Position;
+
+#if defined(DEFERRED)
+layout(location = 0) out vec4 res_AlbedoSpecular; // rgb: diffuse color, a: shininess / 255
+layout(location = 1) out vec4 res_Normal; // xyz: camera space normal
+#else
+out vec4 res_Color;
+#endif
+
+void main() {
+	// half a texel of the largest mip-map, in frame coordinates, keeps the filter inside the frame
+	float inset = 0.5f * float(IMPOSTOR_FRAMES) / float(textureSize(albedo_texture, 0).x);
+
+	// uncovered texels are zero, so the sums are weighed by the coverage already
+	vec4 albedo = vec4(0.f);
+	vec4 normal = vec4(0.f);
+	float offset = 0.f;
+	for(int i = 0; i < 4; ++i) {
+		vec2 frame = vec2(ex_Frame + ivec2(i & 1, i >> 1));
+		vec2 coords = (frame + clamp(ex_FrameCoords[i], vec2(inset), vec2(1.f - inset))) / float(IMPOSTOR_FRAMES);
+		vec4 frame_albedo = texture(albedo_texture, coords);
+		albedo += ex_FrameWeights[i] * frame_albedo;
+		vec4 frame_normal = texture(normal_texture, coords);
+		normal += ex_FrameWeights[i] * vec4(frame_normal.xyz * 2.f - 1.f, frame_normal.a);
+		// how far the surface is in front of the plane through the center, in radii
+		float depth = texture(depth_texture, coords).r;
+		offset += ex_FrameWeights[i] * frame_albedo.a * (1.f - 2.f * depth);
+	}
+
+	// towards the eye, which an orthographic camera, as those of the shadow cascades, has along +z
+	bool orthographic = proj_mat[3][3] == 1.f;
+	vec3 to_eye = orthographic ? vec3(0.f, 0.f, 1.f) : normalize(-ex_Position);
+
+	float coverage = albedo.a;
+	vec3 position = ex_Position + to_eye * (offset / max(coverage, 1e-4f)) * ex_Radius;
+	vec4 clip_position = proj_mat * vec4(position, 1.f);
+	float depth = clip_position.z / clip_position.w * 0.5f + 0.5f;
+#if !defined(LIGHTING) && !defined(DEFERRED)
+	// writing the depth skips the polygon offset of the shadow pass, so the same
+	// glPolygonOffset(2, 4) of renderShadowMaps is added here, before the discard
+	// while the derivatives are still defined
+	if(orthographic) {
+		float slope = max(abs(dFdx(depth)), abs(dFdy(depth)));
+		depth += 2.f * slope + 4.f * exp2(floor(log2(max(depth, 1e-30f))) - 23.f);
+	}
+#endif
+	gl_FragDepth = depth;
+
+	if(coverage < 0.5f)
+		discard;
+
+	vec3 diffColor = albedo.rgb / coverage;
+	float shininess = normal.a / coverage * 255.f;
+	vec3 n = normalize(ex_NormalMat * normal.xyz);
+
+#if defined(DEFERRED)
+	res_AlbedoSpecular = vec4(diffColor, shininess / 255.f);
+	res_Normal = vec4(n, 0.f);
+#elif defined(LIGHTING)
+	// the Blinn-Phong of basic_phong.frag, in camera space
+	vec3 specColor = vec3(1.f);
+	vec3 v = normalize(-position);
+	vec3 l = normalize(light_position - position);
+	vec3 h = normalize(v + l);
+	float diffFactor = max(0.f, dot(l, n));
+	float specFactor = 0.f;
+	if(shininess < 254.5f) {
+		specFactor = pow(max(0.f, dot(h, n)), shininess);
+	}
+
+	vec3 lightweighting = diffColor * diffFactor + specColor * specFactor;
+	lightweighting *= shadowFactor(position);
+	res_Color = vec4(lightweighting, 1.f);
+#else
+	res_Color = vec4(diffColor, 1.f);
+#endif
+}
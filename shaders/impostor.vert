@@ -0,0 +1,93 @@
+#version 430 core
+
+// Draws every instance as one quad facing the eye, generated from
+// gl_VertexID, that shows the frames of the model's impostor atlas
+// nearest the direction the instance is seen from.
+// IMPOSTOR_FRAMES is defined by ImpostorAtlas.
+
+uniform mat4 proj_mat;
+uniform mat4 view_mat;
+// bounding sphere the frames of the atlas picture, in the model's space
+uniform vec3 impostor_center;
+uniform float impostor_radius;
+
+layout(location = 0) in mat4 instance_model_mat; // one per instance, takes the locations 0 to 3
+
+flat out ivec2 ex_Frame; // the first of the 2x2 frames that are blended
+flat out vec4 ex_FrameWeights;
+out vec2 ex_FrameCoords[4]; // where the view ray crosses each of them, in [0, 1] inside the frame
+flat out mat3 ex_NormalMat; // model to camera space, without the scale
+flat out float ex_Radius; // camera space
+out vec3 ex_Position; // camera space, on the quad
+
+vec2 signNotZero(vec2 v) {
+	return vec2(v.x >= 0.f ? 1.f : -1.f, v.y >= 0.f ? 1.f : -1.f);
+}
+
+// the octahedral mapping between directions and [0, 1]^2 the atlas is laid out by, y up
+vec3 octahedronDirection(vec2 coords) {
+	vec2 p = coords * 2.f - 1.f;
+	vec3 direction = vec3(p.x, 1.f - abs(p.x) - abs(p.y), p.y);
+	if(direction.y < 0.f)
+		direction.xz = (1.f - abs(direction.zx)) * signNotZero(direction.xz);
+	return normalize(direction);
+}
+
+vec2 octahedronCoords(vec3 direction) {
+	direction /= abs(direction.x) + abs(direction.y) + abs(direction.z);
+	vec2 p = direction.xz;
+	if(direction.y < 0.f)
+		p = (1.f - abs(p.yx)) * signNotZero(p);
+	return p * 0.5f + 0.5f;
+}
+
+// the image axes of the frame looking along -direction, as glm::lookAt builds them in ImpostorAtlas
+void frameAxes(vec3 direction, out vec3 right, out vec3 up) {
+	vec3 reference = abs(direction.y) > 0.999f ? vec3(0.f, 0.f, 1.f) : vec3(0.f, 1.f, 0.f);
+	right = normalize(cross(reference, direction));
+	up = cross(direction, right);
+}
+
+void main() {
+	mat4 model_view_mat = view_mat * instance_model_mat;
+	float scale = length(model_view_mat[0].xyz);
+	vec3 center = (model_view_mat * vec4(impostor_center, 1.f)).xyz;
+	ex_Radius = impostor_radius * scale;
+	ex_NormalMat = mat3(model_view_mat) / scale;
+
+	// an orthographic camera, as those of the shadow cascades, looks along -z from infinitely far
+	bool orthographic = proj_mat[3][3] == 1.f;
+
+	// facing the eye rather than along the view direction, so that the sphere
+	// stays inside the quad towards the sides of the screen
+	vec3 forward = orthographic ? vec3(0.f, 0.f, 1.f) : normalize(-center);
+	vec3 reference = abs(forward.y) > 0.999f ? vec3(0.f, 0.f, 1.f) : vec3(0.f, 1.f, 0.f);
+	vec3 right = normalize(cross(reference, forward));
+	vec3 up = cross(forward, right);
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.f - 1.f;
+	ex_Position = center + (corner.x * right + corner.y * up) * ex_Radius;
+	gl_Position = proj_mat * vec4(ex_Position, 1.f);
+
+	// the direction towards the eye and the view ray in the model's space
+	mat4 inverse_model_view = inverse(model_view_mat);
+	vec3 eye = (inverse_model_view * vec4(0.f, 0.f, 0.f, 1.f)).xyz;
+	vec3 position = (inverse_model_view * vec4(ex_Position, 1.f)).xyz;
+	vec3 eye_direction = orthographic ? normalize(inverse_model_view[2].xyz) : normalize(eye - impostor_center);
+	vec3 ray = orthographic ? -eye_direction : normalize(position - eye);
+
+	// the four frames around the direction of the eye, weighed bilinearly
+	vec2 grid = octahedronCoords(eye_direction) * float(IMPOSTOR_FRAMES - 1);
+	vec2 base = min(floor(grid), vec2(IMPOSTOR_FRAMES - 2));
+	vec2 f = grid - base;
+	ex_Frame = ivec2(base);
+	ex_FrameWeights = vec4((1.f - f.x) * (1.f - f.y), f.x * (1.f - f.y), (1.f - f.x) * f.y, f.x * f.y);
+	for(int i = 0; i < 4; ++i) {
+		vec2 frame = base + vec2(i & 1, i >> 1);
+		vec3 direction = octahedronDirection(frame / float(IMPOSTOR_FRAMES - 1));
+		vec3 frame_right, frame_up;
+		frameAxes(direction, frame_right, frame_up);
+		// the frame pictures the model on the plane through the center facing its direction
+		vec3 hit = position + ray * (dot(impostor_center - position, direction) / dot(ray, direction)) - impostor_center;
+		ex_FrameCoords[i] = vec2(dot(hit, frame_right), dot(hit, frame_up)) / impostor_radius * 0.5f + 0.5f;
+	}
+}
@@ -0,0 +1,28 @@
+#version 430 core
+
+// Stores the surface attributes of one frame of an impostor atlas, unlit,
+// so that the impostors can be lit wherever they are drawn
+
+uniform sampler2D diffuse_texture;
+uniform sampler2D specular_texture;
+uniform sampler2D normal_texture;
+
+in vec2 ex_Texture_coords;
+in vec3 ex_Tangent;
+in vec3 ex_Binormal;
+in vec3 ex_Normal;
+
+layout(location = 0) out vec4 res_Albedo; // rgb: diffuse color, a: coverage
+layout(location = 1) out vec4 res_Normal; // rgb: normal * 0.5 + 0.5 in the space of the atlas, a: shininess / 255
+
+void main() {
+	vec4 diffColor = texture(diffuse_texture, ex_Texture_coords);
+	float shininess = texture(specular_texture, ex_Texture_coords).r;
+
+	// the normal map is read as in gbuffer.frag
+	vec3 normal = texture(normal_texture, ex_Texture_coords).rgb * 2.f - 1.f;
+	mat3 TBN = mat3(ex_Tangent, ex_Binormal, ex_Normal);
+
+	res_Albedo = vec4(diffColor.rgb, 1.f);
+	res_Normal = vec4(normalize(TBN * normal) * 0.5f + 0.5f, shininess);
+}
@@ -0,0 +1,32 @@
+#version 430 core
+
+// Renders a model into one frame of its impostor atlas, see ImpostorAtlas.
+// The patches are drawn as plain triangles, the atlas is far too small
+// for the tessellation to show.
+
+uniform mat4 model_view_projection_mat;
+uniform mat3 model_mat_3x3; // to the space of the atlas
+uniform mat3 normal_mat;
+
+// the locations of basic_phong.vert, so that the model's vertex array can be used
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 UV;
+layout(location = 3) in vec4 tangent; // handedness in w
+
+out vec2 ex_Texture_coords;
+out vec3 ex_Tangent;
+out vec3 ex_Binormal;
+out vec3 ex_Normal;
+
+void main() {
+	ex_Texture_coords = UV;
+
+	// the binormal follows from the handedness, as in basic_phong.vert
+	vec3 binormal = tangent.w * cross(normal, tangent.xyz);
+	ex_Tangent = model_mat_3x3 * tangent.xyz;
+	ex_Binormal = model_mat_3x3 * binormal;
+	ex_Normal = normal_mat * normal;
+
+	gl_Position = model_view_projection_mat * vec4(position, 1.0);
+}
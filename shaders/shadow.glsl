@@ -0,0 +1,32 @@
+// Cascaded shadow map lookup of the main light, inserted into the shaders
+// that light with it. SHADOW_CASCADE_COUNT is defined by CascadedShadowMap.
+
+uniform bool shadows_enabled;
+uniform sampler2DArrayShadow shadow_map;
+// camera space to shadow map coordinates of each cascade
+uniform mat4 shadow_mat[SHADOW_CASCADE_COUNT];
+// distance from the camera where each cascade ends
+uniform float shadow_split[SHADOW_CASCADE_COUNT];
+uniform float shadow_bias;
+
+// fraction of the main light reaching the camera space position
+float shadowFactor(vec3 position) {
+	float distance = -position.z;
+	if(!shadows_enabled || distance > shadow_split[SHADOW_CASCADE_COUNT - 1])
+		return 1.f;
+
+	int cascade = 0;
+	while(cascade < SHADOW_CASCADE_COUNT - 1 && distance > shadow_split[cascade])
+		++cascade;
+
+	vec3 coords = (shadow_mat[cascade] * vec4(position, 1.f)).xyz;
+	vec2 texel = 1.f / vec2(textureSize(shadow_map, 0).xy);
+
+	// 3x3 taps of the bilinear comparison
+	float lit = 0.f;
+	for(int y = -1; y <= 1; ++y)
+		for(int x = -1; x <= 1; ++x)
+			lit += texture(shadow_map, vec4(coords.xy + vec2(x, y) * texel, float(cascade), coords.z - shadow_bias));
+	return lit / 9.f;
+}
+
@@ -0,0 +1,56 @@
+#version 430 core
+
+// Colors the terrain by height and steepness: grass in the valleys, rock on
+// the slopes and snow on the peaks. LIGHTING and DEFERRED are defined per
+// program permutation, as for the models.
+
+uniform vec3 light_position;
+
+// shadowFactor() is inserted from shadow.glsl, except for DEFERRED
+
+in vec3 ex_Position;
+in vec3 ex_Normal;
+in vec2 ex_Surface;
+
+#if defined(DEFERRED)
+layout(location = 0) out vec4 res_AlbedoSpecular; // rgb: diffuse color, a: shininess / 255
+layout(location = 1) out vec4 res_Normal; // xyz: camera space normal
+#else
+out vec4 res_Color;
+#endif
+
+void main() {
+	const vec3 grass = vec3(0.24f, 0.36f, 0.14f);
+	const vec3 rock = vec3(0.38f, 0.34f, 0.3f);
+	const vec3 snow = vec3(0.92f, 0.93f, 0.95f);
+	float height = ex_Surface.x;
+	float steepness = ex_Surface.y;
+	float rockiness = smoothstep(0.15f, 0.35f, steepness);
+	float snowiness = smoothstep(0.65f, 0.75f, height) * (1.f - smoothstep(0.3f, 0.5f, steepness));
+	vec3 diffColor = mix(mix(grass, rock, rockiness), snow, snowiness);
+	// only the snow has a highlight, 255 turns it off
+	float shininess = mix(255.f, 48.f, snowiness);
+	vec3 n = normalize(ex_Normal);
+
+#if defined(DEFERRED)
+	res_AlbedoSpecular = vec4(diffColor, shininess / 255.f);
+	res_Normal = vec4(n, 0.f);
+#elif defined(LIGHTING)
+	// the Blinn-Phong of basic_phong.frag, in camera space
+	vec3 specColor = vec3(1.f);
+	vec3 v = normalize(-ex_Position);
+	vec3 l = normalize(light_position - ex_Position);
+	vec3 h = normalize(v + l);
+	float diffFactor = max(0.f, dot(l, n));
+	float specFactor = 0.f;
+	if(shininess < 254.5f) {
+		specFactor = pow(max(0.f, dot(h, n)), shininess);
+	}
+
+	vec3 lightweighting = diffColor * diffFactor + specColor * specFactor;
+	lightweighting *= shadowFactor(ex_Position);
+	res_Color = vec4(lightweighting, 1.f);
+#else
+	res_Color = vec4(diffColor, 1.f);
+#endif
+}
@@ -0,0 +1,15 @@
+#version 430 core
+
+// Hands the node of the instance on to terrain.tcs. The patch of a node has
+// four corners and no vertices of its own, terrain.tes places its grid.
+
+layout(location = 0) in vec4 node_area; // x, z of the corner with the smallest coordinates, size, depth
+layout(location = 1) in vec4 node_tile; // s, t of that corner in its height tile, size in the tile, texture layer
+
+out vec4 tc_Area;
+out vec4 tc_Tile;
+
+void main() {
+	tc_Area = node_area;
+	tc_Tile = node_tile;
+}
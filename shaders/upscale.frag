@@ -0,0 +1,26 @@
+#version 430 core
+
+uniform sampler2D source_texture;
+// part of source_texture that was rendered to, in [0, 1]
+uniform vec2 source_scale;
+uniform float sharpness;
+
+in vec2 ex_Texture_coords;
+out vec4 res_Color;
+
+void main() {
+	vec2 texel = 1.f / vec2(textureSize(source_texture, 0));
+	// keep the bilinear footprint inside the rendered region
+	vec2 max_uv = source_scale - 0.5f * texel;
+	vec2 uv = min(ex_Texture_coords * source_scale, max_uv);
+
+	vec3 center = texture(source_texture, uv).rgb;
+	vec3 north = texture(source_texture, min(uv + vec2(0.f, texel.y), max_uv)).rgb;
+	vec3 south = texture(source_texture, uv - vec2(0.f, texel.y)).rgb;
+	vec3 east = texture(source_texture, min(uv + vec2(texel.x, 0.f), max_uv)).rgb;
+	vec3 west = texture(source_texture, uv - vec2(texel.x, 0.f)).rgb;
+
+	// unsharp mask to recover some of the detail lost to the bilinear upscale
+	vec3 sharpened = center + sharpness * (4.f * center - north - south - east - west);
+	res_Color = vec4(clamp(sharpened, 0.f, 1.f), 1.f);
+}
@@ -0,0 +1,692 @@
+#include "BVH.h"
+
+#include "GameException.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BVH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const unsigned int bin_count = 16;
+	const uint32_t max_leaf_triangles = 16;
+	// cost of visiting a node, relative to intersecting one triangle pack
+	const float traversal_cost = 1.f;
+	// past this depth nodes are split at the median, which keeps the tree shallow whatever the input
+	const unsigned int max_sah_depth = 48;
+	// large nodes of the top levels are binned by all threads at once
+	const uint32_t parallel_binning_threshold = 1u << 16;
+	const uint32_t binning_chunk = 1u << 14;
+	const size_t triangles_per_batch = 1u << 14;
+	const size_t leaves_per_batch = 1u << 12;
+	// the median splits halve the references, which leaves one by 32 levels further down
+	const unsigned int max_depth = max_sah_depth + 32;
+	// a node pops one entry and pushes up to four, and the 4-wide tree is no deeper than the binary one
+	const unsigned int stack_size = 3 * max_depth + 1;
+	const uint32_t no_child = ~0u;
+
+	inline uint32_t packCount(uint32_t triangle_count){
+		return (triangle_count + 3) / 4;
+	}
+
+	struct Box{
+		Box() : min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max()){}
+
+		void grow(const glm::vec3 &p){
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		void grow(const Box &box){
+			min = glm::min(min, box.min);
+			max = glm::max(max, box.max);
+		}
+
+		float area() const{
+			const glm::vec3 d = max - min;
+			return d.x < 0.f ? 0.f : 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+		}
+
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	/**
+	 * A triangle during the build, carrying its bounds so that every pass reads the references in order
+	 */
+	struct Reference{
+		Box box;
+		glm::vec3 centroid;
+		uint32_t triangle;
+	};
+
+	struct BuildNode{
+		Box box;
+		uint32_t first; //< references of a leaf
+		uint32_t count;
+		uint32_t left; //< children of an inner node, no_child for a leaf
+		uint32_t right;
+	};
+
+	/**
+	 * The references whose centroids fall into one slice of the parent's centroid bounds
+	 */
+	struct Bin{
+		Bin() : count(0){}
+		Box box;
+		Box centroid_box;
+		uint32_t count;
+	};
+
+	/**
+	 * A range of references with its bounds, as handed from a node to its children
+	 */
+	struct Range{
+		uint32_t first;
+		uint32_t count;
+		Box box;
+		Box centroid_box;
+	};
+
+	/**
+	 * A node of the top levels whose subtree is built on its own
+	 */
+	struct Subtree{
+		uint32_t node;
+		Range range;
+		unsigned int depth;
+	};
+
+	/**
+	 * Binary SAH build over a range of the references, which it reorders in place.
+	 * Only the widest axis of the centroid bounds is binned, as fast binned builders do,
+	 * and the bins carry the bounds of both children so that every level takes
+	 * one binning pass and one partition.
+	 */
+	class Builder{
+	public:
+		explicit Builder(std::vector<Reference> &references) : references(references){
+			const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+			subtree_size = uint32_t(std::max<size_t>(1024, references.size() / (16 * thread_count)));
+		}
+
+		/**
+		 * The range of all references with its bounds, binned by all threads
+		 */
+		Range root() const{
+			Range range = {0, uint32_t(references.size()), Box(), Box()};
+			const size_t chunk_count = (references.size() + binning_chunk - 1) / binning_chunk;
+			std::vector<Box> boxes(chunk_count), centroid_boxes(chunk_count);
+			parallelFor(chunk_count, [&](size_t c){
+				const uint32_t begin = uint32_t(c) * binning_chunk;
+				boundsOf(begin, std::min<uint32_t>(begin + binning_chunk, range.count), boxes[c], centroid_boxes[c]);
+			});
+			for(size_t c = 0; c < chunk_count; ++c){
+				range.box.grow(boxes[c]);
+				range.centroid_box.grow(centroid_boxes[c]);
+			}
+			return range;
+		}
+
+		/**
+		 * Builds the nodes over range, returns the index of the root.
+		 * With subtrees the nodes of at most subtree_size references are left as they are
+		 * and listed there instead.
+		 */
+		uint32_t build(std::vector<BuildNode> &nodes, const Range &range, unsigned int depth,
+		               std::vector<Subtree> *subtrees){
+			const uint32_t index = uint32_t(nodes.size());
+			nodes.push_back(BuildNode());
+			nodes[index].box = range.box;
+			nodes[index].first = range.first;
+			nodes[index].count = range.count;
+			nodes[index].left = no_child;
+			nodes[index].right = no_child;
+
+			// the traversal stack only holds the nodes of trees up to max_depth, in release builds as well
+			if(depth > max_depth)
+				THROW_EXCEPTION("BVH deeper than its traversal stack allows");
+			if(range.count <= 1)
+				return index;
+			if(subtrees && range.count <= subtree_size){
+				Subtree subtree = {index, range, depth};
+				subtrees->push_back(subtree);
+				return index;
+			}
+
+			Range left, right;
+			if(!split(range, depth, subtrees != nullptr && range.count >= parallel_binning_threshold, left, right))
+				return index;
+			const uint32_t left_index = build(nodes, left, depth + 1, subtrees);
+			const uint32_t right_index = build(nodes, right, depth + 1, subtrees);
+			nodes[index].left = left_index;
+			nodes[index].right = right_index;
+			return index;
+		}
+
+	private:
+		static inline uint32_t binOf(const Reference &reference, int axis, float min, float scale){
+			const float offset = (reference.centroid[axis] - min) * scale;
+			return std::min(bin_count - 1, uint32_t(std::max(offset, 0.f)));
+		}
+
+		void boundsOf(uint32_t begin, uint32_t end, Box &box, Box &centroid_box) const{
+			for(uint32_t i = begin; i < end; ++i){
+				box.grow(references[i].box);
+				centroid_box.grow(references[i].centroid);
+			}
+		}
+
+		void binsOf(uint32_t begin, uint32_t end, int axis, float min, float scale, Bin *bins) const{
+			for(uint32_t i = begin; i < end; ++i){
+				const Reference &reference = references[i];
+				Bin &bin = bins[binOf(reference, axis, min, scale)];
+				bin.box.grow(reference.box);
+				bin.centroid_box.grow(reference.centroid);
+				++bin.count;
+			}
+		}
+
+		/**
+		 * Splits range at middle, after the references have been reordered
+		 */
+		void halves(const Range &range, uint32_t middle, Range &left, Range &right) const{
+			left.first = range.first;
+			left.count = middle - range.first;
+			right.first = middle;
+			right.count = range.first + range.count - middle;
+			boundsOf(left.first, middle, left.box, left.centroid_box);
+			boundsOf(middle, range.first + range.count, right.box, right.centroid_box);
+		}
+
+		/**
+		 * Reorders the references of range into the left and right children, false if a leaf is cheaper
+		 */
+		bool split(const Range &range, unsigned int depth, bool parallel, Range &left, Range &right){
+			const uint32_t first = range.first;
+			const uint32_t count = range.count;
+			const glm::vec3 extent = range.centroid_box.max - range.centroid_box.min;
+			int axis = 0;
+			for(int a = 1; a < 3; ++a)
+				if(extent[a] > extent[axis])
+					axis = a;
+
+			// all centroids in one spot, no plane separates them
+			if(extent[axis] <= 0.f){
+				if(count <= max_leaf_triangles)
+					return false;
+				halves(range, first + count / 2, left, right);
+				return true;
+			}
+
+			if(depth >= max_sah_depth){
+				const uint32_t middle = first + count / 2;
+				std::nth_element(references.begin() + first, references.begin() + middle, references.begin() + first + count,
+				                 [axis](const Reference &a, const Reference &b){
+					return a.centroid[axis] < b.centroid[axis];
+				});
+				halves(range, middle, left, right);
+				return true;
+			}
+
+			const float min = range.centroid_box.min[axis];
+			const float scale = bin_count / extent[axis];
+			Bin bins[bin_count];
+			if(parallel){
+				const size_t chunk_count = (count + binning_chunk - 1) / binning_chunk;
+				std::vector<Bin> chunk_bins(chunk_count * bin_count);
+				parallelFor(chunk_count, [&](size_t c){
+					const uint32_t begin = first + uint32_t(c) * binning_chunk;
+					binsOf(begin, std::min(begin + binning_chunk, first + count), axis, min, scale, &chunk_bins[c * bin_count]);
+				});
+				for(size_t c = 0; c < chunk_count; ++c)
+					for(unsigned int b = 0; b < bin_count; ++b){
+						const Bin &chunk_bin = chunk_bins[c * bin_count + b];
+						bins[b].box.grow(chunk_bin.box);
+						bins[b].centroid_box.grow(chunk_bin.centroid_box);
+						bins[b].count += chunk_bin.count;
+					}
+			}
+			else
+				binsOf(first, first + count, axis, min, scale, bins);
+
+			// sweep from the right, then from the left, splitting after bin b
+			float right_cost[bin_count];
+			Box right_box;
+			uint32_t right_count = 0;
+			for(unsigned int b = bin_count - 1; b > 0; --b){
+				right_box.grow(bins[b].box);
+				right_count += bins[b].count;
+				right_cost[b - 1] = right_box.area() * packCount(right_count);
+			}
+			const float inverse_area = 1.f / std::max(range.box.area(), 1e-30f);
+			float best_cost = std::numeric_limits<float>::max();
+			int best_bin = -1;
+			Box left_box;
+			uint32_t left_count = 0;
+			for(unsigned int b = 0; b + 1 < bin_count; ++b){
+				left_box.grow(bins[b].box);
+				left_count += bins[b].count;
+				if(left_count == 0 || left_count == count)
+					continue;
+				const float cost = traversal_cost + (left_box.area() * packCount(left_count) + right_cost[b]) * inverse_area;
+				if(cost < best_cost){
+					best_cost = cost;
+					best_bin = int(b);
+				}
+			}
+
+			if(best_bin < 0 || (count <= max_leaf_triangles && best_cost >= float(packCount(count)))){
+				if(count <= max_leaf_triangles)
+					return false;
+				// no split was found, halve the references in any order
+				halves(range, first + count / 2, left, right);
+				return true;
+			}
+
+			const uint32_t middle = uint32_t(std::partition(references.begin() + first, references.begin() + first + count,
+			                                                [&](const Reference &reference){
+				return binOf(reference, axis, min, scale) <= uint32_t(best_bin);
+			}) - references.begin());
+			left = Range{first, middle - first, Box(), Box()};
+			right = Range{middle, first + count - middle, Box(), Box()};
+			for(unsigned int b = 0; b < bin_count; ++b){
+				Range &side = b <= unsigned(best_bin) ? left : right;
+				side.box.grow(bins[b].box);
+				side.centroid_box.grow(bins[b].centroid_box);
+			}
+			return true;
+		}
+
+		std::vector<Reference> &references;
+		uint32_t subtree_size;
+	};
+
+	/**
+	 * The packs of a leaf, filled once the whole tree is laid out
+	 */
+	struct LeafPacks{
+		uint32_t first_pack;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	/**
+	 * The ray, with every value splat over the four lanes
+	 */
+	struct RayLanes{
+#ifdef BVH_SSE
+		__m128 origin[3];
+		__m128 direction[3];
+		__m128 inverse_direction[3];
+#else
+		float origin[3];
+		float direction[3];
+		float inverse_direction[3];
+#endif
+		int near[3]; //< row of the near plane in the node bounds for every axis
+		int far[3];
+	};
+
+	void setupRay(const glm::vec3 &origin, const glm::vec3 &direction, RayLanes &ray){
+		for(int axis = 0; axis < 3; ++axis){
+			// a tiny instead of a zero component keeps inf * 0 out of the slab test
+			float d = direction[axis];
+			if(std::abs(d) < 1e-20f)
+				d = d < 0.f ? -1e-20f : 1e-20f;
+#ifdef BVH_SSE
+			ray.origin[axis] = _mm_set1_ps(origin[axis]);
+			ray.direction[axis] = _mm_set1_ps(direction[axis]);
+			ray.inverse_direction[axis] = _mm_set1_ps(1.f / d);
+#else
+			ray.origin[axis] = origin[axis];
+			ray.direction[axis] = direction[axis];
+			ray.inverse_direction[axis] = 1.f / d;
+#endif
+			ray.near[axis] = d < 0.f ? axis + 3 : axis;
+			ray.far[axis] = d < 0.f ? axis : axis + 3;
+		}
+	}
+
+#ifdef BVH_SSE
+	/**
+	 * Slab test against the four boxes, returns the mask of those hit before max_distance
+	 * and stores the entry distances
+	 */
+	inline int intersectBoxes(const RayLanes &ray, const float bounds[6][4], float max_distance, float *distances){
+		__m128 t_near = _mm_setzero_ps();
+		__m128 t_far = _mm_set1_ps(max_distance);
+		for(int axis = 0; axis < 3; ++axis){
+			const __m128 near = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds[ray.near[axis]]), ray.origin[axis]),
+			                               ray.inverse_direction[axis]);
+			const __m128 far = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(bounds[ray.far[axis]]), ray.origin[axis]),
+			                              ray.inverse_direction[axis]);
+			t_near = _mm_max_ps(t_near, near);
+			t_far = _mm_min_ps(t_far, far);
+		}
+		_mm_storeu_ps(distances, t_near);
+		return _mm_movemask_ps(_mm_cmple_ps(t_near, t_far));
+	}
+
+	/**
+	 * Moeller-Trumbore against the four triangles, returns the mask of those hit before max_distance
+	 */
+	inline int intersectTriangles(const RayLanes &ray, const float v0[3][4], const float e1[3][4], const float e2[3][4],
+	                              float max_distance, float *distances, float *us, float *vs){
+		const __m128 e1x = _mm_loadu_ps(e1[0]), e1y = _mm_loadu_ps(e1[1]), e1z = _mm_loadu_ps(e1[2]);
+		const __m128 e2x = _mm_loadu_ps(e2[0]), e2y = _mm_loadu_ps(e2[1]), e2z = _mm_loadu_ps(e2[2]);
+		const __m128 &dx = ray.direction[0], &dy = ray.direction[1], &dz = ray.direction[2];
+
+		const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+		const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+		const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+		const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+		const __m128 inverse_det = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+		const __m128 tx = _mm_sub_ps(ray.origin[0], _mm_loadu_ps(v0[0]));
+		const __m128 ty = _mm_sub_ps(ray.origin[1], _mm_loadu_ps(v0[1]));
+		const __m128 tz = _mm_sub_ps(ray.origin[2], _mm_loadu_ps(v0[2]));
+		const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)),
+		                            inverse_det);
+
+		const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+		const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+		const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+		const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)),
+		                            inverse_det);
+		const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)),
+		                            inverse_det);
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 abs_det = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+		__m128 hit = _mm_cmpgt_ps(abs_det, _mm_set1_ps(1e-30f));
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(u, zero));
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(v, zero));
+		hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(t, zero));
+		hit = _mm_and_ps(hit, _mm_cmplt_ps(t, _mm_set1_ps(max_distance)));
+		_mm_storeu_ps(distances, t);
+		_mm_storeu_ps(us, u);
+		_mm_storeu_ps(vs, v);
+		return _mm_movemask_ps(hit);
+	}
+#else
+	inline int intersectBoxes(const RayLanes &ray, const float bounds[6][4], float max_distance, float *distances){
+		int mask = 0;
+		for(int lane = 0; lane < 4; ++lane){
+			float t_near = 0.f, t_far = max_distance;
+			for(int axis = 0; axis < 3; ++axis){
+				t_near = std::max(t_near, (bounds[ray.near[axis]][lane] - ray.origin[axis]) * ray.inverse_direction[axis]);
+				t_far = std::min(t_far, (bounds[ray.far[axis]][lane] - ray.origin[axis]) * ray.inverse_direction[axis]);
+			}
+			distances[lane] = t_near;
+			if(t_near <= t_far)
+				mask |= 1 << lane;
+		}
+		return mask;
+	}
+
+	inline int intersectTriangles(const RayLanes &ray, const float v0[3][4], const float e1[3][4], const float e2[3][4],
+	                              float max_distance, float *distances, float *us, float *vs){
+		const glm::vec3 origin(ray.origin[0], ray.origin[1], ray.origin[2]);
+		const glm::vec3 direction(ray.direction[0], ray.direction[1], ray.direction[2]);
+		int mask = 0;
+		for(int lane = 0; lane < 4; ++lane){
+			const glm::vec3 edge1(e1[0][lane], e1[1][lane], e1[2][lane]);
+			const glm::vec3 edge2(e2[0][lane], e2[1][lane], e2[2][lane]);
+			const glm::vec3 p = glm::cross(direction, edge2);
+			const float det = glm::dot(edge1, p);
+			if(std::abs(det) <= 1e-30f)
+				continue;
+			const float inverse_det = 1.f / det;
+			const glm::vec3 t = origin - glm::vec3(v0[0][lane], v0[1][lane], v0[2][lane]);
+			const glm::vec3 q = glm::cross(t, edge1);
+			us[lane] = glm::dot(t, p) * inverse_det;
+			vs[lane] = glm::dot(direction, q) * inverse_det;
+			distances[lane] = glm::dot(edge2, q) * inverse_det;
+			if(us[lane] >= 0.f && vs[lane] >= 0.f && us[lane] + vs[lane] <= 1.f
+			   && distances[lane] >= 0.f && distances[lane] < max_distance)
+				mask |= 1 << lane;
+		}
+		return mask;
+	}
+#endif
+}
+
+BVH::BVH(const std::vector<glm::vec3> &triangle_vertices)
+	: triangle_count(triangle_vertices.size() / 3), min_dim(0.f), max_dim(0.f){
+	TRACE_SCOPE("BVH::BVH");
+	if(triangle_count == 0)
+		return;
+
+	std::vector<Reference> references(triangle_count);
+	parallelFor((triangle_count + triangles_per_batch - 1) / triangles_per_batch, [&](size_t batch){
+		const size_t end = std::min((batch + 1) * triangles_per_batch, triangle_count);
+		for(size_t t = batch * triangles_per_batch; t < end; ++t){
+			Box box;
+			for(int c = 0; c < 3; ++c)
+				box.grow(triangle_vertices[t * 3 + c]);
+			references[t].box = box;
+			references[t].centroid = (box.min + box.max) * 0.5f;
+			references[t].triangle = uint32_t(t);
+		}
+	});
+
+	// the top levels first, then the subtrees below them on all threads
+	Builder builder(references);
+	std::vector<BuildNode> binary;
+	std::vector<Subtree> subtrees;
+	{
+		TRACE_SCOPE("BVH top levels");
+		builder.build(binary, builder.root(), 0, &subtrees);
+	}
+	std::vector<std::vector<BuildNode>> subtree_nodes(subtrees.size());
+	{
+		TRACE_SCOPE("BVH subtrees");
+		parallelFor(subtrees.size(), [&](size_t s){
+			builder.build(subtree_nodes[s], subtrees[s].range, subtrees[s].depth, nullptr);
+		});
+	}
+
+	// the roots of the subtrees take the place of their top level nodes, the rest goes to the end
+	for(size_t s = 0; s < subtrees.size(); ++s){
+		const uint32_t offset = uint32_t(binary.size()) - 1;
+		const uint32_t top = subtrees[s].node;
+		for(size_t i = 0; i < subtree_nodes[s].size(); ++i){
+			BuildNode node = subtree_nodes[s][i];
+			if(node.left != no_child){
+				node.left = node.left == 0 ? top : node.left + offset;
+				node.right = node.right == 0 ? top : node.right + offset;
+			}
+			if(i == 0)
+				binary[top] = node;
+			else
+				binary.push_back(node);
+		}
+	}
+	min_dim = binary[0].box.min;
+	max_dim = binary[0].box.max;
+
+	// collapse into the 4-wide tree, depth-first, opening the largest children first
+	std::vector<LeafPacks> leaves;
+	uint32_t pack_total = 0;
+	auto addLeaf = [&](const BuildNode &leaf){
+		LeafPacks packs_of_leaf = {pack_total, leaf.first, leaf.count};
+		leaves.push_back(packs_of_leaf);
+		pack_total += packCount(leaf.count);
+		return leaf_flag | packs_of_leaf.first_pack;
+	};
+	auto emptyNode = [](){
+		Node node;
+		for(int lane = 0; lane < 4; ++lane){
+			for(int axis = 0; axis < 3; ++axis){
+				node.bounds[axis][lane] = std::numeric_limits<float>::infinity();
+				node.bounds[axis + 3][lane] = -std::numeric_limits<float>::infinity();
+			}
+			node.child[lane] = 0;
+			node.count[lane] = 0;
+		}
+		return node;
+	};
+	auto setChild = [this, &binary](uint32_t node, int lane, uint32_t index, uint32_t child){
+		for(int axis = 0; axis < 3; ++axis){
+			nodes[node].bounds[axis][lane] = binary[index].box.min[axis];
+			nodes[node].bounds[axis + 3][lane] = binary[index].box.max[axis];
+		}
+		nodes[node].child[lane] = child;
+		nodes[node].count[lane] = binary[index].left == no_child ? packCount(binary[index].count) : 0;
+	};
+	std::function<uint32_t(uint32_t)> collapse = [&](uint32_t index){
+		uint32_t children[4] = {binary[index].left, binary[index].right, 0, 0};
+		int child_count = 2;
+		while(child_count < 4){
+			int largest = -1;
+			for(int i = 0; i < child_count; ++i)
+				if(binary[children[i]].left != no_child
+				   && (largest < 0 || binary[children[i]].box.area() > binary[children[largest]].box.area()))
+					largest = i;
+			if(largest < 0)
+				break;
+			const uint32_t opened = children[largest];
+			children[largest] = binary[opened].left;
+			children[child_count++] = binary[opened].right;
+		}
+
+		const uint32_t node = uint32_t(nodes.size());
+		nodes.push_back(emptyNode());
+		for(int i = 0; i < child_count; ++i){
+			const uint32_t child = binary[children[i]].left == no_child ? addLeaf(binary[children[i]])
+			                                                            : collapse(children[i]);
+			setChild(node, i, children[i], child);
+		}
+		return node;
+	};
+	{
+		TRACE_SCOPE("BVH collapse");
+		nodes.reserve(binary.size() / 2 + 1);
+		if(binary[0].left == no_child){
+			nodes.push_back(emptyNode());
+			setChild(0, 0, 0, addLeaf(binary[0]));
+		}
+		else
+			collapse(0);
+	}
+
+	packs.resize(pack_total);
+	parallelFor((leaves.size() + leaves_per_batch - 1) / leaves_per_batch, [&](size_t batch){
+		const size_t end = std::min((batch + 1) * leaves_per_batch, leaves.size());
+		for(size_t l = batch * leaves_per_batch; l < end; ++l){
+			const LeafPacks &leaf = leaves[l];
+			for(uint32_t i = 0; i < packCount(leaf.count) * 4; ++i){
+				TrianglePack &pack = packs[leaf.first_pack + i / 4];
+				const int lane = i % 4;
+				glm::vec3 v0(0.f), e1(0.f), e2(0.f);
+				pack.triangle[lane] = ~0u;
+				if(i < leaf.count){
+					const uint32_t triangle = references[leaf.first + i].triangle;
+					v0 = triangle_vertices[triangle * 3];
+					e1 = triangle_vertices[triangle * 3 + 1] - v0;
+					e2 = triangle_vertices[triangle * 3 + 2] - v0;
+					pack.triangle[lane] = triangle;
+				}
+				for(int axis = 0; axis < 3; ++axis){
+					pack.v0[axis][lane] = v0[axis];
+					pack.e1[axis][lane] = e1[axis];
+					pack.e2[axis][lane] = e2[axis];
+				}
+			}
+		}
+	});
+}
+
+bool BVH::intersect(const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit, float max_distance) const{
+	return traverse<false>(origin, direction, max_distance, &hit);
+}
+
+bool BVH::occluded(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance) const{
+	return traverse<true>(origin, direction, max_distance, nullptr);
+}
+
+template<bool any_hit>
+bool BVH::traverse(const glm::vec3 &origin, const glm::vec3 &direction, float max_distance, Hit *hit) const{
+	if(nodes.empty())
+		return false;
+	RayLanes ray;
+	setupRay(origin, direction, ray);
+
+	struct Entry{
+		uint32_t child;
+		uint32_t count;
+		float distance;
+	};
+	// deep enough for every tree the build lets through, see max_depth
+	Entry stack[stack_size];
+	unsigned int stack_top = 0;
+	stack[stack_top++] = Entry{0, 0, 0.f};
+
+	float best_distance = max_distance;
+	const TrianglePack *best_pack = nullptr;
+	int best_lane = 0;
+	float best_u = 0.f, best_v = 0.f;
+	while(stack_top > 0){
+		const Entry entry = stack[--stack_top];
+		if(entry.distance > best_distance)
+			continue;
+
+		if(entry.child & leaf_flag){
+			const TrianglePack *pack = &packs[entry.child & ~leaf_flag];
+			for(const TrianglePack *end = pack + entry.count; pack != end; ++pack){
+				float distances[4], us[4], vs[4];
+				int mask = intersectTriangles(ray, pack->v0, pack->e1, pack->e2, best_distance, distances, us, vs);
+				if(mask && any_hit)
+					return true;
+				for(int lane = 0; mask; ++lane, mask >>= 1)
+					if((mask & 1) && distances[lane] < best_distance){
+						best_distance = distances[lane];
+						best_pack = pack;
+						best_lane = lane;
+						best_u = us[lane];
+						best_v = vs[lane];
+					}
+			}
+			continue;
+		}
+
+		const Node &node = nodes[entry.child];
+		float distances[4];
+		const int mask = intersectBoxes(ray, node.bounds, best_distance, distances);
+		// far to near, so that the nearest child is popped first
+		Entry hits[4];
+		int hit_count = 0;
+		for(int lane = 0; lane < 4; ++lane){
+			if(!(mask & (1 << lane)))
+				continue;
+			const Entry child = {node.child[lane], node.count[lane], distances[lane]};
+			int i = hit_count++;
+			for(; i > 0 && hits[i - 1].distance < child.distance; --i)
+				hits[i] = hits[i - 1];
+			hits[i] = child;
+		}
+		for(int i = 0; i < hit_count; ++i)
+			stack[stack_top++] = hits[i];
+	}
+
+	if(!best_pack)
+		return false;
+	if(hit){
+		hit->distance = best_distance;
+		hit->triangle = best_pack->triangle[best_lane];
+		hit->barycentrics = glm::vec2(best_u, best_v);
+		const glm::vec3 e1(best_pack->e1[0][best_lane], best_pack->e1[1][best_lane], best_pack->e1[2][best_lane]);
+		const glm::vec3 e2(best_pack->e2[0][best_lane], best_pack->e2[1][best_lane], best_pack->e2[2][best_lane]);
+		hit->normal = glm::normalize(glm::cross(e1, e2));
+	}
+	return true;
+}
@@ -0,0 +1,115 @@
+#include "CascadedShadowMap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "GLUtils/GLUtils.hpp"
+
+const float CascadedShadowMap::split_lambda = 0.75f;
+const float CascadedShadowMap::caster_distance = 20.f;
+
+CascadedShadowMap::CascadedShadowMap(unsigned int resolution) : resolution(resolution){
+	glGenTextures(1, &depth_texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, depth_texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, resolution, resolution, cascade_count, 0,
+	             GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	// hardware depth comparison, linear filtering gives 2x2 PCF for free
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	// everything outside a cascade is lit
+	const GLfloat border[4] = { 1.f, 1.f, 1.f, 1.f };
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &fbo_name);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo_name);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		THROW_EXCEPTION("Shadow map framebuffer is incomplete");
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	for(unsigned int i = 0; i < cascade_count; ++i)
+		split_distances[i] = 0.f;
+	CHECK_GL_ERROR();
+}
+
+CascadedShadowMap::~CascadedShadowMap(){
+	glDeleteFramebuffers(1, &fbo_name);
+	glDeleteTextures(1, &depth_texture);
+}
+
+std::vector<std::string> CascadedShadowMap::getShaderDefines(){
+	std::stringstream cascades;
+	cascades << "SHADOW_CASCADE_COUNT " << cascade_count;
+	return std::vector<std::string>(1, cascades.str());
+}
+
+void CascadedShadowMap::update(const glm::mat4 &view, float fovy, float aspect, float near_plane, float far_plane,
+                               const glm::vec3 &light_direction){
+	const glm::mat4 inverse_view = glm::inverse(view);
+	const float tan_y = std::tan(fovy * 0.5f);
+	const float tan_x = tan_y * aspect;
+	const glm::vec3 direction = glm::normalize(light_direction);
+	// any up vector that is not parallel to the light
+	const glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+
+	// maps the light clip space cube to texture coordinates and depth in [0, 1]
+	const glm::mat4 bias = glm::translate(glm::mat4(1.f), glm::vec3(0.5f)) * glm::scale(glm::mat4(1.f), glm::vec3(0.5f));
+
+	float slice_near = near_plane;
+	for(unsigned int i = 0; i < cascade_count; ++i){
+		const float fraction = (i + 1) / float(cascade_count);
+		const float uniform_split = near_plane + (far_plane - near_plane) * fraction;
+		const float log_split = near_plane * std::pow(far_plane / near_plane, fraction);
+		const float slice_far = split_lambda * log_split + (1.f - split_lambda) * uniform_split;
+		split_distances[i] = slice_far;
+
+		// bounding sphere of the slice, in world space
+		glm::vec3 corners[8];
+		glm::vec3 center(0.f);
+		for(unsigned int c = 0; c < 8; ++c){
+			const float z = (c & 4) ? slice_far : slice_near;
+			const glm::vec4 corner((c & 1 ? 1.f : -1.f) * tan_x * z, (c & 2 ? 1.f : -1.f) * tan_y * z, -z, 1.f);
+			corners[c] = glm::vec3(inverse_view * corner);
+			center += corners[c] / 8.f;
+		}
+		float radius = 0.f;
+		for(unsigned int c = 0; c < 8; ++c)
+			radius = std::max(radius, glm::length(corners[c] - center));
+		radius = std::ceil(radius * 16.f) / 16.f;
+
+		glm::mat4 light_view = glm::lookAt(center + direction * (radius + caster_distance), center, up);
+		glm::mat4 light_projection = glm::ortho(-radius, radius, -radius, radius, 0.f, 2.f * radius + caster_distance);
+
+		// move the light camera in whole texels
+		const glm::vec4 origin = light_projection * light_view * glm::vec4(0.f, 0.f, 0.f, 1.f);
+		const float texels = resolution * 0.5f;
+		const glm::vec2 offset = glm::vec2(std::floor(origin.x * texels + 0.5f), std::floor(origin.y * texels + 0.5f)) / texels
+		                         - glm::vec2(origin.x, origin.y);
+		light_projection = glm::translate(glm::mat4(1.f), glm::vec3(offset, 0.f)) * light_projection;
+
+		light_views[i] = light_view;
+		light_projections[i] = light_projection;
+		shadow_matrices[i] = bias * light_projection * light_view * inverse_view;
+		slice_near = slice_far;
+	}
+}
+
+void CascadedShadowMap::bindCascade(unsigned int cascade){
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo_name);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth_texture, 0, cascade);
+	glViewport(0, 0, resolution, resolution);
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void CascadedShadowMap::unbind(){
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
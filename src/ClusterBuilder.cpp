@@ -0,0 +1,666 @@
+#include "ClusterBuilder.h"
+
+#include "GameException.h"
+#include "TangentSpace.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+namespace {
+	// a DAG this deep halves the triangles of any mesh that fits in memory down to a single cluster
+	const uint32_t max_levels = 24;
+	// groups left with more of their triangles than this are mostly locked border, they are not merged further
+	const float max_remaining_ratio = 0.85f;
+
+	/**
+	 * The quadric error of a set of planes, the upper triangle of the 4x4 matrix
+	 */
+	struct Quadric{
+		Quadric(){
+			std::fill(a, a + 10, 0.0);
+		}
+
+		/**
+		 * Of the plane x * p.x + y * p.y + z * p.z + w = 0, with (x, y, z) of unit length
+		 */
+		Quadric(double x, double y, double z, double w){
+			a[0] = x * x; a[1] = x * y; a[2] = x * z; a[3] = x * w;
+			a[4] = y * y; a[5] = y * z; a[6] = y * w;
+			a[7] = z * z; a[8] = z * w;
+			a[9] = w * w;
+		}
+
+		void add(const Quadric &other){
+			for(int i = 0; i < 10; ++i)
+				a[i] += other.a[i];
+		}
+
+		/**
+		 * The sum of the squared distances of p to the planes
+		 */
+		double evaluate(const glm::vec3 &p) const{
+			const double x = p.x, y = p.y, z = p.z;
+			return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+			     + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+			     + a[7] * z * z + 2.0 * a[8] * z
+			     + a[9];
+		}
+
+		double a[10];
+	};
+
+	/**
+	 * Moving vertex from onto vertex to, as it was costed
+	 */
+	struct Collapse{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+		uint32_t from_version; //< of the vertices when the cost was computed, older entries are skipped
+		uint32_t to_version;
+
+		bool operator>(const Collapse &other) const{
+			return cost > other.cost;
+		}
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b){
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	/**
+	 * Spreads the lower 10 bits of value over every third bit
+	 */
+	uint32_t expandBits(uint32_t value){
+		value &= 0x3ff;
+		value = (value | (value << 16)) & 0x030000ff;
+		value = (value | (value << 8)) & 0x0300f00f;
+		value = (value | (value << 4)) & 0x030c30c3;
+		value = (value | (value << 2)) & 0x09249249;
+		return value;
+	}
+
+	uint32_t mortonCode(const glm::vec3 &p, const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+		const glm::vec3 extent = glm::max(max_dim - min_dim, glm::vec3(1e-20f));
+		const glm::vec3 cell = glm::clamp((p - min_dim) / extent, 0.f, 1.f) * 1023.f;
+		return (expandBits(uint32_t(cell.x)) << 2) | (expandBits(uint32_t(cell.y)) << 1) | expandBits(uint32_t(cell.z));
+	}
+
+	/**
+	 * A sphere around the vertices of indices: the centre of their box and the distance to the furthest
+	 */
+	glm::vec4 boundingSphere(const std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions){
+		glm::vec3 min_dim(FLT_MAX), max_dim(-FLT_MAX);
+		for(uint32_t index : indices){
+			min_dim = glm::min(min_dim, positions[index]);
+			max_dim = glm::max(max_dim, positions[index]);
+		}
+		const glm::vec3 center = (min_dim + max_dim) * 0.5f;
+		float radius = 0.f;
+		for(uint32_t index : indices)
+			radius = std::max(radius, glm::length(positions[index] - center));
+		return glm::vec4(center, radius);
+	}
+
+	/**
+	 * A sphere holding all of spheres, not the smallest one but never smaller than any of them
+	 */
+	glm::vec4 enclosingSphere(const std::vector<glm::vec4> &spheres){
+		glm::vec3 min_dim(FLT_MAX), max_dim(-FLT_MAX);
+		for(const glm::vec4 &sphere : spheres){
+			min_dim = glm::min(min_dim, glm::vec3(sphere) - sphere.w);
+			max_dim = glm::max(max_dim, glm::vec3(sphere) + sphere.w);
+		}
+		const glm::vec3 center = (min_dim + max_dim) * 0.5f;
+		float radius = 0.f;
+		for(const glm::vec4 &sphere : spheres)
+			radius = std::max(radius, glm::length(glm::vec3(sphere) - center) + sphere.w);
+		return glm::vec4(center, radius);
+	}
+
+	glm::vec3 triangleNormal(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2){
+		return glm::cross(p1 - p0, p2 - p0);
+	}
+}
+
+ClusterBuilder::ClusterBuilder(const std::string &mesh_path)
+	: min_dim(0.f), max_dim(0.f), level_count(0), page_count(0), root_page_count(0), triangle_count(0){
+	TRACE_SCOPE("ClusterBuilder::ClusterBuilder");
+	std::vector<glm::vec3> corner_positions, corner_normals;
+	std::vector<glm::vec2> corner_uvs;
+	{
+		// the model is only needed until its corners are copied out
+		Model model(mesh_path, "", "", "", false, Model::STORE_CPU);
+		if(model.getGeometry().normals.empty())
+			THROW_EXCEPTION(mesh_path + " has no normals");
+		// in the space of the model's BVH, as the scene places instances of any other model
+		flatten(model.getGeometry(), model.getMesh(), model.getMesh().transform, corner_positions, corner_normals,
+		        corner_uvs);
+	}
+
+	// the corners share a vertex where all of their attributes match
+	const size_t corner_count = corner_positions.size();
+	std::vector<uint32_t> order(corner_count);
+	std::iota(order.begin(), order.end(), 0u);
+	auto key = [&](uint32_t corner){
+		const glm::vec3 &p = corner_positions[corner], &n = corner_normals[corner];
+		const glm::vec2 &uv = corner_uvs[corner];
+		return std::make_tuple(p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y);
+	};
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b){
+		return key(a) < key(b);
+	});
+	std::vector<uint32_t> corner_vertices(corner_count);
+	for(size_t i = 0; i < corner_count; ++i){
+		if(i == 0 || key(order[i]) != key(order[i - 1])){
+			positions.push_back(corner_positions[order[i]]);
+			normals.push_back(corner_normals[order[i]]);
+			uvs.push_back(corner_uvs[order[i]]);
+		}
+		corner_vertices[order[i]] = uint32_t(positions.size() - 1);
+	}
+
+	// triangles that the welding closed up cover nothing
+	std::vector<uint32_t> indices;
+	indices.reserve(corner_count);
+	for(size_t t = 0; t + 2 < corner_count; t += 3){
+		const uint32_t a = corner_vertices[t], b = corner_vertices[t + 1], c = corner_vertices[t + 2];
+		if(a == b || b == c || c == a)
+			continue;
+		indices.push_back(a);
+		indices.push_back(b);
+		indices.push_back(c);
+	}
+	triangle_count = indices.size() / 3;
+	if(triangle_count == 0)
+		THROW_EXCEPTION(mesh_path + " has no triangles");
+
+	min_dim = glm::vec3(FLT_MAX);
+	max_dim = glm::vec3(-FLT_MAX);
+	for(const glm::vec3 &position : positions){
+		min_dim = glm::min(min_dim, position);
+		max_dim = glm::max(max_dim, position);
+	}
+
+	std::vector<uint32_t> level_clusters;
+	makeClusters(indices, 0, level_clusters);
+	for(uint32_t level = 0; level_clusters.size() > 1 && level < max_levels; ++level){
+		TRACE_SCOPE("ClusterBuilder level");
+		std::vector<std::vector<uint32_t> > level_groups;
+		groupClusters(level_clusters, level_groups);
+
+		std::vector<uint32_t> next_level;
+		for(const std::vector<uint32_t> &members : level_groups){
+			std::vector<uint32_t> group_indices;
+			std::vector<glm::vec4> child_bounds;
+			float child_error = 0.f;
+			for(uint32_t member : members){
+				const BuildCluster &child = clusters[member];
+				group_indices.insert(group_indices.end(), child.indices.begin(), child.indices.end());
+				child_bounds.push_back(child.cluster.lod_bounds);
+				child_error = std::max(child_error, child.cluster.lod_error);
+			}
+
+			const size_t group_triangles = group_indices.size() / 3;
+			const float simplify_error = simplify(group_indices, group_triangles / 2);
+			// the children of a group that hardly simplified stay the coarsest clusters of their part of the mesh
+			if(group_indices.empty() || group_indices.size() / 3 > size_t(max_remaining_ratio * group_triangles))
+				continue;
+
+			// neither may shrink towards the coarse levels, or the cut could pick a parent and its child
+			const float error = std::max(simplify_error, child_error);
+			const glm::vec4 bounds = enclosingSphere(child_bounds);
+			const uint32_t group_index = uint32_t(groups.size());
+			Group group;
+			group.first_child = uint32_t(group_children.size());
+			group.child_count = uint32_t(members.size());
+			for(uint32_t member : members){
+				Cluster &child = clusters[member].cluster;
+				child.group = group_index;
+				child.parent_lod_error = error;
+				child.parent_lod_bounds = bounds;
+				group_children.push_back(member);
+			}
+
+			group.first_cluster = uint32_t(clusters.size());
+			makeClusters(group_indices, level + 1, next_level);
+			group.cluster_count = uint32_t(clusters.size()) - group.first_cluster;
+			for(uint32_t c = group.first_cluster; c < group.first_cluster + group.cluster_count; ++c){
+				clusters[c].cluster.lod_error = error;
+				clusters[c].cluster.lod_bounds = bounds;
+				clusters[c].cluster.source_group = group_index;
+			}
+			groups.push_back(group);
+		}
+		level_clusters.swap(next_level);
+	}
+
+	for(const BuildCluster &cluster : clusters)
+		level_count = std::max(level_count, size_t(cluster.cluster.level) + 1);
+	layOut();
+}
+
+void ClusterBuilder::write(const std::string &filename) const{
+	TRACE_SCOPE("ClusterBuilder::write");
+	std::ofstream file(filename.c_str(), std::ios::binary);
+	if(!file)
+		THROW_EXCEPTION("Unable to write " + filename);
+
+	Header header;
+	std::memcpy(header.magic, "CDAG", 4);
+	header.version = file_version;
+	header.corners_per_page = corners_per_page;
+	header.page_count = uint32_t(page_count);
+	header.cluster_count = uint32_t(clusters.size());
+	header.group_count = uint32_t(groups.size());
+	header.group_child_count = uint32_t(group_children.size());
+	header.root_page_count = uint32_t(root_page_count);
+	header.min_dim = min_dim;
+	header.max_dim = max_dim;
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for(const BuildCluster &cluster : clusters)
+		file.write(reinterpret_cast<const char *>(&cluster.cluster), sizeof(Cluster));
+	file.write(reinterpret_cast<const char *>(groups.data()), groups.size() * sizeof(Group));
+	file.write(reinterpret_cast<const char *>(group_children.data()), group_children.size() * sizeof(uint32_t));
+
+	// every page is written whole, so that the streamer reads and uploads them all alike
+	std::vector<Vertex> page(corners_per_page);
+	std::vector<glm::vec3> local_positions, local_normals;
+	std::vector<glm::vec2> local_uvs;
+	std::vector<unsigned int> local_indices;
+	std::vector<glm::vec4> tangents;
+	std::unordered_map<uint32_t, unsigned int> local_ids;
+	for(const std::vector<uint32_t> &page_cluster_list : page_clusters){
+		std::memset(page.data(), 0, page.size() * sizeof(Vertex));
+		for(uint32_t c : page_cluster_list){
+			const BuildCluster &cluster = clusters[c];
+			// the tangents of the simplified levels follow their own triangles
+			local_positions.clear();
+			local_normals.clear();
+			local_uvs.clear();
+			local_indices.clear();
+			local_ids.clear();
+			for(uint32_t index : cluster.indices){
+				auto inserted = local_ids.insert(std::make_pair(index, (unsigned int) local_positions.size()));
+				if(inserted.second){
+					local_positions.push_back(positions[index]);
+					local_normals.push_back(normals[index]);
+					local_uvs.push_back(uvs[index]);
+				}
+				local_indices.push_back(inserted.first->second);
+			}
+			TangentSpace::generate(local_positions, local_normals, local_uvs, local_indices, tangents);
+
+			Vertex *corners = &page[cluster.cluster.first_corner];
+			for(size_t i = 0; i < cluster.indices.size(); ++i){
+				const uint32_t index = cluster.indices[i];
+				Vertex &corner = corners[i];
+				for(int k = 0; k < 3; ++k){
+					corner.position[k] = positions[index][k];
+					corner.normal[k] = normals[index][k];
+				}
+				corner.uv[0] = uvs[index].x;
+				corner.uv[1] = uvs[index].y;
+				for(int k = 0; k < 4; ++k)
+					corner.tangent[k] = tangents[i][k];
+				const size_t triangle = i - i % 3;
+				corner.edge_curvature = Model::edgeCurvature(normals[cluster.indices[triangle + (i + 1) % 3]],
+				                                             normals[cluster.indices[triangle + (i + 2) % 3]]);
+			}
+		}
+		file.write(reinterpret_cast<const char *>(page.data()), page.size() * sizeof(Vertex));
+	}
+
+	if(!file)
+		THROW_EXCEPTION("Unable to write " + filename);
+}
+
+void ClusterBuilder::flatten(const Model::Geometry &geometry, const MeshPart &part, const glm::mat4 &transform,
+                             std::vector<glm::vec3> &positions, std::vector<glm::vec3> &normals,
+                             std::vector<glm::vec2> &uvs){
+	const size_t corner_count = geometry.positions.size() / 3;
+	if(positions.size() != corner_count){
+		positions.assign(corner_count, glm::vec3(0.f));
+		normals.assign(corner_count, glm::vec3(0.f, 0.f, 1.f));
+		uvs.assign(corner_count, glm::vec2(0.f));
+	}
+
+	const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+	for(unsigned int v = part.first; v < part.first + part.count; ++v){
+		positions[v] = glm::vec3(transform * glm::vec4(geometry.positions[3 * v], geometry.positions[3 * v + 1],
+		                                               geometry.positions[3 * v + 2], 1.f));
+		normals[v] = glm::normalize(normal_matrix * glm::vec3(geometry.normals[3 * v], geometry.normals[3 * v + 1],
+		                                                      geometry.normals[3 * v + 2]));
+		if(!geometry.uvs.empty())
+			uvs[v] = glm::vec2(geometry.uvs[2 * v], geometry.uvs[2 * v + 1]);
+	}
+
+	for(size_t i = 0; i < part.children.size(); ++i)
+		flatten(geometry, part.children[i], transform * part.children[i].transform, positions, normals, uvs);
+}
+
+void ClusterBuilder::groupClusters(const std::vector<uint32_t> &level_clusters,
+                                   std::vector<std::vector<uint32_t> > &level_groups) const{
+	// how many vertices each pair of clusters shares, which are on the border between them
+	std::unordered_map<uint32_t, std::vector<uint32_t> > vertex_clusters;
+	for(uint32_t i = 0; i < level_clusters.size(); ++i){
+		std::vector<uint32_t> vertices = clusters[level_clusters[i]].indices;
+		std::sort(vertices.begin(), vertices.end());
+		vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+		for(uint32_t vertex : vertices)
+			vertex_clusters[vertex].push_back(i);
+	}
+	std::vector<std::unordered_map<uint32_t, unsigned int> > shared(level_clusters.size());
+	for(const auto &vertex : vertex_clusters){
+		for(size_t a = 0; a < vertex.second.size(); ++a){
+			for(size_t b = a + 1; b < vertex.second.size(); ++b){
+				++shared[vertex.second[a]][vertex.second[b]];
+				++shared[vertex.second[b]][vertex.second[a]];
+			}
+		}
+	}
+
+	// seeded along the Morton curve of the centres, each group grows by the neighbour sharing the longest
+	// border with it: those are the borders that were locked the longest, and merging unlocks them
+	std::vector<std::pair<uint32_t, uint32_t> > seeds(level_clusters.size());
+	for(uint32_t i = 0; i < level_clusters.size(); ++i)
+		seeds[i] = std::make_pair(mortonCode(glm::vec3(clusters[level_clusters[i]].cluster.bounds), min_dim, max_dim), i);
+	std::sort(seeds.begin(), seeds.end());
+
+	std::vector<bool> grouped(level_clusters.size(), false);
+	std::unordered_map<uint32_t, unsigned int> candidates;
+	for(const std::pair<uint32_t, uint32_t> &seed : seeds){
+		if(grouped[seed.second])
+			continue;
+		std::vector<uint32_t> members(1, seed.second);
+		grouped[seed.second] = true;
+		candidates.clear();
+		while(true){
+			for(const auto &neighbour : shared[members.back()]){
+				if(!grouped[neighbour.first])
+					candidates[neighbour.first] += neighbour.second;
+			}
+			if(members.size() == group_size)
+				break;
+			uint32_t best = 0;
+			unsigned int best_shared = 0;
+			for(const auto &candidate : candidates){
+				if(!grouped[candidate.first] && (candidate.second > best_shared
+				   || (candidate.second == best_shared && candidate.first < best))){
+					best = candidate.first;
+					best_shared = candidate.second;
+				}
+			}
+			if(best_shared == 0)
+				break;
+			members.push_back(best);
+			grouped[best] = true;
+		}
+
+		level_groups.push_back(std::vector<uint32_t>());
+		for(uint32_t member : members)
+			level_groups.back().push_back(level_clusters[member]);
+	}
+}
+
+void ClusterBuilder::makeClusters(const std::vector<uint32_t> &indices, uint32_t level, std::vector<uint32_t> &made){
+	const size_t count = indices.size() / 3;
+	std::vector<std::pair<uint32_t, uint32_t> > sorted(count);
+	for(size_t t = 0; t < count; ++t){
+		const glm::vec3 centroid = (positions[indices[3 * t]] + positions[indices[3 * t + 1]]
+		                            + positions[indices[3 * t + 2]]) / 3.f;
+		sorted[t] = std::make_pair(mortonCode(centroid, min_dim, max_dim), uint32_t(t));
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	for(size_t first = 0; first < count; first += max_cluster_triangles){
+		const size_t last = std::min(first + max_cluster_triangles, count);
+		BuildCluster cluster;
+		for(size_t i = first; i < last; ++i){
+			const uint32_t t = sorted[i].second;
+			cluster.indices.push_back(indices[3 * t]);
+			cluster.indices.push_back(indices[3 * t + 1]);
+			cluster.indices.push_back(indices[3 * t + 2]);
+		}
+
+		// full detail until a group says otherwise, and never merged until one takes it
+		Cluster &info = cluster.cluster;
+		info.bounds = boundingSphere(cluster.indices, positions);
+		info.lod_bounds = info.bounds;
+		info.parent_lod_bounds = info.bounds;
+		info.lod_error = 0.f;
+		info.parent_lod_error = FLT_MAX;
+		info.page = 0;
+		info.first_corner = 0;
+		info.corner_count = uint32_t(cluster.indices.size());
+		info.group = no_group;
+		info.source_group = no_group;
+		info.level = level;
+
+		made.push_back(uint32_t(clusters.size()));
+		clusters.push_back(std::move(cluster));
+	}
+}
+
+float ClusterBuilder::simplify(std::vector<uint32_t> &indices, size_t target_triangles) const{
+	// the vertices the group uses, numbered from 0
+	std::unordered_map<uint32_t, uint32_t> local_ids;
+	std::vector<uint32_t> global_ids;
+	std::vector<uint32_t> triangles(indices.size());
+	for(size_t i = 0; i < indices.size(); ++i){
+		auto inserted = local_ids.insert(std::make_pair(indices[i], uint32_t(global_ids.size())));
+		if(inserted.second)
+			global_ids.push_back(indices[i]);
+		triangles[i] = inserted.first->second;
+	}
+	const size_t vertex_count = global_ids.size();
+	const size_t group_triangle_count = triangles.size() / 3;
+	auto position = [&](uint32_t vertex) -> const glm::vec3 &{
+		return positions[global_ids[vertex]];
+	};
+
+	// the plane of every triangle goes into the quadrics of its corners
+	std::vector<Quadric> quadrics(vertex_count);
+	std::vector<std::vector<uint32_t> > vertex_triangles(vertex_count);
+	std::unordered_map<uint64_t, unsigned int> edge_use;
+	for(uint32_t t = 0; t < group_triangle_count; ++t){
+		const uint32_t *corners = &triangles[3 * t];
+		const glm::vec3 normal = triangleNormal(position(corners[0]), position(corners[1]), position(corners[2]));
+		const float length = glm::length(normal);
+		if(length > 0.f){
+			const glm::vec3 unit = normal / length;
+			const Quadric quadric(unit.x, unit.y, unit.z, -glm::dot(unit, position(corners[0])));
+			for(int k = 0; k < 3; ++k)
+				quadrics[corners[k]].add(quadric);
+		}
+		for(int k = 0; k < 3; ++k){
+			vertex_triangles[corners[k]].push_back(t);
+			++edge_use[edgeKey(corners[k], corners[(k + 1) % 3])];
+		}
+	}
+
+	// edges of one triangle are on the border of the group or on a seam, edges of more than two are
+	// not manifold: their vertices stay, so that the neighbouring groups still fit
+	std::vector<bool> locked(vertex_count, false);
+	for(const auto &edge : edge_use){
+		if(edge.second != 2){
+			locked[uint32_t(edge.first >> 32)] = true;
+			locked[uint32_t(edge.first & 0xffffffffu)] = true;
+		}
+	}
+
+	std::vector<uint32_t> versions(vertex_count, 0);
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > queue;
+	auto push = [&](uint32_t from, uint32_t to){
+		if(locked[from])
+			return;
+		Quadric quadric = quadrics[from];
+		quadric.add(quadrics[to]);
+		const Collapse collapse = { quadric.evaluate(position(to)), from, to, versions[from], versions[to] };
+		queue.push(collapse);
+	};
+	for(const auto &edge : edge_use){
+		const uint32_t a = uint32_t(edge.first >> 32), b = uint32_t(edge.first & 0xffffffffu);
+		push(a, b);
+		push(b, a);
+	}
+
+	std::vector<bool> alive(group_triangle_count, true);
+	std::vector<bool> removed(vertex_count, false);
+	size_t alive_count = group_triangle_count;
+	double max_cost = 0.0;
+	std::vector<uint32_t> from_neighbours, to_neighbours;
+	auto gatherNeighbours = [&](uint32_t vertex, std::vector<uint32_t> &neighbours){
+		neighbours.clear();
+		for(uint32_t t : vertex_triangles[vertex]){
+			if(!alive[t])
+				continue;
+			for(int k = 0; k < 3; ++k){
+				if(triangles[3 * t + k] != vertex)
+					neighbours.push_back(triangles[3 * t + k]);
+			}
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+	};
+
+	while(alive_count > target_triangles && !queue.empty()){
+		const Collapse collapse = queue.top();
+		queue.pop();
+		const uint32_t from = collapse.from, to = collapse.to;
+		if(removed[from] || removed[to] || versions[from] != collapse.from_version || versions[to] != collapse.to_version)
+			continue;
+
+		// an edge with more than two shared neighbours would pinch the surface into a non-manifold one
+		gatherNeighbours(from, from_neighbours);
+		gatherNeighbours(to, to_neighbours);
+		if(!std::binary_search(from_neighbours.begin(), from_neighbours.end(), to))
+			continue;
+		std::vector<uint32_t> shared;
+		std::set_intersection(from_neighbours.begin(), from_neighbours.end(), to_neighbours.begin(), to_neighbours.end(),
+		                      std::back_inserter(shared));
+		if(shared.size() > 2)
+			continue;
+
+		// none of the triangles that move with from may turn over
+		bool flips = false;
+		for(uint32_t t : vertex_triangles[from]){
+			const uint32_t *corners = &triangles[3 * t];
+			if(!alive[t] || corners[0] == to || corners[1] == to || corners[2] == to)
+				continue;
+			glm::vec3 moved[3];
+			for(int k = 0; k < 3; ++k)
+				moved[k] = position(corners[k] == from ? to : corners[k]);
+			const glm::vec3 before = triangleNormal(position(corners[0]), position(corners[1]), position(corners[2]));
+			const glm::vec3 after = triangleNormal(moved[0], moved[1], moved[2]);
+			if(glm::dot(before, after) <= 0.f){
+				flips = true;
+				break;
+			}
+		}
+		if(flips)
+			continue;
+
+		for(uint32_t t : vertex_triangles[from]){
+			uint32_t *corners = &triangles[3 * t];
+			if(!alive[t])
+				continue;
+			if(corners[0] == to || corners[1] == to || corners[2] == to){
+				alive[t] = false;
+				--alive_count;
+				continue;
+			}
+			for(int k = 0; k < 3; ++k){
+				if(corners[k] == from)
+					corners[k] = to;
+			}
+			vertex_triangles[to].push_back(t);
+		}
+		quadrics[to].add(quadrics[from]);
+		removed[from] = true;
+		++versions[to];
+		max_cost = std::max(max_cost, collapse.cost);
+
+		// the collapses of to are costed with its new quadric
+		gatherNeighbours(to, to_neighbours);
+		for(uint32_t neighbour : to_neighbours){
+			push(to, neighbour);
+			push(neighbour, to);
+		}
+	}
+
+	indices.clear();
+	for(size_t t = 0; t < group_triangle_count; ++t){
+		if(!alive[t])
+			continue;
+		for(int k = 0; k < 3; ++k)
+			indices.push_back(global_ids[triangles[3 * t + k]]);
+	}
+	return float(std::sqrt(std::max(max_cost, 0.0)));
+}
+
+void ClusterBuilder::layOut(){
+	// the coarsest clusters first, the streamer loads their pages up front and keeps them
+	std::vector<uint32_t> roots;
+	for(uint32_t c = 0; c < clusters.size(); ++c){
+		if(clusters[c].cluster.group == no_group)
+			roots.push_back(c);
+	}
+	std::stable_sort(roots.begin(), roots.end(), [&](uint32_t a, uint32_t b){
+		return clusters[a].cluster.level > clusters[b].cluster.level;
+	});
+
+	page_clusters.clear();
+	uint32_t used = corners_per_page;
+	auto place = [&](uint32_t c){
+		Cluster &cluster = clusters[c].cluster;
+		if(used + cluster.corner_count > corners_per_page){
+			page_clusters.push_back(std::vector<uint32_t>());
+			used = 0;
+		}
+		cluster.page = uint32_t(page_clusters.size() - 1);
+		cluster.first_corner = used;
+		used += cluster.corner_count;
+		page_clusters.back().push_back(c);
+	};
+	for(uint32_t c : roots)
+		place(c);
+	root_page_count = page_clusters.size();
+
+	// then the children of every group together, which the streamer loads together, coarse groups first
+	used = corners_per_page;
+	for(size_t g = groups.size(); g-- > 0;){
+		const Group &group = groups[g];
+		uint32_t group_corners = 0;
+		for(uint32_t i = 0; i < group.child_count; ++i)
+			group_corners += clusters[group_children[group.first_child + i]].cluster.corner_count;
+		if(group_corners <= corners_per_page && used + group_corners > corners_per_page)
+			used = corners_per_page;
+		for(uint32_t i = 0; i < group.child_count; ++i)
+			place(group_children[group.first_child + i]);
+	}
+	page_count = page_clusters.size();
+
+	// the table runs from the coarse to the fine clusters, reversing the order they were made in
+	// keeps the clusters of each group next to each other
+	const uint32_t last = uint32_t(clusters.size()) - 1;
+	std::reverse(clusters.begin(), clusters.end());
+	for(uint32_t &child : group_children)
+		child = last - child;
+	for(Group &group : groups)
+		group.first_cluster = last - (group.first_cluster + group.cluster_count - 1);
+	for(std::vector<uint32_t> &page : page_clusters){
+		for(uint32_t &c : page)
+			c = last - c;
+	}
+}
@@ -0,0 +1,303 @@
+#include "ClusterStreamer.h"
+
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+#include "LooseOctree.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+
+namespace {
+	const uint32_t no_page = 0xffffffffu;
+	// pages copied into the vertex buffer per frame, so that a burst of reads does not stall one frame
+	const size_t max_uploads_per_frame = 16;
+	// pages handed to the loader thread per frame, the rest are asked for again next frame if still needed
+	const size_t max_queued_pages = 64;
+
+	// the attribute locations of basic_phong.vert
+	const GLuint position_location = 0;
+	const GLuint normal_location = 1;
+	const GLuint uv_location = 2;
+	const GLuint tangent_location = 3;
+	const GLuint edge_curvature_location = 5;
+}
+
+ClusterStreamer::ClusterStreamer(const std::string &filename, size_t budget_bytes)
+	: page_bytes(0), data_offset(0), vertex_buffer(0), vertex_array(0), frame(0), resident_pages(0), pending_pages(0),
+	  uploaded_bytes(0), cut_scale(1.f), pixels_per_unit(1.f), stopping(false){
+	TRACE_SCOPE("ClusterStreamer::ClusterStreamer");
+	file.open(filename.c_str(), std::ios::binary);
+	if(!file)
+		THROW_EXCEPTION("Unable to open " + filename);
+	file.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if(!file || std::memcmp(header.magic, "CDAG", 4) != 0 || header.version != ClusterBuilder::file_version)
+		THROW_EXCEPTION(filename + " is not a cluster file of this version");
+
+	clusters.resize(header.cluster_count);
+	groups.resize(header.group_count);
+	group_children.resize(header.group_child_count);
+	file.read(reinterpret_cast<char *>(clusters.data()), clusters.size() * sizeof(Cluster));
+	file.read(reinterpret_cast<char *>(groups.data()), groups.size() * sizeof(Group));
+	file.read(reinterpret_cast<char *>(group_children.data()), group_children.size() * sizeof(uint32_t));
+	if(!file)
+		THROW_EXCEPTION(filename + " is truncated");
+	page_bytes = size_t(header.corners_per_page) * sizeof(Vertex);
+	data_offset = size_t(file.tellg());
+
+	const size_t slot_count = std::min(budget_bytes / page_bytes, size_t(header.page_count));
+	if(slot_count < header.root_page_count)
+		THROW_EXCEPTION("The coarsest clusters of " + filename + " do not fit in the streaming budget");
+	slot_pages.assign(slot_count, no_page);
+	page_slots.assign(header.page_count, no_page);
+	page_last_used.assign(header.page_count, 0);
+	page_requested.assign(header.page_count, 0);
+	page_pending.assign(header.page_count, false);
+	refinable.assign(groups.size(), 0);
+
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(slot_count * page_bytes), NULL, GL_DYNAMIC_DRAW);
+
+	// one interleaved buffer in place of the separate ones of Model
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+	const GLsizei stride = sizeof(Vertex);
+	glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(Vertex, position)));
+	glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(Vertex, normal)));
+	glVertexAttribPointer(uv_location, 2, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(Vertex, uv)));
+	glVertexAttribPointer(tangent_location, 4, GL_FLOAT, GL_FALSE, stride, BUFFER_OFFSET(offsetof(Vertex, tangent)));
+	glVertexAttribPointer(edge_curvature_location, 1, GL_FLOAT, GL_FALSE, stride,
+	                      BUFFER_OFFSET(offsetof(Vertex, edge_curvature)));
+	const GLuint locations[5] = { position_location, normal_location, uv_location, tangent_location,
+	                              edge_curvature_location };
+	for(GLuint location : locations)
+		glEnableVertexAttribArray(location);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CHECK_GL_ERROR();
+
+	// the coarsest clusters are always there to fall back to
+	for(uint32_t page = 0; page < header.root_page_count; ++page){
+		LoadedPage loaded;
+		loaded.page = page;
+		if(!readPage(page, loaded.corners))
+			THROW_EXCEPTION(filename + " is truncated");
+		upload(loaded);
+	}
+
+	loader = std::thread(&ClusterStreamer::loadPages, this);
+}
+
+ClusterStreamer::~ClusterStreamer(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	if(loader.joinable())
+		loader.join();
+	glDeleteVertexArrays(1, &vertex_array);
+	glDeleteBuffers(1, &vertex_buffer);
+}
+
+void ClusterStreamer::update(const glm::mat4 &model_view, const glm::mat4 &projection, float viewport_height,
+                             float error_pixels, std::vector<Draw> &draws, std::vector<Draw> *unculled_draws){
+	TRACE_SCOPE("ClusterStreamer::update");
+	++frame;
+
+	std::vector<LoadedPage> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const size_t count = std::min(loaded_pages.size(), max_uploads_per_frame);
+		std::move(loaded_pages.begin(), loaded_pages.begin() + count, std::back_inserter(ready));
+		loaded_pages.erase(loaded_pages.begin(), loaded_pages.begin() + count);
+	}
+	for(const LoadedPage &loaded : ready){
+		page_pending[loaded.page] = false;
+		--pending_pages;
+		if(loaded.corners.empty())
+			THROW_EXCEPTION("Unable to read a page of a cluster file");
+		// dropped if the cut still needs every page in memory, it is asked for again later
+		upload(loaded);
+	}
+
+	// a group can be refined where its children are in memory, and the coarser groups its own
+	// clusters belong to are refined too; those were made later and come after it
+	for(size_t g = groups.size(); g-- > 0;){
+		const Group &group = groups[g];
+		bool ready_to_refine = true;
+		for(uint32_t i = 0; i < group.child_count && ready_to_refine; ++i)
+			ready_to_refine = page_slots[clusters[group_children[group.first_child + i]].page] != no_page;
+		for(uint32_t c = group.first_cluster; c < group.first_cluster + group.cluster_count && ready_to_refine; ++c)
+			ready_to_refine = clusters[c].group == ClusterBuilder::no_group || refinable[clusters[c].group];
+		refinable[g] = ready_to_refine ? 1 : 0;
+	}
+
+	cut_model_view = model_view;
+	const glm::mat3 linear(model_view);
+	cut_scale = std::max(std::max(glm::length(linear[0]), glm::length(linear[1])), glm::length(linear[2]));
+	pixels_per_unit = projection[1][1] * viewport_height * 0.5f;
+	const LooseOctree::Frustum frustum(projection * model_view);
+
+	requests.clear();
+	for(const Cluster &cluster : clusters){
+		// the parents are only left for their children where they would be too coarse
+		if(cluster.group != ClusterBuilder::no_group
+		   && !(refinable[cluster.group] && projectedError(cluster.parent_lod_bounds, cluster.parent_lod_error) > error_pixels))
+			continue;
+		page_last_used[cluster.page] = frame;
+
+		// and the children only make way for their own children where those are in memory
+		if(cluster.source_group != ClusterBuilder::no_group){
+			const float error = projectedError(cluster.lod_bounds, cluster.lod_error);
+			if(error > error_pixels){
+				if(refinable[cluster.source_group])
+					continue;
+				requestGroup(cluster.source_group, error);
+			}
+		}
+
+		Draw draw;
+		draw.first = GLint(page_slots[cluster.page] * header.corners_per_page + cluster.first_corner);
+		draw.count = GLsizei(cluster.corner_count);
+		draw.bounds = cluster.bounds;
+		if(unculled_draws)
+			unculled_draws->push_back(draw);
+		bool inside = true;
+		for(unsigned int i = 0; i < 6 && inside; ++i)
+			inside = glm::dot(glm::vec3(frustum.planes[i]), glm::vec3(cluster.bounds)) + frustum.planes[i].w >= -cluster.bounds.w;
+		if(inside)
+			draws.push_back(draw);
+	}
+
+	// the loader works through this frame's requests, the largest error first, in place of the last frame's
+	std::sort(requests.begin(), requests.end(), std::greater<std::pair<float, uint32_t> >());
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(uint32_t page : queue){
+			page_pending[page] = false;
+			--pending_pages;
+		}
+		queue.clear();
+		for(const std::pair<float, uint32_t> &request : requests){
+			if(queue.size() >= max_queued_pages)
+				break;
+			if(page_pending[request.second])
+				continue;
+			queue.push_back(request.second);
+			page_pending[request.second] = true;
+			++pending_pages;
+		}
+		queued = !queue.empty();
+	}
+	if(queued)
+		condition.notify_one();
+}
+
+void ClusterStreamer::loadPages(){
+	Trace::setThreadName("cluster streamer");
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		condition.wait(lock, [this]{ return stopping || !queue.empty(); });
+		if(stopping)
+			return;
+		LoadedPage loaded;
+		loaded.page = queue.front();
+		queue.pop_front();
+
+		lock.unlock();
+		readPage(loaded.page, loaded.corners);
+		lock.lock();
+		loaded_pages.push_back(std::move(loaded));
+	}
+}
+
+bool ClusterStreamer::readPage(uint32_t page, std::vector<Vertex> &corners){
+	TRACE_SCOPE("ClusterStreamer::readPage");
+	corners.resize(header.corners_per_page);
+	file.clear();
+	file.seekg(std::streamoff(data_offset + size_t(page) * page_bytes));
+	file.read(reinterpret_cast<char *>(corners.data()), std::streamsize(page_bytes));
+	if(!file){
+		corners.clear();
+		return false;
+	}
+	return true;
+}
+
+bool ClusterStreamer::upload(const LoadedPage &loaded){
+	if(page_slots[loaded.page] != no_page)
+		return true;
+
+	// a free slot, or else the one of the page the cut went through the longest time ago
+	uint32_t slot = no_page;
+	uint32_t oldest = no_page;
+	for(uint32_t s = 0; s < slot_pages.size(); ++s){
+		const uint32_t page = slot_pages[s];
+		if(page == no_page){
+			slot = s;
+			break;
+		}
+		// the coarsest pages never leave, and the ones of the last cut stay or the cut would swap them back and forth
+		if(page < header.root_page_count || page_last_used[page] + 1 >= frame)
+			continue;
+		if(page_last_used[page] < oldest){
+			oldest = page_last_used[page];
+			slot = s;
+		}
+	}
+	if(slot == no_page)
+		return false;
+
+	if(slot_pages[slot] != no_page){
+		page_slots[slot_pages[slot]] = no_page;
+		--resident_pages;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, GLintptr(size_t(slot) * page_bytes), GLsizeiptr(page_bytes), loaded.corners.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	slot_pages[slot] = loaded.page;
+	page_slots[loaded.page] = slot;
+	page_last_used[loaded.page] = frame;
+	++resident_pages;
+	uploaded_bytes += page_bytes;
+	return true;
+}
+
+float ClusterStreamer::projectedError(const glm::vec4 &bounds, float error) const{
+	if(error <= 0.f)
+		return 0.f;
+	if(error == FLT_MAX)
+		return std::numeric_limits<float>::infinity();
+	// from the nearest point of the sphere, which keeps the error of a parent above its children's
+	const glm::vec3 center = glm::vec3(cut_model_view * glm::vec4(glm::vec3(bounds), 1.f));
+	const float distance = glm::length(center) - bounds.w * cut_scale;
+	if(distance <= 0.f)
+		return std::numeric_limits<float>::infinity();
+	return error * cut_scale * pixels_per_unit / distance;
+}
+
+void ClusterStreamer::requestGroup(uint32_t group, float priority){
+	const Group &requested = groups[group];
+	for(uint32_t i = 0; i < requested.child_count; ++i){
+		const uint32_t page = clusters[group_children[requested.first_child + i]].page;
+		if(page_slots[page] == no_page && page_requested[page] != frame){
+			page_requested[page] = frame;
+			requests.push_back(std::make_pair(priority, page));
+		}
+	}
+	// the clusters of the group may also belong to coarser groups that cannot be refined yet
+	for(uint32_t c = requested.first_cluster; c < requested.first_cluster + requested.cluster_count; ++c){
+		const uint32_t parent = clusters[c].group;
+		if(parent != ClusterBuilder::no_group && !refinable[parent])
+			requestGroup(parent, priority);
+	}
+}
@@ -0,0 +1,57 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+
+namespace {
+	const double smoothing = 0.1; //< weight of the newest frame in the moving average
+	const double over_budget_ratio = 1.05;
+	const double under_budget_ratio = 0.75; //< scaling up costs ~1/scale^2, so keep more headroom
+	const int frames_before_decrease = 5;
+	const int frames_before_increase = 30;
+
+	const float min_scale = 0.5f;
+	const float scale_step = 0.05f;
+}
+
+DynamicResolution::DynamicResolution(double target_ms) : enabled(false), target_ms(target_ms){
+	setEnabled(false);
+}
+
+void DynamicResolution::setEnabled(bool enabled){
+	this->enabled = enabled;
+	smoothed_ms = target_ms;
+	scale = 1.f;
+	frames_over_budget = 0;
+	frames_under_budget = 0;
+}
+
+void DynamicResolution::update(double gpu_ms){
+	if(!enabled)
+		return;
+
+	smoothed_ms += smoothing * (gpu_ms - smoothed_ms);
+
+	if(smoothed_ms > target_ms * over_budget_ratio){
+		frames_under_budget = 0;
+		if(++frames_over_budget >= frames_before_decrease){
+			scale = std::max(scale - scale_step, min_scale);
+			frames_over_budget = 0;
+		}
+	}
+	else if(smoothed_ms < target_ms * under_budget_ratio){
+		frames_over_budget = 0;
+		if(++frames_under_budget >= frames_before_increase){
+			scale = std::min(scale + scale_step, 1.f);
+			frames_under_budget = 0;
+		}
+	}
+	else{
+		frames_over_budget = 0;
+		frames_under_budget = 0;
+	}
+}
+
+void DynamicResolution::printState(std::ostream &os) const{
+	os << "dynamic resolution " << (enabled ? "on" : "off")
+		<< " | scale " << getScale();
+}
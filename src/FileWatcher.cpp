@@ -0,0 +1,115 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "GameException.h"
+
+namespace {
+	// how often the modification times are compared where inotify is missing
+	const unsigned int poll_interval_ms = 250;
+
+#ifdef __linux__
+	void splitPath(const std::string &path, std::string &directory, std::string &name){
+		const std::string::size_type slash = path.find_last_of("/\\");
+		if(slash == std::string::npos){
+			directory = ".";
+			name = path;
+		}
+		else{
+			directory = path.substr(0, slash);
+			name = path.substr(slash + 1);
+		}
+	}
+#endif
+}
+
+FileWatcher::FileWatcher(){
+#ifdef __linux__
+	inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(inotify_fd < 0)
+		THROW_EXCEPTION("inotify_init1 failed");
+#endif
+}
+
+FileWatcher::~FileWatcher(){
+#ifdef __linux__
+	close(inotify_fd);
+#endif
+}
+
+time_t FileWatcher::modificationTime(const std::string &path){
+	struct stat info;
+	if(stat(path.c_str(), &info) != 0)
+		return 0;
+	return info.st_mtime;
+}
+
+void FileWatcher::addFile(const std::string &path){
+	files[path] = modificationTime(path);
+
+#ifdef __linux__
+	std::string directory, name;
+	splitPath(path, directory, name);
+	// the same directory gives back the same descriptor
+	const int wd = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if(wd < 0){
+		std::cerr << "Could not watch " << directory << " for changes" << std::endl;
+		return;
+	}
+	directories[wd] = directory;
+#endif
+}
+
+std::vector<std::string> FileWatcher::waitForChanges(unsigned int timeout_ms){
+	std::vector<std::string> changed;
+
+#ifdef __linux__
+	pollfd descriptor;
+	descriptor.fd = inotify_fd;
+	descriptor.events = POLLIN;
+	if(poll(&descriptor, 1, int(timeout_ms)) <= 0)
+		return changed;
+
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while((length = read(inotify_fd, buffer, sizeof(buffer))) > 0){
+		for(char *event_data = buffer; event_data < buffer + length;){
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(event_data);
+			event_data += sizeof(inotify_event) + event->len;
+
+			std::map<int, std::string>::const_iterator directory = directories.find(event->wd);
+			if(directory == directories.end() || event->len == 0)
+				continue;
+
+			const std::string path = directory->second == "." ? std::string(event->name)
+			                                                  : directory->second + "/" + event->name;
+			if(files.count(path) > 0 && std::find(changed.begin(), changed.end(), path) == changed.end())
+				changed.push_back(path);
+		}
+	}
+#else
+	for(unsigned int waited = 0; changed.empty() && waited < timeout_ms; waited += poll_interval_ms){
+		std::this_thread::sleep_for(std::chrono::milliseconds(std::min(poll_interval_ms, timeout_ms - waited)));
+		for(std::map<std::string, time_t>::iterator it = files.begin(); it != files.end(); ++it){
+			const time_t time = modificationTime(it->first);
+			if(time != it->second){
+				it->second = time;
+				changed.push_back(it->first);
+			}
+		}
+	}
+#endif
+
+	return changed;
+}
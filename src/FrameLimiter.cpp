@@ -0,0 +1,59 @@
+#include "FrameLimiter.h"
+#include "Timer.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace {
+	const double decay = 0.02; //< how fast the estimate forgets a slow update
+	const double safety_margin_ms = 1.0;
+	const double spin_ms = 2.0; //< below this, sleeping is not precise enough
+}
+
+FrameLimiter::FrameLimiter(double target_fps) : update_estimate_ms(0.0){
+	setTargetFrameRate(target_fps);
+}
+
+void FrameLimiter::setTargetFrameRate(double target_fps){
+	this->target_fps = target_fps;
+	deadline = Timer::getCurrentTime();
+}
+
+void FrameLimiter::waitForInputSample(){
+	if(target_fps <= 0.0)
+		return;
+
+	TRACE_SCOPE("FrameLimiter::waitForInputSample");
+	const double wake = deadline - (update_estimate_ms + safety_margin_ms) * 0.001;
+	const double remaining = wake - Timer::getCurrentTime();
+	if(remaining > spin_ms * 0.001)
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining - spin_ms * 0.001));
+	while(Timer::getCurrentTime() < wake)
+		std::this_thread::yield();
+}
+
+void FrameLimiter::frameSubmitted(double update_ms){
+	// jumps up at once, comes down slowly
+	update_estimate_ms = std::max(update_ms, update_estimate_ms + decay * (update_ms - update_estimate_ms));
+
+	if(target_fps <= 0.0)
+		return;
+
+	// after a long hitch, start over from now instead of rushing to catch up
+	const double period = 1.0 / target_fps;
+	const double now = Timer::getCurrentTime();
+	deadline += period;
+	if(deadline < now)
+		deadline = now + period;
+}
+
+void FrameLimiter::printState(std::ostream &os) const{
+	os << "frame limit ";
+	if(target_fps > 0.0)
+		os << target_fps << " fps";
+	else
+		os << "off";
+	os << " | update estimate " << update_estimate_ms << " ms";
+}
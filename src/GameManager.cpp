@@ -5,13 +5,17 @@
 #include <vector>
 #include <assert.h>
 #include <stdexcept>
+#include <algorithm>
+#include <random>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/constants.hpp>
 #include <glm/gtx/transform2.hpp>
 #include "GLUtils/DebugOutput.hpp"
+#include "Trace.h"
 #include <IL/il.h>
 #include <IL/ilut.h>
 
@@ -21,11 +25,23 @@ using GLUtils::VBO;
 using GLUtils::Program;
 using GLUtils::readFile;
 
+namespace {
+	// instances with a smaller radius on screen are not drawn at all
+	const float min_instance_pixels = 0.5f;
+	// pixels of radius on screen per level of tessellation, in the manual LOD mode
+	const float pixels_per_tess_level = 12.f;
+	// GPU memory the pages of each streamed mesh may take
+	const size_t cluster_budget_bytes = size_t(256) << 20;
+	// tiles of the terrain kept in its height texture, about 17 MB at 128 x 128 cells a tile
+	const size_t terrain_budget_tiles = 512;
+}
 
-GameManager::GameManager(){
+GameManager::GameManager(const std::string &scene_path) : scene_path(scene_path){
 	fps_timer.restart();
+	programs_reloaded = false;
 
 	render_mode = RENDERMODE_PHONG;
+	aa_mode = AA_MSAA_4X;
 	zoom = 1;
 	LOD = 1.f;
 	near_plane = 0.5f;
@@ -37,6 +53,7 @@ GameManager::GameManager(){
 GameManager::~GameManager(){}
 
 void GameManager::init() {
+	TRACE_SCOPE("GameManager::init");
 	// Initialize SDL
 	if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
 		std::stringstream err;
@@ -49,13 +66,21 @@ void GameManager::init() {
 	iluInit();
 
 	createOpenGLContext();
+	render_device.reset(new GLRenderDevice());
+	gpu_frame_timer.reset(new GLUtils::GPUTimer());
+	gpu_post_timer.reset(new GLUtils::GPUTimer());
+	gpu_shadow_timer.reset(new GLUtils::GPUTimer());
+	latency_monitor.reset(new LatencyMonitor());
 	setOpenGLStates();
 	createMatrices();
 	createSimpleProgram();
 	createVAO();
+	createPostProcessing();
+	createHotReload();
 }
 
 void GameManager::createOpenGLContext(){
+	TRACE_SCOPE("GameManager::createOpenGLContext");
 	//Set OpenGL major an minor versions
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
 	SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
@@ -67,8 +92,9 @@ void GameManager::createOpenGLContext(){
 	SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8); // Use framebuffer with 8 bit for green
 	SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8); // Use framebuffer with 8 bit for blue
 	SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8); // Use framebuffer with 8 bit for alpha
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 1);
-	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 4);
+	// anti-aliasing happens in the offscreen scene target, the window only receives the result
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLEBUFFERS, 0);
+	SDL_GL_SetAttribute(SDL_GL_MULTISAMPLESAMPLES, 0);
 
 	// Initalize video
 	main_window = SDL_CreateWindow("Westerdals - PG6200 Reworked Template", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -94,6 +120,10 @@ void GameManager::createOpenGLContext(){
 	glDebugMessageCallback(GLDEBUGPROC(GLUtils::DebugOutput::myCallback), nullptr);
 	glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
 
+	// compile in the background and reuse the binaries of earlier runs
+	Program::enableParallelCompile();
+	Program::setBinaryCacheDirectory("shaders/cache");
+
 	// Lets do the ugly thing of swallowing the error....
 	glGetError();
 
@@ -115,116 +145,1096 @@ void GameManager::setOpenGLStates(){
 }
 
 void GameManager::createMatrices(){
-	model_matrix = scale(glm::mat4(1.0f), glm::vec3(3));
-
 	camera.projection = glm::perspective(fovy / zoom, window_width / (float)window_height, near_plane, far_plane);
 	camera.view = translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -10.0f));
 
 }
 
 void GameManager::createSimpleProgram(){
+	TRACE_SCOPE("GameManager::createSimpleProgram");
+	scene_programs = createScenePrograms();
+
+	// with background compilation every variant can be started up front,
+	// otherwise they are compiled when first selected
+	if(GLEW_KHR_parallel_shader_compile){
+		scene_programs.phong->prebuildAll();
+		scene_programs.depth->prebuildAll();
+		scene_programs.gbuffer->prebuildAll();
+		scene_programs.deferred_lighting->prebuildAll();
+		scene_programs.impostor->prebuildAll();
+		scene_programs.impostor_gbuffer->prebuildAll();
+		scene_programs.terrain->prebuildAll();
+		scene_programs.terrain_depth->prebuildAll();
+		scene_programs.terrain_gbuffer->prebuildAll();
+	}
+
+	selectProgramVariants(getShaderFeatures());
+	CHECK_GL_ERROR();
+}
+
+GameManager::ScenePrograms GameManager::createScenePrograms() const{
+	ScenePrograms programs;
 	std::string fs_src = readFile("shaders/basic_phong.frag");
 	std::string tcs_src = readFile("shaders/basic_phong.tcs");
 	std::string tes_src = readFile("shaders/basic_phong.tes");
 	std::string vs_src = readFile("shaders/basic_phong.vert");
 
-	program.reset(new Program(vs_src, tcs_src, tes_src, fs_src));
+	// the passes lit by the main light look it up in the shadow map
+	const std::string shadow_src = readFile("shaders/shadow.glsl");
+	const std::vector<std::string> shadow_defines = CascadedShadowMap::getShaderDefines();
 
-	//Set uniforms for the program.
-	program->use();
-	glUniform1i(program->getUniform("diffuse_texture"), DIFFUSE_TEX);
-	glUniform1i(program->getUniform("specular_texture"), SPECULAR_TEX);
-	glUniform1i(program->getUniform("normal_texture"), NORMAL_TEX);
-	CHECK_GL_ERROR();
-	program->disuse();
-	
+	typedef GLUtils::ProgramPermutations::FeatureDefines FeatureDefines;
+	FeatureDefines lod_features;
+	lod_features[FEATURE_DISTANCE_LOD] = "DISTANCE_LOD";
+	lod_features[FEATURE_CURVATURE_LOD] = "CURVATURE_LOD";
+	FeatureDefines phong_features = lod_features;
+	phong_features[FEATURE_LIGHTING] = "LIGHTING";
+	phong_features[FEATURE_DEBUG_BARY] = "DEBUG_BARY";
+	FeatureDefines lighting_features;
+	lighting_features[FEATURE_LIGHTING] = "LIGHTING";
+
+	const GLUtils::ProgramPermutations::Initializer set_material_units = [](Program &program){
+		program.use();
+		glUniform1i(program.getUniform("diffuse_texture"), DIFFUSE_TEX);
+		glUniform1i(program.getUniform("specular_texture"), SPECULAR_TEX);
+		glUniform1i(program.getUniform("normal_texture"), NORMAL_TEX);
+		program.disuse();
+	};
+
+	programs.phong.reset(new GLUtils::ProgramPermutations(phong_features, vs_src, tcs_src, tes_src,
+	                     GLUtils::addDefines(GLUtils::insertAfterVersion(fs_src, shadow_src), shadow_defines),
+	                     set_material_units));
+
+	// shares the tessellation stages so both passes produce identical depths
+	programs.depth.reset(new GLUtils::ProgramPermutations(lod_features, vs_src, tcs_src, tes_src,
+	                                                      readFile("shaders/depth_only.frag")));
+
+	// the deferred path carries the tangent frame instead of the per-light vectors
+	const std::vector<std::string> deferred_defines(1, "DEFERRED");
+	programs.gbuffer.reset(new GLUtils::ProgramPermutations(lod_features,
+	                                                        GLUtils::addDefines(vs_src, deferred_defines),
+	                                                        GLUtils::addDefines(tcs_src, deferred_defines),
+	                                                        GLUtils::addDefines(tes_src, deferred_defines),
+	                                                        readFile("shaders/gbuffer.frag"),
+	                                                        set_material_units));
+
+	std::vector<std::string> lighting_defines = TiledLightCulling::getShaderDefines();
+	lighting_defines.insert(lighting_defines.end(), shadow_defines.begin(), shadow_defines.end());
+	programs.deferred_lighting.reset(new GLUtils::ProgramPermutations(lighting_features,
+	                                 readFile("shaders/fullscreen.vert"),
+	                                 GLUtils::addDefines(GLUtils::insertAfterVersion(
+	                                     readFile("shaders/deferred_lighting.frag"), shadow_src), lighting_defines),
+	                                 [](Program &program){
+		program.use();
+		glUniform1i(program.getUniform("albedo_specular_texture"), 0);
+		glUniform1i(program.getUniform("normal_texture"), 1);
+		glUniform1i(program.getUniform("depth_texture"), 2);
+		program.disuse();
+	}));
+
+	// the distant instances, lit like the models they stand for
+	const std::string impostor_vs_src = GLUtils::addDefines(readFile("shaders/impostor.vert"),
+	                                                        ImpostorAtlas::getShaderDefines());
+	const std::string impostor_fs_src = GLUtils::addDefines(readFile("shaders/impostor.frag"),
+	                                                        ImpostorAtlas::getShaderDefines());
+	const GLUtils::ProgramPermutations::Initializer set_atlas_units = [](Program &program){
+		program.use();
+		glUniform1i(program.getUniform("albedo_texture"), IMPOSTOR_ALBEDO_TEX);
+		glUniform1i(program.getUniform("normal_texture"), IMPOSTOR_NORMAL_TEX);
+		glUniform1i(program.getUniform("depth_texture"), IMPOSTOR_DEPTH_TEX);
+		program.disuse();
+	};
+	programs.impostor.reset(new GLUtils::ProgramPermutations(lighting_features, impostor_vs_src,
+	                        GLUtils::addDefines(GLUtils::insertAfterVersion(impostor_fs_src, shadow_src), shadow_defines),
+	                        set_atlas_units));
+	programs.impostor_gbuffer.reset(new GLUtils::ProgramPermutations(FeatureDefines(), impostor_vs_src,
+	                                GLUtils::addDefines(impostor_fs_src, deferred_defines), set_atlas_units));
+
+	// the terrain has its own tessellation stages, shared by all its passes, and the same outputs as the models
+	const std::vector<std::string> terrain_defines = Terrain::getShaderDefines();
+	const std::string terrain_vs_src = readFile("shaders/terrain.vert");
+	const std::string terrain_tcs_src = GLUtils::addDefines(readFile("shaders/terrain.tcs"), terrain_defines);
+	const std::string terrain_tes_src = GLUtils::addDefines(readFile("shaders/terrain.tes"), terrain_defines);
+	const std::string terrain_fs_src = readFile("shaders/terrain.frag");
+	const GLUtils::ProgramPermutations::Initializer set_height_unit = [](Program &program){
+		program.use();
+		glUniform1i(program.getUniform("height_texture"), TERRAIN_HEIGHT_TEX);
+		program.disuse();
+	};
+	programs.terrain.reset(new GLUtils::ProgramPermutations(lighting_features, terrain_vs_src, terrain_tcs_src,
+	                       terrain_tes_src,
+	                       GLUtils::addDefines(GLUtils::insertAfterVersion(terrain_fs_src, shadow_src), shadow_defines),
+	                       set_height_unit));
+	programs.terrain_depth.reset(new GLUtils::ProgramPermutations(FeatureDefines(), terrain_vs_src, terrain_tcs_src,
+	                             terrain_tes_src, readFile("shaders/depth_only.frag"), set_height_unit));
+	programs.terrain_gbuffer.reset(new GLUtils::ProgramPermutations(FeatureDefines(), terrain_vs_src, terrain_tcs_src,
+	                               terrain_tes_src, GLUtils::addDefines(terrain_fs_src, deferred_defines),
+	                               set_height_unit));
+	return programs;
+}
+
+unsigned int GameManager::getShaderFeatures() const{
+	unsigned int features = 0;
+	if(lighting_enabled)
+		features |= FEATURE_LIGHTING;
+	// the barycentric colors replace the lit shading only
+	if(lighting_enabled && debugSwitch)
+		features |= FEATURE_DEBUG_BARY;
+	if(distance_LOD_enabled)
+		features |= FEATURE_DISTANCE_LOD;
+	if(curvature_LOD_enabled)
+		features |= FEATURE_CURVATURE_LOD;
+	return features;
+}
+
+void GameManager::selectProgramVariants(unsigned int features){
+	program = scene_programs.phong->get(features);
+	depth_program = scene_programs.depth->get(features);
+	gbuffer_program = scene_programs.gbuffer->get(features);
+	deferred_lighting_program = scene_programs.deferred_lighting->get(features);
+	impostor_program = scene_programs.impostor->get(features);
+	impostor_depth_program = scene_programs.impostor->get(0);
+	impostor_gbuffer_program = scene_programs.impostor_gbuffer->get(features);
+	terrain_program = scene_programs.terrain->get(features);
+	terrain_depth_program = scene_programs.terrain_depth->get(features);
+	terrain_gbuffer_program = scene_programs.terrain_gbuffer->get(features);
 }
 
 void GameManager::createVAO(){
-	glGenVertexArrays(1, &main_scene_vao[0]);
-	glBindVertexArray(main_scene_vao[0]);
+	TRACE_SCOPE("GameManager::createVAO");
+	scene.reset(new Scene(scene_path));
+	const std::vector<Scene::ModelDescription> &descriptions = scene->getModels();
+	scene_vaos.resize(descriptions.size());
+	glGenVertexArrays(GLsizei(scene_vaos.size()), scene_vaos.data());
 	CHECK_GL_ERROR();
 
-	// Seperate VBOs
-	model.reset(new Model("models/ico-sphere.obj", false));
-//	model.reset(new Model("models/low_poly_ico_sphere.obj", false));
-	model->getVertices()->bind();
+	// Seperate VBOs, and a VAO, for every model
+	for(unsigned int i = 0; i < descriptions.size(); ++i){
+		const Scene::ModelDescription &description = descriptions[i];
+		std::shared_ptr<Model> model(new Model(description.mesh_path, description.diffuse_map_path,
+		                                       description.normal_map_path, description.specular_map_path, false));
+		models[description.name] = model;
+		scene_bounds_models.push_back(model);
+		scene->setModelBounds(i, model->getBVH()->getMin(), model->getBVH()->getMax());
+		bound_models.push_back(model);
+		bindModelAttributes(i);
+	}
+
+	impostor_bake_program.reset(new Program(readFile("shaders/impostor_bake.vert"), readFile("shaders/impostor_bake.frag")));
+	for(unsigned int i = 0; i < descriptions.size(); ++i)
+		impostor_atlases.push_back(std::make_shared<ImpostorAtlas>(*bound_models[i], scene_vaos[i], *impostor_bake_program));
+
+	// the quad comes from gl_VertexID, only the model matrices are read per instance
+	glGenVertexArrays(1, &impostor_vao);
+	glGenBuffers(1, &impostor_instance_buffer);
+	glBindVertexArray(impostor_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, impostor_instance_buffer);
+	for(GLuint column = 0; column < 4; ++column){
+		glEnableVertexAttribArray(column);
+		glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), BUFFER_OFFSET(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(column, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CHECK_GL_ERROR();
+
+	// only the coarsest clusters of the streamed meshes are loaded here, the rest follows the camera
+	for(const Scene::StreamedMesh &mesh : scene->getStreamedMeshes()){
+		std::shared_ptr<ClusterStreamer> streamer(new ClusterStreamer(mesh.cluster_path, cluster_budget_bytes));
+		ModelBinding binding;
+		binding.vertex_array = streamer->getVertexArray();
+		binding.diffuse_map = Model::loadTexture(mesh.diffuse_map_path);
+		binding.normal_map = Model::loadTexture(mesh.normal_map_path);
+		binding.specular_map = Model::loadTexture(mesh.specular_map_path);
+		cluster_streamers.push_back(streamer);
+		streamed_transforms.push_back(mesh.transform);
+		streamed_bindings.push_back(binding);
+	}
+
+	// likewise, only the tile covering the whole terrain is loaded up front
+	if(scene->hasTerrain()){
+		const Scene::TerrainDescription &description = scene->getTerrain();
+		terrain.reset(new Terrain(description.tile_path, description.position, description.size, description.height,
+		                          terrain_budget_tiles));
+	}
+}
+
+void GameManager::bindModelAttributes(unsigned int model){
+	const std::shared_ptr<Model> &bound_model = bound_models[model];
+	glBindVertexArray(scene_vaos[model]);
+	bound_model->getVertices()->bind();
 	program->setAttributePointer("position", 3);
 	CHECK_GL_ERROR();
-	model->getNormals()->bind();
+	bound_model->getNormals()->bind();
 	program->setAttributePointer("normal", 3);
 	CHECK_GL_ERROR();
-	model->getUVs()->bind();
+	bound_model->getUVs()->bind();
 	program->setAttributePointer("UV", 2);
 	CHECK_GL_ERROR();
 
-	model->getTangents()->bind();
-	program->setAttributePointer("tangent", 3);
+	bound_model->getTangents()->bind();
+	program->setAttributePointer("tangent", 4);
 	CHECK_GL_ERROR();
-	model->getBinormals()->bind();
-	program->setAttributePointer("binormal", 3);
+	bound_model->getEdgeCurvatures()->bind();
+	program->setAttributePointer("edge_curvature", 1);
 	CHECK_GL_ERROR();
 
 	glBindVertexArray(0);
 	CHECK_GL_ERROR();
 }
 
+void GameManager::createHotReload(){
+	TRACE_SCOPE("GameManager::createHotReload");
+	hot_reloader.reset(new HotReloader(main_window, main_context));
 
-void GameManager::renderMeshRecursive(MeshPart &mesh, const std::shared_ptr<Program> &program,
-                                      const glm::mat4 &view_matrix, const glm::mat4 &model_matrix,
-                                      glm::mat4 &projection_matrix){
-	//Create modelview matrix
-	const glm::mat4 meshpart_model_matrix = model_matrix * mesh.transform;
-	glm::mat4 model_view_mat = view_matrix * meshpart_model_matrix;
-	glm::mat3 model_view_mat_3x3 = glm::mat3(model_view_mat);
-	
-	//3x3 leading submatrix of the modelview matrix for the TBN matrix in the vertex shader
-	glm::mat3 normal_matrix = transpose(inverse(glm::mat3(model_view_mat)));
+	std::vector<std::string> shader_files;
+	shader_files.push_back("shaders/basic_phong.vert");
+	shader_files.push_back("shaders/basic_phong.tcs");
+	shader_files.push_back("shaders/basic_phong.tes");
+	shader_files.push_back("shaders/basic_phong.frag");
+	shader_files.push_back("shaders/depth_only.frag");
+	shader_files.push_back("shaders/gbuffer.frag");
+	shader_files.push_back("shaders/shadow.glsl");
+	shader_files.push_back("shaders/fullscreen.vert");
+	shader_files.push_back("shaders/deferred_lighting.frag");
+	shader_files.push_back("shaders/impostor.vert");
+	shader_files.push_back("shaders/impostor.frag");
+	shader_files.push_back("shaders/terrain.vert");
+	shader_files.push_back("shaders/terrain.tcs");
+	shader_files.push_back("shaders/terrain.tes");
+	shader_files.push_back("shaders/terrain.frag");
+	hot_reloader->watch(shader_files, [this](){
+		// every variant is compiled and checked here, so a broken save never reaches the render loop
+		ScenePrograms programs = createScenePrograms();
+		programs.phong->buildAll();
+		programs.depth->buildAll();
+		programs.gbuffer->buildAll();
+		programs.deferred_lighting->buildAll();
+		programs.impostor->buildAll();
+		programs.impostor_gbuffer->buildAll();
+		programs.terrain->buildAll();
+		programs.terrain_depth->buildAll();
+		programs.terrain_gbuffer->buildAll();
+		return HotReloader::Commit([this, programs](){
+			scene_programs = programs;
+			programs_reloaded = true;
+			std::cout << "Shaders reloaded" << std::endl;
+		});
+	});
+
+	for(const Scene::ModelDescription &description : scene->getModels()){
+		std::vector<std::string> model_files;
+		model_files.push_back(description.mesh_path);
+		model_files.push_back(description.diffuse_map_path);
+		model_files.push_back(description.normal_map_path);
+		model_files.push_back(description.specular_map_path);
+		hot_reloader->watch(model_files, [this, description](){
+			std::shared_ptr<Model> new_model(new Model(description.mesh_path, description.diffuse_map_path,
+			                                           description.normal_map_path, description.specular_map_path, false));
+			return HotReloader::Commit([this, description, new_model](){
+				// picked up by the next snapshot, which also moves the instances to the new bounds,
+				// the render thread rebinds the vertex arrays once a frame drawing it comes through
+				std::atomic_store(&models.at(description.name), new_model);
+				std::cout << "Model " << description.name << " reloaded" << std::endl;
+			});
+		});
+	}
+
+	hot_reloader->start();
+}
+
+void GameManager::createPostProcessing(){
+	TRACE_SCOPE("GameManager::createPostProcessing");
+	// allocated at full size, lower resolutions only render to a part of them
+	createSceneTarget(aa_mode);
+	resolve_fbo.reset(new GLUtils::FBO(window_width, window_height));
+	gbuffer.reset(new GLUtils::GBuffer(window_width, window_height));
+	post_fbo.reset(new GLUtils::FBO(window_width, window_height));
+
+	upscale_program.reset(new Program(readFile("shaders/fullscreen.vert"), readFile("shaders/upscale.frag")));
+	fxaa_program.reset(new Program(readFile("shaders/fullscreen.vert"), readFile("shaders/fxaa.frag")));
+
+	upscale_program->use();
+	glUniform1i(upscale_program->getUniform("source_texture"), 0);
+	upscale_program->disuse();
+
+	fxaa_program->use();
+	glUniform1i(fxaa_program->getUniform("source_texture"), 0);
+	fxaa_program->disuse();
+
+	glGenVertexArrays(1, &fullscreen_vao);
+
+	hiz_culling.reset(new HiZCulling(window_width, window_height));
+	light_culling.reset(new TiledLightCulling(window_width, window_height));
+	shadow_map.reset(new CascadedShadowMap(2048));
+	createPointLights(point_light_count);
+	CHECK_GL_ERROR();
+}
+
+void GameManager::createPointLights(unsigned int count){
+	// fixed seed, the same count always gives the same lights
+	std::mt19937 generator(1234);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+
+	point_lights.resize(count);
+	for(TiledLightCulling::PointLight &point_light : point_lights){
+		const float angle = unit(generator) * 2.f * glm::pi<float>();
+		const float height = unit(generator) * 2.f - 1.f;
+		const float distance = 2.f + unit(generator) * 2.f;
+		const float ring = std::sqrt(1.f - height * height);
+		const glm::vec3 position = distance * glm::vec3(ring * std::cos(angle), height, ring * std::sin(angle));
+
+		point_light.position_radius = glm::vec4(position, 1.f + unit(generator) * 1.5f);
+		point_light.color = glm::vec4(unit(generator), unit(generator), unit(generator), 1.f);
+	}
+}
+
+void GameManager::createSceneTarget(AntiAliasingMode mode){
+	scene_fbo_mode = mode;
+	scene_fbo.reset(new GLUtils::FBO(window_width, window_height, getSampleCount(mode)));
+	CHECK_GL_ERROR();
+}
+
+unsigned int GameManager::getSampleCount(AntiAliasingMode mode){
+	switch(mode){
+		case AA_MSAA_2X:
+			return 2;
+		case AA_MSAA_4X:
+			return 4;
+		case AA_MSAA_8X:
+			return 8;
+		default:
+			return 1;
+	}
+}
+
+const char *GameManager::getAntiAliasingModeName(AntiAliasingMode mode){
+	switch(mode){
+		case AA_OFF:
+			return "off";
+		case AA_MSAA_2X:
+			return "MSAA 2x";
+		case AA_MSAA_4X:
+			return "MSAA 4x";
+		case AA_MSAA_8X:
+			return "MSAA 8x";
+		case AA_FXAA:
+			return "FXAA";
+		default:
+			THROW_EXCEPTION("Anti-aliasing mode not supported");
+	}
+}
+
+const char *GameManager::getSwapIntervalName(int swap_interval){
+	switch(swap_interval){
+		case 0:
+			return "off";
+		case 1:
+			return "vsync";
+		case -1:
+			return "adaptive vsync";
+		default:
+			THROW_EXCEPTION("Swap interval not supported");
+	}
+}
+
+void GameManager::applySwapInterval(int swap_interval){
+	applied_swap_interval = swap_interval;
+	if(SDL_GL_SetSwapInterval(swap_interval) == 0)
+		return;
+
+	if(swap_interval == -1 && SDL_GL_SetSwapInterval(1) == 0){
+		std::cout << "Adaptive vsync is not supported, using vsync" << std::endl;
+		return;
+	}
+	std::cout << "Could not set the swap interval: " << SDL_GetError() << std::endl;
+}
+
+void GameManager::renderDeferredLighting(const FrameSnapshot &frame){
+	const float resolution_scale = frame.resolution_scale;
+	if(frame.lighting_enabled){
+		// light 0 is the main light, far enough reaching to light every tile
+		const std::vector<TiledLightCulling::PointLight> &point_lights = frame.point_lights;
+		std::vector<TiledLightCulling::PointLight> lights(1 + point_lights.size());
+		lights[0].position_radius = glm::vec4(frame.light_position, 1e6f);
+		lights[0].color = glm::vec4(1.f);
+		for(size_t i = 0; i < point_lights.size(); ++i){
+			const glm::vec4 &world = point_lights[i].position_radius;
+			lights[i + 1].position_radius = glm::vec4(glm::vec3(frame.view * glm::vec4(glm::vec3(world), 1.f)), world.w);
+			lights[i + 1].color = point_lights[i].color;
+		}
+
+		light_culling->cull(lights, gbuffer->getDepthTexture(),
+		                    GLuint(window_width * resolution_scale), GLuint(window_height * resolution_scale),
+		                    frame.projection);
+	}
+
+	// the lighting pass also copies the G-buffer depth into the scene target
+	glDepthFunc(GL_ALWAYS);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	deferred_lighting_program->use();
+	glUniformMatrix4fv(deferred_lighting_program->getUniform("inv_proj_mat"), 1, 0,
+	                   value_ptr(inverse(frame.projection)));
+	glUniform1ui(deferred_lighting_program->getUniform("tiles_x"), light_culling->getTileCountX());
+	glUniform4f(deferred_lighting_program->getUniform("clear_color"), 0.5f, 0.5f, 0.5f, 1.f);
+	glUniform2f(deferred_lighting_program->getUniform("source_scale"), resolution_scale, resolution_scale);
+	if(frame.lighting_enabled)
+		setShadowUniforms(deferred_lighting_program, frame);
+
+	gbuffer->bindTextures(0);
+	light_culling->bindBuffers();
+	glBindVertexArray(fullscreen_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	TiledLightCulling::unbindBuffers();
+	deferred_lighting_program->disuse();
+
+	glDepthFunc(GL_LEQUAL);
+}
 
+void GameManager::drawFullscreenPass(const std::shared_ptr<Program> &program, GLuint source_texture,
+                                     float source_scale){
 	program->use();
+	glUniform2f(program->getUniform("source_scale"), source_scale, source_scale);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, source_texture);
+	glBindVertexArray(fullscreen_vao);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	program->disuse();
+}
+
+void GameManager::postProcess(const FrameSnapshot &frame){
+	const float resolution_scale = frame.resolution_scale;
+	const GLsizei width = GLsizei(window_width * resolution_scale);
+	const GLsizei height = GLsizei(window_height * resolution_scale);
+	const bool upscaling = width != window_width || height != window_height;
+
+	glDisable(GL_DEPTH_TEST);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	// a multisampled target at full resolution is resolved straight into the window
+	if(!upscaling && frame.aa_mode != AA_FXAA){
+		scene_fbo->blitTo(nullptr, width, height, window_width, window_height);
+		glEnable(GL_DEPTH_TEST);
+		return;
+	}
+
+	// the fullscreen passes need a texture to sample
+	GLUtils::FBO *source = scene_fbo.get();
+	if(source->isMultisampled()){
+		source->blitTo(resolve_fbo.get(), width, height, width, height);
+		source = resolve_fbo.get();
+	}
+
+	if(frame.aa_mode == AA_FXAA && upscaling){
+		post_fbo->bind();
+		glViewport(0, 0, width, height);
+		drawFullscreenPass(fxaa_program, source->getColorTexture(), resolution_scale);
+		source = post_fbo.get();
+	}
+
+	GLUtils::FBO::unbind();
+	glViewport(0, 0, window_width, window_height);
+	if(upscaling){
+		upscale_program->use();
+		// sharpen more the more we stretch, up to 0.25 at half resolution
+		glUniform1f(upscale_program->getUniform("sharpness"), 0.5f * (1.f - resolution_scale));
+		drawFullscreenPass(upscale_program, source->getColorTexture(), resolution_scale);
+	}
+	else{
+		drawFullscreenPass(fxaa_program, source->getColorTexture(), 1.f);
+	}
 
-	glUniformMatrix4fv(program->getUniform("model_view_mat"), 1, 0, value_ptr(model_view_mat));
-	glUniformMatrix4fv(program->getUniform("model_mat"), 1, 0, value_ptr(meshpart_model_matrix));
-	glUniformMatrix3fv(program->getUniform("model_view_mat_3x3"), 1, 0, value_ptr(model_view_mat_3x3));
-	glUniformMatrix4fv(program->getUniform("proj_mat"), 1, 0, value_ptr(projection_matrix));
-	glUniformMatrix3fv(program->getUniform("normal_mat"), 1, 0, value_ptr(normal_matrix));
-	// glm::mat4 view_projection_matrix =  projection_matrix * view_matrix;
-	// glUniformMatrix4fv(program->getUniform("view_proj_mat"), 1, 0, value_ptr(view_projection_matrix));
+	glEnable(GL_DEPTH_TEST);
+}
 
-	glDrawArrays(GL_PATCHES, mesh.first, mesh.count);
+void GameManager::collectInstanceDraws(const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix,
+                                       const std::vector<const MeshPart *> &meshes, const std::vector<uint32_t> &instances,
+                                       std::vector<DrawItem> &draw_list, std::vector<ImpostorDraw> *impostor_list) const{
+	const std::vector<Scene::Instance> &scene_instances = scene->getInstances();
+	// radius on screen of a unit sphere at unit distance
+	const float pixels_per_unit = projection_matrix[1][1] * window_height * 0.5f;
+	for(uint32_t index : instances){
+		const Scene::Instance &instance = scene_instances[index];
+		const glm::vec3 center = (instance.min_dim + instance.max_dim) * 0.5f;
+		const float radius = glm::length(instance.max_dim - instance.min_dim) * 0.5f;
+		const float distance = max(glm::length(glm::vec3(view_matrix * glm::vec4(center, 1.f))), near_plane);
+		const float projected_radius = radius * pixels_per_unit / distance;
+		if(projected_radius < min_instance_pixels)
+			continue;
+
+		// the pictures of the atlas look the same as the model from far enough
+		if(impostor_list && impostor_distance > 0.f && distance > impostor_distance * radius){
+			ImpostorDraw impostor;
+			impostor.model = instance.model;
+			impostor.model_matrix = instance.transform;
+			impostor_list->push_back(impostor);
+			continue;
+		}
+
+		// the manual LOD is the most any instance gets, the ones further away get less
+		const float tess_level = glm::clamp(projected_radius / pixels_per_tess_level, 1.f, LOD);
+		collectDrawsRecursive(*meshes[instance.model], view_matrix, instance.transform,
+		                      instance.model, tess_level, draw_list);
+	}
+}
+
+bool GameManager::isDrawnBefore(const DrawItem &a, const DrawItem &b){
+	return a.model != b.model ? a.model < b.model : a.view_distance < b.view_distance;
+}
+
+void GameManager::collectDrawsRecursive(const MeshPart &mesh, const glm::mat4 &view_matrix,
+                                        const glm::mat4 &model_matrix, unsigned int model, float tess_level,
+                                        std::vector<DrawItem> &draw_list){
+	const glm::mat4 meshpart_model_matrix = model_matrix * mesh.transform;
+
+	if(mesh.count > 0){
+		const glm::vec3 center = (mesh.min_dim + mesh.max_dim) * 0.5f;
+		DrawItem item;
+		item.model = model;
+		item.first = mesh.first;
+		item.count = mesh.count;
+		item.model_matrix = meshpart_model_matrix;
+		item.min_dim = mesh.min_dim;
+		item.max_dim = mesh.max_dim;
+		item.view_distance = glm::length(glm::vec3(view_matrix * meshpart_model_matrix * glm::vec4(center, 1.f)));
+		item.tess_level = tess_level;
+		draw_list.push_back(item);
+	}
 
 	for(int i = 0; i < (int)mesh.children.size(); ++i)
-		renderMeshRecursive(mesh.children.at(i), program, view_matrix, meshpart_model_matrix, projection_matrix);
+		collectDrawsRecursive(mesh.children.at(i), view_matrix, meshpart_model_matrix, model, tess_level, draw_list);
+}
 
-	program->disuse();
+void GameManager::collectClusterDraws(const FrameSnapshot &frame, float viewport_height){
+	cluster_draw_list.clear();
+	cluster_shadow_draw_list.clear();
+	const bool shadows = frame.shadows_enabled && frame.lighting_enabled;
+	size_t resident_pages = 0, pending_pages = 0;
+	for(unsigned int s = 0; s < cluster_streamers.size(); ++s){
+		const glm::mat4 &model_matrix = streamed_transforms[s];
+		const glm::mat4 model_view = frame.view * model_matrix;
+		cluster_draws.clear();
+		cluster_shadow_draws.clear();
+		// the shadows take the cut of the main view, unculled, and so page in nothing of their own
+		cluster_streamers[s]->update(model_view, frame.projection, viewport_height, frame.cluster_error_pixels,
+		                             cluster_draws, shadows ? &cluster_shadow_draws : nullptr);
+		resident_pages += cluster_streamers[s]->getResidentPageCount();
+		pending_pages += cluster_streamers[s]->getPendingPageCount();
+
+		// the streamed meshes are bound after the models of the frame
+		const unsigned int model = (unsigned int) (frame.models.size() + s);
+		auto append = [&](const std::vector<ClusterStreamer::Draw> &draws, std::vector<DrawItem> &draw_list){
+			for(const ClusterStreamer::Draw &draw : draws){
+				const glm::vec3 center(draw.bounds);
+				DrawItem item;
+				item.model = model;
+				item.first = (unsigned int) draw.first;
+				item.count = (unsigned int) draw.count;
+				item.model_matrix = model_matrix;
+				item.min_dim = center - glm::vec3(draw.bounds.w);
+				item.max_dim = center + glm::vec3(draw.bounds.w);
+				item.view_distance = glm::length(glm::vec3(model_view * glm::vec4(center, 1.f)));
+				// the clusters already carry the detail, tessellation would only add to it
+				item.tess_level = 1.f;
+				draw_list.push_back(item);
+			}
+		};
+		append(cluster_draws, cluster_draw_list);
+		append(cluster_shadow_draws, cluster_shadow_draw_list);
+	}
+	std::sort(cluster_draw_list.begin(), cluster_draw_list.end(), isDrawnBefore);
+
+	TRACE_COUNTER("clusters", double(cluster_draw_list.size()));
+	TRACE_COUNTER("resident cluster pages", double(resident_pages));
+	TRACE_COUNTER("pending cluster pages", double(pending_pages));
 }
 
+void GameManager::setFrameUniforms(const std::shared_ptr<Program> &program, const FrameSnapshot &frame){
+	program->waitForLink();
+	render_device->useProgram(program->name);
+	render_device->setUniform(program->getUniform("light_position"), frame.light_position);
+	render_device->setUniform(program->getUniform("TessScale"), frame.tess_scale);
+	render_device->setUniform(program->getUniform("LODBias"), static_cast<float>(frame.lod_bias));
+	render_device->setUniform(program->getUniform("eyeOrigin"), glm::vec3(0.f));
+}
+
+void GameManager::renderShadowMaps(const FrameSnapshot &frame){
+	// the main light is given in camera space, it shines towards the model at the origin
+	const glm::mat4 inverse_view = inverse(frame.view);
+	const glm::vec3 light_direction = glm::vec3(inverse_view * glm::vec4(frame.light_position, 1.f));
+	const float fovy = 2.f * std::atan(1.f / frame.projection[1][1]);
+	const float aspect = frame.projection[1][1] / frame.projection[0][0];
+	shadow_map->update(frame.view, fovy, aspect, near_plane, far_plane, light_direction);
+
+	setFrameUniforms(depth_program, frame);
+	// the cheaper LOD policy: the level the main view would pick, scaled down
+	render_device->setUniform(depth_program->getUniform("TessScale"), frame.tess_scale * frame.shadow_lod_scale);
+
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	render_device->setPolygonOffset(2.f, 4.f);
+	for(unsigned int i = 0; i < CascadedShadowMap::cascade_count; ++i){
+		const glm::mat4 &light_view = shadow_map->getLightView(i);
+		// distance based LOD keeps measuring from the main camera
+		const glm::vec3 eye = glm::vec3(light_view * inverse_view * glm::vec4(0.f, 0.f, 0.f, 1.f));
+		render_device->useProgram(depth_program->name);
+		render_device->setUniform(depth_program->getUniform("eyeOrigin"), eye);
+
+		shadow_map->bindCascade(i);
+		// casters outside the main view still cast shadows, so no GPU culling here
+		renderDrawList(depth_program, frame, frame.shadow_draw_list, light_view, shadow_map->getLightProjection(i), false);
+		renderDrawList(depth_program, frame, cluster_shadow_draw_list, light_view, shadow_map->getLightProjection(i), false);
+		// the impostors turn towards the light camera and cast the outline it sees
+		renderImpostorList(impostor_depth_program, frame.shadow_impostor_list, GLuint(frame.impostor_list.size()),
+		                   light_view, shadow_map->getLightProjection(i));
+		if(terrain)
+			renderTerrain(terrain_depth_program, frame, GLuint(terrain->getNodeCount()), terrain->getShadowNodeCount(),
+			              light_view, shadow_map->getLightProjection(i));
+	}
+	render_device->setPolygonOffset(0.f, 0.f);
+	CascadedShadowMap::unbind();
+}
+
+void GameManager::setShadowUniforms(const std::shared_ptr<Program> &program, const FrameSnapshot &frame){
+	render_device->bindTexture(SHADOW_TEX, GL_TEXTURE_2D_ARRAY, shadow_map->getTexture());
+
+	float splits[CascadedShadowMap::cascade_count];
+	glm::mat4 shadow_matrices[CascadedShadowMap::cascade_count];
+	for(unsigned int i = 0; i < CascadedShadowMap::cascade_count; ++i){
+		splits[i] = shadow_map->getSplitDistance(i);
+		shadow_matrices[i] = shadow_map->getShadowMatrix(i);
+	}
+
+	render_device->setUniform(program->getUniform("shadows_enabled"), frame.shadows_enabled ? 1 : 0);
+	render_device->setUniform(program->getUniform("shadow_map"), int(SHADOW_TEX));
+	render_device->setUniform(program->getUniform("shadow_mat"), shadow_matrices, CascadedShadowMap::cascade_count);
+	render_device->setUniform(program->getUniform("shadow_split"), splits, CascadedShadowMap::cascade_count);
+	render_device->setUniform(program->getUniform("shadow_bias"), 0.0005f);
+}
+
+void GameManager::cullDrawList(const FrameSnapshot &frame){
+	const std::vector<DrawItem> &draw_list = frame.draw_list;
+	std::vector<HiZCulling::DrawArraysIndirectCommand> commands(draw_list.size());
+	std::vector<HiZCulling::Bounds> bounds(draw_list.size());
+	for(size_t i = 0; i < draw_list.size(); ++i){
+		commands[i].count = draw_list[i].count;
+		commands[i].instance_count = 1;
+		commands[i].first = draw_list[i].first;
+		commands[i].base_instance = 0;
+
+		bounds[i].model_matrix = draw_list[i].model_matrix;
+		bounds[i].min_dim = glm::vec4(draw_list[i].min_dim, 1.f);
+		bounds[i].max_dim = glm::vec4(draw_list[i].max_dim, 1.f);
+	}
+	hiz_culling->cull(commands, bounds, frame.projection * frame.view);
+}
+
+void GameManager::buildDepthPyramid(GLsizei width, GLsizei height){
+	// multisampled depth has to be resolved before it can be read
+	GLuint depth_texture = scene_fbo->getDepthTexture();
+	if(scene_fbo->isMultisampled()){
+		scene_fbo->blitDepthTo(resolve_fbo.get(), width, height);
+		depth_texture = resolve_fbo->getDepthTexture();
+	}
+	hiz_culling->buildPyramid(depth_texture, width, height);
+}
+
+void GameManager::renderDrawList(const std::shared_ptr<Program> &program, const FrameSnapshot &frame,
+                                 const std::vector<DrawItem> &draw_list, const glm::mat4 &view_matrix,
+                                 const glm::mat4 &projection_matrix, bool gpu_culled){
+	const bool indirect = gpu_culled && frame.occlusion_culling_enabled;
+	const DrawUniforms uniforms = getDrawUniforms(*program);
+
+	if(indirect)
+		hiz_culling->bindIndirectBuffer();
+
+	submitDrawList(*render_device, program->name, uniforms, model_bindings, draw_list, view_matrix,
+	               projection_matrix, indirect);
+
+	if(indirect)
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+GameManager::DrawUniforms GameManager::getDrawUniforms(Program &program){
+	DrawUniforms uniforms;
+	uniforms.proj_mat = program.getUniform("proj_mat");
+	uniforms.model_view_mat = program.getUniform("model_view_mat");
+	uniforms.model_mat = program.getUniform("model_mat");
+	uniforms.model_view_mat_3x3 = program.getUniform("model_view_mat_3x3");
+	uniforms.normal_mat = program.getUniform("normal_mat");
+	uniforms.tess_level = program.getUniform("TessLevel");
+	return uniforms;
+}
+
+void GameManager::submitDrawList(RenderDevice &device, GLuint program, const DrawUniforms &uniforms,
+                                 const std::vector<ModelBinding> &models, const std::vector<DrawItem> &draw_list,
+                                 const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix, bool indirect){
+	device.useProgram(program);
+	device.setUniform(uniforms.proj_mat, projection_matrix);
+
+	unsigned int bound_model = ~0u;
+	float tess_level = -1.f;
+	for(size_t i = 0; i < draw_list.size(); ++i){
+		const DrawItem &item = draw_list[i];
+		// the draws of a model come one after the other
+		if(item.model != bound_model){
+			bound_model = item.model;
+			const ModelBinding &binding = models[bound_model];
+			device.bindVertexArray(binding.vertex_array);
+			device.bindTexture(DIFFUSE_TEX, GL_TEXTURE_2D, binding.diffuse_map);
+			device.bindTexture(SPECULAR_TEX, GL_TEXTURE_2D, binding.specular_map);
+			device.bindTexture(NORMAL_TEX, GL_TEXTURE_2D, binding.normal_map);
+		}
+
+		//Create modelview matrix
+		const glm::mat4 model_view_mat = view_matrix * item.model_matrix;
+		const glm::mat3 model_view_mat_3x3 = glm::mat3(model_view_mat);
 
+		//3x3 leading submatrix of the modelview matrix for the TBN matrix in the vertex shader
+		const glm::mat3 normal_matrix = transpose(inverse(glm::mat3(model_view_mat)));
 
-void GameManager::render(){
+		device.setUniform(uniforms.model_view_mat, model_view_mat);
+		device.setUniform(uniforms.model_mat, item.model_matrix);
+		device.setUniform(uniforms.model_view_mat_3x3, model_view_mat_3x3);
+		device.setUniform(uniforms.normal_mat, normal_matrix);
+		// the instances of a grid mostly share their level
+		if(item.tess_level != tess_level){
+			tess_level = item.tess_level;
+			device.setUniform(uniforms.tess_level, tess_level);
+		}
+
+		if(indirect)
+			device.drawArraysIndirect(GL_PATCHES, i * sizeof(HiZCulling::DrawArraysIndirectCommand));
+		else
+			device.drawArrays(GL_PATCHES, item.first, item.count);
+	}
+
+	device.useProgram(0);
+}
+
+GameManager::ImpostorUniforms GameManager::getImpostorUniforms(Program &program){
+	ImpostorUniforms uniforms;
+	uniforms.proj_mat = program.getUniform("proj_mat");
+	uniforms.view_mat = program.getUniform("view_mat");
+	uniforms.center = program.getUniform("impostor_center");
+	uniforms.radius = program.getUniform("impostor_radius");
+	return uniforms;
+}
+
+void GameManager::renderImpostorList(const std::shared_ptr<Program> &program,
+                                     const std::vector<ImpostorDraw> &impostor_list, GLuint base_instance,
+                                     const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix){
+	if(impostor_list.empty())
+		return;
+	submitImpostorList(*render_device, program->name, getImpostorUniforms(*program), impostor_vao, impostor_bindings,
+	                   impostor_list, base_instance, view_matrix, projection_matrix);
+}
+
+void GameManager::submitImpostorList(RenderDevice &device, GLuint program, const ImpostorUniforms &uniforms,
+                                     GLuint vertex_array, const std::vector<ImpostorBinding> &bindings,
+                                     const std::vector<ImpostorDraw> &impostor_list, GLuint base_instance,
+                                     const glm::mat4 &view_matrix, const glm::mat4 &projection_matrix){
+	device.useProgram(program);
+	device.setUniform(uniforms.proj_mat, projection_matrix);
+	device.setUniform(uniforms.view_mat, view_matrix);
+	device.bindVertexArray(vertex_array);
+
+	size_t first = 0;
+	while(first < impostor_list.size()){
+		// the instances of a model come one after the other and share a single draw
+		const unsigned int model = impostor_list[first].model;
+		size_t end = first + 1;
+		while(end < impostor_list.size() && impostor_list[end].model == model)
+			++end;
+
+		const ImpostorBinding &binding = bindings[model];
+		device.bindTexture(IMPOSTOR_ALBEDO_TEX, GL_TEXTURE_2D, binding.albedo_map);
+		device.bindTexture(IMPOSTOR_NORMAL_TEX, GL_TEXTURE_2D, binding.normal_map);
+		device.bindTexture(IMPOSTOR_DEPTH_TEX, GL_TEXTURE_2D, binding.depth_map);
+		device.setUniform(uniforms.center, binding.center);
+		device.setUniform(uniforms.radius, binding.radius);
+		device.drawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(end - first), base_instance + GLuint(first));
+		first = end;
+	}
+
+	device.useProgram(0);
+}
+
+void GameManager::renderTerrain(const std::shared_ptr<Program> &program, const FrameSnapshot &frame,
+                                GLuint first_node, size_t node_count, const glm::mat4 &view_matrix,
+                                const glm::mat4 &projection_matrix){
+	if(node_count == 0)
+		return;
+	program->waitForLink();
+	const glm::vec3 camera_position = glm::vec3(inverse(frame.view)[3]);
+	const std::vector<glm::vec2> &morph_ranges = terrain->getMorphRanges();
+	render_device->useProgram(program->name);
+	render_device->setUniform(program->getUniform("camera_position"), camera_position);
+	render_device->setUniform(program->getUniform("height_range"), terrain->getHeightRange());
+	render_device->setUniform(program->getUniform("tile_resolution"), float(terrain->getTileResolution()));
+	render_device->setUniform(program->getUniform("morph_ranges"), &morph_ranges[0], GLsizei(morph_ranges.size()));
+
+	// a node is a quad patch, where the models draw triangle patches
+	render_device->setPatchVertices(4);
+	render_device->setUniform(program->getUniform("proj_mat"), projection_matrix);
+	render_device->setUniform(program->getUniform("view_mat"), view_matrix);
+	render_device->bindVertexArray(terrain->getVertexArray());
+	render_device->bindTexture(TERRAIN_HEIGHT_TEX, GL_TEXTURE_2D_ARRAY, terrain->getHeightTexture());
+	render_device->drawArraysInstanced(GL_PATCHES, 0, 4, GLsizei(node_count), first_node);
+	render_device->useProgram(0);
+	render_device->setPatchVertices(3);
+}
+
+void GameManager::animate(){
 	const float elapsed = fps_timer.elapsedAndRestart();
 
 	const glm::mat4 rotation = rotate(elapsed, glm::vec3(0.0f, 1.0f, 0.0f));
 	light.position = glm::mat3(rotation) * light.position;
+	for(TiledLightCulling::PointLight &point_light : point_lights){
+		const glm::vec3 position = glm::mat3(rotation) * glm::vec3(point_light.position_radius);
+		point_light.position_radius = glm::vec4(position, point_light.position_radius.w);
+	}
+	scene->animate(elapsed);
 
-	const glm::mat4 view = camera.view * cam_trackball.getTransform();
+	// the wireframe is always drawn lit
+	if(render_mode == RENDERMODE_WIREFRAME)
+		lighting_enabled = true;
+}
+
+void GameManager::fillFrameSnapshot(FrameSnapshot &frame){
+	TRACE_SCOPE("GameManager::fillFrameSnapshot");
+	frame.view = camera.view * cam_trackball.getTransform();
+	frame.projection = camera.projection;
+	frame.light_position = light.position;
+	frame.point_lights = point_lights;
+	frame.tess_scale = lod_governor.getTessellationScale();
+	frame.lod_bias = lod_governor.getLODBias();
+	frame.shadow_lod_scale = shadow_lod_scale;
+	frame.cluster_error_pixels = cluster_error_pixels;
+	frame.terrain_detail = terrain_detail;
+	frame.resolution_scale = dynamic_resolution.getScale();
+	frame.render_mode = render_mode;
+	frame.aa_mode = aa_mode;
+	frame.swap_interval = swap_interval;
+	frame.shader_features = getShaderFeatures();
+	frame.lighting_enabled = lighting_enabled;
+	frame.depth_prepass_enabled = depth_prepass_enabled;
+	frame.occlusion_culling_enabled = occlusion_culling_enabled;
+	frame.deferred_enabled = deferred_enabled;
+	frame.shadows_enabled = shadows_enabled;
+
+	const std::vector<Scene::ModelDescription> &descriptions = scene->getModels();
+	frame.models.resize(descriptions.size());
+	scene_meshes.resize(descriptions.size());
+	for(unsigned int i = 0; i < descriptions.size(); ++i){
+		frame.models[i] = std::atomic_load(&models.at(descriptions[i].name));
+		scene_meshes[i] = &frame.models[i]->getMesh();
+		// a reloaded mesh can have other bounds, which moves its instances in the octree
+		if(frame.models[i] != scene_bounds_models[i]){
+			scene_bounds_models[i] = frame.models[i];
+			scene->setModelBounds(i, frame.models[i]->getBVH()->getMin(), frame.models[i]->getBVH()->getMax());
+		}
+	}
+
+	// the instances the octree finds in the view frustum
+	const glm::mat4 view_projection = frame.projection * frame.view;
+	visible_instances.clear();
+	scene->queryVisible(view_projection, visible_instances);
+	TRACE_COUNTER("visible instances", double(visible_instances.size()));
+	frame.draw_list.clear();
+	frame.impostor_list.clear();
+	collectInstanceDraws(frame.view, frame.projection, scene_meshes, visible_instances, frame.draw_list,
+	                     &frame.impostor_list);
+	std::sort(frame.draw_list.begin(), frame.draw_list.end(), isDrawnBefore);
+	std::sort(frame.impostor_list.begin(), frame.impostor_list.end(), [](const ImpostorDraw &a, const ImpostorDraw &b){
+		return a.model < b.model;
+	});
+
+	// instances outside the view can still shadow it, so the octree sweeps their boxes along the light
+	frame.shadow_draw_list.clear();
+	frame.shadow_impostor_list.clear();
+	if(frame.shadows_enabled && frame.lighting_enabled){
+		const glm::vec3 light_position = glm::vec3(glm::inverse(frame.view) * glm::vec4(frame.light_position, 1.f));
+		visible_instances.clear();
+		scene->queryShadowCasters(view_projection, -light_position, visible_instances);
+		collectInstanceDraws(frame.view, frame.projection, scene_meshes, visible_instances, frame.shadow_draw_list,
+		                     &frame.shadow_impostor_list);
+		std::sort(frame.shadow_draw_list.begin(), frame.shadow_draw_list.end(), [](const DrawItem &a, const DrawItem &b){
+			return a.model < b.model;
+		});
+		std::sort(frame.shadow_impostor_list.begin(), frame.shadow_impostor_list.end(),
+		          [](const ImpostorDraw &a, const ImpostorDraw &b){
+			return a.model < b.model;
+		});
+	}
+}
+
+void GameManager::renderLoop(){
+	Trace::setThreadName("render");
+	try{
+		SDL_GL_MakeCurrent(main_window, main_context);
+
+		Timer submit_timer;
+		while(const FrameSnapshot *frame = frame_queue.beginRead()){
+			TRACE_SCOPE("render frame");
+			if(frame->swap_interval != applied_swap_interval)
+				applySwapInterval(frame->swap_interval);
+
+			submit_timer.restart();
+			render(*frame);
+			const double submit_ms = submit_timer.elapsed() * 1000.0;
+			const double input_time = frame->input_time;
+			// everything the frame needs is in the command stream by now
+			frame_queue.endRead();
+
+			{
+				TRACE_SCOPE("SDL_GL_SwapWindow");
+				SDL_GL_SwapWindow(main_window);
+			}
+			latency_monitor->frameSwapped(input_time);
+			latency_monitor->collect();
+
+			std::lock_guard<std::mutex> lock(timings_mutex);
+			last_timings.submit_ms = submit_ms;
+			last_timings.gpu_ms = gpu_frame_timer->elapsedMilliseconds();
+			last_timings.gpu_shadow_ms = gpu_shadow_timer->elapsedMilliseconds();
+			last_timings.gpu_post_ms = gpu_post_timer->elapsedMilliseconds();
+			timings_pending = true;
+		}
+	}
+	catch(...){
+		render_error = std::current_exception();
+		frame_queue.close();
+	}
+	SDL_GL_MakeCurrent(main_window, nullptr);
+}
+
+void GameManager::render(const FrameSnapshot &frame){
+	TRACE_SCOPE("GameManager::render");
+
+	// swap in whatever finished reloading since the last frame
+	hot_reloader->commitFinished();
+
+	// the options are compiled into the shaders, pick the matching variants
+	selectProgramVariants(frame.shader_features);
+
+	// the attributes are pointed at the locations of the program selected above
+	if(programs_reloaded){
+		for(unsigned int i = 0; i < bound_models.size(); ++i)
+			bindModelAttributes(i);
+		programs_reloaded = false;
+	}
+
+	// GL side of the options that changed since the last frame
+	for(unsigned int i = 0; i < frame.models.size(); ++i){
+		if(frame.models[i] != bound_models[i]){
+			// vertex array objects are not shared between contexts, so they are rebound here
+			retired_models.push_back(bound_models[i]);
+			bound_models[i] = frame.models[i];
+			bindModelAttributes(i);
+			hiz_culling->invalidate();
+			impostor_atlases[i] = std::make_shared<ImpostorAtlas>(*bound_models[i], scene_vaos[i], *impostor_bake_program);
+		}
+	}
+	// the queued snapshots and the scene bounds of the main thread may still hold a replaced model, it is
+	// destroyed here once they let go, so that its textures and buffers are deleted with the context current
+	retired_models.erase(std::remove_if(retired_models.begin(), retired_models.end(),
+	                                    [](const std::shared_ptr<Model> &model){ return model.use_count() == 1; }),
+	                     retired_models.end());
+	model_bindings.resize(frame.models.size());
+	for(unsigned int i = 0; i < frame.models.size(); ++i){
+		model_bindings[i].vertex_array = scene_vaos[i];
+		model_bindings[i].diffuse_map = frame.models[i]->getDiffuseMap();
+		model_bindings[i].normal_map = frame.models[i]->getBumpMap();
+		model_bindings[i].specular_map = frame.models[i]->getSpecularMap();
+	}
+	model_bindings.insert(model_bindings.end(), streamed_bindings.begin(), streamed_bindings.end());
+	impostor_bindings.resize(impostor_atlases.size());
+	for(unsigned int i = 0; i < impostor_atlases.size(); ++i){
+		impostor_bindings[i].albedo_map = impostor_atlases[i]->getAlbedoTexture();
+		impostor_bindings[i].normal_map = impostor_atlases[i]->getNormalTexture();
+		impostor_bindings[i].depth_map = impostor_atlases[i]->getDepthTexture();
+		impostor_bindings[i].center = impostor_atlases[i]->getCenter();
+		impostor_bindings[i].radius = impostor_atlases[i]->getRadius();
+	}
+
+	// the model matrices of both impostor lists, in one upload
+	impostor_instances.clear();
+	for(const ImpostorDraw &impostor : frame.impostor_list)
+		impostor_instances.push_back(impostor.model_matrix);
+	for(const ImpostorDraw &impostor : frame.shadow_impostor_list)
+		impostor_instances.push_back(impostor.model_matrix);
+	if(!impostor_instances.empty()){
+		const GLsizeiptr instances_size = GLsizeiptr(impostor_instances.size() * sizeof(glm::mat4));
+		glBindBuffer(GL_ARRAY_BUFFER, impostor_instance_buffer);
+		// orphaned every frame, so the driver does not wait for the last frame's draws
+		glBufferData(GL_ARRAY_BUFFER, instances_size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, instances_size, impostor_instances.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	if(!cluster_streamers.empty()){
+		TRACE_SCOPE("cluster streaming");
+		collectClusterDraws(frame, float(window_height) * frame.resolution_scale);
+	}
+	if(terrain){
+		TRACE_SCOPE("terrain selection");
+		// the shadows take every node of the selection, inside the view or not
+		const glm::vec3 camera_position = glm::vec3(inverse(frame.view)[3]);
+		terrain->update(camera_position, frame.projection * frame.view, frame.terrain_detail,
+		                frame.shadows_enabled && frame.lighting_enabled);
+		TRACE_COUNTER("terrain nodes", double(terrain->getNodeCount()));
+		TRACE_COUNTER("resident terrain tiles", double(terrain->getResidentTileCount()));
+		TRACE_COUNTER("pending terrain tiles", double(terrain->getPendingTileCount()));
+	}
+	if(frame.aa_mode != scene_fbo_mode)
+		createSceneTarget(frame.aa_mode);
+	if(frame.occlusion_culling_enabled != occlusion_culling_rendered){
+		occlusion_culling_rendered = frame.occlusion_culling_enabled;
+		hiz_culling->invalidate();
+	}
+
+	gpu_frame_timer->begin();
+
+	TRACE_COUNTER("draws", double(frame.draw_list.size()));
+	TRACE_COUNTER("impostors", double(frame.impostor_list.size()));
+
+	gpu_shadow_timer->begin();
+	if(frame.shadows_enabled && frame.lighting_enabled){
+		TRACE_SCOPE("shadow maps");
+		glCullFace(GL_BACK);
+		renderShadowMaps(frame);
+		glBindVertexArray(0);
+	}
+	gpu_shadow_timer->end();
+
+	const float resolution_scale = frame.resolution_scale;
+	const GLsizei render_width = GLsizei(window_width * resolution_scale);
+	const GLsizei render_height = GLsizei(window_height * resolution_scale);
+	// the deferred path first renders the surface attributes into the G-buffer
+	if(frame.deferred_enabled)
+		gbuffer->bind();
+	else
+		scene_fbo->bind();
+	glViewport(0, 0, render_width, render_height);
 
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	program->use();
 
-	glUniform3fv(program->getUniform("light_position"), 1, value_ptr(light.position));
-	glUniform1i(program->getUniform("lighting"), lighting_enabled ? 1 : 0);
-	glUniform1i(program->getUniform("debugSwitch"), debugSwitch ? 1 : 0);
-	glUniform1i(program->getUniform("distance_LOD_enabled"), distance_LOD_enabled ? 1 : 0);
-	glUniform1f(program->getUniform("TessLevel"), LOD);
+	if(frame.occlusion_culling_enabled){
+		TRACE_SCOPE("occlusion culling");
+		cullDrawList(frame);
+	}
 
-	model->bindDiffuseMap(DIFFUSE_TEX);
-	model->bindSpecularMap(SPECULAR_TEX);
-	model->bindBumpMap(NORMAL_TEX);
+	const std::shared_ptr<Program> &shading_program = frame.deferred_enabled ? gbuffer_program : program;
+	setFrameUniforms(shading_program, frame);
+	if(!frame.deferred_enabled && frame.lighting_enabled)
+		setShadowUniforms(program, frame);
 
 	//Render geometry
-	glBindVertexArray(main_scene_vao[0]);
-	switch(render_mode){
+	switch(frame.render_mode){
 		case RENDERMODE_PHONG:
 			glCullFace(GL_BACK);
 			glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -232,18 +1242,134 @@ void GameManager::render(){
 		case RENDERMODE_WIREFRAME:
 			glCullFace(GL_BACK);
 			glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			lighting_enabled = true;
 			break;
 		default:
 			THROW_EXCEPTION("Rendermode not supported");
 	}
 
-	renderMeshRecursive(model->getMesh(), program, view, model_matrix, camera.projection);
+	// lines do not rasterize to the same depths as the filled pre-pass
+	const bool depth_prepass = frame.depth_prepass_enabled && frame.render_mode == RENDERMODE_PHONG;
+	if(depth_prepass){
+		TRACE_SCOPE("depth pre-pass");
+		setFrameUniforms(depth_program, frame);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		renderDrawList(depth_program, frame, frame.draw_list, frame.view, frame.projection, true);
+		renderDrawList(depth_program, frame, cluster_draw_list, frame.view, frame.projection, false);
+		if(terrain)
+			renderTerrain(terrain_depth_program, frame, 0, terrain->getNodeCount(), frame.view, frame.projection);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		// only the nearest fragment of each pixel gets shaded
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	{
+		TRACE_SCOPE("scene pass");
+		renderDrawList(shading_program, frame, frame.draw_list, frame.view, frame.projection, true);
+		// the streamers culled their clusters themselves
+		renderDrawList(shading_program, frame, cluster_draw_list, frame.view, frame.projection, false);
+	}
+
+	if(terrain){
+		TRACE_SCOPE("terrain");
+		const std::shared_ptr<Program> &terrain_shading_program = frame.deferred_enabled ? terrain_gbuffer_program
+		                                                                                 : terrain_program;
+		if(!frame.deferred_enabled && frame.lighting_enabled){
+			terrain_program->waitForLink();
+			render_device->useProgram(terrain_program->name);
+			render_device->setUniform(terrain_program->getUniform("light_position"), frame.light_position);
+			setShadowUniforms(terrain_program, frame);
+		}
+		renderTerrain(terrain_shading_program, frame, 0, terrain->getNodeCount(), frame.view, frame.projection);
+	}
+
+	if(depth_prepass){
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_TRUE);
+	}
+
+	if(!frame.impostor_list.empty()){
+		TRACE_SCOPE("impostors");
+		const std::shared_ptr<Program> &impostor_shading_program = frame.deferred_enabled ? impostor_gbuffer_program
+		                                                                                  : impostor_program;
+		if(!frame.deferred_enabled && frame.lighting_enabled){
+			impostor_program->waitForLink();
+			render_device->useProgram(impostor_program->name);
+			render_device->setUniform(impostor_program->getUniform("light_position"), frame.light_position);
+			setShadowUniforms(impostor_program, frame);
+		}
+		renderImpostorList(impostor_shading_program, frame.impostor_list, 0, frame.view, frame.projection);
+	}
 
 	glBindVertexArray(0);
+
+	if(frame.deferred_enabled){
+		TRACE_SCOPE("deferred lighting");
+		scene_fbo->bind();
+		renderDeferredLighting(frame);
+	}
+
+	if(frame.occlusion_culling_enabled){
+		TRACE_SCOPE("depth pyramid");
+		buildDepthPyramid(render_width, render_height);
+	}
+
+	gpu_post_timer->begin();
+	{
+		TRACE_SCOPE("post-processing");
+		postProcess(frame);
+	}
+	gpu_post_timer->end();
+
+	gpu_frame_timer->end();
 	CHECK_GL_ERROR();
 }
 
+void GameManager::updateFrameTimings(double update_ms, const FrameTimings &timings){
+	// the threads overlap, the slower of the two sets the frame rate
+	const double cpu_ms = max(update_ms, timings.submit_ms);
+	const double gpu_ms = timings.gpu_ms;
+	lod_governor.update(cpu_ms, gpu_ms);
+	dynamic_resolution.update(gpu_ms);
+	TRACE_COUNTER("update ms", update_ms);
+	TRACE_COUNTER("submit ms", timings.submit_ms);
+	TRACE_COUNTER("gpu ms", gpu_ms);
+	TRACE_COUNTER("tessellation scale", lod_governor.getTessellationScale());
+	TRACE_COUNTER("resolution scale", dynamic_resolution.getScale());
+
+	if(print_timings && timings_print_timer.elapsed() > 1.0){
+		timings_print_timer.restart();
+		std::cout << "cpu " << cpu_ms << " ms (update " << update_ms << " ms, submit " << timings.submit_ms << " ms)"
+			<< " | gpu " << gpu_ms << " ms"
+			<< " (shadows " << timings.gpu_shadow_ms << " ms,"
+			<< " post-processing " << timings.gpu_post_ms << " ms)"
+			<< " | AA " << getAntiAliasingModeName(aa_mode) << " | ";
+		lod_governor.printState(std::cout);
+		std::cout << " | ";
+		dynamic_resolution.printState(std::cout);
+		std::cout << " | swap " << getSwapIntervalName(swap_interval) << " | ";
+		frame_limiter.printState(std::cout);
+		std::cout << " | ";
+		latency_monitor->printState(std::cout);
+		std::cout << std::endl;
+	}
+}
+
+double GameManager::getInputEventTime(const SDL_Event &event){
+	switch(event.type){
+		case SDL_KEYDOWN:
+		case SDL_MOUSEMOTION:
+		case SDL_MOUSEBUTTONDOWN:
+		case SDL_MOUSEBUTTONUP:
+		case SDL_MOUSEWHEEL:
+			// SDL stamps events in milliseconds since its initialisation
+			return Timer::getCurrentTime() - (SDL_GetTicks() - event.common.timestamp) * 0.001;
+		default:
+			return -1.0;
+	}
+}
+
 void GameManager::move_ball(float zOffset){
 	auto view_with_newZ = translate(camera.view, glm::vec3(0.0, 0.0, zOffset));
 	view_with_newZ[3][2] = glm::clamp(view_with_newZ[3][2] + zOffset, -26.f, -2.f);
@@ -257,12 +1383,29 @@ void GameManager::display_commands(){
 	std::cout << "[s]: move away from the ball\n";
 	std::cout << "Mouse wheel up: zoom in (does not affect LOD)\n";
 	std::cout << "Mouse wheel down: zoom out (does not affect LOD)\n";
-	std::cout << "Rotate the ball by holding LMB and moving the mouse.\n\n";
+	std::cout << "Rotate the scene by holding LMB and moving the mouse.\n";
+	std::cout << "Click RMB to pick the instance and triangle under the cursor.\n\n";
 
 	std::cout << "== Options ==\n";
 	std::cout << "[L] toggle Blinn-Phong light reflection + normal mapping\n";
 	std::cout << "[Z] switch between LOD modes: by distance or manual\n";
-	std::cout << "[+ / -] increases / decreases the LOD under manual LOD mode\n";
+	std::cout << "[+ / -] increases / decreases the most LOD of an instance under manual LOD mode\n";
+	std::cout << "[C] toggle scaling the LOD by the curvature of each edge\n";
+	std::cout << "[G] toggle the LOD governor holding a " << lod_governor.getTargetFrameTime() << " ms frame time\n";
+	std::cout << "[R] toggle dynamic resolution driven by the GPU frame time\n";
+	std::cout << "[A] cycle anti-aliasing: off, MSAA 2x / 4x / 8x, FXAA\n";
+	std::cout << "[P] toggle the depth pre-pass\n";
+	std::cout << "[O] toggle GPU occlusion culling against last frame's depth\n";
+	std::cout << "[D] toggle deferred shading (lighting once per pixel from a G-buffer)\n";
+	std::cout << "[H] toggle the cascaded shadow map of the main light\n";
+	std::cout << "[I] cycle the distance beyond which instances are drawn as impostors: 15, 30, 60 radii, never\n";
+	std::cout << "[E] cycle the screen space error the streamed meshes are refined to: 1, 2, 4, 8 pixels\n";
+	std::cout << "[U] cycle the distance the terrain is refined within: 3, 6, 12 times the size of a node\n";
+	std::cout << "[J] cycle the tessellation of the shadow casters: 100%, 50%, 25% of the main view\n";
+	std::cout << "[K] cycle the number of point lights of the deferred path: 0, 16, 64, 256, 1024\n";
+	std::cout << "[V] cycle the swap interval: vsync, adaptive vsync, off\n";
+	std::cout << "[F] cycle the frame limit: off, 30, 60, 120 fps (input is read as late as the limit allows)\n";
+	std::cout << "[T] toggle printing the frame timings and input latency every second\n";
 	std::cout << "[Space] toggle coloring by barycentric coordinate per face\n\n";
 
 	std::cout << "== Render modes ==\n";
@@ -282,6 +1425,54 @@ void GameManager::zoomOut(){
 	                                     window_width / (float)window_height, near_plane, far_plane);
 }
 
+void GameManager::pick(int x, int y){
+	// unproject the pixel centre on the near and far planes into world space
+	const glm::vec2 ndc(2.f * (x + 0.5f) / window_width - 1.f, 1.f - 2.f * (y + 0.5f) / window_height);
+	const glm::mat4 inverse_view_projection = glm::inverse(camera.projection * camera.view * cam_trackball.getTransform());
+	const glm::vec4 near_point = inverse_view_projection * glm::vec4(ndc.x, ndc.y, -1.f, 1.f);
+	const glm::vec4 far_point = inverse_view_projection * glm::vec4(ndc.x, ndc.y, 1.f, 1.f);
+	const glm::vec3 origin = glm::vec3(near_point) / near_point.w;
+	const glm::vec3 direction = glm::normalize(glm::vec3(far_point) / far_point.w - origin);
+
+	Timer pick_timer;
+	std::vector<std::pair<float, uint32_t> > candidates;
+	scene->queryRay(origin, direction, candidates);
+	const std::vector<Scene::Instance> &instances = scene->getInstances();
+	Model::Hit hit;
+	Model::Hit closest_hit;
+	uint32_t closest_instance = 0;
+	bool found = false;
+	for(const std::pair<float, uint32_t> &candidate : candidates){
+		// the boxes come nearest first, none entered past the closest hit can hold a closer one
+		if(found && candidate.first > closest_hit.distance)
+			break;
+		const Scene::Instance &instance = instances[candidate.second];
+		const std::shared_ptr<Model> model = std::atomic_load(&models.at(scene->getModels()[instance.model].name));
+		// the direction is left unnormalized in the space of the model, so that distances stay comparable
+		const glm::mat4 inverse_transform = glm::inverse(instance.transform);
+		const glm::vec3 model_origin = glm::vec3(inverse_transform * glm::vec4(origin, 1.f));
+		const glm::vec3 model_direction = glm::vec3(inverse_transform * glm::vec4(direction, 0.f));
+		if(model->intersect(model_origin, model_direction, hit) && (!found || hit.distance < closest_hit.distance)){
+			found = true;
+			closest_hit = hit;
+			closest_instance = candidate.second;
+		}
+	}
+	const double pick_ms = pick_timer.elapsed() * 1000.0;
+
+	if(!found){
+		std::cout << "Picked nothing among " << candidates.size() << " candidate instances (" << pick_ms << " ms)" << std::endl;
+		return;
+	}
+	const Scene::Instance &instance = instances[closest_instance];
+	const glm::vec3 position = glm::vec3(instance.transform * glm::vec4(closest_hit.position, 1.f));
+	std::cout << "Picked triangle " << closest_hit.triangle << " of instance " << closest_instance << " ("
+	          << scene->getModels()[instance.model].name << "), in the part drawing vertices " << closest_hit.part->first
+	          << " to " << closest_hit.part->first + closest_hit.part->count << ", at (" << position.x << ", "
+	          << position.y << ", " << position.z << ") among " << candidates.size() << " candidate instances ("
+	          << pick_ms << " ms)" << std::endl;
+}
+
 void GameManager::increaseLOD(){
 	LOD = min(LOD + 1.f, 12.f);
 }
@@ -295,10 +1486,28 @@ void GameManager::play(){
 
 	display_commands();
 
+	// the render thread owns the context from here on
+	SDL_GL_MakeCurrent(main_window, nullptr);
+	render_thread = std::thread(&GameManager::renderLoop, this);
+
 	//SDL main loop
 	while(!doExit){
+		TRACE_SCOPE("frame");
+		// sleep for as long as the frame limit allows, then wait for a free slot,
+		// so that the input is read right before the frame is built
+		frame_limiter.waitForInputSample();
+		FrameSnapshot *frame = frame_queue.beginWrite();
+		if(!frame)
+			break;
+		cpu_frame_timer.restart();
+
+		double input_time = -1.0;
 		SDL_Event event;
 		while(SDL_PollEvent(&event)){
+			const double event_time = getInputEventTime(event);
+			if(event_time >= 0.0 && (input_time < 0.0 || event_time < input_time))
+				input_time = event_time;
+
 			// poll for pending events
 			switch(event.type){
 				case SDL_MOUSEWHEEL:
@@ -308,10 +1517,14 @@ void GameManager::play(){
 						zoomOut();
 					break;
 				case SDL_MOUSEBUTTONDOWN:
-					cam_trackball.rotateBegin(event.motion.x, event.motion.y);
+					if(event.button.button == SDL_BUTTON_RIGHT)
+						pick(event.button.x, event.button.y);
+					else
+						cam_trackball.rotateBegin(event.button.x, event.button.y);
 					break;
 				case SDL_MOUSEBUTTONUP:
-					cam_trackball.rotateEnd(event.motion.x, event.motion.y);
+					if(event.button.button != SDL_BUTTON_RIGHT)
+						cam_trackball.rotateEnd(event.button.x, event.button.y);
 					break;
 				case SDL_MOUSEMOTION:
 					cam_trackball.rotate(event.motion.x, event.motion.y, zoom);
@@ -348,6 +1561,84 @@ void GameManager::play(){
 						case SDLK_z:
 							distance_LOD_enabled = !distance_LOD_enabled;
 							break;
+						case SDLK_c:
+							curvature_LOD_enabled = !curvature_LOD_enabled;
+							break;
+						case SDLK_g:
+							lod_governor.setEnabled(!lod_governor.isEnabled());
+							lod_governor.printState(std::cout);
+							std::cout << std::endl;
+							break;
+						case SDLK_t:
+							print_timings = !print_timings;
+							break;
+						case SDLK_a:
+							aa_mode = AntiAliasingMode((aa_mode + 1) % AA_MODE_COUNT);
+							std::cout << "Anti-aliasing: " << getAntiAliasingModeName(aa_mode) << std::endl;
+							break;
+						case SDLK_p:
+							depth_prepass_enabled = !depth_prepass_enabled;
+							std::cout << "Depth pre-pass " << (depth_prepass_enabled ? "on" : "off") << std::endl;
+							break;
+						case SDLK_o:
+							occlusion_culling_enabled = !occlusion_culling_enabled;
+							std::cout << "Occlusion culling " << (occlusion_culling_enabled ? "on" : "off") << std::endl;
+							break;
+						case SDLK_d:
+							deferred_enabled = !deferred_enabled;
+							std::cout << "Deferred shading " << (deferred_enabled ? "on" : "off") << std::endl;
+							break;
+						case SDLK_h:
+							shadows_enabled = !shadows_enabled;
+							std::cout << "Shadows " << (shadows_enabled ? "on" : "off") << std::endl;
+							break;
+						case SDLK_j:
+							shadow_lod_scale = shadow_lod_scale > 0.3f ? shadow_lod_scale * 0.5f : 1.f;
+							std::cout << "Shadow tessellation: " << shadow_lod_scale * 100.f << "% of the main view" << std::endl;
+							break;
+						case SDLK_i:
+							impostor_distance = impostor_distance == 0.f ? 15.f : impostor_distance * 2.f;
+							if(impostor_distance > 60.f)
+								impostor_distance = 0.f;
+							if(impostor_distance > 0.f)
+								std::cout << "Impostors beyond " << impostor_distance << " radii" << std::endl;
+							else
+								std::cout << "Impostors off" << std::endl;
+							break;
+						case SDLK_e:
+							cluster_error_pixels = cluster_error_pixels >= 8.f ? 1.f : cluster_error_pixels * 2.f;
+							std::cout << "Streamed mesh error: " << cluster_error_pixels << " pixels" << std::endl;
+							break;
+						case SDLK_u:
+							terrain_detail = terrain_detail >= 12.f ? 3.f : terrain_detail * 2.f;
+							std::cout << "Terrain nodes split within " << terrain_detail << " times their size" << std::endl;
+							break;
+						case SDLK_k:
+							point_light_count = point_light_count == 0 ? 16 : point_light_count * 4;
+							if(point_light_count > 1024)
+								point_light_count = 0;
+							createPointLights(point_light_count);
+							std::cout << "Point lights: " << point_light_count << std::endl;
+							break;
+						case SDLK_v:
+							swap_interval = swap_interval == 1 ? -1 : swap_interval == -1 ? 0 : 1;
+							std::cout << "Swap interval: " << getSwapIntervalName(swap_interval) << std::endl;
+							break;
+						case SDLK_f:{
+							double target_fps = frame_limiter.getTargetFrameRate();
+							target_fps = target_fps == 0.0 ? 30.0 : target_fps * 2.0;
+							if(target_fps > 120.0)
+								target_fps = 0.0;
+							frame_limiter.setTargetFrameRate(target_fps);
+							frame_limiter.printState(std::cout);
+							std::cout << std::endl;
+							break;
+						}
+						case SDLK_r:
+							dynamic_resolution.setEnabled(!dynamic_resolution.isEnabled());
+							dynamic_resolution.printState(std::cout);
+							std::cout << std::endl;
+							break;
 						case SDLK_PLUS:
 							increaseLOD();
 							break;
@@ -371,14 +1662,200 @@ void GameManager::play(){
 			}
 		}
 
-		//Render, and swap front and back buffers
-		render();
-		SDL_GL_SwapWindow(main_window);
+		animate();
+		fillFrameSnapshot(*frame);
+		frame->input_time = input_time;
+		frame_queue.endWrite();
+		const double update_ms = cpu_frame_timer.elapsed() * 1000.0;
+		frame_limiter.frameSubmitted(update_ms);
+
+		FrameTimings timings;
+		bool rendered = false;
+		{
+			std::lock_guard<std::mutex> lock(timings_mutex);
+			timings = last_timings;
+			rendered = timings_pending;
+			timings_pending = false;
+		}
+		if(rendered)
+			updateFrameTimings(update_ms, timings);
 	}
 	quit();
+
+	if(render_error)
+		std::rethrow_exception(render_error);
+}
+
+void GameManager::benchmarkNullDevice(unsigned int frames){
+	createMatrices();
+	scene.reset(new Scene(scene_path));
+	const std::vector<Scene::ModelDescription> &descriptions = scene->getModels();
+
+	// one part per model, over the same unit box as its bounds
+	std::vector<MeshPart> meshes(descriptions.size());
+	std::vector<ModelBinding> bindings(descriptions.size());
+	std::vector<ImpostorBinding> atlas_bindings(descriptions.size());
+	scene_meshes.resize(descriptions.size());
+	for(unsigned int i = 0; i < descriptions.size(); ++i){
+		meshes[i].count = 3;
+		meshes[i].min_dim = glm::vec3(-1.f);
+		meshes[i].max_dim = glm::vec3(1.f);
+		scene_meshes[i] = &meshes[i];
+		scene->setModelBounds(i, meshes[i].min_dim, meshes[i].max_dim);
+		// made up names, there is no context to create any
+		bindings[i].vertex_array = 1 + i;
+		bindings[i].diffuse_map = 1 + 3 * i;
+		bindings[i].normal_map = 2 + 3 * i;
+		bindings[i].specular_map = 3 + 3 * i;
+		atlas_bindings[i].albedo_map = 1 + 3 * (descriptions.size() + i);
+		atlas_bindings[i].normal_map = 2 + 3 * (descriptions.size() + i);
+		atlas_bindings[i].depth_map = 3 + 3 * (descriptions.size() + i);
+		atlas_bindings[i].center = glm::vec3(0.f);
+		atlas_bindings[i].radius = glm::length(meshes[i].max_dim);
+	}
+	const GLuint program_name = 1;
+	const DrawUniforms uniforms = {0, 1, 2, 3, 4, 5};
+	const GLuint impostor_program_name = 2;
+	const ImpostorUniforms impostor_uniforms = {0, 1, 2, 3};
+	const GLuint impostor_vertex_array = 1 + GLuint(descriptions.size());
+
+	NullRenderDevice counting_device;
+	NullRenderDevice recording_device(true);
+	std::vector<DrawItem> draw_list;
+	std::vector<ImpostorDraw> impostor_list;
+	double cull_seconds = 0.0;
+	double submit_seconds = 0.0;
+	double record_seconds = 0.0;
+	size_t draws = 0;
+	size_t impostors = 0;
+	Timer timer;
+	for(unsigned int i = 0; i < frames; ++i){
+		const glm::mat4 view = camera.view * cam_trackball.getTransform();
+
+		timer.restart();
+		scene->animate(1.f / 60.f);
+		visible_instances.clear();
+		scene->queryVisible(camera.projection * view, visible_instances);
+		draw_list.clear();
+		impostor_list.clear();
+		collectInstanceDraws(view, camera.projection, scene_meshes, visible_instances, draw_list, &impostor_list);
+		std::sort(draw_list.begin(), draw_list.end(), isDrawnBefore);
+		std::sort(impostor_list.begin(), impostor_list.end(), [](const ImpostorDraw &a, const ImpostorDraw &b){
+			return a.model < b.model;
+		});
+		cull_seconds += timer.elapsedAndRestart();
+
+		counting_device.reset();
+		submitDrawList(counting_device, program_name, uniforms, bindings, draw_list, view, camera.projection, false);
+		submitImpostorList(counting_device, impostor_program_name, impostor_uniforms, impostor_vertex_array,
+		                   atlas_bindings, impostor_list, 0, view, camera.projection);
+		submit_seconds += timer.elapsedAndRestart();
+
+		recording_device.reset();
+		submitDrawList(recording_device, program_name, uniforms, bindings, draw_list, view, camera.projection, false);
+		submitImpostorList(recording_device, impostor_program_name, impostor_uniforms, impostor_vertex_array,
+		                   atlas_bindings, impostor_list, 0, view, camera.projection);
+		record_seconds += timer.elapsedAndRestart();
+		draws += draw_list.size();
+		impostors += impostor_list.size();
+	}
+
+	// the recording has to play back into the same calls
+	NullRenderDevice replayed;
+	recording_device.replay(replayed);
+	for(int command = 0; command < NullRenderDevice::COMMAND_COUNT; ++command){
+		const NullRenderDevice::Command c = NullRenderDevice::Command(command);
+		if(replayed.getCallCount(c) != recording_device.getCallCount(c))
+			THROW_EXCEPTION(std::string("Replaying the recording changed the number of ")
+			                + NullRenderDevice::getCommandName(c) + " calls");
+	}
+
+	const double frame_count = max(frames, 1u);
+	const double draws_per_frame = draws / frame_count;
+	std::cout << frames << " frames of " << scene_path << ", " << scene->getInstances().size() << " instances, "
+	          << draws_per_frame << " draws and " << impostors / frame_count << " impostors per frame\n";
+	std::cout << "cull and sort: " << 1000.0 * cull_seconds / frame_count << " ms per frame\n";
+	std::cout << "submit: " << 1000.0 * submit_seconds / frame_count << " ms per frame, "
+	          << 1e9 * submit_seconds / max(draws, size_t(1)) << " ns per draw\n";
+	std::cout << "submit and record: " << 1000.0 * record_seconds / frame_count << " ms per frame, "
+	          << 1e9 * record_seconds / max(draws, size_t(1)) << " ns per draw\n";
+	std::cout << "last frame: ";
+	recording_device.printCounts(std::cout);
+	std::cout << "\n";
+	for(int command = 0; command < NullRenderDevice::COMMAND_COUNT; ++command){
+		const NullRenderDevice::Command c = NullRenderDevice::Command(command);
+		std::cout << "  " << NullRenderDevice::getCommandName(c) << ": " << recording_device.getCallCount(c) << "\n";
+	}
+	std::cout << std::flush;
+}
+
+void GameManager::renderSoftware(const std::string &filename){
+	ilInit();
+	iluInit();
+	createMatrices();
+	scene.reset(new Scene(scene_path));
+	const std::vector<Scene::ModelDescription> &descriptions = scene->getModels();
+
+	std::vector<std::shared_ptr<Model> > cpu_models(descriptions.size());
+	scene_meshes.resize(descriptions.size());
+	for(unsigned int i = 0; i < descriptions.size(); ++i){
+		const Scene::ModelDescription &description = descriptions[i];
+		cpu_models[i].reset(new Model(description.mesh_path, description.diffuse_map_path, description.normal_map_path,
+		                              description.specular_map_path, false, Model::STORE_CPU));
+		scene_meshes[i] = &cpu_models[i]->getMesh();
+		scene->setModelBounds(i, cpu_models[i]->getBVH()->getMin(), cpu_models[i]->getBVH()->getMax());
+	}
+
+	const glm::mat4 view = camera.view * cam_trackball.getTransform();
+	visible_instances.clear();
+	scene->queryVisible(camera.projection * view, visible_instances);
+	std::vector<DrawItem> draw_list;
+	collectInstanceDraws(view, camera.projection, scene_meshes, visible_instances, draw_list);
+	std::sort(draw_list.begin(), draw_list.end(), isDrawnBefore);
+
+	// the uniforms submitDrawList and setFrameUniforms would set
+	SoftwareRenderer renderer(window_width, window_height);
+	renderer.clear(glm::vec3(0.5f));
+	SoftwareRenderer::DrawState state;
+	state.projection = camera.projection;
+	state.light_position = light.position;
+	state.tess_scale = lod_governor.getTessellationScale();
+	state.lod_bias = static_cast<float>(lod_governor.getLODBias());
+	state.distance_lod = distance_LOD_enabled;
+	state.curvature_lod = curvature_LOD_enabled;
+	state.lighting = lighting_enabled;
+	for(const DrawItem &item : draw_list){
+		state.model_view = view * item.model_matrix;
+		state.model = item.model_matrix;
+		state.model_view_3x3 = glm::mat3(state.model_view);
+		state.normal = transpose(inverse(glm::mat3(state.model_view)));
+		state.tess_level = item.tess_level;
+		renderer.draw(cpu_models[item.model], item.first, item.count, state);
+	}
+
+	Timer timer;
+	timer.restart();
+	renderer.finish();
+	const double seconds = timer.elapsed();
+	renderer.writeImage(filename);
+	std::cout << scene_path << ": " << draw_list.size() << " draws, " << renderer.getTriangleCount()
+	          << " triangles rasterized in " << 1000.0 * seconds << " ms, written to " << filename << std::endl;
 }
 
 void GameManager::quit(){
+	// take the context back from the render thread
+	frame_queue.close();
+	if(render_thread.joinable()){
+		render_thread.join();
+		SDL_GL_MakeCurrent(main_window, main_context);
+	}
+
+	// the loader thread and its context go before the main context
+	hot_reloader.reset();
+
+	latency_monitor->collect();
+	latency_monitor->printState(std::cout);
+	std::cout << std::endl;
 	std::cout << "Bye bye..." << endl;
 }
 
@@ -0,0 +1,117 @@
+#include "HiZCulling.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+	const unsigned int build_group_size = 8; //< local_size_x/y of hiz_build.comp
+	const unsigned int cull_group_size = 64; //< local_size_x of hiz_cull.comp
+
+	/**
+	 * Levels of a full mip chain, each level rounding the size of the one above down as GL does
+	 */
+	unsigned int levelCount(unsigned int width, unsigned int height){
+		unsigned int levels = 1;
+		for(unsigned int size = width > height ? width : height; size > 1; size /= 2)
+			++levels;
+		return levels;
+	}
+
+	unsigned int groupCount(unsigned int size, unsigned int group_size){
+		return (size + group_size - 1) / group_size;
+	}
+}
+
+HiZCulling::HiZCulling(unsigned int width, unsigned int height) : used_levels(0), pyramid_valid(false){
+	build_program.reset(new GLUtils::Program(GLUtils::readFile("shaders/hiz_build.comp")));
+	cull_program.reset(new GLUtils::Program(GLUtils::readFile("shaders/hiz_cull.comp")));
+
+	pyramid_levels = levelCount(width, height);
+	glGenTextures(1, &pyramid_texture);
+	glBindTexture(GL_TEXTURE_2D, pyramid_texture);
+	glTexStorage2D(GL_TEXTURE_2D, pyramid_levels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenBuffers(1, &bounds_buffer);
+	glGenBuffers(1, &command_buffer);
+	CHECK_GL_ERROR();
+}
+
+HiZCulling::~HiZCulling(){
+	glDeleteTextures(1, &pyramid_texture);
+	glDeleteBuffers(1, &bounds_buffer);
+	glDeleteBuffers(1, &command_buffer);
+}
+
+void HiZCulling::buildPyramid(GLuint depth_texture, unsigned int width, unsigned int height){
+	build_program->use();
+	glUniform1i(build_program->getUniform("source"), 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	glm::ivec2 source_size(width, height);
+	used_levels = std::min(levelCount(width, height), pyramid_levels);
+	for(unsigned int level = 0; level < used_levels; ++level){
+		// level 0 copies the depth buffer, the others reduce the previous level
+		const glm::ivec2 target_size = level == 0 ? source_size
+		                                          : glm::ivec2(std::max(source_size.x / 2, 1), std::max(source_size.y / 2, 1));
+
+		glBindTexture(GL_TEXTURE_2D, level == 0 ? depth_texture : pyramid_texture);
+		glUniform1i(build_program->getUniform("copy_depth"), level == 0 ? 1 : 0);
+		glUniform1i(build_program->getUniform("source_level"), level == 0 ? 0 : level - 1);
+		glUniform2i(build_program->getUniform("source_size"), source_size.x, source_size.y);
+		glUniform2i(build_program->getUniform("target_size"), target_size.x, target_size.y);
+		glBindImageTexture(0, pyramid_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute(groupCount(target_size.x, build_group_size), groupCount(target_size.y, build_group_size), 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		source_size = target_size;
+	}
+
+	glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	build_program->disuse();
+
+	pyramid_size = glm::ivec2(width, height);
+	pyramid_valid = true;
+	CHECK_GL_ERROR();
+}
+
+void HiZCulling::cull(const std::vector<DrawArraysIndirectCommand> &commands, const std::vector<Bounds> &bounds,
+                      const glm::mat4 &view_projection){
+	// orphan the previous contents instead of waiting for the last frame's draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, bounds_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, bounds.size() * sizeof(Bounds), bounds.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, command_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.data(),
+	             GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, bounds_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, command_buffer);
+
+	cull_program->use();
+	glUniformMatrix4fv(cull_program->getUniform("view_proj_mat"), 1, 0, glm::value_ptr(view_projection));
+	glUniform1ui(cull_program->getUniform("draw_count"), GLuint(commands.size()));
+	glUniform1i(cull_program->getUniform("occlusion_test"), pyramid_valid ? 1 : 0);
+	glUniform1i(cull_program->getUniform("depth_pyramid"), 0);
+	glUniform2i(cull_program->getUniform("pyramid_size"), pyramid_size.x, pyramid_size.y);
+	glUniform1i(cull_program->getUniform("pyramid_levels"), used_levels);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, pyramid_texture);
+
+	glDispatchCompute(groupCount(GLuint(commands.size()), cull_group_size), 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	cull_program->disuse();
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+	CHECK_GL_ERROR();
+}
+
+void HiZCulling::bindIndirectBuffer(){
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+}
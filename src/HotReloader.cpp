@@ -0,0 +1,118 @@
+#include "HotReloader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "GameException.h"
+#include "Trace.h"
+
+namespace {
+	// how long the loader thread sleeps before checking whether it should stop
+	const unsigned int wait_timeout_ms = 250;
+	// editors touch a file several times per save, those changes are merged into one rebuild
+	const unsigned int settle_time_ms = 100;
+}
+
+HotReloader::HotReloader(SDL_Window *window, SDL_GLContext context) : window(window), stopping(false){
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 1);
+	loader_context = SDL_GL_CreateContext(window);
+	SDL_GL_SetAttribute(SDL_GL_SHARE_WITH_CURRENT_CONTEXT, 0);
+	if(loader_context == NULL)
+		THROW_EXCEPTION("Could not create the loader OpenGL context");
+
+	// creating a context makes it current, hand the thread back to the main context
+	SDL_GL_MakeCurrent(window, context);
+}
+
+HotReloader::~HotReloader(){
+	stopping = true;
+	if(loader_thread.joinable())
+		loader_thread.join();
+
+	for(size_t i = 0; i < finished.size(); ++i)
+		glDeleteSync(finished[i].fence);
+	SDL_GL_DeleteContext(loader_context);
+}
+
+void HotReloader::watch(const std::vector<std::string> &files, Build build){
+	Watch watch;
+	watch.files = files;
+	watch.build = build;
+	watches.push_back(watch);
+
+	for(size_t i = 0; i < files.size(); ++i)
+		file_watcher.addFile(files[i]);
+}
+
+void HotReloader::start(){
+	loader_thread = std::thread(&HotReloader::run, this);
+}
+
+void HotReloader::run(){
+	Trace::setThreadName("hot reload loader");
+	SDL_GL_MakeCurrent(window, loader_context);
+
+	while(!stopping){
+		std::vector<std::string> changed = file_watcher.waitForChanges(wait_timeout_ms);
+		if(changed.empty())
+			continue;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(settle_time_ms));
+		const std::vector<std::string> more = file_watcher.waitForChanges(0);
+		changed.insert(changed.end(), more.begin(), more.end());
+
+		for(size_t i = 0; i < watches.size(); ++i){
+			const std::vector<std::string> &files = watches[i].files;
+			bool affected = false;
+			for(size_t f = 0; f < files.size() && !affected; ++f)
+				affected = std::find(changed.begin(), changed.end(), files[f]) != changed.end();
+			if(!affected)
+				continue;
+
+			std::cout << "Reloading " << files.front() << "..." << std::endl;
+			TRACE_SCOPE("HotReloader build");
+			Finished result;
+			try{
+				result.commit = watches[i].build();
+			}
+			catch(std::exception &e){
+				std::cerr << "Reload failed, keeping the current version: " << e.what() << std::endl;
+				continue;
+			}
+
+			// the render thread may only use the new objects once the GPU is done creating them
+			result.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+
+			std::lock_guard<std::mutex> lock(finished_mutex);
+			finished.push_back(result);
+		}
+	}
+
+	SDL_GL_MakeCurrent(window, NULL);
+}
+
+void HotReloader::commitFinished(){
+	TRACE_SCOPE("HotReloader::commitFinished");
+	std::vector<Finished> ready;
+	{
+		std::lock_guard<std::mutex> lock(finished_mutex);
+		for(size_t i = 0; i < finished.size();){
+			const GLenum status = glClientWaitSync(finished[i].fence, 0, 0);
+			if(status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED){
+				ready.push_back(finished[i]);
+				finished.erase(finished.begin() + i);
+			}
+			else{
+				++i;
+			}
+		}
+	}
+
+	// in the order the builds finished, so a later save always wins
+	for(size_t i = 0; i < ready.size(); ++i){
+		glDeleteSync(ready[i].fence);
+		ready[i].commit();
+	}
+}
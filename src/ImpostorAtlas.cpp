@@ -0,0 +1,147 @@
+#include "ImpostorAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+	// the mip-maps stop where a level would blend neighbouring frames into each other
+	const unsigned int mip_levels = 4;
+
+	float signNotZero(float value){
+		return value >= 0.f ? 1.f : -1.f;
+	}
+
+	/**
+	 * The direction the octahedron maps coords in [0, 1]^2 to, as in impostor.vert
+	 */
+	glm::vec3 octahedronDirection(const glm::vec2 &coords){
+		const glm::vec2 p = coords * 2.f - 1.f;
+		glm::vec3 direction(p.x, 1.f - std::abs(p.x) - std::abs(p.y), p.y);
+		// the lower half is folded over the diagonals
+		if(direction.y < 0.f){
+			const float x = (1.f - std::abs(direction.z)) * signNotZero(direction.x);
+			const float z = (1.f - std::abs(direction.x)) * signNotZero(direction.z);
+			direction.x = x;
+			direction.z = z;
+		}
+		return glm::normalize(direction);
+	}
+}
+
+ImpostorAtlas::ImpostorAtlas(Model &model, GLuint vertex_array, GLUtils::Program &bake_program){
+	const glm::vec3 min_dim = model.getBVH()->getMin();
+	const glm::vec3 max_dim = model.getBVH()->getMax();
+	center = (min_dim + max_dim) * 0.5f;
+	radius = std::max(glm::length(max_dim - min_dim) * 0.5f, 1e-4f);
+
+	const GLsizei atlas_size = frame_count * frame_size;
+	glGenTextures(1, &albedo_texture);
+	glGenTextures(1, &normal_texture);
+	glGenTextures(1, &depth_texture);
+	const GLuint color_textures[2] = { albedo_texture, normal_texture };
+	for(GLuint texture : color_textures){
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, mip_levels, GL_RGBA8, atlas_size, atlas_size);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, depth_texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, atlas_size, atlas_size);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fbo_name);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo_name);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, albedo_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal_texture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture, 0);
+	const GLenum draw_buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, draw_buffers);
+	if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		THROW_EXCEPTION("Impostor atlas framebuffer is incomplete");
+
+	// uncovered texels hold no color, and a normal of length 0 once decoded, so that
+	// filtering across the silhouette weighs both by the coverage
+	const GLfloat no_albedo[4] = { 0.f, 0.f, 0.f, 0.f };
+	const GLfloat no_normal[4] = { 0.5f, 0.5f, 0.5f, 0.f };
+	const GLfloat far_depth = 1.f;
+	glClearBufferfv(GL_COLOR, 0, no_albedo);
+	glClearBufferfv(GL_COLOR, 1, no_normal);
+	glClearBufferfv(GL_DEPTH, 0, &far_depth);
+
+	bake_program.use();
+	glUniform1i(bake_program.getUniform("diffuse_texture"), 0);
+	glUniform1i(bake_program.getUniform("normal_texture"), 1);
+	glUniform1i(bake_program.getUniform("specular_texture"), 2);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, model.getDiffuseMap());
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, model.getBumpMap());
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, model.getSpecularMap());
+	glBindVertexArray(vertex_array);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	// the near plane touches the sphere, so the depth runs over its diameter
+	const glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, radius, 3.f * radius);
+	for(unsigned int y = 0; y < frame_count; ++y){
+		for(unsigned int x = 0; x < frame_count; ++x){
+			const glm::vec3 direction = octahedronDirection(glm::vec2(float(x), float(y)) / float(frame_count - 1));
+			// any up vector that is not parallel to the direction, the same one impostor.vert picks
+			const glm::vec3 up = std::abs(direction.y) > 0.999f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+			const glm::mat4 view = glm::lookAt(center + direction * 2.f * radius, center, up);
+			glViewport(x * frame_size, y * frame_size, frame_size, frame_size);
+			bakePart(model.getMesh(), glm::mat4(1.f), projection * view, bake_program);
+		}
+	}
+
+	glBindVertexArray(0);
+	bake_program.disuse();
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	for(GLuint texture : color_textures){
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	CHECK_GL_ERROR();
+}
+
+ImpostorAtlas::~ImpostorAtlas(){
+	glDeleteFramebuffers(1, &fbo_name);
+	glDeleteTextures(1, &albedo_texture);
+	glDeleteTextures(1, &normal_texture);
+	glDeleteTextures(1, &depth_texture);
+}
+
+std::vector<std::string> ImpostorAtlas::getShaderDefines(){
+	std::stringstream frames;
+	frames << "IMPOSTOR_FRAMES " << frame_count;
+	return std::vector<std::string>(1, frames.str());
+}
+
+void ImpostorAtlas::bakePart(const MeshPart &part, const glm::mat4 &model_matrix, const glm::mat4 &view_projection,
+                             GLUtils::Program &bake_program){
+	const glm::mat4 part_matrix = model_matrix * part.transform;
+
+	if(part.count > 0){
+		const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(part_matrix)));
+		glUniformMatrix4fv(bake_program.getUniform("model_view_projection_mat"), 1, 0,
+		                   glm::value_ptr(view_projection * part_matrix));
+		glUniformMatrix3fv(bake_program.getUniform("model_mat_3x3"), 1, 0, glm::value_ptr(glm::mat3(part_matrix)));
+		glUniformMatrix3fv(bake_program.getUniform("normal_mat"), 1, 0, glm::value_ptr(normal_matrix));
+		// the patches are plain triangles without the tessellation stages
+		glDrawArrays(GL_TRIANGLES, part.first, part.count);
+	}
+
+	for(size_t i = 0; i < part.children.size(); ++i)
+		bakePart(part.children[i], part_matrix, view_projection, bake_program);
+}
@@ -0,0 +1,82 @@
+#include "LODGovernor.h"
+
+#include <algorithm>
+
+namespace {
+	const double smoothing = 0.1; //< weight of the newest frame in the moving average
+	const double over_budget_ratio = 1.05; //< frame time above target * ratio is too slow
+	const double under_budget_ratio = 0.8; //< frame time below target * ratio leaves headroom
+	const int frames_before_decrease = 5;
+	const int frames_before_increase = 30; //< recover slower than we back off
+
+	const float min_tess_scale = 0.25f;
+	const float tess_scale_step = 0.9f;
+	const int max_lod_bias = 11;
+}
+
+LODGovernor::LODGovernor(double target_ms) : enabled(false), target_ms(target_ms){
+	reset();
+}
+
+void LODGovernor::reset(){
+	smoothed_ms = target_ms;
+	tess_scale = 1.f;
+	lod_bias = 0;
+	frames_over_budget = 0;
+	frames_under_budget = 0;
+}
+
+void LODGovernor::setEnabled(bool enabled){
+	this->enabled = enabled;
+	reset();
+}
+
+void LODGovernor::update(double cpu_ms, double gpu_ms){
+	if(!enabled)
+		return;
+
+	const double frame_ms = std::max(cpu_ms, gpu_ms);
+	smoothed_ms += smoothing * (frame_ms - smoothed_ms);
+
+	if(smoothed_ms > target_ms * over_budget_ratio){
+		frames_under_budget = 0;
+		if(++frames_over_budget >= frames_before_decrease){
+			decreaseDetail();
+			frames_over_budget = 0;
+		}
+	}
+	else if(smoothed_ms < target_ms * under_budget_ratio){
+		frames_over_budget = 0;
+		if(++frames_under_budget >= frames_before_increase){
+			increaseDetail();
+			frames_under_budget = 0;
+		}
+	}
+	else{
+		// inside the hysteresis band: hold the current detail
+		frames_over_budget = 0;
+		frames_under_budget = 0;
+	}
+}
+
+void LODGovernor::decreaseDetail(){
+	if(tess_scale > min_tess_scale)
+		tess_scale = std::max(tess_scale * tess_scale_step, min_tess_scale);
+	else
+		lod_bias = std::min(lod_bias + 1, max_lod_bias);
+}
+
+void LODGovernor::increaseDetail(){
+	if(lod_bias > 0)
+		--lod_bias;
+	else
+		tess_scale = std::min(tess_scale / tess_scale_step, 1.f);
+}
+
+void LODGovernor::printState(std::ostream &os) const{
+	os << "LOD governor " << (enabled ? "on" : "off")
+		<< " | target " << target_ms << " ms"
+		<< " | smoothed " << smoothed_ms << " ms"
+		<< " | tessellation scale " << getTessellationScale()
+		<< " | LOD bias " << getLODBias();
+}
@@ -0,0 +1,95 @@
+#include "LatencyMonitor.h"
+#include "Timer.h"
+#include "Trace.h"
+
+#include <algorithm>
+
+LatencyMonitor::LatencyMonitor() : next(0), sample_cursor(0){
+	for(unsigned int i = 0; i < ring_size; ++i){
+		glGenQueries(1, &pending[i].query);
+		pending[i].fence = nullptr;
+		pending[i].input_time = -1.0;
+	}
+	samples.reserve(window_size);
+}
+
+LatencyMonitor::~LatencyMonitor(){
+	for(unsigned int i = 0; i < ring_size; ++i){
+		glDeleteQueries(1, &pending[i].query);
+		if(pending[i].fence)
+			glDeleteSync(pending[i].fence);
+	}
+}
+
+void LatencyMonitor::frameSwapped(double input_time){
+	if(input_time < 0.0)
+		return;
+
+	// with every slot in flight the GPU is far behind, skip this frame rather than wait
+	Pending &frame = pending[next];
+	if(frame.fence)
+		return;
+
+	glQueryCounter(frame.query, GL_TIMESTAMP);
+	frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	frame.input_time = input_time;
+	next = (next + 1) % ring_size;
+}
+
+void LatencyMonitor::collect(){
+	// both clocks read back to back, the GPU one does not wait for queued work
+	GLint64 gpu_now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+	const double gpu_to_cpu = Timer::getCurrentTime() - gpu_now * 1e-9;
+
+	// oldest first, the fences signal in submission order
+	for(unsigned int n = 0; n < ring_size; ++n){
+		Pending &frame = pending[(next + n) % ring_size];
+		if(!frame.fence)
+			continue;
+		if(glClientWaitSync(frame.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+			break;
+
+		GLuint64 gpu_time = 0;
+		glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpu_time);
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+
+		const double latency_ms = (gpu_time * 1e-9 + gpu_to_cpu - frame.input_time) * 1000.0;
+		TRACE_COUNTER("input latency ms", latency_ms);
+
+		std::lock_guard<std::mutex> lock(samples_mutex);
+		if(samples.size() < window_size)
+			samples.push_back(latency_ms);
+		else
+			samples[sample_cursor] = latency_ms;
+		sample_cursor = (sample_cursor + 1) % window_size;
+	}
+}
+
+LatencyMonitor::Percentiles LatencyMonitor::getPercentiles() const{
+	std::vector<double> sorted;
+	{
+		std::lock_guard<std::mutex> lock(samples_mutex);
+		sorted = samples;
+	}
+
+	Percentiles result = {0.0, 0.0, 0.0, 0.0, sorted.size()};
+	if(sorted.empty())
+		return result;
+
+	std::sort(sorted.begin(), sorted.end());
+	const size_t last = sorted.size() - 1;
+	result.p50 = sorted[last * 50 / 100];
+	result.p90 = sorted[last * 90 / 100];
+	result.p99 = sorted[last * 99 / 100];
+	result.max = sorted[last];
+	return result;
+}
+
+void LatencyMonitor::printState(std::ostream &os) const{
+	const Percentiles latency = getPercentiles();
+	os << "input latency p50 " << latency.p50 << " ms, p90 " << latency.p90
+		<< " ms, p99 " << latency.p99 << " ms, max " << latency.max
+		<< " ms (" << latency.sample_count << " frames)";
+}
@@ -0,0 +1,250 @@
+#include "LooseOctree.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	enum Classification{
+		OUTSIDE,
+		INTERSECTING,
+		INSIDE
+	};
+
+	/**
+	 * Where a box lies against the frustum, conservatively. With a sweep, a plane only
+	 * rejects the box if the sweep does not carry it back across the plane, so a box
+	 * swept past the frustum between two planes can be kept even though it misses.
+	 */
+	Classification classify(const LooseOctree::Frustum &frustum, const glm::vec3 &min_dim,
+	                        const glm::vec3 &max_dim, const glm::vec3 &sweep){
+		Classification result = INSIDE;
+		for(unsigned int i = 0; i < 6; ++i){
+			const glm::vec3 normal(frustum.planes[i]);
+			const float offset = frustum.planes[i].w;
+			// the corners farthest along and against the normal
+			const glm::vec3 positive(normal.x >= 0.f ? max_dim.x : min_dim.x,
+			                         normal.y >= 0.f ? max_dim.y : min_dim.y,
+			                         normal.z >= 0.f ? max_dim.z : min_dim.z);
+			const glm::vec3 negative(normal.x >= 0.f ? min_dim.x : max_dim.x,
+			                         normal.y >= 0.f ? min_dim.y : max_dim.y,
+			                         normal.z >= 0.f ? min_dim.z : max_dim.z);
+			if(glm::dot(normal, positive) + offset < 0.f){
+				if(glm::dot(normal, sweep) <= 0.f)
+					return OUTSIDE;
+				result = INTERSECTING;
+			}
+			else if(glm::dot(normal, negative) + offset < 0.f){
+				result = INTERSECTING;
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * Slab test, t_enter is where the ray enters the box, 0 if it starts inside
+	 */
+	bool intersectBox(const glm::vec3 &origin, const glm::vec3 &inverse_direction,
+	                  const glm::vec3 &min_dim, const glm::vec3 &max_dim, float &t_enter){
+		const glm::vec3 t0 = (min_dim - origin) * inverse_direction;
+		const glm::vec3 t1 = (max_dim - origin) * inverse_direction;
+		const glm::vec3 t_near = glm::min(t0, t1);
+		const glm::vec3 t_far = glm::max(t0, t1);
+		const float t_min = std::max(std::max(t_near.x, t_near.y), std::max(t_near.z, 0.f));
+		const float t_max = std::min(std::min(t_far.x, t_far.y), t_far.z);
+		t_enter = t_min;
+		return t_min <= t_max;
+	}
+}
+
+LooseOctree::Frustum::Frustum(const glm::mat4 &view_projection){
+	// Gribb and Hartmann: the clip space conditions -w <= x, y, z <= w as planes in world space
+	glm::vec4 rows[4];
+	for(unsigned int i = 0; i < 4; ++i)
+		rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	for(unsigned int i = 0; i < 3; ++i){
+		planes[2 * i] = rows[3] + rows[i];
+		planes[2 * i + 1] = rows[3] - rows[i];
+	}
+	for(unsigned int i = 0; i < 6; ++i)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+LooseOctree::LooseOctree(const glm::vec3 &min_dim, const glm::vec3 &max_dim, unsigned int max_depth)
+	: max_depth(max_depth), nodes(1), object_count(0){
+	const glm::vec3 extent = max_dim - min_dim;
+	root_size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-3f));
+	root_min = (min_dim + max_dim) * 0.5f - glm::vec3(root_size * 0.5f);
+
+	Node &root = nodes[0];
+	root.min_dim = root_min - glm::vec3(root_size * 0.5f);
+	root.max_dim = root_min + glm::vec3(root_size * 1.5f);
+	root.parent = no_node;
+	std::fill(root.children, root.children + 8, 0u);
+	root.subtree_count = 0;
+}
+
+void LooseOctree::insert(uint32_t object, const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+	if(object >= objects.size()){
+		Object unused;
+		unused.node = no_node;
+		objects.resize(object + 1, unused);
+	}
+	if(objects[object].node != no_node)
+		unlink(object);
+	else
+		++object_count;
+	objects[object].min_dim = min_dim;
+	objects[object].max_dim = max_dim;
+	link(object, findNode(min_dim, max_dim));
+}
+
+void LooseOctree::update(uint32_t object, const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+	if(object >= objects.size() || objects[object].node == no_node){
+		insert(object, min_dim, max_dim);
+		return;
+	}
+	objects[object].min_dim = min_dim;
+	objects[object].max_dim = max_dim;
+	const uint32_t node = findNode(min_dim, max_dim);
+	if(node != objects[object].node){
+		unlink(object);
+		link(object, node);
+	}
+}
+
+void LooseOctree::remove(uint32_t object){
+	if(object >= objects.size() || objects[object].node == no_node)
+		return;
+	unlink(object);
+	objects[object].node = no_node;
+	--object_count;
+}
+
+void LooseOctree::queryFrustum(const Frustum &frustum, std::vector<uint32_t> &objects, const glm::vec3 &sweep) const{
+	if(nodes[0].subtree_count > 0)
+		queryFrustum(0, frustum, sweep, objects);
+}
+
+void LooseOctree::queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+                           std::vector<std::pair<float, uint32_t> > &hits) const{
+	hits.clear();
+	if(nodes[0].subtree_count > 0)
+		queryRay(0, origin, glm::vec3(1.f) / direction, hits);
+	std::sort(hits.begin(), hits.end());
+}
+
+uint32_t LooseOctree::findNode(const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+	const glm::vec3 center = (min_dim + max_dim) * 0.5f;
+	const glm::vec3 extent = max_dim - min_dim;
+	const float largest = std::max(std::max(extent.x, extent.y), extent.z);
+
+	// only the root takes objects that stick out of it
+	const glm::vec3 root_max = root_min + glm::vec3(root_size);
+	if(largest > root_size
+	   || center.x < root_min.x || center.y < root_min.y || center.z < root_min.z
+	   || center.x > root_max.x || center.y > root_max.y || center.z > root_max.z)
+		return 0;
+
+	// the deepest level whose cells are still as large as the box
+	unsigned int depth = 0;
+	float cell_size = root_size;
+	while(depth < max_depth && largest <= cell_size * 0.5f){
+		cell_size *= 0.5f;
+		++depth;
+	}
+
+	uint32_t node = 0;
+	glm::vec3 cell_min = root_min;
+	cell_size = root_size;
+	for(unsigned int level = 0; level < depth; ++level){
+		cell_size *= 0.5f;
+		const glm::vec3 middle = cell_min + glm::vec3(cell_size);
+		const unsigned int octant = (center.x >= middle.x ? 1 : 0)
+		                          | (center.y >= middle.y ? 2 : 0)
+		                          | (center.z >= middle.z ? 4 : 0);
+		cell_min = glm::vec3((octant & 1) ? middle.x : cell_min.x,
+		                     (octant & 2) ? middle.y : cell_min.y,
+		                     (octant & 4) ? middle.z : cell_min.z);
+		if(nodes[node].children[octant] == 0){
+			const uint32_t child = uint32_t(nodes.size());
+			nodes.push_back(Node());
+			Node &created = nodes.back();
+			created.min_dim = cell_min - glm::vec3(cell_size * 0.5f);
+			created.max_dim = cell_min + glm::vec3(cell_size * 1.5f);
+			created.parent = node;
+			std::fill(created.children, created.children + 8, 0u);
+			created.subtree_count = 0;
+			nodes[node].children[octant] = child;
+		}
+		node = nodes[node].children[octant];
+	}
+	return node;
+}
+
+void LooseOctree::link(uint32_t object, uint32_t node){
+	objects[object].node = node;
+	objects[object].slot = uint32_t(nodes[node].objects.size());
+	nodes[node].objects.push_back(object);
+	for(uint32_t ancestor = node; ancestor != no_node; ancestor = nodes[ancestor].parent)
+		++nodes[ancestor].subtree_count;
+}
+
+void LooseOctree::unlink(uint32_t object){
+	const uint32_t node = objects[object].node;
+	std::vector<uint32_t> &node_objects = nodes[node].objects;
+	const uint32_t last = node_objects.back();
+	node_objects[objects[object].slot] = last;
+	objects[last].slot = objects[object].slot;
+	node_objects.pop_back();
+	for(uint32_t ancestor = node; ancestor != no_node; ancestor = nodes[ancestor].parent)
+		--nodes[ancestor].subtree_count;
+}
+
+void LooseOctree::collect(uint32_t node, std::vector<uint32_t> &objects) const{
+	const Node &current = nodes[node];
+	objects.insert(objects.end(), current.objects.begin(), current.objects.end());
+	for(unsigned int i = 0; i < 8; ++i){
+		if(current.children[i] != 0 && nodes[current.children[i]].subtree_count > 0)
+			collect(current.children[i], objects);
+	}
+}
+
+void LooseOctree::queryFrustum(uint32_t node, const Frustum &frustum, const glm::vec3 &sweep,
+                               std::vector<uint32_t> &objects) const{
+	const Node &current = nodes[node];
+	for(uint32_t object : current.objects){
+		if(classify(frustum, this->objects[object].min_dim, this->objects[object].max_dim, sweep) != OUTSIDE)
+			objects.push_back(object);
+	}
+	for(unsigned int i = 0; i < 8; ++i){
+		const uint32_t child = current.children[i];
+		if(child == 0 || nodes[child].subtree_count == 0)
+			continue;
+		switch(classify(frustum, nodes[child].min_dim, nodes[child].max_dim, sweep)){
+		case INSIDE:
+			collect(child, objects);
+			break;
+		case INTERSECTING:
+			queryFrustum(child, frustum, sweep, objects);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void LooseOctree::queryRay(uint32_t node, const glm::vec3 &origin, const glm::vec3 &inverse_direction,
+                           std::vector<std::pair<float, uint32_t> > &hits) const{
+	const Node &current = nodes[node];
+	float t_enter;
+	for(uint32_t object : current.objects){
+		if(intersectBox(origin, inverse_direction, objects[object].min_dim, objects[object].max_dim, t_enter))
+			hits.push_back(std::make_pair(t_enter, object));
+	}
+	for(unsigned int i = 0; i < 8; ++i){
+		const uint32_t child = current.children[i];
+		if(child != 0 && nodes[child].subtree_count > 0
+		   && intersectBox(origin, inverse_direction, nodes[child].min_dim, nodes[child].max_dim, t_enter))
+			queryRay(child, origin, inverse_direction, hits);
+	}
+}
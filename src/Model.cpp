@@ -1,32 +1,64 @@
 #include "Model.h"
 
 #include "GameException.h"
+#include "ObjLoader.h"
+#include "TangentSpace.h"
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <mutex>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
 #include <IL/il.h>
 #include <IL/ilu.h>
 #include "GLUtils/GLUtils.hpp"
+#include "Trace.h"
 
-Model::Model(std::string filename, bool invert){
-	std::vector<float> vertex_data, normal_data, color_data, uv_data, tangent_data, binormal_data;
-	aiMatrix4x4 trafo;
-	aiIdentityMatrix4(&trafo);
+namespace {
+	// angle between two vertex normals at which an edge is considered fully curved
+	const float curvature_saturation_angle = glm::pi<float>() / 4.f;
+	// DevIL keeps its current image in global state
+	std::mutex devil_mutex;
+}
 
-	scene = aiImportFile(filename.c_str(), aiProcessPreset_TargetRealtime_Quality);// | aiProcess_FlipWindingOrder);
-	if(!scene){
-		std::string log = "Unable to load mesh from ";
-		log.append(filename);
-		THROW_EXCEPTION(log);
+Model::Model(std::string filename, std::string diffuse_map, std::string normal_map, std::string specular_map,
+             bool invert, Storage storage) : storage(storage), diffuse_texture(0), bump_texture(0), specular_texture(0){
+	TRACE_SCOPE("Model::Model");
+	std::vector<float> vertex_data, normal_data, color_data, uv_data, tangent_data, curvature_data;
+	if(ObjLoader::isObjFile(filename)){
+		TRACE_SCOPE("Model::loadObj");
+		loadObj(filename, invert, vertex_data, normal_data, uv_data, tangent_data, curvature_data);
 	}
+	else{
+		aiMatrix4x4 trafo;
+		aiIdentityMatrix4(&trafo);
+
+		const aiScene *scene;
+		{
+			TRACE_SCOPE("aiImportFile");
+			// the tangents come from TangentSpace, which also keeps mirrored UVs apart
+			scene = aiImportFile(filename.c_str(),
+			                     aiProcessPreset_TargetRealtime_Quality & ~aiProcess_CalcTangentSpace);// | aiProcess_FlipWindingOrder);
+		}
+		if(!scene){
+			std::string log = "Unable to load mesh from ";
+			log.append(filename);
+			THROW_EXCEPTION(log);
+		}
 
-	//Load the model recursively into data
-	min_dim = glm::vec3(std::numeric_limits<float>::max());
-	max_dim = glm::vec3(std::numeric_limits<float>::min());
-	findBBoxRecursive(scene, scene->mRootNode, min_dim, max_dim, &trafo);
+		//Load the model recursively into data
+		min_dim = glm::vec3(std::numeric_limits<float>::max());
+		max_dim = glm::vec3(std::numeric_limits<float>::min());
+		findBBoxRecursive(scene, scene->mRootNode, min_dim, max_dim, &trafo);
 
-	loadRecursive(root, invert, vertex_data, normal_data, color_data, uv_data, tangent_data, binormal_data, scene,
-	              scene->mRootNode);
+		{
+			TRACE_SCOPE("Model::loadRecursive");
+			loadRecursive(root, invert, vertex_data, normal_data, color_data, uv_data, tangent_data,
+			              curvature_data, scene, scene->mRootNode);
+		}
+		aiReleaseImport(scene);
+	}
 
 	//Translate to center
 	glm::vec3 translation = (max_dim - min_dim) / glm::vec3(2.0f) + min_dim;
@@ -39,37 +71,132 @@ Model::Model(std::string filename, bool invert){
 
 	n_vertices = vertex_data.size();
 
-	//Create the VBOs from the data.
-	if(fmod(static_cast<float>(n_vertices), 3.0f) < 0.000001f)
-		vertices.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(vertex_data.data(), n_vertices * sizeof(float)));
-	else
+	{
+		TRACE_SCOPE("Model BVH");
+		std::vector<glm::vec3> triangle_vertices(n_vertices / 3);
+		collectTriangles(root, glm::mat4(1.f), vertex_data, triangle_vertices);
+		std::sort(part_ranges.begin(), part_ranges.end(), [](const PartRange &a, const PartRange &b){
+			return a.first_triangle < b.first_triangle;
+		});
+		bvh.reset(new BVH(triangle_vertices));
+	}
+
+	if(fmod(static_cast<float>(n_vertices), 3.0f) >= 0.000001f)
 		THROW_EXCEPTION("The number of vertices in the mesh is wrong");
-	if(normal_data.size() == n_vertices)
-		normals.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(normal_data.data(), n_vertices * sizeof(float)));
 
-	if(color_data.size() == 4 * n_vertices / 3)
-		colors.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(color_data.data(), n_vertices * sizeof(float)));
+	if(storage == STORE_CPU){
+		// the same arrays the buffers would be made from
+		geometry.positions.swap(vertex_data);
+		if(normal_data.size() == n_vertices)
+			geometry.normals.swap(normal_data);
+		if(uv_data.size() == 2 * n_vertices / 3)
+			geometry.uvs.swap(uv_data);
+		if(tangent_data.size() == 4 * n_vertices / 3)
+			geometry.tangents.swap(tangent_data);
+		if(curvature_data.size() == n_vertices / 3)
+			geometry.edge_curvatures.swap(curvature_data);
+
+		// the maps can be left out here, for tools that only need the geometry
+		if(!diffuse_map.empty()){
+			std::cout << "Loading diffuse map... ";
+			loadImage(diffuse_map, diffuse_image);
+			std::cout << "Done" << std::endl;
+		}
+		if(!normal_map.empty()){
+			std::cout << "Loading normal map... ";
+			loadImage(normal_map, bump_image);
+			std::cout << "Done" << std::endl;
+		}
+		if(!specular_map.empty()){
+			std::cout << "Loading specular map... ";
+			loadImage(specular_map, specular_image);
+			std::cout << "Done" << std::endl;
+		}
+		return;
+	}
+
+	{
+		TRACE_SCOPE("Model VBO upload");
+		//Create the VBOs from the data.
+		vertices.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(vertex_data.data(), n_vertices * sizeof(float)));
+		if(normal_data.size() == n_vertices)
+			normals.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(normal_data.data(), n_vertices * sizeof(float)));
+
+		if(color_data.size() == 4 * n_vertices / 3)
+			colors.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(color_data.data(), n_vertices * sizeof(float)));
 
-	if(uv_data.size() == 2 * n_vertices / 3)
-		uvs.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(uv_data.data(), n_vertices * sizeof(float)));
+		if(uv_data.size() == 2 * n_vertices / 3)
+			uvs.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(uv_data.data(), n_vertices * sizeof(float)));
 
-	if(tangent_data.size() == n_vertices)
-		tangents.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(tangent_data.data(), n_vertices * sizeof(float)));
-	
-	if(binormal_data.size() == n_vertices)
-		binormals.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(binormal_data.data(), n_vertices * sizeof(float)));
+		if(tangent_data.size() == 4 * n_vertices / 3)
+			tangents.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(tangent_data.data(), tangent_data.size() * sizeof(float)));
+
+		if(curvature_data.size() == n_vertices / 3)
+			edge_curvatures.reset(new GLUtils::VBO<GL_ARRAY_BUFFER>(curvature_data.data(), curvature_data.size() * sizeof(float)));
+	}
 
 	std::cout << "Loading diffuse map... ";
-	diffuse_texture = loadTexture("textures/basketball/bball_diffuse.png");
+	diffuse_texture = loadTexture(diffuse_map);
 	std::cout << "Done\nLoading normal map... ";
-	bump_texture = loadTexture("textures/basketball/bball_normal.png");
+	bump_texture = loadTexture(normal_map);
 	std::cout << "Done\nLoading specular map... ";
-	specular_texture = loadTexture("textures/basketball/bball_specular.png");
+	specular_texture = loadTexture(specular_map);
 	std::cout << "Done" << std::endl;
 
 }
 
-Model::~Model(){ }
+Model::~Model(){
+	if(storage == STORE_CPU)
+		return;
+	glDeleteTextures(1, &diffuse_texture);
+	glDeleteTextures(1, &bump_texture);
+	glDeleteTextures(1, &specular_texture);
+}
+
+bool Model::intersect(const glm::vec3 &origin, const glm::vec3 &direction, Hit &hit) const{
+	BVH::Hit bvh_hit;
+	if(!bvh->intersect(origin, direction, bvh_hit))
+		return false;
+
+	hit.position = origin + direction * bvh_hit.distance;
+	hit.normal = bvh_hit.normal;
+	hit.distance = bvh_hit.distance;
+	hit.triangle = bvh_hit.triangle;
+	// the last part starting at or before the triangle
+	const auto range = std::upper_bound(part_ranges.begin(), part_ranges.end(), bvh_hit.triangle,
+	                                    [](unsigned int triangle, const PartRange &part_range){
+		return triangle < part_range.first_triangle;
+	});
+	hit.part = range != part_ranges.begin() ? (range - 1)->part : nullptr;
+	return true;
+}
+
+void Model::collectTriangles(const MeshPart &part, const glm::mat4 &parent_transform,
+                             const std::vector<float> &vertex_data, std::vector<glm::vec3> &triangle_vertices){
+	const glm::mat4 transform = parent_transform * part.transform;
+	if(part.count > 0){
+		PartRange range = {part.first / 3, &part};
+		part_ranges.push_back(range);
+	}
+	for(unsigned int v = part.first; v < part.first + part.count; ++v){
+		const glm::vec4 position(vertex_data[v * 3], vertex_data[v * 3 + 1], vertex_data[v * 3 + 2], 1.f);
+		triangle_vertices[v] = glm::vec3(transform * position);
+	}
+
+	for(size_t i = 0; i < part.children.size(); ++i)
+		collectTriangles(part.children[i], transform, vertex_data, triangle_vertices);
+}
+
+/**
+ * How far the PN patch bulges out of the flat triangle along an edge.
+ * ProjectToPlane in the TCS only moves the edge control points if the two
+ * vertex normals disagree, so the angle between them is used as the metric,
+ * mapped to [0, 1] where 0 is a flat edge.
+ */
+float Model::edgeCurvature(const glm::vec3 &n0, const glm::vec3 &n1){
+	const float cos_angle = glm::clamp(glm::dot(glm::normalize(n0), glm::normalize(n1)), -1.f, 1.f);
+	return glm::clamp(std::acos(cos_angle) / curvature_saturation_angle, 0.f, 1.f);
+}
 
 void Model::findBBoxRecursive(const aiScene *scene, const aiNode *node,
                               glm::vec3 &min_dim, glm::vec3 &max_dim, aiMatrix4x4 *trafo){
@@ -103,7 +230,7 @@ void Model::findBBoxRecursive(const aiScene *scene, const aiNode *node,
 void Model::loadRecursive(MeshPart &part, bool invert,
                           std::vector<float> &vertex_data, std::vector<float> &normal_data,
                           std::vector<float> &color_data, std::vector<float> &uv_data,
-                          std::vector<float> &tangent_data, std::vector<float> &binormal_data,
+                          std::vector<float> &tangent_data, std::vector<float> &curvature_data,
                           const aiScene *scene, const aiNode *node){
 	//update transform matrix. notice that we also transpose it
 	aiMatrix4x4 m = node->mTransformation;
@@ -111,25 +238,47 @@ void Model::loadRecursive(MeshPart &part, bool invert,
 		for(int i = 0; i < 4; ++i)
 			part.transform[j][i] = m[i][j];
 
+	// the meshes of a node are stored one after the other and drawn as one range
+	part.first = vertex_data.size() / 3;
+	part.count = 0;
+	part.min_dim = glm::vec3(std::numeric_limits<float>::max());
+	part.max_dim = glm::vec3(-std::numeric_limits<float>::max());
+
 	// draw all meshes assigned to this node
 	for(unsigned int n = 0; n < node->mNumMeshes; ++n){
 		const struct aiMesh *mesh = scene->mMeshes[node->mMeshes[n]];
-
-		part.first = vertex_data.size() / 3;
-		part.count = mesh->mNumFaces * 3;
+		const unsigned int mesh_count = mesh->mNumFaces * 3;
+		part.count += mesh_count;
 
 		//Allocate data
-		vertex_data.reserve(vertex_data.size() + part.count * 3);
-		if(mesh->HasNormals())
-			normal_data.reserve(normal_data.size() + part.count * 3);
+		vertex_data.reserve(vertex_data.size() + mesh_count * 3);
+		if(mesh->HasNormals()){
+			normal_data.reserve(normal_data.size() + mesh_count * 3);
+			curvature_data.reserve(curvature_data.size() + mesh_count);
+		}
 		if(mesh->mColors[0] != nullptr)
-			color_data.reserve(color_data.size() + part.count * 4);
+			color_data.reserve(color_data.size() + mesh_count * 4);
 		if(mesh->mTextureCoords[0] != nullptr)
-			uv_data.reserve(uv_data.size() + part.count * 2);
+			uv_data.reserve(uv_data.size() + mesh_count * 2);
 
 		if(mesh->HasNormals() && mesh->mTextureCoords[0] != nullptr){
-			tangent_data.reserve(tangent_data.size() + part.count * 3);
-			binormal_data.reserve(binormal_data.size() + part.count * 3);
+			// the mesh is indexed already, aiProcess_JoinIdenticalVertices welded it
+			std::vector<glm::vec3> positions(mesh->mNumVertices), normals(mesh->mNumVertices);
+			std::vector<glm::vec2> uvs(mesh->mNumVertices);
+			for(unsigned int v = 0; v < mesh->mNumVertices; ++v){
+				positions[v] = glm::vec3(mesh->mVertices[v].x, mesh->mVertices[v].y, mesh->mVertices[v].z);
+				normals[v] = glm::vec3(mesh->mNormals[v].x, mesh->mNormals[v].y, mesh->mNormals[v].z);
+				uvs[v] = glm::vec2(mesh->mTextureCoords[0][v].x, mesh->mTextureCoords[0][v].y);
+			}
+			std::vector<unsigned int> indices;
+			indices.reserve(mesh_count);
+			for(unsigned int t = 0; t < mesh->mNumFaces; ++t){
+				if(mesh->mFaces[t].mNumIndices != 3)
+					THROW_EXCEPTION("Only triangle meshes are supported");
+				indices.insert(indices.end(), mesh->mFaces[t].mIndices, mesh->mFaces[t].mIndices + 3);
+			}
+			tangent_data.reserve(tangent_data.size() + mesh_count * 4);
+			appendTangents(positions, normals, uvs, indices, invert, tangent_data);
 		}
 
 		//Add the vertices from file
@@ -139,24 +288,25 @@ void Model::loadRecursive(MeshPart &part, bool invert,
 			if(face->mNumIndices != 3)
 				THROW_EXCEPTION("Only triangle meshes are supported");
 
-			// storage to calculate the current face's binormals and tangents
-			std::vector<glm::vec3> face_vertices, face_normals;
-			std::vector<glm::vec2> face_uvs;
+			// storage to calculate the current face's edge curvatures
+			glm::vec3 face_normals[3];
 
 			for(unsigned int i = 0; i < face->mNumIndices; i++){
 				const int index = face->mIndices[i];
 				const auto v = mesh->mVertices[index];
-				face_vertices.push_back(glm::vec3{ v.x,v.y,v.z });
+				const glm::vec3 position(v.x, v.y, v.z);
 
 				vertex_data.push_back(v.x);
 				vertex_data.push_back(v.y);
 				vertex_data.push_back(v.z);
+				part.min_dim = glm::min(part.min_dim, position);
+				part.max_dim = glm::max(part.max_dim, position);
 
 				if(mesh->HasNormals()){
 					auto n = mesh->mNormals[index];
 					if(invert)
 						n = -n;
-					face_normals.push_back(glm::vec3{ n.x,n.y,n.z });
+					face_normals[i] = glm::vec3{ n.x,n.y,n.z };
 					normal_data.push_back(n.x);
 					normal_data.push_back(n.y);
 					normal_data.push_back(n.z);
@@ -170,41 +320,131 @@ void Model::loadRecursive(MeshPart &part, bool invert,
 				}
 				if(mesh->mTextureCoords[0] != nullptr){
 					auto uv = mesh->mTextureCoords[0][index];
-					face_uvs.push_back(glm::vec2{ uv.x, uv.y });
 					uv_data.push_back(uv.x);
 					uv_data.push_back(uv.y);
 				}
+			}
 
-				// the model is loaded by ASSIMP with the aiProcess_CalcTangentSpace flag
-				// so the tangents and binormals (bitangents) are calculated for us
-				if(mesh->mTangents != nullptr){
-					tangent_data.push_back(mesh->mTangents[index].x);
-					tangent_data.push_back(mesh->mTangents[index].y);
-					tangent_data.push_back(mesh->mTangents[index].z);
-
-					// as per description, if mTangents is filled, so is mBitangents
-					binormal_data.push_back(mesh->mBitangents[index].x);
-					binormal_data.push_back(mesh->mBitangents[index].y);
-					binormal_data.push_back(mesh->mBitangents[index].z);
-				}
+			// each vertex carries the curvature of the edge facing it, which is
+			// the edge the TCS tessellates with gl_TessLevelOuter[i]
+			if(mesh->HasNormals()){
+				curvature_data.push_back(edgeCurvature(face_normals[1], face_normals[2]));
+				curvature_data.push_back(edgeCurvature(face_normals[2], face_normals[0]));
+				curvature_data.push_back(edgeCurvature(face_normals[0], face_normals[1]));
 			}
 		}
 	}
 
+	if(part.count == 0){
+		part.min_dim = glm::vec3(0.f);
+		part.max_dim = glm::vec3(0.f);
+	}
+
 	// load all children
 	for(unsigned int n = 0; n < node->mNumChildren; ++n){
 		part.children.push_back(MeshPart());
 		loadRecursive(part.children.back(), invert, vertex_data, normal_data, color_data, uv_data, tangent_data,
-		              binormal_data, scene, node->mChildren[n]);
+		              curvature_data, scene, node->mChildren[n]);
+	}
+}
+
+void Model::loadObj(const std::string &filename, bool invert,
+                    std::vector<float> &vertex_data, std::vector<float> &normal_data, std::vector<float> &uv_data,
+                    std::vector<float> &tangent_data, std::vector<float> &curvature_data){
+	ObjLoader::Mesh mesh;
+	ObjLoader::load(filename, mesh);
+	const bool has_uvs = !mesh.uvs.empty();
+
+	const size_t corner_count = mesh.indices.size();
+	vertex_data.reserve(corner_count * 3);
+	normal_data.reserve(corner_count * 3);
+	curvature_data.reserve(corner_count);
+	if(has_uvs){
+		uv_data.reserve(corner_count * 2);
+		tangent_data.reserve(corner_count * 4);
+		// in the order of the corners, like the rest of the data below
+		appendTangents(mesh.positions, mesh.normals, mesh.uvs, mesh.indices, invert, tangent_data);
+	}
+
+	// the groups become the children of an empty root, as Assimp's OBJ importer makes them
+	min_dim = glm::vec3(std::numeric_limits<float>::max());
+	max_dim = glm::vec3(-std::numeric_limits<float>::max());
+	for(const ObjLoader::Group &group : mesh.groups){
+		root.children.push_back(MeshPart());
+		MeshPart &part = root.children.back();
+		part.first = group.first_triangle * 3;
+		part.count = group.triangle_count * 3;
+		part.min_dim = glm::vec3(std::numeric_limits<float>::max());
+		part.max_dim = glm::vec3(-std::numeric_limits<float>::max());
+
+		for(size_t t = part.first; t < part.first + part.count; t += 3){
+			glm::vec3 face_normals[3];
+			for(int c = 0; c < 3; ++c){
+				const unsigned int index = mesh.indices[t + c];
+				const glm::vec3 &v = mesh.positions[index];
+				vertex_data.push_back(v.x);
+				vertex_data.push_back(v.y);
+				vertex_data.push_back(v.z);
+				part.min_dim = glm::min(part.min_dim, v);
+				part.max_dim = glm::max(part.max_dim, v);
+
+				face_normals[c] = invert ? -mesh.normals[index] : mesh.normals[index];
+				normal_data.push_back(face_normals[c].x);
+				normal_data.push_back(face_normals[c].y);
+				normal_data.push_back(face_normals[c].z);
+
+				if(has_uvs){
+					uv_data.push_back(mesh.uvs[index].x);
+					uv_data.push_back(mesh.uvs[index].y);
+				}
+			}
+
+			curvature_data.push_back(edgeCurvature(face_normals[1], face_normals[2]));
+			curvature_data.push_back(edgeCurvature(face_normals[2], face_normals[0]));
+			curvature_data.push_back(edgeCurvature(face_normals[0], face_normals[1]));
+		}
+
+		min_dim = glm::min(min_dim, part.min_dim);
+		max_dim = glm::max(max_dim, part.max_dim);
+	}
+}
+
+void Model::appendTangents(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                           const std::vector<glm::vec2> &uvs, const std::vector<unsigned int> &indices,
+                           bool invert, std::vector<float> &tangent_data){
+	std::vector<glm::vec4> corner_tangents;
+	TangentSpace::generate(positions, normals, uvs, indices, corner_tangents);
+	for(size_t i = 0; i < corner_tangents.size(); ++i){
+		tangent_data.push_back(corner_tangents[i].x);
+		tangent_data.push_back(corner_tangents[i].y);
+		tangent_data.push_back(corner_tangents[i].z);
+		tangent_data.push_back(invert ? -corner_tangents[i].w : corner_tangents[i].w);
 	}
 }
 
 GLuint Model::loadTexture(std::string filename){
-	std::vector<unsigned char> data;
-	ILuint ImageName;
-	unsigned int width, height;
+	TRACE_SCOPE("Model::loadTexture");
+	Image image;
 	GLuint texture;
+	loadImage(filename, image);
+
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.rgb.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+	CHECK_GL_ERROR();
+
+	return texture;
+}
 
+void Model::loadImage(const std::string &filename, Image &image){
+	ILuint ImageName;
+
+	std::unique_lock<std::mutex> devil_lock(devil_mutex);
 	ilGenImages(1, &ImageName); // Grab a new image name.
 	ilBindImage(ImageName);
 
@@ -218,24 +458,12 @@ GLuint Model::loadTexture(std::string filename){
 		throw std::runtime_error(error.str());
 	}
 
-	width = ilGetInteger(IL_IMAGE_WIDTH); // getting image width
-	height = ilGetInteger(IL_IMAGE_HEIGHT); // and height
-	data.resize(width * height * 3);
+	image.width = ilGetInteger(IL_IMAGE_WIDTH); // getting image width
+	image.height = ilGetInteger(IL_IMAGE_HEIGHT); // and height
+	image.rgb.resize(image.width * image.height * 3);
 
-	ilCopyPixels(0, 0, 0, width, height, 1, IL_RGB, IL_UNSIGNED_BYTE, data.data());
+	ilCopyPixels(0, 0, 0, image.width, image.height, 1, IL_RGB, IL_UNSIGNED_BYTE, image.rgb.data());
 	ilDeleteImages(1, &ImageName); // Delete the image name. 
-
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
-	glBindTexture(GL_TEXTURE_2D, 0);
-	CHECK_GL_ERROR();
-
-	return texture;
 }
 
 void Model::bindDiffuseMap(GLuint texture_unit){
@@ -256,61 +484,3 @@ void Model::bindSpecularMap(GLuint texture_unit){
 void Model::unbindTexture(){
 	glBindTexture(GL_TEXTURE_2D, 0);
 }
-
-/**
- * Compute the tangents and binormals for each vertex per face.
- * tangent_data and binormal_data are out values;
- * 
- * This is a copy of what is shown on this tutorial:
- * http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/
- */
-/*void Model::compute_tangent_space(const std::vector<glm::vec3> &vertices,
-                                  const std::vector<glm::vec3> &normals,
-                                  const std::vector<glm::vec2> &uvs,
-                                  std::vector<float> &tangent_data_out, std::vector<float> &binormal_data_out){
-
-		auto &v0 = vertices[0];
-		auto &v1 = vertices[1];
-		auto &v2 = vertices[2];
-
-		auto &uv0 = uvs[0];
-		auto &uv1 = uvs[1];
-		auto &uv2 = uvs[2];
-
-
-		// position deltas (edges)
-		glm::vec3 edge1{ v1 - v0 };
-		glm::vec3 edge2{ v2 - v0 };
-
-		// UV delta ("texture span")
-		glm::vec2 deltaUV1{ uv1 - uv0  };
-		glm::vec2 deltaUV2{ uv2 - uv0  };
-
-		float UVdet = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
-		float r = 1.0f / UVdet;
-
-		glm::vec3 tangent = (edge1 * deltaUV2.y - edge2 * deltaUV1.y) * r;
-		glm::vec3 binormal = (edge2 * deltaUV1.x - edge1 * deltaUV2.x) * r;
-
-
-		for(int i = 0; i < 3; i++){
-			glm::vec3 n{ normals[i] };
-			auto t = tangent;
-			// Gram-Schmidt orthogonalize
-			t = glm::normalize(t - n * glm::dot(n, t));
-
-			// Calculate handedness
-			if (glm::dot(glm::cross(n, t), binormal) < 0.0f) {
-				t = t * -1.0f;
-			}
-
-			tangent_data_out.push_back(t.x);
-			tangent_data_out.push_back(t.y);
-			tangent_data_out.push_back(t.z);
-
-			binormal_data_out.push_back(binormal.x);
-			binormal_data_out.push_back(binormal.y);
-			binormal_data_out.push_back(binormal.z);			
-		}
-
-}*/
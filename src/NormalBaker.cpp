@@ -0,0 +1,224 @@
+#include "NormalBaker.h"
+
+#include "GameException.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <IL/il.h>
+
+namespace {
+	// rows of texels per task
+	const unsigned int rows_per_band = 8;
+	// how many texels the baked islands grow past their UV borders
+	const unsigned int dilation_passes = 4;
+	// texel centres this close outside a UV triangle still count, so that shared edges leave no gaps
+	const float inside_epsilon = 1e-6f;
+
+	float cross2(const glm::vec2 &a, const glm::vec2 &b){
+		return a.x * b.y - a.y * b.x;
+	}
+}
+
+NormalBaker::NormalBaker(const std::string &high_poly_path, const std::string &low_poly_path, float max_distance)
+	: max_distance(max_distance), width(0), height(0), covered_texels(0), missed_texels(0){
+	TRACE_SCOPE("NormalBaker::NormalBaker");
+	high_poly.reset(new Model(high_poly_path, "", "", "", false, Model::STORE_CPU));
+	low_poly.reset(new Model(low_poly_path, "", "", "", false, Model::STORE_CPU));
+	if(high_poly->getGeometry().normals.empty())
+		THROW_EXCEPTION(high_poly_path + " has no normals to bake");
+	if(low_poly->getGeometry().uvs.empty() || low_poly->getGeometry().tangents.empty())
+		THROW_EXCEPTION(low_poly_path + " has no UVs to bake into");
+
+	// Model scales every mesh into a unit box with its root transform. The low poly
+	// mesh takes the high poly one's in place of its own, so both stay where they
+	// were relative to each other in their files, in the space of the high poly BVH.
+	const glm::mat4 space = high_poly->getMesh().transform;
+	flatten(high_poly->getGeometry(), high_poly->getMesh(), space, high_surface);
+	flatten(low_poly->getGeometry(), low_poly->getMesh(), space, low_surface);
+}
+
+void NormalBaker::bake(unsigned int width, unsigned int height){
+	TRACE_SCOPE("NormalBaker::bake");
+	this->width = std::max(width, 1u);
+	this->height = std::max(height, 1u);
+	const float map_width = float(this->width);
+	const float map_height = float(this->height);
+
+	// the triangles whose UVs reach into each band of rows
+	const size_t triangle_count = low_surface.uvs.size() / 3;
+	const unsigned int band_count = (this->height + rows_per_band - 1) / rows_per_band;
+	std::vector<std::vector<uint32_t> > bands(band_count);
+	for(size_t t = 0; t < triangle_count; ++t){
+		const glm::vec2 *uv = &low_surface.uvs[3 * t];
+		const float min_v = std::min(std::min(uv[0].y, uv[1].y), uv[2].y);
+		const float max_v = std::max(std::max(uv[0].y, uv[1].y), uv[2].y);
+		const int y0 = std::max(0, int(std::ceil(min_v * map_height - 0.5f)));
+		const int y1 = std::min(int(this->height) - 1, int(std::floor(max_v * map_height - 0.5f)));
+		for(int band = y0 / int(rows_per_band); y0 <= y1 && band <= y1 / int(rows_per_band); ++band)
+			bands[band].push_back(uint32_t(t));
+	}
+
+	std::vector<glm::vec3> normals(this->width * this->height, glm::vec3(0.f, 0.f, 1.f));
+	// one byte per texel, the bands are written from several threads
+	std::vector<unsigned char> baked(this->width * this->height, 0);
+	const std::shared_ptr<BVH> bvh = high_poly->getBVH();
+	std::atomic<size_t> covered(0), missed(0);
+	parallelFor(band_count, [&](size_t band){
+		size_t band_covered = 0, band_missed = 0;
+		const int band_y0 = int(band * rows_per_band);
+		const int band_y1 = std::min(int(this->height), band_y0 + int(rows_per_band)) - 1;
+		for(uint32_t t : bands[band]){
+			const glm::vec2 *uv = &low_surface.uvs[3 * t];
+			const glm::vec2 edge1 = uv[1] - uv[0], edge2 = uv[2] - uv[0];
+			const float area = cross2(edge1, edge2);
+			if(area == 0.f)
+				continue;
+			const float min_u = std::min(std::min(uv[0].x, uv[1].x), uv[2].x);
+			const float max_u = std::max(std::max(uv[0].x, uv[1].x), uv[2].x);
+			const float min_v = std::min(std::min(uv[0].y, uv[1].y), uv[2].y);
+			const float max_v = std::max(std::max(uv[0].y, uv[1].y), uv[2].y);
+			const int x0 = std::max(0, int(std::ceil(min_u * map_width - 0.5f)));
+			const int x1 = std::min(int(this->width) - 1, int(std::floor(max_u * map_width - 0.5f)));
+			const int y0 = std::max(band_y0, int(std::ceil(min_v * map_height - 0.5f)));
+			const int y1 = std::min(band_y1, int(std::floor(max_v * map_height - 0.5f)));
+
+			const glm::vec3 *positions = &low_surface.positions[3 * t];
+			const glm::vec3 *vertex_normals = &low_surface.normals[3 * t];
+			const glm::vec4 *tangents = &low_surface.tangents[3 * t];
+			for(int y = y0; y <= y1; ++y){
+				for(int x = x0; x <= x1; ++x){
+					const glm::vec2 texel((float(x) + 0.5f) / map_width, (float(y) + 0.5f) / map_height);
+					const glm::vec2 offset = texel - uv[0];
+					const float b1 = cross2(offset, edge2) / area;
+					const float b2 = cross2(edge1, offset) / area;
+					const float b0 = 1.f - b1 - b2;
+					if(b0 < -inside_epsilon || b1 < -inside_epsilon || b2 < -inside_epsilon)
+						continue;
+
+					const glm::vec3 position = b0 * positions[0] + b1 * positions[1] + b2 * positions[2];
+					const glm::vec3 normal = glm::normalize(b0 * vertex_normals[0] + b1 * vertex_normals[1]
+					                                        + b2 * vertex_normals[2]);
+					const glm::vec3 tangent = b0 * glm::vec3(tangents[0]) + b1 * glm::vec3(tangents[1])
+					                        + b2 * glm::vec3(tangents[2]);
+
+					// from the cage back through the low poly surface, the first hit is the outermost detail
+					glm::vec3 detail_normal = normal;
+					BVH::Hit hit;
+					if(bvh->intersect(position + normal * max_distance, -normal, hit, 2.f * max_distance)){
+						const glm::vec3 *high_normals = &high_surface.normals[3 * hit.triangle];
+						detail_normal = glm::normalize((1.f - hit.barycentrics.x - hit.barycentrics.y) * high_normals[0]
+						                               + hit.barycentrics.x * high_normals[1]
+						                               + hit.barycentrics.y * high_normals[2]);
+					}
+					else{
+						++band_missed;
+					}
+
+					// the frame of the vertex shader, the faces of a triangle share their handedness
+					const glm::vec3 frame_tangent = glm::normalize(tangent - normal * glm::dot(normal, tangent));
+					const glm::vec3 frame_binormal = tangents[0].w * glm::cross(normal, frame_tangent);
+					const size_t index = size_t(y) * this->width + size_t(x);
+					normals[index] = glm::normalize(glm::vec3(glm::dot(frame_tangent, detail_normal),
+					                                          glm::dot(frame_binormal, detail_normal),
+					                                          glm::dot(normal, detail_normal)));
+					if(!baked[index])
+						++band_covered;
+					baked[index] = 1;
+				}
+			}
+		}
+		covered += band_covered;
+		missed += band_missed;
+	});
+	covered_texels = covered;
+	missed_texels = missed;
+
+	std::vector<bool> filled(baked.begin(), baked.end());
+	dilate(normals, filled, dilation_passes);
+
+	pixels.resize(3 * normals.size());
+	for(size_t i = 0; i < normals.size(); ++i){
+		for(int c = 0; c < 3; ++c)
+			pixels[3 * i + c] = (unsigned char) (glm::clamp(normals[i][c] * 0.5f + 0.5f, 0.f, 1.f) * 255.f + 0.5f);
+	}
+}
+
+void NormalBaker::writeImage(const std::string &filename) const{
+	ILuint image;
+	ilGenImages(1, &image);
+	ilBindImage(image);
+	// the rows are bottom up, which is DevIL's default origin
+	ilTexImage(width, height, 1, 3, IL_RGB, IL_UNSIGNED_BYTE, (void *) pixels.data());
+	ilEnable(IL_FILE_OVERWRITE);
+	const ILboolean saved = ilSaveImage(filename.c_str());
+	ilDeleteImages(1, &image);
+	if(!saved)
+		THROW_EXCEPTION("Unable to write " + filename);
+}
+
+void NormalBaker::flatten(const Model::Geometry &geometry, const MeshPart &part, const glm::mat4 &transform,
+                          Surface &surface){
+	// indexed like the vertex buffers, so that the triangles line up with the BVH's
+	const size_t corner_count = geometry.positions.size() / 3;
+	if(surface.positions.size() != corner_count){
+		surface.positions.assign(corner_count, glm::vec3(0.f));
+		surface.normals.assign(corner_count, glm::vec3(0.f, 0.f, 1.f));
+		surface.uvs.assign(geometry.uvs.empty() ? 0 : corner_count, glm::vec2(0.f));
+		surface.tangents.assign(geometry.tangents.empty() ? 0 : corner_count, glm::vec4(1.f, 0.f, 0.f, 1.f));
+	}
+
+	const glm::mat3 linear(transform);
+	const glm::mat3 normal_matrix = glm::transpose(glm::inverse(linear));
+	// a mirroring transform flips the handedness of the frames
+	const float handedness = glm::determinant(linear) < 0.f ? -1.f : 1.f;
+	for(unsigned int v = part.first; v < part.first + part.count; ++v){
+		surface.positions[v] = glm::vec3(transform * glm::vec4(geometry.positions[3 * v], geometry.positions[3 * v + 1],
+		                                                       geometry.positions[3 * v + 2], 1.f));
+		if(!geometry.normals.empty())
+			surface.normals[v] = glm::normalize(normal_matrix * glm::vec3(geometry.normals[3 * v], geometry.normals[3 * v + 1],
+			                                                              geometry.normals[3 * v + 2]));
+		if(!geometry.uvs.empty())
+			surface.uvs[v] = glm::vec2(geometry.uvs[2 * v], geometry.uvs[2 * v + 1]);
+		if(!geometry.tangents.empty()){
+			const glm::vec3 tangent = glm::normalize(linear * glm::vec3(geometry.tangents[4 * v], geometry.tangents[4 * v + 1],
+			                                                            geometry.tangents[4 * v + 2]));
+			surface.tangents[v] = glm::vec4(tangent, handedness * geometry.tangents[4 * v + 3]);
+		}
+	}
+
+	for(size_t i = 0; i < part.children.size(); ++i)
+		flatten(geometry, part.children[i], transform * part.children[i].transform, surface);
+}
+
+void NormalBaker::dilate(std::vector<glm::vec3> &normals, std::vector<bool> &filled, unsigned int passes) const{
+	std::vector<bool> next_filled;
+	for(unsigned int pass = 0; pass < passes; ++pass){
+		next_filled = filled;
+		for(unsigned int y = 0; y < height; ++y){
+			for(unsigned int x = 0; x < width; ++x){
+				const size_t index = size_t(y) * width + x;
+				if(filled[index])
+					continue;
+				glm::vec3 sum(0.f);
+				bool found = false;
+				for(int dy = -1; dy <= 1; ++dy){
+					for(int dx = -1; dx <= 1; ++dx){
+						const int nx = int(x) + dx, ny = int(y) + dy;
+						if(nx < 0 || ny < 0 || nx >= int(width) || ny >= int(height) || !filled[size_t(ny) * width + nx])
+							continue;
+						sum += normals[size_t(ny) * width + nx];
+						found = true;
+					}
+				}
+				if(found && glm::dot(sum, sum) > 0.f){
+					normals[index] = glm::normalize(sum);
+					next_filled[index] = true;
+				}
+			}
+		}
+		filled.swap(next_filled);
+	}
+}
@@ -0,0 +1,577 @@
+#include "ObjLoader.h"
+
+#include "GameException.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const size_t min_chunk_size = 1 << 20; //< below this the threads cost more than they save
+	const size_t chunks_per_thread = 4;
+	const unsigned int shard_bits = 6;
+	const size_t shard_count = size_t(1) << shard_bits;
+	const uint32_t missing_index = std::numeric_limits<uint32_t>::max();
+
+	/**
+	 * Read-only mapping of a whole file
+	 */
+	class MappedFile{
+	public:
+		explicit MappedFile(const std::string &filename) : data(nullptr), size(0){
+#ifdef _WIN32
+			mapping = nullptr;
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			                   FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if(file == INVALID_HANDLE_VALUE)
+				THROW_EXCEPTION("Unable to open " + filename);
+			LARGE_INTEGER file_size;
+			GetFileSizeEx(file, &file_size);
+			size = size_t(file_size.QuadPart);
+			if(size == 0)
+				return;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if(mapping)
+				data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+			descriptor = open(filename.c_str(), O_RDONLY);
+			if(descriptor < 0)
+				THROW_EXCEPTION("Unable to open " + filename);
+			struct stat file_stat;
+			fstat(descriptor, &file_stat);
+			size = size_t(file_stat.st_size);
+			if(size == 0)
+				return;
+			void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if(view != MAP_FAILED){
+				// every chunk is read at once, start paging in the whole file
+				madvise(view, size, MADV_WILLNEED);
+				data = static_cast<const char *>(view);
+			}
+#endif
+			if(!data){
+				close();
+				THROW_EXCEPTION("Unable to map " + filename);
+			}
+		}
+
+		~MappedFile(){
+			close();
+		}
+
+		const char *data;
+		size_t size;
+
+	private:
+		MappedFile(const MappedFile &);
+		MappedFile &operator=(const MappedFile &);
+
+		void close(){
+#ifdef _WIN32
+			if(data)
+				UnmapViewOfFile(data);
+			if(mapping)
+				CloseHandle(mapping);
+			CloseHandle(file);
+#else
+			if(data)
+				munmap(const_cast<char *>(data), size);
+			::close(descriptor);
+#endif
+			data = nullptr;
+		}
+
+#ifdef _WIN32
+		HANDLE file;
+		HANDLE mapping;
+#else
+		int descriptor;
+#endif
+	};
+
+	/**
+	 * One corner of a face as written in the file. Relative indices are
+	 * only known within their chunk until the chunks before it are counted.
+	 */
+	struct Corner{
+		int index[3]; //< v, vt, vn, 0-based
+		unsigned char relative; //< bit i set if index[i] counts from the start of the chunk
+		unsigned char present; //< bit i set if index[i] was given
+	};
+
+	struct GroupStart{
+		std::string name;
+		size_t triangle; //< first triangle, within the chunk
+	};
+
+	struct Key{
+		uint32_t v, vt, vn;
+		bool operator==(const Key &other) const{ return v == other.v && vt == other.vt && vn == other.vn; }
+	};
+
+	inline uint64_t hashKey(const Key &key){
+		uint64_t h = key.v * 0x9E3779B97F4A7C15ull;
+		h ^= key.vt * 0xC2B2AE3D27D4EB4Full;
+		h ^= key.vn * 0x165667B19E3779F9ull;
+		return h ^ (h >> 31);
+	}
+
+	struct BucketEntry{
+		Key key;
+		size_t corner; //< into the indices of the mesh
+	};
+
+	struct Chunk{
+		const char *begin;
+		const char *end;
+
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		std::vector<Corner> corners; //< three per triangle
+		std::vector<GroupStart> groups;
+
+		size_t position_offset;
+		size_t uv_offset;
+		size_t normal_offset;
+		size_t corner_offset;
+
+		std::vector<BucketEntry> buckets[shard_count]; //< the welded corners, by shard
+	};
+
+	struct Shard{
+		std::vector<Key> vertices; //< in the order they were first seen
+		size_t offset; //< of the first vertex in the mesh
+	};
+
+	inline bool isSpace(char c){
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c){
+		return c >= '0' && c <= '9';
+	}
+
+	inline void skipSpaces(const char *&p, const char *end){
+		while(p < end && isSpace(*p))
+			++p;
+	}
+
+	/**
+	 * Parses a decimal number and advances p past it. Up to 19 significant
+	 * digits are kept, and the scaling by a power of ten is exact up to 1e22,
+	 * so what the exporters write comes out within one float ulp.
+	 */
+	float parseFloat(const char *&p, const char *end){
+		static const double powers_of_ten[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		skipSpaces(p, end);
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		const char *digits_begin = p;
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		for(; p < end && isDigit(*p); ++p){
+			if(digits < 19){
+				mantissa = mantissa * 10 + unsigned(*p - '0');
+				if(mantissa != 0)
+					++digits;
+			}
+			else{
+				++exponent;
+			}
+		}
+		if(p < end && *p == '.'){
+			for(++p; p < end && isDigit(*p); ++p){
+				if(digits < 19){
+					mantissa = mantissa * 10 + unsigned(*p - '0');
+					--exponent;
+					if(mantissa != 0)
+						++digits;
+				}
+			}
+		}
+		if(p == digits_begin)
+			THROW_EXCEPTION("Expected a number in the OBJ file");
+
+		if(p < end && (*p == 'e' || *p == 'E')){
+			++p;
+			bool negative_exponent = false;
+			if(p < end && (*p == '-' || *p == '+'))
+				negative_exponent = *p++ == '-';
+			int written_exponent = 0;
+			for(; p < end && isDigit(*p); ++p)
+				written_exponent = std::min(written_exponent * 10 + (*p - '0'), 10000);
+			exponent += negative_exponent ? -written_exponent : written_exponent;
+		}
+
+		double value = double(mantissa);
+		if(exponent < 0)
+			value = exponent >= -22 ? value / powers_of_ten[-exponent] : value * std::pow(10.0, exponent);
+		else if(exponent > 0)
+			value = exponent <= 22 ? value * powers_of_ten[exponent] : value * std::pow(10.0, exponent);
+		return float(negative ? -value : value);
+	}
+
+	/**
+	 * Parses the number at p if the line goes on, the components an OBJ line may leave out default to 0
+	 */
+	float parseOptionalFloat(const char *&p, const char *end){
+		skipSpaces(p, end);
+		if(p == end || *p == '#')
+			return 0.f;
+		return parseFloat(p, end);
+	}
+
+	int parseInt(const char *&p, const char *end){
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+		if(p == end || !isDigit(*p))
+			THROW_EXCEPTION("Expected an index in the OBJ file");
+		int value = 0;
+		for(; p < end && isDigit(*p); ++p)
+			value = value * 10 + (*p - '0');
+		return negative ? -value : value;
+	}
+
+	/**
+	 * Turns a 1-based or negative index into a 0-based one, relative
+	 * ones count from the start of the chunk and may be negative
+	 */
+	inline void setIndex(Corner &corner, int slot, int index, size_t chunk_count){
+		if(index == 0)
+			THROW_EXCEPTION("Index 0 in the OBJ file");
+		corner.present |= 1 << slot;
+		if(index > 0){
+			corner.index[slot] = index - 1;
+		}
+		else{
+			corner.index[slot] = int(chunk_count) + index;
+			corner.relative |= 1 << slot;
+		}
+	}
+
+	void parseFace(const char *p, const char *end, Chunk &chunk, std::vector<Corner> &polygon){
+		polygon.clear();
+		// the corners end where the line or a comment does
+		for(skipSpaces(p, end); p < end && *p != '#'; skipSpaces(p, end)){
+			Corner corner = {{0, 0, 0}, 0, 0};
+			setIndex(corner, 0, parseInt(p, end), chunk.positions.size());
+			if(p < end && *p == '/'){
+				++p;
+				if(p < end && *p != '/')
+					setIndex(corner, 1, parseInt(p, end), chunk.uvs.size());
+				if(p < end && *p == '/'){
+					++p;
+					setIndex(corner, 2, parseInt(p, end), chunk.normals.size());
+				}
+			}
+			if(p < end && !isSpace(*p) && *p != '#')
+				THROW_EXCEPTION("Malformed face in the OBJ file");
+			polygon.push_back(corner);
+		}
+		if(polygon.size() < 3)
+			THROW_EXCEPTION("Face with less than three corners in the OBJ file");
+
+		for(size_t i = 2; i < polygon.size(); ++i){
+			chunk.corners.push_back(polygon[0]);
+			chunk.corners.push_back(polygon[i - 1]);
+			chunk.corners.push_back(polygon[i]);
+		}
+	}
+
+	void parseChunk(Chunk &chunk){
+		std::vector<Corner> polygon;
+		const char *line = chunk.begin;
+		while(line < chunk.end){
+			const char *line_end = static_cast<const char *>(std::memchr(line, '\n', chunk.end - line));
+			if(!line_end)
+				line_end = chunk.end;
+
+			const char *p = line;
+			skipSpaces(p, line_end);
+			const size_t length = line_end - p;
+			if(length >= 2 && p[0] == 'v' && isSpace(p[1])){
+				p += 2;
+				glm::vec3 position;
+				position.x = parseFloat(p, line_end);
+				position.y = parseFloat(p, line_end);
+				position.z = parseFloat(p, line_end);
+				chunk.positions.push_back(position);
+			}
+			else if(length >= 3 && p[0] == 'v' && p[1] == 't' && isSpace(p[2])){
+				p += 3;
+				glm::vec2 uv;
+				uv.x = parseFloat(p, line_end);
+				uv.y = parseOptionalFloat(p, line_end); // the w after it is optional as well, and not kept
+				chunk.uvs.push_back(uv);
+			}
+			else if(length >= 3 && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])){
+				p += 3;
+				glm::vec3 normal;
+				normal.x = parseFloat(p, line_end);
+				normal.y = parseFloat(p, line_end);
+				normal.z = parseFloat(p, line_end);
+				chunk.normals.push_back(normal);
+			}
+			else if(length >= 2 && p[0] == 'f' && isSpace(p[1])){
+				parseFace(p + 2, line_end, chunk, polygon);
+			}
+			else if(length >= 1 && (p[0] == 'o' || p[0] == 'g') && (length == 1 || isSpace(p[1]))){
+				const char *name_begin = p + 1;
+				skipSpaces(name_begin, line_end);
+				const char *name_end = line_end;
+				while(name_end > name_begin && isSpace(name_end[-1]))
+					--name_end;
+				GroupStart group;
+				group.name.assign(name_begin, name_end);
+				group.triangle = chunk.corners.size() / 3;
+				chunk.groups.push_back(group);
+			}
+			// comments, materials and smoothing groups are not needed
+
+			line = line_end + 1;
+		}
+	}
+
+	/**
+	 * Makes the indices of corner global and checks them
+	 */
+	Key resolveCorner(const Corner &corner, const size_t offsets[3], const size_t counts[3]){
+		uint32_t resolved[3];
+		for(int slot = 0; slot < 3; ++slot){
+			if(!(corner.present & (1 << slot))){
+				resolved[slot] = missing_index;
+				continue;
+			}
+			long long index = corner.index[slot];
+			if(corner.relative & (1 << slot))
+				index += (long long)offsets[slot];
+			if(index < 0 || index >= (long long)counts[slot])
+				THROW_EXCEPTION("Index out of range in the OBJ file");
+			resolved[slot] = uint32_t(index);
+		}
+		Key key = {resolved[0], resolved[1], resolved[2]};
+		return key;
+	}
+}
+
+bool ObjLoader::isObjFile(const std::string &filename){
+	if(filename.size() < 4)
+		return false;
+	std::string extension = filename.substr(filename.size() - 4);
+	for(size_t i = 0; i < extension.size(); ++i)
+		extension[i] = char(std::tolower(extension[i]));
+	return extension == ".obj";
+}
+
+void ObjLoader::load(const std::string &filename, Mesh &mesh){
+	TRACE_SCOPE("ObjLoader::load");
+	MappedFile file(filename);
+	if(file.size == 0)
+		THROW_EXCEPTION("No faces in " + filename);
+
+	// line-aligned chunks, a few per thread so that uneven ones balance out
+	const size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+	const size_t chunk_count = std::max<size_t>(1, std::min(file.size / min_chunk_size, thread_count * chunks_per_thread));
+	std::vector<Chunk> chunks(chunk_count);
+	const char *begin = file.data;
+	const char *file_end = file.data + file.size;
+	for(size_t i = 0; i < chunk_count; ++i){
+		const char *end = i + 1 == chunk_count ? file_end : file.data + file.size * (i + 1) / chunk_count;
+		if(end < begin)
+			end = begin;
+		const char *newline = static_cast<const char *>(std::memchr(end, '\n', file_end - end));
+		end = newline ? newline + 1 : file_end;
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		begin = end;
+	}
+
+	{
+		TRACE_SCOPE("parse chunks");
+		parallelFor(chunk_count, [&](size_t i){
+			parseChunk(chunks[i]);
+		});
+	}
+
+	// where every chunk's vertices and triangles start
+	size_t counts[3] = {0, 0, 0};
+	size_t corner_count = 0;
+	for(size_t i = 0; i < chunk_count; ++i){
+		chunks[i].position_offset = counts[0];
+		chunks[i].uv_offset = counts[1];
+		chunks[i].normal_offset = counts[2];
+		chunks[i].corner_offset = corner_count;
+		counts[0] += chunks[i].positions.size();
+		counts[1] += chunks[i].uvs.size();
+		counts[2] += chunks[i].normals.size();
+		corner_count += chunks[i].corners.size();
+	}
+	if(corner_count == 0)
+		THROW_EXCEPTION("No faces in " + filename);
+
+	std::vector<glm::vec3> file_positions(counts[0]);
+	std::vector<glm::vec2> file_uvs(counts[1]);
+	std::vector<glm::vec3> file_normals(counts[2]);
+	mesh.indices.resize(corner_count);
+	{
+		TRACE_SCOPE("resolve corners");
+		parallelFor(chunk_count, [&](size_t i){
+			Chunk &chunk = chunks[i];
+			std::copy(chunk.positions.begin(), chunk.positions.end(), file_positions.begin() + chunk.position_offset);
+			std::copy(chunk.uvs.begin(), chunk.uvs.end(), file_uvs.begin() + chunk.uv_offset);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), file_normals.begin() + chunk.normal_offset);
+
+			const size_t offsets[3] = {chunk.position_offset, chunk.uv_offset, chunk.normal_offset};
+			for(size_t c = 0; c < chunk.corners.size(); ++c){
+				BucketEntry entry;
+				entry.key = resolveCorner(chunk.corners[c], offsets, counts);
+				entry.corner = chunk.corner_offset + c;
+				chunk.buckets[hashKey(entry.key) >> (64 - shard_bits)].push_back(entry);
+			}
+			std::vector<Corner>().swap(chunk.corners);
+		});
+	}
+
+	// every shard welds its own keys, visiting the chunks in file order
+	std::vector<Shard> shards(shard_count);
+	{
+		TRACE_SCOPE("weld vertices");
+		parallelFor(shard_count, [&](size_t s){
+			size_t entry_count = 0;
+			for(size_t i = 0; i < chunk_count; ++i)
+				entry_count += chunks[i].buckets[s].size();
+
+			// open addressing with linear probing, at most half full; the low bits of
+			// the hash pick the slot, the high ones already picked the shard
+			size_t capacity = 16;
+			while(capacity < entry_count * 2)
+				capacity *= 2;
+			const size_t mask = capacity - 1;
+			std::vector<unsigned int> slots(capacity, missing_index); //< vertex within the shard
+
+			std::vector<Key> &vertices = shards[s].vertices;
+			for(size_t i = 0; i < chunk_count; ++i){
+				for(const BucketEntry &entry : chunks[i].buckets[s]){
+					size_t slot = size_t(hashKey(entry.key)) & mask;
+					while(slots[slot] != missing_index && !(vertices[slots[slot]] == entry.key))
+						slot = (slot + 1) & mask;
+					if(slots[slot] == missing_index){
+						slots[slot] = unsigned(vertices.size());
+						vertices.push_back(entry.key);
+					}
+					mesh.indices[entry.corner] = slots[slot];
+				}
+			}
+		});
+	}
+
+	size_t vertex_count = 0;
+	for(size_t s = 0; s < shard_count; ++s){
+		shards[s].offset = vertex_count;
+		vertex_count += shards[s].vertices.size();
+	}
+	if(vertex_count > std::numeric_limits<unsigned int>::max())
+		THROW_EXCEPTION("Too many vertices in " + filename);
+
+	mesh.positions.resize(vertex_count);
+	mesh.normals.resize(vertex_count);
+	mesh.uvs.assign(counts[1] > 0 ? vertex_count : 0, glm::vec2(0.f));
+	std::vector<uint32_t> vertex_position(vertex_count); //< position index in the file, to smooth normals over
+	bool normals_missing = false;
+	{
+		TRACE_SCOPE("gather vertices");
+		parallelFor(shard_count, [&](size_t s){
+			const Shard &shard = shards[s];
+			for(size_t i = 0; i < chunk_count; ++i){
+				for(const BucketEntry &entry : chunks[i].buckets[s])
+					mesh.indices[entry.corner] += unsigned(shard.offset);
+				std::vector<BucketEntry>().swap(chunks[i].buckets[s]);
+			}
+			for(size_t i = 0; i < shard.vertices.size(); ++i){
+				const Key &key = shard.vertices[i];
+				const size_t vertex = shard.offset + i;
+				vertex_position[vertex] = key.v;
+				mesh.positions[vertex] = file_positions[key.v];
+				if(key.vt != missing_index)
+					mesh.uvs[vertex] = file_uvs[key.vt];
+				mesh.normals[vertex] = key.vn != missing_index ? file_normals[key.vn] : glm::vec3(0.f);
+			}
+		});
+		for(size_t s = 0; s < shard_count && !normals_missing; ++s){
+			for(size_t i = 0; i < shards[s].vertices.size(); ++i){
+				if(shards[s].vertices[i].vn == missing_index){
+					normals_missing = true;
+					break;
+				}
+			}
+		}
+	}
+
+	if(normals_missing){
+		TRACE_SCOPE("smooth normals");
+		// the cross product is twice the area, so larger faces weigh more
+		std::vector<glm::vec3> position_normals(counts[0], glm::vec3(0.f));
+		for(size_t t = 0; t < mesh.indices.size(); t += 3){
+			const glm::vec3 &p0 = mesh.positions[mesh.indices[t]];
+			const glm::vec3 &p1 = mesh.positions[mesh.indices[t + 1]];
+			const glm::vec3 &p2 = mesh.positions[mesh.indices[t + 2]];
+			const glm::vec3 face_normal = glm::cross(p1 - p0, p2 - p0);
+			for(int c = 0; c < 3; ++c)
+				position_normals[vertex_position[mesh.indices[t + c]]] += face_normal;
+		}
+		for(size_t s = 0; s < shard_count; ++s){
+			for(size_t i = 0; i < shards[s].vertices.size(); ++i){
+				const Key &key = shards[s].vertices[i];
+				if(key.vn != missing_index)
+					continue;
+				const glm::vec3 &sum = position_normals[key.v];
+				const float length = glm::length(sum);
+				mesh.normals[shards[s].offset + i] = length > 0.f ? sum / length : glm::vec3(0.f, 0.f, 1.f);
+			}
+		}
+	}
+
+	// o and g lines split the triangles into groups, faces before the first one form an unnamed group
+	mesh.groups.clear();
+	Group current = {std::string(), 0, 0};
+	const unsigned int triangle_count = unsigned(corner_count / 3);
+	for(size_t i = 0; i < chunk_count; ++i){
+		for(const GroupStart &start : chunks[i].groups){
+			const unsigned int first = unsigned(chunks[i].corner_offset / 3 + start.triangle);
+			current.triangle_count = first - current.first_triangle;
+			if(current.triangle_count > 0)
+				mesh.groups.push_back(current);
+			current.name = start.name;
+			current.first_triangle = first;
+		}
+	}
+	current.triangle_count = triangle_count - current.first_triangle;
+	if(current.triangle_count > 0)
+		mesh.groups.push_back(current);
+}
@@ -0,0 +1,400 @@
+#include "RenderDevice.h"
+
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+	uint32_t toWord(float value){
+		uint32_t word;
+		std::memcpy(&word, &value, sizeof(word));
+		return word;
+	}
+
+	float toFloat(uint32_t word){
+		float value;
+		std::memcpy(&value, &word, sizeof(value));
+		return value;
+	}
+
+	// the number of argument words following each command in the stream
+	const size_t argument_counts[NullRenderDevice::COMMAND_COUNT] = {
+		1, // USE_PROGRAM
+		1, // BIND_VERTEX_ARRAY
+		3, // BIND_TEXTURE
+		1, // PATCH_VERTICES
+		2, // POLYGON_OFFSET
+		2, // UNIFORM_INT
+		2, // UNIFORM_FLOAT
+		3, // UNIFORM_VEC2
+		4, // UNIFORM_VEC3
+		10, // UNIFORM_MAT3
+		17, // UNIFORM_MAT4
+		2, // UNIFORM_FLOAT_ARRAY
+		2, // UNIFORM_VEC2_ARRAY
+		2, // UNIFORM_MAT4_ARRAY
+		3, // DRAW_ARRAYS
+		2, // DRAW_ARRAYS_INDIRECT
+		5 // DRAW_ARRAYS_INSTANCED
+	};
+
+	// the words per element the arrays add after their arguments, given by the count among them
+	size_t elementWords(NullRenderDevice::Command command){
+		switch(command){
+		case NullRenderDevice::UNIFORM_FLOAT_ARRAY: return 1;
+		case NullRenderDevice::UNIFORM_VEC2_ARRAY: return 2;
+		case NullRenderDevice::UNIFORM_MAT4_ARRAY: return 16;
+		default: return 0;
+		}
+	}
+}
+
+void GLRenderDevice::useProgram(GLuint program){
+	glUseProgram(program);
+}
+
+void GLRenderDevice::bindVertexArray(GLuint vertex_array){
+	glBindVertexArray(vertex_array);
+}
+
+void GLRenderDevice::bindTexture(GLuint unit, GLenum target, GLuint texture){
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glBindTexture(target, texture);
+}
+
+void GLRenderDevice::setUniform(GLint location, int value){
+	glUniform1i(location, value);
+}
+
+void GLRenderDevice::setUniform(GLint location, float value){
+	glUniform1f(location, value);
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::vec2 &value){
+	glUniform2fv(location, 1, glm::value_ptr(value));
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::vec3 &value){
+	glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::mat3 &value){
+	glUniformMatrix3fv(location, 1, 0, glm::value_ptr(value));
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::mat4 &value){
+	glUniformMatrix4fv(location, 1, 0, glm::value_ptr(value));
+}
+
+void GLRenderDevice::setUniform(GLint location, const float *values, GLsizei count){
+	glUniform1fv(location, count, values);
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::vec2 *values, GLsizei count){
+	glUniform2fv(location, count, glm::value_ptr(values[0]));
+}
+
+void GLRenderDevice::setUniform(GLint location, const glm::mat4 *values, GLsizei count){
+	glUniformMatrix4fv(location, count, 0, glm::value_ptr(values[0]));
+}
+
+void GLRenderDevice::setPatchVertices(GLint count){
+	glPatchParameteri(GL_PATCH_VERTICES, count);
+}
+
+void GLRenderDevice::setPolygonOffset(float factor, float units){
+	if(factor == 0.f && units == 0.f){
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		return;
+	}
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(factor, units);
+}
+
+void GLRenderDevice::drawArrays(GLenum mode, GLint first, GLsizei count){
+	glDrawArrays(mode, first, count);
+}
+
+void GLRenderDevice::drawArraysIndirect(GLenum mode, size_t offset){
+	glDrawArraysIndirect(mode, BUFFER_OFFSET(offset));
+}
+
+void GLRenderDevice::drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
+                                         GLuint base_instance){
+	glDrawArraysInstancedBaseInstance(mode, first, count, instance_count, base_instance);
+}
+
+NullRenderDevice::NullRenderDevice(bool record) : recording(record){
+	reset();
+}
+
+void NullRenderDevice::useProgram(GLuint program){
+	recordState(bound_program, program);
+	record(USE_PROGRAM, &program, 1);
+}
+
+void NullRenderDevice::bindVertexArray(GLuint vertex_array){
+	recordState(bound_vertex_array, vertex_array);
+	record(BIND_VERTEX_ARRAY, &vertex_array, 1);
+}
+
+void NullRenderDevice::bindTexture(GLuint unit, GLenum target, GLuint texture){
+	// the target is not told apart, no unit holds textures of two targets here
+	if(unit < texture_units)
+		recordState(bound_textures[unit], texture);
+	const uint32_t arguments[3] = {unit, target, texture};
+	record(BIND_TEXTURE, arguments, 3);
+}
+
+void NullRenderDevice::setPatchVertices(GLint count){
+	recordState(bound_patch_vertices, GLuint(count));
+	const uint32_t arguments[1] = {uint32_t(count)};
+	record(PATCH_VERTICES, arguments, 1);
+}
+
+void NullRenderDevice::setPolygonOffset(float factor, float units){
+	const uint32_t arguments[2] = {toWord(factor), toWord(units)};
+	record(POLYGON_OFFSET, arguments, 2);
+}
+
+void NullRenderDevice::setUniform(GLint location, int value){
+	const uint32_t arguments[2] = {uint32_t(location), uint32_t(value)};
+	record(UNIFORM_INT, arguments, 2);
+}
+
+void NullRenderDevice::setUniform(GLint location, float value){
+	const uint32_t arguments[2] = {uint32_t(location), toWord(value)};
+	record(UNIFORM_FLOAT, arguments, 2);
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::vec2 &value){
+	const uint32_t arguments[3] = {uint32_t(location), toWord(value.x), toWord(value.y)};
+	record(UNIFORM_VEC2, arguments, 3);
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::vec3 &value){
+	uint32_t arguments[4] = {uint32_t(location)};
+	for(int i = 0; i < 3; ++i)
+		arguments[1 + i] = toWord(value[i]);
+	record(UNIFORM_VEC3, arguments, 4);
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::mat3 &value){
+	uint32_t arguments[10] = {uint32_t(location)};
+	for(int column = 0; column < 3; ++column){
+		for(int row = 0; row < 3; ++row)
+			arguments[1 + 3 * column + row] = toWord(value[column][row]);
+	}
+	record(UNIFORM_MAT3, arguments, 10);
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::mat4 &value){
+	uint32_t arguments[17] = {uint32_t(location)};
+	for(int column = 0; column < 4; ++column){
+		for(int row = 0; row < 4; ++row)
+			arguments[1 + 4 * column + row] = toWord(value[column][row]);
+	}
+	record(UNIFORM_MAT4, arguments, 17);
+}
+
+void NullRenderDevice::setUniform(GLint location, const float *values, GLsizei count){
+	recordArray(UNIFORM_FLOAT_ARRAY, location, values, size_t(count));
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::vec2 *values, GLsizei count){
+	recordArray(UNIFORM_VEC2_ARRAY, location, glm::value_ptr(values[0]), 2 * size_t(count));
+}
+
+void NullRenderDevice::setUniform(GLint location, const glm::mat4 *values, GLsizei count){
+	recordArray(UNIFORM_MAT4_ARRAY, location, glm::value_ptr(values[0]), 16 * size_t(count));
+}
+
+void NullRenderDevice::drawArrays(GLenum mode, GLint first, GLsizei count){
+	const uint32_t arguments[3] = {mode, uint32_t(first), uint32_t(count)};
+	record(DRAW_ARRAYS, arguments, 3);
+}
+
+void NullRenderDevice::drawArraysIndirect(GLenum mode, size_t offset){
+	const uint32_t arguments[2] = {mode, uint32_t(offset)};
+	record(DRAW_ARRAYS_INDIRECT, arguments, 2);
+}
+
+void NullRenderDevice::drawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instance_count,
+                                           GLuint base_instance){
+	const uint32_t arguments[5] = {mode, uint32_t(first), uint32_t(count), uint32_t(instance_count), base_instance};
+	record(DRAW_ARRAYS_INSTANCED, arguments, 5);
+}
+
+size_t NullRenderDevice::getStateChanges() const{
+	return call_counts[USE_PROGRAM] + call_counts[BIND_VERTEX_ARRAY] + call_counts[BIND_TEXTURE]
+	       + call_counts[PATCH_VERTICES] + call_counts[POLYGON_OFFSET];
+}
+
+size_t NullRenderDevice::getUniformUploads() const{
+	size_t uploads = 0;
+	for(int command = UNIFORM_INT; command <= UNIFORM_MAT4_ARRAY; ++command)
+		uploads += call_counts[command];
+	return uploads;
+}
+
+size_t NullRenderDevice::getDrawCalls() const{
+	return call_counts[DRAW_ARRAYS] + call_counts[DRAW_ARRAYS_INDIRECT] + call_counts[DRAW_ARRAYS_INSTANCED];
+}
+
+void NullRenderDevice::replay(RenderDevice &device) const{
+	size_t i = 0;
+	while(i < stream.size()){
+		const Command command = Command(stream[i]);
+		if(command >= COMMAND_COUNT || i + 1 + argument_counts[command] > stream.size())
+			THROW_EXCEPTION("Corrupt render command stream");
+		const uint32_t *arguments = &stream[i + 1];
+		const GLint location = GLint(arguments[0]);
+		size_t words = argument_counts[command];
+		std::vector<float> elements;
+		if(elementWords(command) > 0){
+			words += elementWords(command) * arguments[1];
+			if(i + 1 + words > stream.size())
+				THROW_EXCEPTION("Corrupt render command stream");
+			for(size_t w = argument_counts[command]; w < words; ++w)
+				elements.push_back(toFloat(arguments[w]));
+		}
+		switch(command){
+		case USE_PROGRAM:
+			device.useProgram(arguments[0]);
+			break;
+		case BIND_VERTEX_ARRAY:
+			device.bindVertexArray(arguments[0]);
+			break;
+		case BIND_TEXTURE:
+			device.bindTexture(arguments[0], arguments[1], arguments[2]);
+			break;
+		case PATCH_VERTICES:
+			device.setPatchVertices(GLint(arguments[0]));
+			break;
+		case POLYGON_OFFSET:
+			device.setPolygonOffset(toFloat(arguments[0]), toFloat(arguments[1]));
+			break;
+		case UNIFORM_INT:
+			device.setUniform(location, int(arguments[1]));
+			break;
+		case UNIFORM_FLOAT:
+			device.setUniform(location, toFloat(arguments[1]));
+			break;
+		case UNIFORM_VEC2:
+			device.setUniform(location, glm::vec2(toFloat(arguments[1]), toFloat(arguments[2])));
+			break;
+		case UNIFORM_VEC3:
+			device.setUniform(location, glm::vec3(toFloat(arguments[1]), toFloat(arguments[2]), toFloat(arguments[3])));
+			break;
+		case UNIFORM_MAT3:{
+			glm::mat3 value;
+			for(int column = 0; column < 3; ++column){
+				for(int row = 0; row < 3; ++row)
+					value[column][row] = toFloat(arguments[1 + 3 * column + row]);
+			}
+			device.setUniform(location, value);
+			break;
+		}
+		case UNIFORM_MAT4:{
+			glm::mat4 value;
+			for(int column = 0; column < 4; ++column){
+				for(int row = 0; row < 4; ++row)
+					value[column][row] = toFloat(arguments[1 + 4 * column + row]);
+			}
+			device.setUniform(location, value);
+			break;
+		}
+		case UNIFORM_FLOAT_ARRAY:
+			device.setUniform(location, elements.data(), GLsizei(arguments[1]));
+			break;
+		case UNIFORM_VEC2_ARRAY:
+			device.setUniform(location, reinterpret_cast<const glm::vec2 *>(elements.data()), GLsizei(arguments[1]));
+			break;
+		case UNIFORM_MAT4_ARRAY:
+			device.setUniform(location, reinterpret_cast<const glm::mat4 *>(elements.data()), GLsizei(arguments[1]));
+			break;
+		case DRAW_ARRAYS:
+			device.drawArrays(arguments[0], GLint(arguments[1]), GLsizei(arguments[2]));
+			break;
+		case DRAW_ARRAYS_INDIRECT:
+			device.drawArraysIndirect(arguments[0], arguments[1]);
+			break;
+		case DRAW_ARRAYS_INSTANCED:
+			device.drawArraysInstanced(arguments[0], GLint(arguments[1]), GLsizei(arguments[2]), GLsizei(arguments[3]),
+			                           arguments[4]);
+			break;
+		default:
+			break;
+		}
+		i += 1 + words;
+	}
+}
+
+void NullRenderDevice::reset(){
+	std::fill(call_counts, call_counts + COMMAND_COUNT, size_t(0));
+	redundant_state_changes = 0;
+	stream.clear();
+	bound_program = 0;
+	bound_vertex_array = 0;
+	// the patch size the models draw with, set once at startup
+	bound_patch_vertices = 3;
+	std::fill(bound_textures, bound_textures + texture_units, 0u);
+}
+
+void NullRenderDevice::printCounts(std::ostream &out) const{
+	out << getStateChanges() << " state changes (" << redundant_state_changes << " redundant), "
+	    << getUniformUploads() << " uniform uploads, " << getDrawCalls() << " draw calls";
+	if(recording)
+		out << ", " << stream.size() * sizeof(uint32_t) << " bytes recorded";
+}
+
+const char *NullRenderDevice::getCommandName(Command command){
+	switch(command){
+	case USE_PROGRAM: return "useProgram";
+	case BIND_VERTEX_ARRAY: return "bindVertexArray";
+	case BIND_TEXTURE: return "bindTexture";
+	case PATCH_VERTICES: return "setPatchVertices";
+	case POLYGON_OFFSET: return "setPolygonOffset";
+	case UNIFORM_INT: return "setUniform(int)";
+	case UNIFORM_FLOAT: return "setUniform(float)";
+	case UNIFORM_VEC2: return "setUniform(vec2)";
+	case UNIFORM_VEC3: return "setUniform(vec3)";
+	case UNIFORM_MAT3: return "setUniform(mat3)";
+	case UNIFORM_MAT4: return "setUniform(mat4)";
+	case UNIFORM_FLOAT_ARRAY: return "setUniform(float[])";
+	case UNIFORM_VEC2_ARRAY: return "setUniform(vec2[])";
+	case UNIFORM_MAT4_ARRAY: return "setUniform(mat4[])";
+	case DRAW_ARRAYS: return "drawArrays";
+	case DRAW_ARRAYS_INDIRECT: return "drawArraysIndirect";
+	case DRAW_ARRAYS_INSTANCED: return "drawArraysInstanced";
+	default: return "unknown";
+	}
+}
+
+void NullRenderDevice::record(Command command, const uint32_t *arguments, size_t count){
+	++call_counts[command];
+	if(!recording)
+		return;
+	stream.push_back(uint32_t(command));
+	stream.insert(stream.end(), arguments, arguments + count);
+}
+
+void NullRenderDevice::recordState(GLuint &bound, GLuint name){
+	if(bound == name)
+		++redundant_state_changes;
+	bound = name;
+}
+
+void NullRenderDevice::recordArray(Command command, GLint location, const float *values, size_t words){
+	++call_counts[command];
+	if(!recording)
+		return;
+	stream.push_back(uint32_t(command));
+	stream.push_back(uint32_t(location));
+	stream.push_back(uint32_t(words / elementWords(command)));
+	for(size_t w = 0; w < words; ++w)
+		stream.push_back(toWord(values[w]));
+}
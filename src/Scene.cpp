@@ -0,0 +1,294 @@
+#include "Scene.h"
+
+#include "GameException.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/constants.hpp>
+
+namespace {
+	/**
+	 * Reads the options following the position of an instance or the spacing
+	 * of a grid: up to max_numbers plain numbers, then an optional orbit speed
+	 */
+	bool readOptions(std::istream &line, unsigned int max_numbers, float *numbers, unsigned int &number_count,
+	                 float &orbit_speed){
+		number_count = 0;
+		orbit_speed = 0.f;
+		std::string token;
+		while(line >> token){
+			if(token == "orbit"){
+				if(!(line >> orbit_speed))
+					return false;
+				continue;
+			}
+			std::istringstream number(token);
+			if(number_count == max_numbers || !(number >> numbers[number_count]))
+				return false;
+			++number_count;
+		}
+		return true;
+	}
+}
+
+Scene::Scene(const std::string &filename) : models_without_bounds(0), has_terrain(false), orbit_time(0.f){
+	std::ifstream file(filename.c_str());
+	if(!file.is_open())
+		THROW_EXCEPTION("Unable to open " + filename);
+
+	std::string text;
+	unsigned int line_number = 0;
+	while(std::getline(file, text)){
+		++line_number;
+		text = text.substr(0, text.find('#'));
+		std::istringstream line(text);
+		std::string statement;
+		if(!(line >> statement))
+			continue;
+
+		std::stringstream location;
+		location << filename << ":" << line_number << ": ";
+		if(statement == "model")
+			parseModel(line, location.str());
+		else if(statement == "instance")
+			parseInstance(line, location.str());
+		else if(statement == "grid")
+			parseGrid(line, location.str());
+		else if(statement == "streamed")
+			parseStreamed(line, location.str());
+		else if(statement == "terrain")
+			parseTerrain(line, location.str());
+		else
+			THROW_EXCEPTION(location.str() + "unknown statement " + statement);
+	}
+
+	if(instances.empty() && streamed_meshes.empty() && !has_terrain)
+		THROW_EXCEPTION(filename + " has no instances");
+
+	// drop the models nothing refers to, so that nothing loads them
+	std::vector<unsigned int> remap(models.size(), 0);
+	std::vector<bool> used(models.size(), false);
+	for(const Instance &instance : instances)
+		used[instance.model] = true;
+	std::vector<ModelDescription> used_models;
+	for(size_t i = 0; i < models.size(); ++i){
+		if(used[i]){
+			remap[i] = (unsigned int) used_models.size();
+			used_models.push_back(models[i]);
+		}
+	}
+	models.swap(used_models);
+	for(Instance &instance : instances)
+		instance.model = remap[instance.model];
+
+	model_bounds.resize(models.size());
+	has_bounds.assign(models.size(), false);
+	models_without_bounds = (unsigned int) models.size();
+}
+
+void Scene::setModelBounds(unsigned int model, const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+	model_bounds[model] = std::make_pair(min_dim, max_dim);
+	if(!has_bounds[model]){
+		has_bounds[model] = true;
+		--models_without_bounds;
+	}
+	if(models_without_bounds > 0)
+		return;
+
+	if(!octree){
+		for(uint32_t i = 0; i < instances.size(); ++i)
+			updateBounds(i);
+		buildOctree();
+	}
+	else{
+		for(uint32_t i = 0; i < instances.size(); ++i){
+			if(instances[i].model == model){
+				updateBounds(i);
+				octree->update(i, instances[i].min_dim, instances[i].max_dim);
+			}
+		}
+	}
+}
+
+void Scene::animate(float elapsed){
+	orbit_time += elapsed;
+	for(uint32_t i = 0; i < instances.size(); ++i){
+		Instance &instance = instances[i];
+		if(instance.orbit_speed == 0.f)
+			continue;
+		instance.transform = glm::rotate(glm::mat4(1.f), instance.orbit_speed * orbit_time, glm::vec3(0.f, 1.f, 0.f))
+		                   * base_transforms[i];
+		if(octree){
+			updateBounds(i);
+			octree->update(i, instance.min_dim, instance.max_dim);
+		}
+	}
+}
+
+void Scene::queryVisible(const glm::mat4 &view_projection, std::vector<uint32_t> &instances) const{
+	if(octree)
+		octree->queryFrustum(LooseOctree::Frustum(view_projection), instances);
+}
+
+void Scene::queryShadowCasters(const glm::mat4 &view_projection, const glm::vec3 &light_direction,
+                               std::vector<uint32_t> &instances) const{
+	if(octree)
+		octree->queryFrustum(LooseOctree::Frustum(view_projection), instances, light_direction);
+}
+
+void Scene::queryRay(const glm::vec3 &origin, const glm::vec3 &direction,
+                     std::vector<std::pair<float, uint32_t> > &hits) const{
+	hits.clear();
+	if(octree)
+		octree->queryRay(origin, direction, hits);
+}
+
+void Scene::parseModel(std::istream &line, const std::string &location){
+	ModelDescription model;
+	if(!(line >> model.name >> model.mesh_path >> model.diffuse_map_path >> model.normal_map_path
+	     >> model.specular_map_path))
+		THROW_EXCEPTION(location + "expected model <name> <mesh> <diffuse map> <normal map> <specular map>");
+	for(const ModelDescription &other : models){
+		if(other.name == model.name)
+			THROW_EXCEPTION(location + "model " + model.name + " is defined twice");
+	}
+	models.push_back(model);
+}
+
+void Scene::parseInstance(std::istream &line, const std::string &location){
+	std::string model_name;
+	glm::vec3 position;
+	float numbers[2];
+	unsigned int number_count;
+	float orbit_speed;
+	if(!(line >> model_name >> position.x >> position.y >> position.z)
+	   || !readOptions(line, 2, numbers, number_count, orbit_speed))
+		THROW_EXCEPTION(location + "expected instance <model> <x> <y> <z> [scale [yaw]] [orbit <speed>]");
+
+	const float scale = number_count > 0 ? numbers[0] : 1.f;
+	const float yaw = number_count > 1 ? glm::radians(numbers[1]) : 0.f;
+	addInstance(findModel(model_name, location),
+	            glm::translate(glm::mat4(1.f), position)
+	            * glm::rotate(glm::mat4(1.f), yaw, glm::vec3(0.f, 1.f, 0.f))
+	            * glm::scale(glm::mat4(1.f), glm::vec3(scale)),
+	            orbit_speed);
+}
+
+void Scene::parseGrid(std::istream &line, const std::string &location){
+	std::string model_name;
+	int nx, ny, nz;
+	float spacing;
+	float numbers[1];
+	unsigned int number_count;
+	float orbit_speed;
+	if(!(line >> model_name >> nx >> ny >> nz >> spacing) || nx < 1 || ny < 1 || nz < 1
+	   || !readOptions(line, 1, numbers, number_count, orbit_speed))
+		THROW_EXCEPTION(location + "expected grid <model> <nx> <ny> <nz> <spacing> [scale] [orbit <speed>]");
+
+	const unsigned int model = findModel(model_name, location);
+	const float scale = number_count > 0 ? numbers[0] : 1.f;
+	const glm::vec3 corner = -0.5f * spacing * glm::vec3(float(nx - 1), float(ny - 1), float(nz - 1));
+	for(int z = 0; z < nz; ++z){
+		for(int y = 0; y < ny; ++y){
+			for(int x = 0; x < nx; ++x){
+				const glm::vec3 position = corner + spacing * glm::vec3(float(x), float(y), float(z));
+				addInstance(model, glm::translate(glm::mat4(1.f), position) * glm::scale(glm::mat4(1.f), glm::vec3(scale)),
+				            orbit_speed);
+			}
+		}
+	}
+}
+
+void Scene::parseStreamed(std::istream &line, const std::string &location){
+	StreamedMesh mesh;
+	glm::vec3 position;
+	float numbers[2];
+	unsigned int number_count;
+	float orbit_speed;
+	// streamed meshes stay where they are placed, they are not animated with the instances
+	if(!(line >> mesh.cluster_path >> mesh.diffuse_map_path >> mesh.normal_map_path >> mesh.specular_map_path
+	     >> position.x >> position.y >> position.z)
+	   || !readOptions(line, 2, numbers, number_count, orbit_speed) || orbit_speed != 0.f)
+		THROW_EXCEPTION(location + "expected streamed <cluster file> <diffuse map> <normal map> <specular map> "
+		                "<x> <y> <z> [scale [yaw]]");
+
+	const float scale = number_count > 0 ? numbers[0] : 1.f;
+	const float yaw = number_count > 1 ? glm::radians(numbers[1]) : 0.f;
+	mesh.transform = glm::translate(glm::mat4(1.f), position)
+	               * glm::rotate(glm::mat4(1.f), yaw, glm::vec3(0.f, 1.f, 0.f))
+	               * glm::scale(glm::mat4(1.f), glm::vec3(scale));
+	streamed_meshes.push_back(mesh);
+}
+
+void Scene::parseTerrain(std::istream &line, const std::string &location){
+	if(has_terrain)
+		THROW_EXCEPTION(location + "the scene already has a terrain");
+	std::string rest;
+	if(!(line >> terrain.tile_path >> terrain.position.x >> terrain.position.y >> terrain.position.z >> terrain.size
+	     >> terrain.height) || terrain.size <= 0.f || terrain.height < 0.f || (line >> rest))
+		THROW_EXCEPTION(location + "expected terrain <tile file> <x> <y> <z> <size> <height>");
+	has_terrain = true;
+}
+
+unsigned int Scene::findModel(const std::string &name, const std::string &location) const{
+	for(size_t i = 0; i < models.size(); ++i){
+		if(models[i].name == name)
+			return (unsigned int) i;
+	}
+	THROW_EXCEPTION(location + "no model named " + name + " was defined before");
+}
+
+void Scene::addInstance(unsigned int model, const glm::mat4 &transform, float orbit_speed){
+	Instance instance;
+	instance.model = model;
+	instance.transform = transform;
+	instance.orbit_speed = orbit_speed;
+	instance.min_dim = glm::vec3(0.f);
+	instance.max_dim = glm::vec3(0.f);
+	instances.push_back(instance);
+	base_transforms.push_back(transform);
+}
+
+void Scene::updateBounds(uint32_t index){
+	Instance &instance = instances[index];
+	const glm::vec3 &model_min = model_bounds[instance.model].first;
+	const glm::vec3 &model_max = model_bounds[instance.model].second;
+
+	// the box around the transformed box: the centre is transformed, and every
+	// column of the matrix adds its absolute value times the half extent
+	const glm::vec3 center(instance.transform * glm::vec4((model_min + model_max) * 0.5f, 1.f));
+	const glm::vec3 half_extent = (model_max - model_min) * 0.5f;
+	glm::vec3 extent(0.f);
+	for(int column = 0; column < 3; ++column)
+		extent += glm::abs(glm::vec3(instance.transform[column])) * half_extent[column];
+	instance.min_dim = center - extent;
+	instance.max_dim = center + extent;
+}
+
+void Scene::buildOctree(){
+	glm::vec3 min_dim(std::numeric_limits<float>::max());
+	glm::vec3 max_dim(-std::numeric_limits<float>::max());
+	for(const Instance &instance : instances){
+		glm::vec3 instance_min = instance.min_dim;
+		glm::vec3 instance_max = instance.max_dim;
+		if(instance.orbit_speed != 0.f){
+			// the whole circle the box sweeps around the y axis
+			const glm::vec3 center = (instance.min_dim + instance.max_dim) * 0.5f;
+			const glm::vec3 half_extent = (instance.max_dim - instance.min_dim) * 0.5f;
+			const float radius = std::sqrt(center.x * center.x + center.z * center.z)
+			                   + std::sqrt(half_extent.x * half_extent.x + half_extent.z * half_extent.z);
+			instance_min.x = instance_min.z = -radius;
+			instance_max.x = instance_max.z = radius;
+		}
+		min_dim = glm::min(min_dim, instance_min);
+		max_dim = glm::max(max_dim, instance_max);
+	}
+
+	octree.reset(new LooseOctree(min_dim, max_dim));
+	for(uint32_t i = 0; i < instances.size(); ++i)
+		octree->insert(i, instances[i].min_dim, instances[i].max_dim);
+}
@@ -0,0 +1,724 @@
+#include "SoftwareRenderer.h"
+
+#include "GameException.h"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <IL/il.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARERENDERER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	// the lowest GL_MAX_TESS_GEN_LEVEL an implementation may have
+	const float max_tess_level = 64.f;
+	const unsigned int patches_per_task = 1024;
+	const size_t triangles_per_bin_task = 16384;
+	// how far past the viewport, in viewport sizes, triangles are rasterized instead of clipped
+	const float guard_band = 8.f;
+	// window coordinates are snapped to 1/256 of a pixel, like GPUs do
+	const float subpixel_steps = 256.f;
+	const uint32_t no_triangle = 0xFFFFFFFFu;
+	// the near plane and the four sides of the guard band
+	const unsigned int clip_plane_count = 5;
+
+	/**
+	 * What the vertex shader passes to the control shader
+	 */
+	struct PatchVertex{
+		glm::vec3 position; //< camera space
+		glm::vec3 normal; //< world space, what the PN patch is bent by
+		glm::vec2 uv;
+		glm::vec3 view; //< tangent space
+		glm::vec3 light; //< tangent space
+		float edge_curvature;
+	};
+
+	/**
+	 * The control points of calcPositions in the control shader, named alike
+	 */
+	struct PNPatch{
+		glm::vec3 b030, b021, b012, b003, b102, b201, b300, b210, b120, b111;
+	};
+
+	PatchVertex shadeVertex(const Model::Geometry &geometry, unsigned int corner,
+	                        const SoftwareRenderer::DrawState &state){
+		const glm::vec3 position(geometry.positions[3 * corner], geometry.positions[3 * corner + 1],
+		                         geometry.positions[3 * corner + 2]);
+		// attributes without data read as (0, 0, 0, 1), as for a disabled vertex attribute array
+		glm::vec3 normal(0.f);
+		glm::vec2 uv(0.f);
+		glm::vec4 tangent(0.f, 0.f, 0.f, 1.f);
+		float edge_curvature = 0.f;
+		if(!geometry.normals.empty())
+			normal = glm::vec3(geometry.normals[3 * corner], geometry.normals[3 * corner + 1], geometry.normals[3 * corner + 2]);
+		if(!geometry.uvs.empty())
+			uv = glm::vec2(geometry.uvs[2 * corner], geometry.uvs[2 * corner + 1]);
+		if(!geometry.tangents.empty())
+			tangent = glm::vec4(geometry.tangents[4 * corner], geometry.tangents[4 * corner + 1],
+			                    geometry.tangents[4 * corner + 2], geometry.tangents[4 * corner + 3]);
+		if(!geometry.edge_curvatures.empty())
+			edge_curvature = geometry.edge_curvatures[corner];
+
+		PatchVertex vertex;
+		vertex.normal = glm::normalize(glm::vec3(state.model * glm::vec4(normal, 0.f)));
+		vertex.position = glm::vec3(state.model_view * glm::vec4(position, 1.f));
+		vertex.uv = uv;
+		vertex.edge_curvature = edge_curvature;
+
+		const glm::vec3 light_normal = glm::normalize(state.normal * normal);
+		const glm::vec3 binormal = tangent.w * glm::cross(normal, glm::vec3(tangent));
+		const glm::vec3 tangent_camera = state.model_view_3x3 * glm::vec3(tangent);
+		const glm::vec3 binormal_camera = state.model_view_3x3 * binormal;
+		const glm::vec3 normal_camera = state.model_view_3x3 * light_normal;
+		// the rows of the TBN matrix
+		const glm::vec3 to_eye = -vertex.position;
+		const glm::vec3 to_light = state.light_position - vertex.position;
+		vertex.view = glm::vec3(glm::dot(tangent_camera, to_eye), glm::dot(binormal_camera, to_eye),
+		                        glm::dot(normal_camera, to_eye));
+		vertex.light = glm::vec3(glm::dot(tangent_camera, to_light), glm::dot(binormal_camera, to_light),
+		                         glm::dot(normal_camera, to_light));
+		return vertex;
+	}
+
+	glm::vec3 projectToPlane(const glm::vec3 &point, const glm::vec3 &plane_point, const glm::vec3 &plane_normal){
+		return point - glm::dot(point - plane_point, plane_normal) * plane_normal;
+	}
+
+	PNPatch createPatch(const PatchVertex vertices[3]){
+		PNPatch patch;
+		patch.b030 = vertices[0].position;
+		patch.b003 = vertices[1].position;
+		patch.b300 = vertices[2].position;
+
+		// edges are named by the opposing vertex
+		const glm::vec3 edge_b300 = patch.b003 - patch.b030;
+		const glm::vec3 edge_b030 = patch.b300 - patch.b003;
+		const glm::vec3 edge_b003 = patch.b030 - patch.b300;
+
+		patch.b021 = patch.b030 + edge_b300 / 3.f;
+		patch.b012 = patch.b030 + edge_b300 * 2.f / 3.f;
+		patch.b102 = patch.b003 + edge_b030 / 3.f;
+		patch.b201 = patch.b003 + edge_b030 * 2.f / 3.f;
+		patch.b210 = patch.b300 + edge_b003 / 3.f;
+		patch.b120 = patch.b300 + edge_b003 * 2.f / 3.f;
+
+		patch.b021 = projectToPlane(patch.b021, patch.b030, vertices[0].normal);
+		patch.b120 = projectToPlane(patch.b120, patch.b030, vertices[0].normal);
+		patch.b012 = projectToPlane(patch.b012, patch.b003, vertices[1].normal);
+		patch.b102 = projectToPlane(patch.b102, patch.b003, vertices[1].normal);
+		patch.b201 = projectToPlane(patch.b201, patch.b300, vertices[2].normal);
+		patch.b210 = projectToPlane(patch.b210, patch.b300, vertices[2].normal);
+
+		const glm::vec3 center = (patch.b003 + patch.b030 + patch.b300) / 3.f;
+		patch.b111 = (patch.b021 + patch.b012 + patch.b102 + patch.b201 + patch.b210 + patch.b120) / 6.f;
+		patch.b111 += (patch.b111 - center) / 2.f;
+		return patch;
+	}
+
+	float tessLevelPerCurvature(float level, float curvature){
+		return std::max(1.f, 1.f + (level - 1.f) * curvature);
+	}
+
+	float tessLevelPerBudget(float level, const SoftwareRenderer::DrawState &state){
+		return std::max(1.f, (level - state.lod_bias) * state.tess_scale);
+	}
+
+	/**
+	 * The segments equal_spacing cuts an edge into: the level clamped and rounded up
+	 */
+	unsigned int segmentCount(float level){
+		if(!(level >= 1.f))
+			return 1;
+		return (unsigned int) std::ceil(std::min(level, max_tess_level));
+	}
+
+	/**
+	 * The evaluation shader at gl_TessCoord (u, v, w), with the window position and what the fragment shader reads
+	 */
+	void evaluatePatch(const PNPatch &patch, const PatchVertex vertices[3], float u, float v, float w,
+	                   const glm::mat4 &projection, glm::vec4 &position, float *attributes){
+		const glm::vec2 uv = u * vertices[0].uv + v * vertices[1].uv + w * vertices[2].uv;
+		const glm::vec3 view = glm::normalize(u * vertices[0].view + v * vertices[1].view + w * vertices[2].view);
+		const glm::vec3 light = glm::normalize(u * vertices[0].light + v * vertices[1].light + w * vertices[2].light);
+		attributes[0] = uv.x;
+		attributes[1] = uv.y;
+		for(int i = 0; i < 3; ++i){
+			attributes[2 + i] = view[i];
+			attributes[5 + i] = light[i];
+		}
+
+		const glm::vec3 out_position = patch.b300 * (w * w * w) + patch.b030 * (u * u * u) + patch.b003 * (v * v * v)
+		                             + patch.b210 * (3.f * w * w * u) + patch.b120 * (3.f * w * u * u)
+		                             + patch.b201 * (3.f * w * w * v) + patch.b021 * (3.f * u * u * v)
+		                             + patch.b102 * (3.f * w * v * v) + patch.b012 * (3.f * u * v * v)
+		                             + patch.b111 * (6.f * w * u * v);
+		position = projection * glm::vec4(out_position, 1.f);
+	}
+
+	/**
+	 * Signed distance of a clip space position to a clip plane, negative outside
+	 */
+	float planeDistance(const glm::vec4 &position, unsigned int plane){
+		switch(plane){
+		case 0: return position.z + position.w;
+		case 1: return guard_band * position.w + position.x;
+		case 2: return guard_band * position.w - position.x;
+		case 3: return guard_band * position.w + position.y;
+		default: return guard_band * position.w - position.y;
+		}
+	}
+
+	/**
+	 * Bits of the sides of the view frustum a clip space position is outside of
+	 */
+	unsigned int outcode(const glm::vec4 &p){
+		return (p.x < -p.w ? 1u : 0u) | (p.x > p.w ? 2u : 0u) | (p.y < -p.w ? 4u : 0u) | (p.y > p.w ? 8u : 0u)
+		     | (p.z < -p.w ? 16u : 0u) | (p.z > p.w ? 32u : 0u);
+	}
+
+	/**
+	 * An edge function that gives the bit-identical value, negated, for the same edge walked the
+	 * other way, so that triangles sharing the edge neither overlap nor leave a gap along it
+	 */
+	struct EdgeFunction{
+		EdgeFunction(float x0, float y0, float x1, float y1){
+			// the top and left edges of a counter-clockwise triangle with y up own the pixels on them
+			top_left = y1 < y0 || (y1 == y0 && x1 < x0);
+			sign = 1.f;
+			if(x0 > x1 || (x0 == x1 && y0 > y1)){
+				std::swap(x0, x1);
+				std::swap(y0, y1);
+				sign = -1.f;
+			}
+			origin_x = x0;
+			origin_y = y0;
+			dx = x1 - x0;
+			dy = y1 - y0;
+		}
+
+		float evaluate(float x, float y) const{
+			return sign * ((y - origin_y) * dx - (x - origin_x) * dy);
+		}
+
+		float origin_x, origin_y, dx, dy, sign;
+		bool top_left;
+	};
+
+	/**
+	 * texture2D with GL_CLAMP_TO_EDGE and the filters of Model::loadTexture:
+	 * linear when magnified, nearest when minified
+	 */
+	glm::vec3 sample(const Model::Image &image, float u, float v, float texel_density){
+		if(image.width == 0 || image.height == 0)
+			return glm::vec3(0.f);
+		const float width = float(image.width);
+		const float height = float(image.height);
+		const unsigned char *rgb = image.rgb.data();
+		if(texel_density * width * height > 1.f){
+			float x = u * width, y = v * height;
+			x = x >= 0.f ? std::min(x, width - 1.f) : 0.f;
+			y = y >= 0.f ? std::min(y, height - 1.f) : 0.f;
+			const unsigned char *texel = rgb + 3 * ((unsigned int) y * image.width + (unsigned int) x);
+			return glm::vec3(texel[0], texel[1], texel[2]) * (1.f / 255.f);
+		}
+
+		// clamping the position clamps both texels of the filter to the edge
+		float x = u * width - 0.5f, y = v * height - 0.5f;
+		x = x >= 0.f ? std::min(x, width - 1.f) : 0.f;
+		y = y >= 0.f ? std::min(y, height - 1.f) : 0.f;
+		const unsigned int x0 = (unsigned int) x, y0 = (unsigned int) y;
+		const unsigned int x1 = std::min(x0 + 1, image.width - 1), y1 = std::min(y0 + 1, image.height - 1);
+		const float fx = x - float(x0), fy = y - float(y0);
+		glm::vec3 result(0.f);
+		for(int c = 0; c < 3; ++c){
+			const float bottom = rgb[3 * (y0 * image.width + x0) + c] * (1.f - fx) + rgb[3 * (y0 * image.width + x1) + c] * fx;
+			const float top = rgb[3 * (y1 * image.width + x0) + c] * (1.f - fx) + rgb[3 * (y1 * image.width + x1) + c] * fx;
+			result[c] = bottom * (1.f - fy) + top * fy;
+		}
+		return result * (1.f / 255.f);
+	}
+
+	unsigned char toByte(float value){
+		return (unsigned char) (glm::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+	}
+}
+
+SoftwareRenderer::SoftwareRenderer(unsigned int width, unsigned int height)
+	: width(std::max(width, 1u)), height(std::max(height, 1u)), triangle_count(0){
+	tiles_x = (this->width + tile_size - 1) / tile_size;
+	tiles_y = (this->height + tile_size - 1) / tile_size;
+	clear(glm::vec3(0.f));
+}
+
+void SoftwareRenderer::clear(const glm::vec3 &color){
+	depth.assign(width * height, 1.f);
+	pixels.resize(4 * width * height);
+	const unsigned char clear_pixel[4] = {toByte(color.x), toByte(color.y), toByte(color.z), 255};
+	for(size_t i = 0; i < pixels.size(); i += 4)
+		std::copy(clear_pixel, clear_pixel + 4, pixels.begin() + i);
+	draws.clear();
+}
+
+void SoftwareRenderer::draw(const std::shared_ptr<Model> &model, unsigned int first, unsigned int count,
+                            const DrawState &state){
+	if(model->getGeometry().positions.size() < 3 * size_t(first + count))
+		THROW_EXCEPTION("The draw range is outside the model, or the model is not in CPU storage");
+	Draw draw;
+	draw.model = model;
+	draw.first = first;
+	draw.count = count;
+	draw.state = state;
+	draws.push_back(draw);
+}
+
+void SoftwareRenderer::finish(){
+	TRACE_SCOPE("SoftwareRenderer::finish");
+	// the patches of all draws one after the other, cut into tasks of the same size
+	std::vector<size_t> draw_starts(draws.size() + 1, 0);
+	for(size_t i = 0; i < draws.size(); ++i)
+		draw_starts[i + 1] = draw_starts[i] + draws[i].count / 3;
+	const size_t patch_count = draw_starts.back();
+	const size_t task_count = (patch_count + patches_per_task - 1) / patches_per_task;
+
+	std::vector<std::vector<Triangle> > task_triangles(task_count);
+	{
+		TRACE_SCOPE("tessellate");
+		parallelFor(task_count, [&](size_t task){
+			const size_t begin = task * patches_per_task;
+			const size_t end = std::min(begin + patches_per_task, patch_count);
+			// the last draw starting at or before begin, which skips the empty ones
+			size_t draw = std::upper_bound(draw_starts.begin(), draw_starts.end(), begin) - draw_starts.begin() - 1;
+			for(size_t patch = begin; patch < end; ++draw){
+				const size_t draw_end = std::min(end, draw_starts[draw + 1]);
+				if(draw_end > patch)
+					tessellate(uint32_t(draw), unsigned(patch - draw_starts[draw]), unsigned(draw_end - draw_starts[draw]),
+					           task_triangles[task]);
+				patch = std::max(patch, draw_end);
+			}
+		});
+	}
+
+	// the triangles keep the order of the draws, which decides between equal depths
+	std::vector<size_t> task_offsets(task_count + 1, 0);
+	for(size_t i = 0; i < task_count; ++i)
+		task_offsets[i + 1] = task_offsets[i] + task_triangles[i].size();
+	triangles.resize(task_offsets.back());
+	parallelFor(task_count, [&](size_t task){
+		std::copy(task_triangles[task].begin(), task_triangles[task].end(), triangles.begin() + task_offsets[task]);
+		std::vector<Triangle>().swap(task_triangles[task]);
+	});
+
+	// every binning task keeps its own list per tile, the tiles read them in task order
+	const size_t bin_task_count = std::max<size_t>(1, (triangles.size() + triangles_per_bin_task - 1) / triangles_per_bin_task);
+	const unsigned int tile_count = tiles_x * tiles_y;
+	std::vector<std::vector<std::vector<uint32_t> > > bins(bin_task_count, std::vector<std::vector<uint32_t> >(tile_count));
+	{
+		TRACE_SCOPE("bin");
+		parallelFor(bin_task_count, [&](size_t task){
+			const size_t end = std::min(triangles.size(), (task + 1) * triangles_per_bin_task);
+			for(size_t i = task * triangles_per_bin_task; i < end; ++i){
+				const Vertex *v = triangles[i].vertices;
+				const float min_x = std::min(std::min(v[0].x, v[1].x), v[2].x);
+				const float max_x = std::max(std::max(v[0].x, v[1].x), v[2].x);
+				const float min_y = std::min(std::min(v[0].y, v[1].y), v[2].y);
+				const float max_y = std::max(std::max(v[0].y, v[1].y), v[2].y);
+				// the pixel centres inside the bounds
+				const int x0 = std::max(0, int(std::ceil(min_x - 0.5f)));
+				const int x1 = std::min(int(width) - 1, int(std::floor(max_x - 0.5f)));
+				const int y0 = std::max(0, int(std::ceil(min_y - 0.5f)));
+				const int y1 = std::min(int(height) - 1, int(std::floor(max_y - 0.5f)));
+				if(x0 > x1 || y0 > y1)
+					continue;
+				for(int tile_y = y0 / int(tile_size); tile_y <= y1 / int(tile_size); ++tile_y){
+					for(int tile_x = x0 / int(tile_size); tile_x <= x1 / int(tile_size); ++tile_x)
+						bins[task][tile_y * tiles_x + tile_x].push_back(uint32_t(i));
+				}
+			}
+		});
+	}
+
+	{
+		TRACE_SCOPE("rasterize and shade");
+		parallelFor(tile_count, [&](size_t tile){
+			renderTile((unsigned int) tile, bins);
+		});
+	}
+
+	triangle_count = triangles.size();
+	std::vector<Triangle>().swap(triangles);
+	draws.clear();
+}
+
+void SoftwareRenderer::writeImage(const std::string &filename) const{
+	ILuint image;
+	ilGenImages(1, &image);
+	ilBindImage(image);
+	// the rows are bottom up, which is DevIL's default origin
+	ilTexImage(width, height, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE, (void *) pixels.data());
+	ilEnable(IL_FILE_OVERWRITE);
+	const ILboolean saved = ilSaveImage(filename.c_str());
+	ilDeleteImages(1, &image);
+	if(!saved)
+		THROW_EXCEPTION("Unable to write " + filename);
+}
+
+void SoftwareRenderer::tessellate(uint32_t draw_index, unsigned int first_patch, unsigned int end_patch,
+                                  std::vector<Triangle> &triangles) const{
+	const Draw &draw = draws[draw_index];
+	const DrawState &state = draw.state;
+	const Model::Geometry &geometry = draw.model->getGeometry();
+	std::vector<ClipVertex> domain;
+
+	for(unsigned int p = first_patch; p < end_patch; ++p){
+		PatchVertex vertices[3];
+		for(unsigned int c = 0; c < 3; ++c)
+			vertices[c] = shadeVertex(geometry, draw.first + 3 * p + c, state);
+		const PNPatch patch = createPatch(vertices);
+
+		// the levels as the control shader sets them, outer[i] belongs to the edge facing vertex i
+		float outer[3] = {state.tess_level, state.tess_level, state.tess_level};
+		float inner = state.tess_level;
+		if(state.distance_lod){
+			float distances[3];
+			for(int i = 0; i < 3; ++i)
+				distances[i] = glm::length(vertices[i].position);
+			outer[0] = 48.f / (distances[1] + distances[2]);
+			outer[1] = 48.f / (distances[2] + distances[0]);
+			outer[2] = 48.f / (distances[0] + distances[1]);
+			inner = outer[2];
+		}
+		if(state.curvature_lod){
+			for(int i = 0; i < 3; ++i)
+				outer[i] = tessLevelPerCurvature(outer[i], vertices[i].edge_curvature);
+			inner = std::max(outer[0], std::max(outer[1], outer[2]));
+		}
+		unsigned int outer_segments[3];
+		for(int i = 0; i < 3; ++i)
+			outer_segments[i] = segmentCount(tessLevelPerBudget(outer[i], state));
+		unsigned int inner_segments = segmentCount(tessLevelPerBudget(inner, state));
+		// an inner level of 1 is taken as 2 as soon as any edge is split
+		if(inner_segments == 1 && std::max(outer_segments[0], std::max(outer_segments[1], outer_segments[2])) > 1)
+			inner_segments = 2;
+
+		// a uniform grid fine enough for every edge, with (u, v) = (i, j) / n
+		const unsigned int n = std::max(inner_segments, std::max(outer_segments[0],
+		                                std::max(outer_segments[1], outer_segments[2])));
+		domain.resize((n + 1) * (n + 2) / 2);
+		unsigned int index = 0;
+		for(unsigned int j = 0; j <= n; ++j){
+			for(unsigned int i = 0; i + j <= n; ++i, ++index){
+				ClipVertex &vertex = domain[index];
+				const float u = float(i) / float(n), v = float(j) / float(n);
+				// the edge the point lies on, if its level differs from the grid
+				int edge = -1;
+				if(i == 0 && outer_segments[0] != n)
+					edge = 0;
+				else if(j == 0 && outer_segments[1] != n)
+					edge = 1;
+				else if(i + j == n && outer_segments[2] != n)
+					edge = 2;
+				if(edge < 0){
+					evaluatePatch(patch, vertices, u, v, 1.f - u - v, state.projection, vertex.position, vertex.attributes);
+					continue;
+				}
+
+				// moved onto the nearest vertex of the edge's own tessellation, the triangles that
+				// collapse are culled and the neighbouring patch meets the edge without T-junctions
+				const float segments = float(outer_segments[edge]);
+				const float t = std::floor((edge == 0 ? v : u) * segments + 0.5f) / segments;
+				const glm::vec3 uvw = edge == 0 ? glm::vec3(0.f, t, 1.f - t)
+				                    : edge == 1 ? glm::vec3(t, 0.f, 1.f - t)
+				                    : glm::vec3(t, 1.f - t, 0.f);
+				evaluatePatch(patch, vertices, uvw.x, uvw.y, uvw.z, state.projection, vertex.position, vertex.attributes);
+			}
+		}
+
+		// two triangles per grid cell, counter-clockwise like the patch
+		unsigned int row = 0;
+		for(unsigned int j = 0; j < n; ++j){
+			const unsigned int next_row = row + n + 1 - j;
+			for(unsigned int i = 0; i + j < n; ++i){
+				emitTriangle(domain[row + i], domain[row + i + 1], domain[next_row + i], draw_index, triangles);
+				if(i + j + 1 < n)
+					emitTriangle(domain[row + i + 1], domain[next_row + i + 1], domain[next_row + i], draw_index, triangles);
+			}
+			row = next_row;
+		}
+	}
+}
+
+void SoftwareRenderer::emitTriangle(const ClipVertex &v0, const ClipVertex &v1, const ClipVertex &v2, uint32_t draw,
+                                    std::vector<Triangle> &triangles) const{
+	// nothing to draw if all corners are outside the same side of the view frustum
+	if(outcode(v0.position) & outcode(v1.position) & outcode(v2.position))
+		return;
+
+	ClipVertex polygons[2][3 + clip_plane_count];
+	unsigned int vertex_count = 3;
+	polygons[0][0] = v0;
+	polygons[0][1] = v1;
+	polygons[0][2] = v2;
+	unsigned int current = 0;
+	for(unsigned int plane = 0; plane < clip_plane_count; ++plane){
+		float distances[3 + clip_plane_count];
+		bool all_inside = true;
+		for(unsigned int i = 0; i < vertex_count; ++i){
+			distances[i] = planeDistance(polygons[current][i].position, plane);
+			all_inside = all_inside && distances[i] >= 0.f;
+		}
+		if(all_inside)
+			continue;
+
+		// Sutherland-Hodgman against the plane
+		const ClipVertex *in = polygons[current];
+		ClipVertex *out = polygons[1 - current];
+		unsigned int out_count = 0;
+		for(unsigned int i = 0; i < vertex_count; ++i){
+			const unsigned int next = (i + 1) % vertex_count;
+			if(distances[i] >= 0.f)
+				out[out_count++] = in[i];
+			if((distances[i] >= 0.f) != (distances[next] >= 0.f)){
+				const float t = distances[i] / (distances[i] - distances[next]);
+				ClipVertex &vertex = out[out_count++];
+				vertex.position = in[i].position + (in[next].position - in[i].position) * t;
+				for(unsigned int a = 0; a < attribute_count; ++a)
+					vertex.attributes[a] = in[i].attributes[a] + (in[next].attributes[a] - in[i].attributes[a]) * t;
+			}
+		}
+		vertex_count = out_count;
+		current = 1 - current;
+		if(vertex_count < 3)
+			return;
+	}
+
+	// to window coordinates, then fanned back into triangles
+	Vertex window[3 + clip_plane_count];
+	for(unsigned int i = 0; i < vertex_count; ++i){
+		const ClipVertex &clip = polygons[current][i];
+		Vertex &vertex = window[i];
+		vertex.inverse_w = 1.f / clip.position.w;
+		const float x = (clip.position.x * vertex.inverse_w * 0.5f + 0.5f) * float(width);
+		const float y = (clip.position.y * vertex.inverse_w * 0.5f + 0.5f) * float(height);
+		vertex.x = std::floor(x * subpixel_steps + 0.5f) / subpixel_steps;
+		vertex.y = std::floor(y * subpixel_steps + 0.5f) / subpixel_steps;
+		vertex.z = clip.position.z * vertex.inverse_w * 0.5f + 0.5f;
+		std::copy(clip.attributes, clip.attributes + attribute_count, vertex.attributes);
+	}
+	for(unsigned int i = 1; i + 1 < vertex_count; ++i){
+		const Vertex &a = window[0], &b = window[i], &c = window[i + 1];
+		// back faces and degenerate triangles, front faces wind counter-clockwise
+		const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+		if(!(area > 0.f))
+			continue;
+		Triangle triangle;
+		triangle.vertices[0] = a;
+		triangle.vertices[1] = b;
+		triangle.vertices[2] = c;
+		triangle.draw = draw;
+		const float uv_area = (b.attributes[0] - a.attributes[0]) * (c.attributes[1] - a.attributes[1])
+		                    - (c.attributes[0] - a.attributes[0]) * (b.attributes[1] - a.attributes[1]);
+		triangle.texel_density = std::abs(uv_area) / area;
+		triangles.push_back(triangle);
+	}
+}
+
+void SoftwareRenderer::renderTile(unsigned int tile, const std::vector<std::vector<std::vector<uint32_t> > > &bins){
+	const int tile_x = int(tile % tiles_x * tile_size);
+	const int tile_y = int(tile / tiles_x * tile_size);
+	const int tile_width = std::min(int(tile_size), int(width) - tile_x);
+	const int tile_height = std::min(int(tile_size), int(height) - tile_y);
+
+	// the nearest triangle of every pixel and the weights of its second and third vertex there
+	std::vector<uint32_t> ids(tile_size * tile_size, no_triangle);
+	std::vector<float> weights1(tile_size * tile_size), weights2(tile_size * tile_size);
+
+	for(size_t task = 0; task < bins.size(); ++task){
+		for(uint32_t index : bins[task][tile]){
+			const Triangle &triangle = triangles[index];
+			const Vertex *v = triangle.vertices;
+			const float min_x = std::min(std::min(v[0].x, v[1].x), v[2].x);
+			const float max_x = std::max(std::max(v[0].x, v[1].x), v[2].x);
+			const float min_y = std::min(std::min(v[0].y, v[1].y), v[2].y);
+			const float max_y = std::max(std::max(v[0].y, v[1].y), v[2].y);
+			const int x0 = std::max(tile_x, int(std::ceil(min_x - 0.5f)));
+			const int x1 = std::min(tile_x + tile_width - 1, int(std::floor(max_x - 0.5f)));
+			const int y0 = std::max(tile_y, int(std::ceil(min_y - 0.5f)));
+			const int y1 = std::min(tile_y + tile_height - 1, int(std::floor(max_y - 0.5f)));
+			if(x0 > x1 || y0 > y1)
+				continue;
+
+			// edge i faces vertex i, it is the area of the triangle at that vertex
+			const EdgeFunction edges[3] = {EdgeFunction(v[1].x, v[1].y, v[2].x, v[2].y),
+			                               EdgeFunction(v[2].x, v[2].y, v[0].x, v[0].y),
+			                               EdgeFunction(v[0].x, v[0].y, v[1].x, v[1].y)};
+			const float inverse_area = 1.f / ((v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y));
+			const float z0 = v[0].z, dz1 = v[1].z - v[0].z, dz2 = v[2].z - v[0].z;
+
+			for(int y = y0; y <= y1; ++y){
+				const float center_y = float(y) + 0.5f;
+				float *depth_row = &depth[size_t(y) * width];
+				const size_t tile_row = size_t(y - tile_y) * tile_size;
+#ifdef SOFTWARERENDERER_SSE
+				__m128 row_terms[3], origins_x[3], slopes[3], signs[3], ties[3];
+				for(int e = 0; e < 3; ++e){
+					row_terms[e] = _mm_set1_ps((center_y - edges[e].origin_y) * edges[e].dx);
+					origins_x[e] = _mm_set1_ps(edges[e].origin_x);
+					slopes[e] = _mm_set1_ps(edges[e].dy);
+					signs[e] = _mm_set1_ps(edges[e].sign);
+					ties[e] = edges[e].top_left ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : _mm_setzero_ps();
+				}
+				const __m128 zero = _mm_setzero_ps();
+				const __m128 one = _mm_set1_ps(1.f);
+				const __m128 lane_offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+				const __m128 last_x = _mm_set1_ps(float(x1) + 0.5f);
+				for(int x = x0; x <= x1; x += 4){
+					const __m128 center_x = _mm_add_ps(_mm_set1_ps(float(x)), lane_offsets);
+					__m128 mask = _mm_cmple_ps(center_x, last_x);
+					__m128 values[3];
+					for(int e = 0; e < 3; ++e){
+						values[e] = _mm_mul_ps(signs[e], _mm_sub_ps(row_terms[e],
+						                       _mm_mul_ps(_mm_sub_ps(center_x, origins_x[e]), slopes[e])));
+						const __m128 inside = _mm_or_ps(_mm_cmpgt_ps(values[e], zero),
+						                                _mm_and_ps(_mm_cmpeq_ps(values[e], zero), ties[e]));
+						mask = _mm_and_ps(mask, inside);
+					}
+					if(_mm_movemask_ps(mask) == 0)
+						continue;
+
+					const __m128 w1 = _mm_mul_ps(values[1], _mm_set1_ps(inverse_area));
+					const __m128 w2 = _mm_mul_ps(values[2], _mm_set1_ps(inverse_area));
+					const __m128 z = _mm_add_ps(_mm_set1_ps(z0), _mm_add_ps(_mm_mul_ps(w1, _mm_set1_ps(dz1)),
+					                                                        _mm_mul_ps(w2, _mm_set1_ps(dz2))));
+					// GL_LEQUAL against the depth buffer, and nothing past the far plane
+					const int lanes = std::min(4, x1 - x + 1);
+					float stored[4] = {1.f, 1.f, 1.f, 1.f};
+					std::copy(depth_row + x, depth_row + x + lanes, stored);
+					mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmple_ps(z, _mm_loadu_ps(stored)), _mm_cmple_ps(z, one)));
+					const int passed = _mm_movemask_ps(mask);
+					if(passed == 0)
+						continue;
+
+					float z_lanes[4], w1_lanes[4], w2_lanes[4];
+					_mm_storeu_ps(z_lanes, z);
+					_mm_storeu_ps(w1_lanes, w1);
+					_mm_storeu_ps(w2_lanes, w2);
+					for(int lane = 0; lane < lanes; ++lane){
+						if(!(passed & (1 << lane)))
+							continue;
+						const size_t pixel = tile_row + size_t(x + lane - tile_x);
+						depth_row[x + lane] = z_lanes[lane];
+						ids[pixel] = index;
+						weights1[pixel] = w1_lanes[lane];
+						weights2[pixel] = w2_lanes[lane];
+					}
+				}
+#else
+				for(int x = x0; x <= x1; ++x){
+					const float center_x = float(x) + 0.5f;
+					float values[3];
+					bool inside = true;
+					for(int e = 0; e < 3; ++e){
+						values[e] = edges[e].evaluate(center_x, center_y);
+						inside = inside && (values[e] > 0.f || (values[e] == 0.f && edges[e].top_left));
+					}
+					if(!inside)
+						continue;
+					const float w1 = values[1] * inverse_area;
+					const float w2 = values[2] * inverse_area;
+					const float z = z0 + (w1 * dz1 + w2 * dz2);
+					if(z > depth_row[x] || z > 1.f)
+						continue;
+					const size_t pixel = tile_row + size_t(x - tile_x);
+					depth_row[x] = z;
+					ids[pixel] = index;
+					weights1[pixel] = w1;
+					weights2[pixel] = w2;
+				}
+#endif
+			}
+		}
+	}
+
+	// the fragment shader, once per covered pixel, a row at a time in arrays of each input
+	float diffuse[3][tile_size], normal[3][tile_size], view[3][tile_size], light[3][tile_size];
+	float shininess[tile_size], diffuse_factor[tile_size], specular_factor[tile_size];
+	bool lit[tile_size];
+	int columns[tile_size];
+	for(int y = 0; y < tile_height; ++y){
+		int count = 0;
+		for(int x = 0; x < tile_width; ++x){
+			const size_t pixel = size_t(y) * tile_size + size_t(x);
+			if(ids[pixel] == no_triangle)
+				continue;
+			const Triangle &triangle = triangles[ids[pixel]];
+			const Draw &draw = draws[triangle.draw];
+			const Vertex *v = triangle.vertices;
+
+			// perspective correct weights from the screen space ones
+			const float w1 = weights1[pixel] * v[1].inverse_w;
+			const float w2 = weights2[pixel] * v[2].inverse_w;
+			const float w0 = (1.f - weights1[pixel] - weights2[pixel]) * v[0].inverse_w;
+			const float inverse_sum = 1.f / (w0 + w1 + w2);
+			float attributes[attribute_count];
+			for(unsigned int a = 0; a < attribute_count; ++a)
+				attributes[a] = (w0 * v[0].attributes[a] + w1 * v[1].attributes[a] + w2 * v[2].attributes[a]) * inverse_sum;
+
+			const glm::vec3 diffuse_color = sample(draw.model->getDiffuseImage(), attributes[0], attributes[1],
+			                                       triangle.texel_density);
+			lit[count] = draw.state.lighting;
+			if(lit[count]){
+				// a model without a normal map samples as flat
+				const Model::Image &bump_image = draw.model->getBumpImage();
+				const glm::vec3 normal_color = bump_image.width > 0 ? sample(bump_image, attributes[0], attributes[1],
+				                                                             triangle.texel_density)
+				                                                    : glm::vec3(0.5f, 0.5f, 1.f);
+				shininess[count] = sample(draw.model->getSpecularImage(), attributes[0], attributes[1],
+				                          triangle.texel_density).x * 255.f;
+				// decoded from n * 0.5 + 0.5, as in basic_phong.frag
+				for(int c = 0; c < 3; ++c)
+					normal[c][count] = normal_color[c] * 2.f - 1.f;
+			}
+			else{
+				shininess[count] = 255.f;
+				for(int c = 0; c < 3; ++c)
+					normal[c][count] = c == 2 ? 1.f : 0.f;
+			}
+			for(int c = 0; c < 3; ++c){
+				diffuse[c][count] = diffuse_color[c];
+				view[c][count] = attributes[2 + c];
+				light[c][count] = attributes[5 + c];
+			}
+			columns[count] = x;
+			++count;
+		}
+
+		// Blinn-Phong over the whole row, in loops the compiler can vectorize
+		for(int i = 0; i < count; ++i){
+			const float view_scale = 1.f / std::sqrt(view[0][i] * view[0][i] + view[1][i] * view[1][i] + view[2][i] * view[2][i]);
+			const float light_scale = 1.f / std::sqrt(light[0][i] * light[0][i] + light[1][i] * light[1][i] + light[2][i] * light[2][i]);
+			const float normal_scale = 1.f / std::sqrt(normal[0][i] * normal[0][i] + normal[1][i] * normal[1][i] + normal[2][i] * normal[2][i]);
+			const float lx = light[0][i] * light_scale, ly = light[1][i] * light_scale, lz = light[2][i] * light_scale;
+			const float nx = normal[0][i] * normal_scale, ny = normal[1][i] * normal_scale, nz = normal[2][i] * normal_scale;
+			const float hx = view[0][i] * view_scale + lx, hy = view[1][i] * view_scale + ly, hz = view[2][i] * view_scale + lz;
+			const float half_scale = 1.f / std::sqrt(hx * hx + hy * hy + hz * hz);
+			diffuse_factor[i] = std::max(0.f, lx * nx + ly * ny + lz * nz);
+			specular_factor[i] = std::max(0.f, (hx * nx + hy * ny + hz * nz) * half_scale);
+		}
+		for(int i = 0; i < count; ++i)
+			specular_factor[i] = shininess[i] < 255.f ? std::pow(specular_factor[i], shininess[i]) : 0.f;
+
+		unsigned char *row = &pixels[4 * ((size_t(tile_y + y) * width) + size_t(tile_x))];
+		for(int i = 0; i < count; ++i){
+			unsigned char *pixel = row + 4 * columns[i];
+			for(int c = 0; c < 3; ++c)
+				pixel[c] = toByte(lit[i] ? diffuse[c][i] * diffuse_factor[i] + specular_factor[i] : diffuse[c][i]);
+			// the maps are loaded without alpha
+			pixel[3] = 255;
+		}
+	}
+}
@@ -0,0 +1,256 @@
+#include "TangentSpace.h"
+
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TANGENTSPACE_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	const size_t faces_per_batch = 4096;
+	const size_t vertices_per_batch = 8192;
+
+	struct Input{
+		const glm::vec3 *positions;
+		const glm::vec3 *normals;
+		const glm::vec2 *uvs;
+		const unsigned int *indices;
+	};
+
+	/**
+	 * acos from Abramowitz and Stegun 4.4.45, off by less than 7e-5 rad.
+	 * Only used to weigh the corners, and shared by both paths so they agree.
+	 */
+	inline float approxAcos(float x){
+		const float ax = std::min(std::abs(x), 1.f);
+		const float r = std::sqrt(1.f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f - 0.0187293f * ax)));
+		return x < 0.f ? 3.14159265f - r : r;
+	}
+
+	inline glm::vec3 normalizeOrZero(const glm::vec3 &v){
+		const float length_squared = glm::dot(v, v);
+		return length_squared > 1e-30f ? v / std::sqrt(length_squared) : glm::vec3(0.f);
+	}
+
+	inline glm::vec3 projectOnPlane(const glm::vec3 &v, const glm::vec3 &n){
+		return v - n * glm::dot(n, v);
+	}
+
+	/**
+	 * The angle weighted tangent every corner of face adds to its vertex,
+	 * and whether the face's UVs are mirrored
+	 */
+	void faceContribution(const Input &in, size_t face, glm::vec3 *contributions, bool &mirrored){
+		const unsigned int *index = in.indices + face * 3;
+		const glm::vec3 &p0 = in.positions[index[0]];
+		const glm::vec2 &uv0 = in.uvs[index[0]];
+		const glm::vec3 e1 = in.positions[index[1]] - p0;
+		const glm::vec3 e2 = in.positions[index[2]] - p0;
+		const glm::vec2 duv1 = in.uvs[index[1]] - uv0;
+		const glm::vec2 duv2 = in.uvs[index[2]] - uv0;
+
+		const float det = duv1.x * duv2.y - duv1.y * duv2.x;
+		mirrored = det < 0.f;
+		// degenerate UVs give no direction, the neighbours decide
+		glm::vec3 tangent(0.f);
+		if(std::abs(det) > 1e-30f)
+			tangent = normalizeOrZero((e1 * duv2.y - e2 * duv1.y) * (mirrored ? -1.f : 1.f));
+
+		for(int c = 0; c < 3; ++c){
+			const glm::vec3 &p = in.positions[index[c]];
+			const glm::vec3 n = normalizeOrZero(in.normals[index[c]]);
+			const glm::vec3 to_next = normalizeOrZero(projectOnPlane(in.positions[index[(c + 1) % 3]] - p, n));
+			const glm::vec3 to_prev = normalizeOrZero(projectOnPlane(in.positions[index[(c + 2) % 3]] - p, n));
+			const float angle = approxAcos(glm::clamp(glm::dot(to_next, to_prev), -1.f, 1.f));
+			contributions[c] = normalizeOrZero(projectOnPlane(tangent, n)) * angle;
+		}
+	}
+
+#ifdef TANGENTSPACE_SSE
+	struct Vec3x4{
+		__m128 x, y, z;
+	};
+
+	inline Vec3x4 operator-(const Vec3x4 &a, const Vec3x4 &b){
+		Vec3x4 r = {_mm_sub_ps(a.x, b.x), _mm_sub_ps(a.y, b.y), _mm_sub_ps(a.z, b.z)};
+		return r;
+	}
+
+	inline Vec3x4 operator*(const Vec3x4 &a, __m128 s){
+		Vec3x4 r = {_mm_mul_ps(a.x, s), _mm_mul_ps(a.y, s), _mm_mul_ps(a.z, s)};
+		return r;
+	}
+
+	inline __m128 dot(const Vec3x4 &a, const Vec3x4 &b){
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+	}
+
+	inline Vec3x4 normalizeOrZero(const Vec3x4 &v){
+		const __m128 length_squared = dot(v, v);
+		const __m128 valid = _mm_cmpgt_ps(length_squared, _mm_set1_ps(1e-30f));
+		const __m128 inverse_length = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length_squared)));
+		return v * inverse_length;
+	}
+
+	inline Vec3x4 projectOnPlane(const Vec3x4 &v, const Vec3x4 &n){
+		return v - n * dot(n, v);
+	}
+
+	inline __m128 approxAcos(__m128 x){
+		const __m128 one = _mm_set1_ps(1.f);
+		const __m128 sign_bit = _mm_set1_ps(-0.f);
+		const __m128 ax = _mm_min_ps(_mm_andnot_ps(sign_bit, x), one);
+		__m128 poly = _mm_add_ps(_mm_set1_ps(0.0742610f), _mm_mul_ps(ax, _mm_set1_ps(-0.0187293f)));
+		poly = _mm_add_ps(_mm_set1_ps(-0.2121144f), _mm_mul_ps(ax, poly));
+		poly = _mm_add_ps(_mm_set1_ps(1.5707288f), _mm_mul_ps(ax, poly));
+		const __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(one, ax)), poly);
+		const __m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+		return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(3.14159265f), r)), _mm_andnot_ps(negative, r));
+	}
+
+	inline Vec3x4 gather(const glm::vec3 *array, const unsigned int *index, int corner){
+		const glm::vec3 &a = array[index[corner]];
+		const glm::vec3 &b = array[index[3 + corner]];
+		const glm::vec3 &c = array[index[6 + corner]];
+		const glm::vec3 &d = array[index[9 + corner]];
+		Vec3x4 r = {_mm_setr_ps(a.x, b.x, c.x, d.x), _mm_setr_ps(a.y, b.y, c.y, d.y), _mm_setr_ps(a.z, b.z, c.z, d.z)};
+		return r;
+	}
+
+	inline void gatherUV(const glm::vec2 *array, const unsigned int *index, int corner, __m128 &u, __m128 &v){
+		const glm::vec2 &a = array[index[corner]];
+		const glm::vec2 &b = array[index[3 + corner]];
+		const glm::vec2 &c = array[index[6 + corner]];
+		const glm::vec2 &d = array[index[9 + corner]];
+		u = _mm_setr_ps(a.x, b.x, c.x, d.x);
+		v = _mm_setr_ps(a.y, b.y, c.y, d.y);
+	}
+
+	/**
+	 * faceContribution for the four faces starting at face, one per SSE lane
+	 */
+	void faceContribution4(const Input &in, size_t face, glm::vec3 *contributions, unsigned char *mirrored){
+		const unsigned int *index = in.indices + face * 3;
+		Vec3x4 p[3], n[3];
+		__m128 u[3], v[3];
+		for(int c = 0; c < 3; ++c){
+			p[c] = gather(in.positions, index, c);
+			n[c] = normalizeOrZero(gather(in.normals, index, c));
+			gatherUV(in.uvs, index, c, u[c], v[c]);
+		}
+
+		const Vec3x4 e1 = p[1] - p[0];
+		const Vec3x4 e2 = p[2] - p[0];
+		const __m128 du1 = _mm_sub_ps(u[1], u[0]), dv1 = _mm_sub_ps(v[1], v[0]);
+		const __m128 du2 = _mm_sub_ps(u[2], u[0]), dv2 = _mm_sub_ps(v[2], v[0]);
+		const __m128 det = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(dv1, du2));
+
+		const __m128 sign_bit = _mm_set1_ps(-0.f);
+		const __m128 is_mirrored = _mm_cmplt_ps(det, _mm_setzero_ps());
+		const __m128 valid = _mm_cmpgt_ps(_mm_andnot_ps(sign_bit, det), _mm_set1_ps(1e-30f));
+		const __m128 sign = _mm_or_ps(_mm_set1_ps(1.f), _mm_and_ps(is_mirrored, sign_bit));
+		const Vec3x4 tangent = normalizeOrZero((e1 * dv2 - e2 * dv1) * _mm_and_ps(valid, sign));
+
+		const int mirrored_mask = _mm_movemask_ps(is_mirrored);
+		for(int lane = 0; lane < 4; ++lane)
+			mirrored[lane] = (mirrored_mask >> lane) & 1;
+
+		for(int c = 0; c < 3; ++c){
+			const Vec3x4 to_next = normalizeOrZero(projectOnPlane(p[(c + 1) % 3] - p[c], n[c]));
+			const Vec3x4 to_prev = normalizeOrZero(projectOnPlane(p[(c + 2) % 3] - p[c], n[c]));
+			const __m128 cos_angle = _mm_max_ps(_mm_min_ps(dot(to_next, to_prev), _mm_set1_ps(1.f)), _mm_set1_ps(-1.f));
+			const Vec3x4 weighted = normalizeOrZero(projectOnPlane(tangent, n[c])) * approxAcos(cos_angle);
+
+			float x[4], y[4], z[4];
+			_mm_storeu_ps(x, weighted.x);
+			_mm_storeu_ps(y, weighted.y);
+			_mm_storeu_ps(z, weighted.z);
+			for(int lane = 0; lane < 4; ++lane)
+				contributions[lane * 3 + c] = glm::vec3(x[lane], y[lane], z[lane]);
+		}
+	}
+#endif
+
+	/**
+	 * Any unit vector perpendicular to n, for vertices no face gave a direction
+	 */
+	inline glm::vec3 anyTangent(const glm::vec3 &n){
+		const glm::vec3 axis = std::abs(n.x) < 0.9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+		return glm::normalize(projectOnPlane(axis, n));
+	}
+}
+
+void TangentSpace::generate(const std::vector<glm::vec3> &positions, const std::vector<glm::vec3> &normals,
+                            const std::vector<glm::vec2> &uvs, const std::vector<unsigned int> &indices,
+                            std::vector<glm::vec4> &corner_tangents){
+	TRACE_SCOPE("TangentSpace::generate");
+	const Input in = {positions.data(), normals.data(), uvs.data(), indices.data()};
+	const size_t face_count = indices.size() / 3;
+	const size_t vertex_count = positions.size();
+
+	std::vector<glm::vec3> contributions(face_count * 3);
+	std::vector<unsigned char> mirrored(face_count);
+	parallelFor((face_count + faces_per_batch - 1) / faces_per_batch, [&](size_t batch){
+		const size_t begin = batch * faces_per_batch;
+		const size_t end = std::min(begin + faces_per_batch, face_count);
+		size_t face = begin;
+#ifdef TANGENTSPACE_SSE
+		for(; face + 4 <= end; face += 4)
+			faceContribution4(in, face, &contributions[face * 3], &mirrored[face]);
+#endif
+		for(; face < end; ++face){
+			bool face_mirrored;
+			faceContribution(in, face, &contributions[face * 3], face_mirrored);
+			mirrored[face] = face_mirrored ? 1 : 0;
+		}
+	});
+
+	// the corners around every vertex, so that each vertex is summed by one thread
+	std::vector<uint32_t> first_corner(vertex_count + 1, 0);
+	for(size_t i = 0; i < indices.size(); ++i)
+		++first_corner[indices[i] + 1];
+	for(size_t v = 0; v < vertex_count; ++v)
+		first_corner[v + 1] += first_corner[v];
+	std::vector<uint32_t> vertex_corners(indices.size());
+	{
+		std::vector<uint32_t> fill(first_corner.begin(), first_corner.end() - 1);
+		for(size_t i = 0; i < indices.size(); ++i)
+			vertex_corners[fill[indices[i]]++] = uint32_t(i);
+	}
+
+	// two tangents per vertex, for the faces with and without mirrored UVs
+	std::vector<glm::vec3> vertex_tangents(vertex_count * 2);
+	parallelFor((vertex_count + vertices_per_batch - 1) / vertices_per_batch, [&](size_t batch){
+		const size_t begin = batch * vertices_per_batch;
+		const size_t end = std::min(begin + vertices_per_batch, vertex_count);
+		for(size_t v = begin; v < end; ++v){
+			glm::vec3 sum[2] = {glm::vec3(0.f), glm::vec3(0.f)};
+			for(uint32_t i = first_corner[v]; i < first_corner[v + 1]; ++i){
+				const uint32_t corner = vertex_corners[i];
+				sum[mirrored[corner / 3]] += contributions[corner];
+			}
+
+			const glm::vec3 n = normalizeOrZero(normals[v]);
+			for(int side = 0; side < 2; ++side){
+				const glm::vec3 tangent = normalizeOrZero(projectOnPlane(sum[side], n));
+				vertex_tangents[v * 2 + side] = tangent != glm::vec3(0.f) ? tangent : anyTangent(n);
+			}
+		}
+	});
+
+	corner_tangents.resize(indices.size());
+	parallelFor((face_count + faces_per_batch - 1) / faces_per_batch, [&](size_t batch){
+		const size_t begin = batch * faces_per_batch * 3;
+		const size_t end = std::min(begin + faces_per_batch * 3, indices.size());
+		for(size_t corner = begin; corner < end; ++corner){
+			const unsigned char side = mirrored[corner / 3];
+			corner_tangents[corner] = glm::vec4(vertex_tangents[indices[corner] * 2 + side], side ? -1.f : 1.f);
+		}
+	});
+}
@@ -0,0 +1,495 @@
+#include "Terrain.h"
+
+#include "GameException.h"
+#include "GLUtils/GLUtils.hpp"
+#include "ParallelFor.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <sstream>
+
+namespace {
+	const uint32_t no_tile = 0xffffffffu;
+	// tiles copied into the height texture per frame, so that a burst of reads does not stall one frame
+	const size_t max_uploads_per_frame = 8;
+	// tiles handed to the loader thread per frame, the rest are asked for again next frame if still needed
+	const size_t max_queued_tiles = 32;
+	// where between the ranges of its children and its own a node starts morphing into its parent
+	const float morph_start = 0.66f;
+
+	// the instanced attribute locations of terrain.vert
+	const GLuint area_location = 0;
+	const GLuint tile_location = 1;
+
+	/**
+	 * A value in [0, 1] for every point of the lattice of octave
+	 */
+	double latticeValue(int64_t x, int64_t y, unsigned int octave){
+		uint64_t hash = uint64_t(x) * 0x9e3779b97f4a7c15ull ^ uint64_t(y) * 0xc2b2ae3d27d4eb4full ^ uint64_t(octave) << 56;
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdull;
+		hash ^= hash >> 33;
+		return double(hash >> 11) / double(1ull << 53);
+	}
+
+	/**
+	 * Value noise, smoothly interpolated between the lattice points
+	 */
+	double valueNoise(double x, double y, unsigned int octave){
+		const double cell_x = std::floor(x);
+		const double cell_y = std::floor(y);
+		const int64_t ix = int64_t(cell_x);
+		const int64_t iy = int64_t(cell_y);
+		double fx = x - cell_x;
+		double fy = y - cell_y;
+		fx = fx * fx * (3.0 - 2.0 * fx);
+		fy = fy * fy * (3.0 - 2.0 * fy);
+		const double bottom = latticeValue(ix, iy, octave) * (1.0 - fx) + latticeValue(ix + 1, iy, octave) * fx;
+		const double top = latticeValue(ix, iy + 1, octave) * (1.0 - fx) + latticeValue(ix + 1, iy + 1, octave) * fx;
+		return bottom * (1.0 - fy) + top * fy;
+	}
+
+	/**
+	 * Ridged fractal noise at u, v of the terrain, in [0, 1]. The rougher an octave is at
+	 * a point, the more the next ones add to it, which keeps the valleys smooth.
+	 */
+	double ridgedNoise(double u, double v, unsigned int octaves){
+		double sum = 0.0;
+		double amplitude = 0.5;
+		double weight = 1.0;
+		double frequency = 4.0;
+		for(unsigned int octave = 0; octave < octaves; ++octave){
+			double ridge = 1.0 - std::abs(2.0 * valueNoise(u * frequency, v * frequency, octave) - 1.0);
+			ridge *= ridge * weight;
+			weight = std::min(std::max(ridge * 2.0, 0.0), 1.0);
+			sum += ridge * amplitude;
+			amplitude *= 0.5;
+			frequency *= 2.0;
+		}
+		return std::min(sum * 1.25, 1.0);
+	}
+
+	/**
+	 * Whether the box is not entirely behind one of the planes of frustum
+	 */
+	bool intersects(const LooseOctree::Frustum &frustum, const glm::vec3 &min_dim, const glm::vec3 &max_dim){
+		for(const glm::vec4 &plane : frustum.planes){
+			// the corner furthest along the normal of the plane
+			const glm::vec3 corner(plane.x >= 0.f ? max_dim.x : min_dim.x,
+			                       plane.y >= 0.f ? max_dim.y : min_dim.y,
+			                       plane.z >= 0.f ? max_dim.z : min_dim.z);
+			if(glm::dot(glm::vec3(plane), corner) + plane.w < 0.f)
+				return false;
+		}
+		return true;
+	}
+
+	float boxDistance(const glm::vec3 &min_dim, const glm::vec3 &max_dim, const glm::vec3 &point){
+		return glm::length(glm::max(glm::max(min_dim - point, point - max_dim), glm::vec3(0.f)));
+	}
+
+	unsigned int floorLog2(unsigned int value){
+		unsigned int result = 0;
+		while(value > 1){
+			value >>= 1;
+			++result;
+		}
+		return result;
+	}
+
+	/**
+	 * Throws unless the tiles can be drawn with grid_size cells per node and max_depth levels
+	 */
+	void checkTileLayout(unsigned int tile_levels, unsigned int tile_resolution, const std::string &filename){
+		if(tile_resolution < Terrain::grid_size || (tile_resolution & (tile_resolution - 1)) != 0)
+			THROW_EXCEPTION(filename + ": the tile resolution has to be a power of two of at least the grid size");
+		if(tile_levels < 1 || tile_levels - 1 + floorLog2(tile_resolution / Terrain::grid_size) >= Terrain::max_depth)
+			THROW_EXCEPTION(filename + ": the tiles take more levels than the quadtree has");
+	}
+}
+
+void Terrain::generate(const std::string &filename, unsigned int tile_levels, unsigned int tile_resolution){
+	TRACE_SCOPE("Terrain::generate");
+	checkTileLayout(tile_levels, tile_resolution, filename);
+	std::ofstream out(filename.c_str(), std::ios::binary);
+	if(!out)
+		THROW_EXCEPTION("Unable to open " + filename + " for writing");
+
+	Header header;
+	std::memcpy(header.magic, "TERR", 4);
+	header.version = file_version;
+	header.tile_levels = tile_levels;
+	header.tile_resolution = tile_resolution;
+	out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	// filled in once the tiles are written
+	const uint32_t tile_count = tileIndex(tile_levels, 0, 0);
+	std::vector<glm::vec2> bounds(tile_count);
+	const std::streampos bounds_offset = out.tellp();
+	out.write(reinterpret_cast<const char *>(bounds.data()), bounds.size() * sizeof(glm::vec2));
+
+	// down to about two samples of the finest level per cell of the finest octave
+	const unsigned int finest_cells = tile_resolution << (tile_levels - 1);
+	const unsigned int octaves = floorLog2(finest_cells) - 2;
+	const unsigned int samples = tileSamples(tile_resolution);
+	std::vector<uint16_t> level_samples;
+	for(unsigned int level = 0; level < tile_levels; ++level){
+		const uint32_t tiles_per_side = 1u << level;
+		level_samples.resize(size_t(tiles_per_side) * tiles_per_side * samples * samples);
+		parallelFor(size_t(tiles_per_side) * tiles_per_side, [&](size_t t){
+			const uint32_t tile_x = uint32_t(t % tiles_per_side);
+			const uint32_t tile_y = uint32_t(t / tiles_per_side);
+			uint16_t *tile_samples = &level_samples[t * samples * samples];
+			// the positions are exact in double, so every level samples the noise at the very
+			// points the finer ones do, and the tiles agree wherever their samples coincide
+			const double cells = double(tile_resolution) * double(tiles_per_side);
+			glm::vec2 &tile_bounds = bounds[tileIndex(level, tile_x, tile_y)];
+			tile_bounds = glm::vec2(1.f, 0.f);
+			for(unsigned int j = 0; j < samples; ++j){
+				const double v = (double(tile_y) * tile_resolution + j - 1.0) / cells;
+				for(unsigned int i = 0; i < samples; ++i){
+					const double u = (double(tile_x) * tile_resolution + i - 1.0) / cells;
+					const uint16_t value = uint16_t(std::floor(ridgedNoise(u, v, octaves) * 65535.0 + 0.5));
+					tile_samples[j * samples + i] = value;
+					// the border samples belong to the neighbouring tiles
+					if(i > 0 && j > 0 && i + 1 < samples && j + 1 < samples){
+						const float height = float(value) / 65535.f;
+						tile_bounds.x = std::min(tile_bounds.x, height);
+						tile_bounds.y = std::max(tile_bounds.y, height);
+					}
+				}
+			}
+		});
+		out.write(reinterpret_cast<const char *>(level_samples.data()), level_samples.size() * sizeof(uint16_t));
+	}
+
+	out.seekp(bounds_offset);
+	out.write(reinterpret_cast<const char *>(bounds.data()), bounds.size() * sizeof(glm::vec2));
+	if(!out)
+		THROW_EXCEPTION("Unable to write " + filename);
+}
+
+Terrain::Terrain(const std::string &filename, const glm::vec3 &position, float size, float height, size_t budget_tiles)
+	: tile_bytes(0), data_offset(0), leaf_depth(0), origin(position - glm::vec3(0.5f * size, 0.f, 0.5f * size)),
+	  size(size), height(height), height_texture(0), node_buffer(0), vertex_array(0), frame(0), resident_tiles(0),
+	  pending_tiles(0), node_count(0), selection_camera(0.f), selection_frustum(glm::mat4(1.f)),
+	  selecting_shadow_nodes(false), stopping(false){
+	TRACE_SCOPE("Terrain::Terrain");
+	file.open(filename.c_str(), std::ios::binary);
+	if(!file)
+		THROW_EXCEPTION("Unable to open " + filename);
+	file.read(reinterpret_cast<char *>(&header), sizeof(header));
+	if(!file || std::memcmp(header.magic, "TERR", 4) != 0 || header.version != file_version)
+		THROW_EXCEPTION(filename + " is not a terrain file of this version");
+	checkTileLayout(header.tile_levels, header.tile_resolution, filename);
+	// the smallest nodes have a sample of the finest tiles per cell of their grid
+	leaf_depth = header.tile_levels - 1 + floorLog2(header.tile_resolution / grid_size);
+
+	const uint32_t tile_count = tileIndex(header.tile_levels, 0, 0);
+	tile_bounds.resize(tile_count);
+	file.read(reinterpret_cast<char *>(tile_bounds.data()), tile_bounds.size() * sizeof(glm::vec2));
+	if(!file)
+		THROW_EXCEPTION(filename + " is truncated");
+	const unsigned int samples = tileSamples(header.tile_resolution);
+	tile_bytes = size_t(samples) * samples * sizeof(uint16_t);
+	data_offset = size_t(file.tellg());
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	const size_t layer_count = std::min(std::min(budget_tiles, size_t(tile_count)), size_t(max_layers));
+	if(layer_count == 0)
+		THROW_EXCEPTION("The terrain streaming budget has no room for a tile");
+	layer_tiles.assign(layer_count, no_tile);
+	tile_layers.assign(tile_count, no_tile);
+	tile_last_used.assign(tile_count, 0);
+	tile_requested.assign(tile_count, 0);
+	tile_pending.assign(tile_count, false);
+
+	// linear filtering between the samples, which lie on the texel centers
+	glGenTextures(1, &height_texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, height_texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16, GLsizei(samples), GLsizei(samples), GLsizei(layer_count), 0, GL_RED,
+	             GL_UNSIGNED_SHORT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// the patch of a node has no vertices of its own, only the node is read per instance
+	glGenBuffers(1, &node_buffer);
+	glGenVertexArrays(1, &vertex_array);
+	glBindVertexArray(vertex_array);
+	glBindBuffer(GL_ARRAY_BUFFER, node_buffer);
+	glEnableVertexAttribArray(area_location);
+	glVertexAttribPointer(area_location, 4, GL_FLOAT, GL_FALSE, sizeof(Node), BUFFER_OFFSET(offsetof(Node, area)));
+	glVertexAttribDivisor(area_location, 1);
+	glEnableVertexAttribArray(tile_location);
+	glVertexAttribPointer(tile_location, 4, GL_FLOAT, GL_FALSE, sizeof(Node), BUFFER_OFFSET(offsetof(Node, tile)));
+	glVertexAttribDivisor(tile_location, 1);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	CHECK_GL_ERROR();
+
+	// the root tile is always there to fall back to
+	LoadedTile root;
+	root.tile = 0;
+	if(!readTile(0, root.samples))
+		THROW_EXCEPTION(filename + " is truncated");
+	upload(root);
+
+	loader = std::thread(&Terrain::loadTiles, this);
+}
+
+Terrain::~Terrain(){
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	condition.notify_all();
+	if(loader.joinable())
+		loader.join();
+	glDeleteVertexArrays(1, &vertex_array);
+	glDeleteBuffers(1, &node_buffer);
+	glDeleteTextures(1, &height_texture);
+}
+
+std::vector<std::string> Terrain::getShaderDefines(){
+	std::stringstream grid, depth;
+	grid << "TERRAIN_GRID_SIZE " << grid_size;
+	depth << "TERRAIN_MAX_DEPTH " << max_depth;
+	std::vector<std::string> defines;
+	defines.push_back(grid.str());
+	defines.push_back(depth.str());
+	return defines;
+}
+
+void Terrain::update(const glm::vec3 &camera_position, const glm::mat4 &view_projection, float detail, bool shadow_nodes){
+	TRACE_SCOPE("Terrain::update");
+	++frame;
+
+	std::vector<LoadedTile> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		const size_t count = std::min(loaded_tiles.size(), max_uploads_per_frame);
+		std::move(loaded_tiles.begin(), loaded_tiles.begin() + count, std::back_inserter(ready));
+		loaded_tiles.erase(loaded_tiles.begin(), loaded_tiles.begin() + count);
+	}
+	for(const LoadedTile &loaded : ready){
+		tile_pending[loaded.tile] = false;
+		--pending_tiles;
+		if(loaded.samples.empty())
+			THROW_EXCEPTION("Unable to read a tile of a terrain file");
+		// dropped if the nodes still sample every tile in memory, it is asked for again later
+		upload(loaded);
+	}
+
+	// the ranges double from one level to the next, so every level covers a ring of about the same
+	// number of nodes, and a node morphs into its parent over the outer part of its own ring
+	lod_ranges.resize(leaf_depth + 1);
+	morph_ranges.assign(max_depth, glm::vec2(0.f));
+	for(unsigned int depth = 0; depth <= leaf_depth; ++depth){
+		lod_ranges[depth] = detail * size / float(1u << depth);
+		const float children_range = 0.5f * lod_ranges[depth];
+		morph_ranges[depth] = glm::vec2(children_range + (lod_ranges[depth] - children_range) * morph_start,
+		                                lod_ranges[depth]);
+	}
+	// the root has no parent to morph into
+	morph_ranges[0] = glm::vec2(0.5f * FLT_MAX, FLT_MAX);
+
+	selection_camera = camera_position;
+	selection_frustum = LooseOctree::Frustum(view_projection);
+	selecting_shadow_nodes = shadow_nodes;
+	nodes.clear();
+	outside_nodes.clear();
+	requests.clear();
+	selectNode(0, 0, 0);
+
+	// the shadows are cast by every selected node, drawn from the same buffer after the visible ones
+	node_count = nodes.size();
+	if(shadow_nodes){
+		nodes.reserve(2 * node_count + outside_nodes.size());
+		for(size_t i = 0; i < node_count; ++i)
+			nodes.push_back(nodes[i]);
+		nodes.insert(nodes.end(), outside_nodes.begin(), outside_nodes.end());
+	}
+	if(!nodes.empty()){
+		const GLsizeiptr nodes_size = GLsizeiptr(nodes.size() * sizeof(Node));
+		glBindBuffer(GL_ARRAY_BUFFER, node_buffer);
+		// orphaned every frame, so the driver does not wait for the last frame's draws
+		glBufferData(GL_ARRAY_BUFFER, nodes_size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, nodes_size, nodes.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// the loader works through this frame's requests, the nearest first, in place of the last frame's
+	std::sort(requests.begin(), requests.end(), std::greater<std::pair<float, uint32_t> >());
+	bool queued = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for(uint32_t tile : queue){
+			tile_pending[tile] = false;
+			--pending_tiles;
+		}
+		queue.clear();
+		for(const std::pair<float, uint32_t> &request : requests){
+			if(queue.size() >= max_queued_tiles)
+				break;
+			if(tile_pending[request.second])
+				continue;
+			queue.push_back(request.second);
+			tile_pending[request.second] = true;
+			++pending_tiles;
+		}
+		queued = !queue.empty();
+	}
+	if(queued)
+		condition.notify_one();
+}
+
+void Terrain::selectNode(unsigned int depth, uint32_t x, uint32_t y){
+	glm::vec3 min_dim, max_dim;
+	nodeBounds(depth, x, y, min_dim, max_dim);
+	const bool inside = intersects(selection_frustum, min_dim, max_dim);
+	if(!inside && !selecting_shadow_nodes)
+		return;
+	// the ancestors of the tiles in use stay too, or the walk could not reach them
+	tile_last_used[nodeTile(depth, x, y)] = frame;
+
+	// split where the camera comes within the range of the children
+	const float distance = boxDistance(min_dim, max_dim, selection_camera);
+	bool split = depth < leaf_depth && distance < lod_ranges[depth + 1];
+	if(split && depth + 1 < header.tile_levels){
+		// and their tiles are in memory; only the visible nodes ask for them
+		for(uint32_t child = 0; child < 4; ++child){
+			const uint32_t tile = tileIndex(depth + 1, 2 * x + (child & 1), 2 * y + (child >> 1));
+			if(tile_layers[tile] != no_tile)
+				continue;
+			split = false;
+			if(inside && tile_requested[tile] != frame){
+				tile_requested[tile] = frame;
+				requests.push_back(std::make_pair(1.f / (1.f + distance), tile));
+			}
+		}
+	}
+
+	if(!split){
+		addNode(depth, x, y, inside);
+		return;
+	}
+	// the children beyond their own range are drawn fully morphed, matching this node's grid
+	for(uint32_t child = 0; child < 4; ++child)
+		selectNode(depth + 1, 2 * x + (child & 1), 2 * y + (child >> 1));
+}
+
+void Terrain::addNode(unsigned int depth, uint32_t x, uint32_t y, bool inside){
+	const float node_size = size / float(1u << depth);
+	// the nodes below the finest tiles sample a part of one
+	const unsigned int tile_depth = std::min(depth, header.tile_levels - 1);
+	const unsigned int shift = depth - tile_depth;
+	const uint32_t mask = (1u << shift) - 1;
+	const float tile_scale = 1.f / float(1u << shift);
+
+	Node node;
+	node.area = glm::vec4(origin.x + float(x) * node_size, origin.z + float(y) * node_size, node_size, float(depth));
+	node.tile = glm::vec4(float(x & mask) * tile_scale, float(y & mask) * tile_scale, tile_scale,
+	                      float(tile_layers[nodeTile(depth, x, y)]));
+	if(inside)
+		nodes.push_back(node);
+	else
+		outside_nodes.push_back(node);
+}
+
+uint32_t Terrain::nodeTile(unsigned int depth, uint32_t x, uint32_t y) const{
+	const unsigned int tile_depth = std::min(depth, header.tile_levels - 1);
+	const unsigned int shift = depth - tile_depth;
+	return tileIndex(tile_depth, x >> shift, y >> shift);
+}
+
+void Terrain::nodeBounds(unsigned int depth, uint32_t x, uint32_t y, glm::vec3 &min_dim, glm::vec3 &max_dim) const{
+	const float node_size = size / float(1u << depth);
+	// the nodes below the finest tiles take the bounds of the whole tile
+	const glm::vec2 &bounds = tile_bounds[nodeTile(depth, x, y)];
+	min_dim = glm::vec3(origin.x + float(x) * node_size, origin.y + bounds.x * height, origin.z + float(y) * node_size);
+	max_dim = glm::vec3(min_dim.x + node_size, origin.y + bounds.y * height, min_dim.z + node_size);
+}
+
+void Terrain::loadTiles(){
+	Trace::setThreadName("terrain streamer");
+	std::unique_lock<std::mutex> lock(mutex);
+	while(true){
+		condition.wait(lock, [this]{ return stopping || !queue.empty(); });
+		if(stopping)
+			return;
+		LoadedTile loaded;
+		loaded.tile = queue.front();
+		queue.pop_front();
+
+		lock.unlock();
+		readTile(loaded.tile, loaded.samples);
+		lock.lock();
+		loaded_tiles.push_back(std::move(loaded));
+	}
+}
+
+bool Terrain::readTile(uint32_t tile, std::vector<uint16_t> &samples){
+	TRACE_SCOPE("Terrain::readTile");
+	samples.resize(tile_bytes / sizeof(uint16_t));
+	file.clear();
+	file.seekg(std::streamoff(data_offset + size_t(tile) * tile_bytes));
+	file.read(reinterpret_cast<char *>(samples.data()), std::streamsize(tile_bytes));
+	if(!file){
+		samples.clear();
+		return false;
+	}
+	return true;
+}
+
+bool Terrain::upload(const LoadedTile &loaded){
+	if(tile_layers[loaded.tile] != no_tile)
+		return true;
+
+	// a free layer, or else the one of the tile sampled the longest time ago
+	uint32_t layer = no_tile;
+	uint32_t oldest = no_tile;
+	for(uint32_t l = 0; l < layer_tiles.size(); ++l){
+		const uint32_t tile = layer_tiles[l];
+		if(tile == no_tile){
+			layer = l;
+			break;
+		}
+		// the root never leaves, and the tiles of the last selection stay or it would swap them back and forth
+		if(tile == 0 || tile_last_used[tile] + 1 >= frame)
+			continue;
+		if(tile_last_used[tile] < oldest){
+			oldest = tile_last_used[tile];
+			layer = l;
+		}
+	}
+	if(layer == no_tile)
+		return false;
+
+	if(layer_tiles[layer] != no_tile){
+		tile_layers[layer_tiles[layer]] = no_tile;
+		--resident_tiles;
+	}
+	const GLsizei samples = GLsizei(tileSamples(header.tile_resolution));
+	glBindTexture(GL_TEXTURE_2D_ARRAY, height_texture);
+	// the rows are an odd number of samples long
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(layer), samples, samples, 1, GL_RED, GL_UNSIGNED_SHORT,
+	                loaded.samples.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	layer_tiles[layer] = loaded.tile;
+	tile_layers[loaded.tile] = layer;
+	tile_last_used[loaded.tile] = frame;
+	++resident_tiles;
+	return true;
+}
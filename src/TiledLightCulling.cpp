@@ -0,0 +1,76 @@
+#include "TiledLightCulling.h"
+
+#include <sstream>
+#include <glm/gtc/type_ptr.hpp>
+
+TiledLightCulling::TiledLightCulling(unsigned int width, unsigned int height) : tiles_x(0){
+	cull_program.reset(new GLUtils::Program(GLUtils::addDefines(GLUtils::readFile("shaders/light_cull.comp"),
+	                                                            getShaderDefines())));
+
+	const unsigned int max_tiles = ((width + tile_size - 1) / tile_size) * ((height + tile_size - 1) / tile_size);
+	glGenBuffers(1, &light_buffer);
+	glGenBuffers(1, &tile_count_buffer);
+	glGenBuffers(1, &tile_index_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_count_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, max_tiles * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_index_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, max_tiles * max_lights_per_tile * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	CHECK_GL_ERROR();
+}
+
+TiledLightCulling::~TiledLightCulling(){
+	glDeleteBuffers(1, &light_buffer);
+	glDeleteBuffers(1, &tile_count_buffer);
+	glDeleteBuffers(1, &tile_index_buffer);
+}
+
+std::vector<std::string> TiledLightCulling::getShaderDefines(){
+	std::stringstream tile, max_lights;
+	tile << "TILE_SIZE " << tile_size;
+	max_lights << "MAX_LIGHTS_PER_TILE " << max_lights_per_tile;
+
+	std::vector<std::string> defines;
+	defines.push_back(tile.str());
+	defines.push_back(max_lights.str());
+	return defines;
+}
+
+void TiledLightCulling::cull(const std::vector<PointLight> &lights, GLuint depth_texture,
+                             unsigned int width, unsigned int height, const glm::mat4 &projection){
+	tiles_x = (width + tile_size - 1) / tile_size;
+	const unsigned int tiles_y = (height + tile_size - 1) / tile_size;
+
+	// orphan the previous contents instead of waiting for the last frame's lighting
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, light_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, lights.size() * sizeof(PointLight), lights.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	bindBuffers();
+
+	cull_program->use();
+	glUniformMatrix4fv(cull_program->getUniform("inv_proj_mat"), 1, 0, glm::value_ptr(glm::inverse(projection)));
+	glUniform2i(cull_program->getUniform("render_size"), width, height);
+	glUniform1ui(cull_program->getUniform("light_count"), GLuint(lights.size()));
+	glUniform1i(cull_program->getUniform("depth_texture"), 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, depth_texture);
+
+	glDispatchCompute(tiles_x, tiles_y, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	cull_program->disuse();
+	unbindBuffers();
+	CHECK_GL_ERROR();
+}
+
+void TiledLightCulling::bindBuffers(){
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, light_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_count_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, tile_index_buffer);
+}
+
+void TiledLightCulling::unbindBuffers(){
+	for(GLuint binding = 0; binding < 3; ++binding)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+}
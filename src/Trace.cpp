@@ -0,0 +1,185 @@
+#include "Trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+	// per thread, 40 bytes an event so about 10 MB: minutes of frames at a few dozen events each
+	const size_t events_per_thread = 1 << 18;
+
+	enum EventType{
+		EVENT_SCOPE,
+		EVENT_COUNTER
+	};
+
+	struct Event{
+		const char *name;
+		long long start_ns;
+		long long duration_ns;
+		double value;
+		EventType type;
+	};
+
+	/**
+	 * Written by its own thread only. The count is published after the
+	 * event is stored, so the exporter only ever reads complete events.
+	 */
+	struct ThreadBuffer{
+		ThreadBuffer(unsigned int id) : id(id), name(NULL), count(0), dropped(0){
+			events.resize(events_per_thread);
+		}
+
+		unsigned int id;
+		std::atomic<const char *> name;
+		std::vector<Event> events;
+		std::atomic<size_t> count;
+		std::atomic<size_t> dropped;
+	};
+
+	std::atomic<bool> enabled(false);
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::mutex buffers_mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers; //< kept after their thread exits, guarded by buffers_mutex
+
+	long long now(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// the buffer of a thread is only created by its first event, so that naming threads costs nothing without tracing
+	thread_local const char *thread_name = NULL;
+	thread_local ThreadBuffer *thread_buffer = NULL;
+
+	ThreadBuffer &threadBuffer(){
+		if(thread_buffer == NULL){
+			std::lock_guard<std::mutex> lock(buffers_mutex);
+			buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer(unsigned(buffers.size()) + 1)));
+			thread_buffer = buffers.back().get();
+			thread_buffer->name = thread_name;
+		}
+		return *thread_buffer;
+	}
+
+	void record(const Event &event){
+		ThreadBuffer &buffer = threadBuffer();
+		const size_t index = buffer.count.load(std::memory_order_relaxed);
+		if(index >= buffer.events.size()){
+			buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		buffer.events[index] = event;
+		buffer.count.store(index + 1, std::memory_order_release);
+	}
+
+	void writeString(std::ostream &out, const char *text){
+		out << '"';
+		for(const char *c = text; *c != '\0'; ++c){
+			if(*c == '"' || *c == '\\')
+				out << '\\';
+			out << *c;
+		}
+		out << '"';
+	}
+}
+
+namespace Trace {
+
+	void setEnabled(bool enable){
+		enabled = enable;
+	}
+
+	bool isEnabled(){
+		return enabled;
+	}
+
+	void setThreadName(const char *name){
+		thread_name = name;
+		if(thread_buffer != NULL)
+			thread_buffer->name = name;
+	}
+
+	void counter(const char *name, double value){
+		if(!enabled)
+			return;
+
+		Event event;
+		event.name = name;
+		event.start_ns = now();
+		event.duration_ns = 0;
+		event.value = value;
+		event.type = EVENT_COUNTER;
+		record(event);
+	}
+
+	Scope::Scope(const char *name) : name(name), start_ns(enabled ? now() : -1){}
+
+	Scope::~Scope(){
+		if(start_ns < 0)
+			return;
+
+		Event event;
+		event.name = name;
+		event.start_ns = start_ns;
+		event.duration_ns = now() - start_ns;
+		event.value = 0.0;
+		event.type = EVENT_SCOPE;
+		record(event);
+	}
+
+	bool exportChromeJSON(const std::string &filename){
+		std::ofstream out(filename.c_str());
+		if(!out.good()){
+			std::cerr << "Could not write the trace to " << filename << std::endl;
+			return false;
+		}
+
+		// microseconds with nanosecond decimals
+		out << std::fixed << std::setprecision(3);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		for(size_t b = 0; b < buffers.size(); ++b){
+			const ThreadBuffer &buffer = *buffers[b];
+			const char *thread_name = buffer.name;
+			if(thread_name != NULL){
+				out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer.id
+				    << ",\"args\":{\"name\":";
+				writeString(out, thread_name);
+				out << "}}";
+				first = false;
+			}
+
+			const size_t count = buffer.count.load(std::memory_order_acquire);
+			for(size_t i = 0; i < count; ++i){
+				const Event &event = buffer.events[i];
+				out << (first ? "" : ",\n") << "{\"name\":";
+				writeString(out, event.name);
+				if(event.type == EVENT_SCOPE){
+					out << ",\"ph\":\"X\",\"ts\":" << event.start_ns / 1000.0 << ",\"dur\":" << event.duration_ns / 1000.0
+					    << ",\"pid\":1,\"tid\":" << buffer.id << "}";
+				}
+				else{
+					out << ",\"ph\":\"C\",\"ts\":" << event.start_ns / 1000.0 << ",\"pid\":1,\"tid\":" << buffer.id
+					    << ",\"args\":{\"value\":" << event.value << "}}";
+				}
+				first = false;
+			}
+
+			if(buffer.dropped > 0)
+				std::cerr << "Trace buffer of thread " << buffer.id << " was full, " << buffer.dropped
+				          << " events were dropped" << std::endl;
+		}
+
+		out << "\n]}\n";
+		std::cout << "Trace written to " << filename << std::endl;
+		return out.good();
+	}
+
+} // namespace Trace
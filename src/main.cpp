@@ -1,5 +1,15 @@
+#include "ClusterBuilder.h"
 #include "GameManager.h"
+#include "NormalBaker.h"
+#include "Terrain.h"
+#include "Trace.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include <memory>
+#include <string>
+#include <IL/il.h>
+#include <IL/ilu.h>
 
 #ifdef _WIN32
 #include <Windows.h>
@@ -7,12 +17,112 @@
 
 /**
  * Simple program that starts our game manager
+ *
+ * --scene <file>: the scene to draw, scenes/ball.scene by default
+ * --bench-null [frames]: measures the CPU cost of culling and submitting the
+ * scene's draw list without a window or GPU, and prints it with the GL calls made
+ * --software <file>: draws the first frame on the CPU and writes it to an image
+ * file, as a reference for the GPU output or where there is no GPU
+ * --bake <high poly mesh> <low poly mesh> <file> [size [distance]]: bakes the
+ * detail of the high poly mesh into a size x size (1024 by default) tangent
+ * space normal map for the UVs of the low poly one, and writes it to an image
+ * file. distance is how far apart the surfaces may be, relative to the size
+ * of the high poly mesh, 0.05 by default.
+ * --build-clusters <mesh> <file>: cuts the mesh into a DAG of clusters at
+ * decreasing levels of detail and writes it to a cluster file, which a
+ * streamed statement of a scene draws while keeping only part of it in memory
+ * --build-terrain <file> [levels [resolution]]: writes a tile file of procedural
+ * heights, levels (6 by default) of tiles of resolution x resolution cells (128
+ * by default), which a terrain statement of a scene streams around the camera
+ * --trace <file>: records startup and every frame, and writes a
+ * Chrome trace-event JSON (chrome://tracing, Perfetto) on exit
  */
 int main(int argc, char *argv[]) {
+	std::string trace_file;
+	std::string scene_file = "scenes/ball.scene";
+	unsigned int bench_frames = 0;
+	std::string software_file;
+	std::string bake_high_poly, bake_low_poly, bake_file;
+	unsigned int bake_size = 1024;
+	float bake_distance = 0.05f;
+	std::string cluster_mesh, cluster_file;
+	std::string terrain_file;
+	unsigned int terrain_levels = 6;
+	unsigned int terrain_resolution = 128;
+	for(int i = 1; i < argc; ++i){
+		if(std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			trace_file = argv[++i];
+		else if(std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			scene_file = argv[++i];
+		else if(std::strcmp(argv[i], "--software") == 0 && i + 1 < argc)
+			software_file = argv[++i];
+		else if(std::strcmp(argv[i], "--bake") == 0 && i + 3 < argc){
+			bake_high_poly = argv[++i];
+			bake_low_poly = argv[++i];
+			bake_file = argv[++i];
+			if(i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				bake_size = (unsigned int) std::atoi(argv[++i]);
+			if(i + 1 < argc && std::atof(argv[i + 1]) > 0.0)
+				bake_distance = (float) std::atof(argv[++i]);
+		}
+		else if(std::strcmp(argv[i], "--build-clusters") == 0 && i + 2 < argc){
+			cluster_mesh = argv[++i];
+			cluster_file = argv[++i];
+		}
+		else if(std::strcmp(argv[i], "--build-terrain") == 0 && i + 1 < argc){
+			terrain_file = argv[++i];
+			if(i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				terrain_levels = (unsigned int) std::atoi(argv[++i]);
+			if(i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				terrain_resolution = (unsigned int) std::atoi(argv[++i]);
+		}
+		else if(std::strcmp(argv[i], "--bench-null") == 0){
+			bench_frames = 1000;
+			if(i + 1 < argc && std::atoi(argv[i + 1]) > 0)
+				bench_frames = (unsigned int) std::atoi(argv[++i]);
+		}
+	}
+	if(!trace_file.empty()){
+		Trace::setEnabled(true);
+		Trace::setThreadName("main");
+	}
+
 	std::shared_ptr<GameManager> game;
-	game.reset(new GameManager());
-	game->init();
-	game->play();
+	game.reset(new GameManager(scene_file));
+	if(!bake_file.empty()){
+		ilInit();
+		iluInit();
+		NormalBaker baker(bake_high_poly, bake_low_poly, bake_distance);
+		baker.bake(bake_size, bake_size);
+		baker.writeImage(bake_file);
+		std::cout << bake_file << ": " << baker.getCoveredTexels() << " texels baked, "
+		          << baker.getMissedTexels() << " of them missed the high poly mesh" << std::endl;
+	}
+	else if(!cluster_file.empty()){
+		ClusterBuilder builder(cluster_mesh);
+		builder.write(cluster_file);
+		std::cout << cluster_file << ": " << builder.getTriangleCount() << " triangles in " << builder.getClusterCount()
+		          << " clusters over " << builder.getLevelCount() << " levels, " << builder.getPageCount() << " pages"
+		          << std::endl;
+	}
+	else if(!terrain_file.empty()){
+		Terrain::generate(terrain_file, terrain_levels, terrain_resolution);
+		std::cout << terrain_file << ": " << ((1u << (2 * terrain_levels)) - 1) / 3 << " tiles of " << terrain_resolution
+		          << " x " << terrain_resolution << " cells over " << terrain_levels << " levels" << std::endl;
+	}
+	else if(bench_frames > 0){
+		game->benchmarkNullDevice(bench_frames);
+	}
+	else if(!software_file.empty()){
+		game->renderSoftware(software_file);
+	}
+	else{
+		game->init();
+		game->play();
+	}
 	game.reset();
+
+	if(!trace_file.empty())
+		Trace::exportChromeJSON(trace_file);
 	return 0;
 }